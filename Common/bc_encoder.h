@@ -0,0 +1,693 @@
+//--------------------------------------------------------------------------------------
+// File: bc_encoder.h
+//
+// Block compression encoders for the offline texture tools: BC1, BC3, BC4, BC5 and
+// BC7, plus matching decoders so the tools can measure what the compression cost.
+//
+// Every encoder works on a BCBlock, the 16 texels of a 4x4 block as float channels in
+// SoA order. Endpoints start at the ends of the principal axis of the block's colours
+// and are then refined by least squares against the index assignment, alternating
+// with index selection a few times and keeping the best pair. Index selection, the
+// inner loop of every encoder, tests four texels at a time against the whole palette
+// with SSE2 where available.
+//
+// Format notes:
+//   BC1 always uses the four colour mode, so alpha is dropped (no punch-through).
+//   BC3 and BC5 are built from the BC1 colour block and BC4 single channel blocks.
+//   BC4 tries both the eight value and the six value (explicit 0 and 255) modes.
+//   BC7 only uses mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each and 4
+//   bit indices. It beats BC1 on every block, but multi-subset modes would do better on
+//   blocks with two unrelated colours.
+//
+// BCCompressSurface encodes a whole R8G8B8A8 surface, block rows spread over a
+// SoftThreadPool, into the layout DDS files and CreateTexture2D expect. BC4 reads the
+// red channel and BC5 red and green, as the hardware returns them.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include "dds_reader.h"
+#include "thread_pool.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BC_ENCODER_SSE2
+#endif
+
+#define BC_REFINE_PASSES	3
+
+struct BCBlock
+{
+	float texels[4][16];	// channel, texel in row order
+};
+
+// Loads the block at (blockX, blockY), repeating the last row and column past the edges
+inline void BCLoadBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, BCBlock* block)
+{
+	for (int y = 0; y < 4; ++y)
+	{
+		int sy = std::min(blockY * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x)
+		{
+			int sx = std::min(blockX * 4 + x, width - 1);
+			const unsigned char* texel = rgba + ((size_t)sy * width + sx) * 4;
+			for (int c = 0; c < 4; ++c)
+				block->texels[c][y * 4 + x] = texel[c];
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Index selection
+//--------------------------------------------------------------------------------------
+// Picks the nearest palette entry for every texel, distance weighted per channel (0
+// ignores a channel), and returns the total weighted squared error
+inline float BCSelectIndices(const BCBlock& block, const float (*palette)[4], int paletteSize, const float weights[4], unsigned char indices[16])
+{
+#ifdef BC_ENCODER_SSE2
+	__m128 total = _mm_setzero_ps();
+	for (int group = 0; group < 16; group += 4)
+	{
+		__m128 texel[4];
+		for (int c = 0; c < 4; ++c)
+			texel[c] = _mm_loadu_ps(&block.texels[c][group]);
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int i = 0; i < paletteSize; ++i)
+		{
+			__m128 error = _mm_setzero_ps();
+			for (int c = 0; c < 4; ++c)
+			{
+				__m128 d = _mm_sub_ps(texel[c], _mm_set1_ps(palette[i][c]));
+				error = _mm_add_ps(error, _mm_mul_ps(_mm_mul_ps(d, d), _mm_set1_ps(weights[c])));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+			best = _mm_min_ps(best, error);
+		}
+		total = _mm_add_ps(total, best);
+		int lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, bestIndex);
+		for (int k = 0; k < 4; ++k)
+			indices[group + k] = (unsigned char)lanes[k];
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int t = 0; t < 16; ++t)
+	{
+		float best = FLT_MAX;
+		int bestIndex = 0;
+		for (int i = 0; i < paletteSize; ++i)
+		{
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				float d = block.texels[c][t] - palette[i][c];
+				error += d * d * weights[c];
+			}
+			if (error < best)
+			{
+				best = error;
+				bestIndex = i;
+			}
+		}
+		total += best;
+		indices[t] = (unsigned char)bestIndex;
+	}
+	return total;
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Endpoint fitting
+//--------------------------------------------------------------------------------------
+// Ends of the block's extent along its principal axis (power iteration on the
+// weighted covariance), in the channels with a non-zero weight
+inline void BCPrincipalEndpoints(const BCBlock& block, const float weights[4], float start[4], float end[4])
+{
+	float mean[4], low[4], high[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		float sum = 0.0f;
+		low[c] = FLT_MAX;
+		high[c] = -FLT_MAX;
+		for (int t = 0; t < 16; ++t)
+		{
+			sum += block.texels[c][t];
+			low[c] = std::min(low[c], block.texels[c][t]);
+			high[c] = std::max(high[c], block.texels[c][t]);
+		}
+		mean[c] = sum / 16.0f;
+	}
+
+	float covariance[4][4];
+	for (int a = 0; a < 4; ++a)
+	{
+		for (int b = a; b < 4; ++b)
+		{
+			float sum = 0.0f;
+			for (int t = 0; t < 16; ++t)
+				sum += (block.texels[a][t] - mean[a]) * (block.texels[b][t] - mean[b]);
+			covariance[a][b] = covariance[b][a] = sum * sqrtf(weights[a] * weights[b]);
+		}
+	}
+
+	float axis[4];
+	for (int c = 0; c < 4; ++c)
+		axis[c] = (high[c] - low[c]) * (weights[c] > 0.0f ? 1.0f : 0.0f);
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4], length = 0.0f;
+		for (int a = 0; a < 4; ++a)
+		{
+			next[a] = 0.0f;
+			for (int b = 0; b < 4; ++b)
+				next[a] += covariance[a][b] * axis[b];
+			length = std::max(length, fabsf(next[a]));
+		}
+		if (length <= 0.0f)
+			break;
+		for (int c = 0; c < 4; ++c)
+			axis[c] = next[c] / length;
+	}
+
+	float length2 = 0.0f;
+	for (int c = 0; c < 4; ++c)
+		length2 += axis[c] * axis[c];
+	if (length2 <= 0.0f)
+	{
+		// Flat block, every endpoint pair that contains the colour works
+		for (int c = 0; c < 4; ++c)
+			start[c] = end[c] = mean[c];
+		return;
+	}
+
+	float tMin = FLT_MAX, tMax = -FLT_MAX;
+	for (int t = 0; t < 16; ++t)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < 4; ++c)
+			projection += (block.texels[c][t] - mean[c]) * axis[c];
+		tMin = std::min(tMin, projection);
+		tMax = std::max(tMax, projection);
+	}
+	for (int c = 0; c < 4; ++c)
+	{
+		start[c] = mean[c] + axis[c] * tMin / length2;
+		end[c] = mean[c] + axis[c] * tMax / length2;
+	}
+}
+
+// Least squares endpoints for a fixed assignment, where texel t sits at fraction
+// positions[indices[t]] between start and end. Returns false when the assignment
+// does not pin down two endpoints.
+inline bool BCLeastSquaresEndpoints(const BCBlock& block, const unsigned char indices[16], const float* positions, float start[4], float end[4])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = { 0 }, bx[4] = { 0 };
+	for (int t = 0; t < 16; ++t)
+	{
+		float b = positions[indices[t]], a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < 4; ++c)
+		{
+			ax[c] += a * block.texels[c][t];
+			bx[c] += b * block.texels[c][t];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < 4; ++c)
+	{
+		start[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		end[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// BC1
+//--------------------------------------------------------------------------------------
+inline unsigned short BCPack565(const float color[4])
+{
+	int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+inline void BCUnpack565(unsigned short packed, int color[3])
+{
+	int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Four colour mode palette: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+inline void BCColorPalette(unsigned short c0, unsigned short c1, int palette[4][3])
+{
+	BCUnpack565(c0, palette[0]);
+	BCUnpack565(c1, palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+}
+
+// Colour block of BC1, BC2 and BC3, always in four colour mode
+inline void EncodeBC1Block(const BCBlock& block, unsigned char out[8])
+{
+	static const float weights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+	static const float positions[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	float start[4], end[4];
+	BCPrincipalEndpoints(block, weights, start, end);
+
+	float bestError = FLT_MAX;
+	unsigned short best0 = 0, best1 = 0;
+	unsigned char bestIndices[16] = { 0 };
+	for (int pass = 0; pass < BC_REFINE_PASSES; ++pass)
+	{
+		unsigned short c0 = BCPack565(end), c1 = BCPack565(start);
+		int colors[4][3];
+		BCColorPalette(c0, c1, colors);
+		float palette[4][4];
+		for (int i = 0; i < 4; ++i)
+			palette[i][0] = (float)colors[i][0], palette[i][1] = (float)colors[i][1], palette[i][2] = (float)colors[i][2], palette[i][3] = 0.0f;
+
+		unsigned char indices[16];
+		float error = BCSelectIndices(block, palette, 4, weights, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = c0;
+			best1 = c1;
+			memcpy(bestIndices, indices, 16);
+		}
+		if (error == 0.0f || c0 == c1 || !BCLeastSquaresEndpoints(block, indices, positions, end, start))
+			break;
+	}
+
+	// Four colour mode needs c0 > c1; equal endpoints decode as three colour mode, where
+	// index 0 is still c0
+	if (best0 < best1)
+	{
+		std::swap(best0, best1);
+		static const unsigned char swapped[4] = { 1, 0, 3, 2 };
+		for (int t = 0; t < 16; ++t)
+			bestIndices[t] = swapped[bestIndices[t]];
+	}
+	else if (best0 == best1)
+		memset(bestIndices, 0, 16);
+
+	unsigned int bits = 0;
+	for (int t = 0; t < 16; ++t)
+		bits |= (unsigned int)bestIndices[t] << (t * 2);
+	out[0] = (unsigned char)best0;
+	out[1] = (unsigned char)(best0 >> 8);
+	out[2] = (unsigned char)best1;
+	out[3] = (unsigned char)(best1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = (unsigned char)(bits >> (i * 8));
+}
+
+//--------------------------------------------------------------------------------------
+// BC4
+//--------------------------------------------------------------------------------------
+// e0 > e1 selects eight interpolated values, otherwise six plus 0 and 255
+inline void BCValuePalette(int e0, int e1, int palette[8])
+{
+	palette[0] = e0;
+	palette[1] = e1;
+	if (e0 > e1)
+	{
+		for (int i = 1; i < 7; ++i)
+			palette[1 + i] = ((7 - i) * e0 + i * e1 + 3) / 7;
+	}
+	else
+	{
+		for (int i = 1; i < 5; ++i)
+			palette[1 + i] = ((5 - i) * e0 + i * e1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Single channel block from channel 'channel' of the BCBlock
+inline void EncodeBC4Block(const BCBlock& block, int channel, unsigned char out[8])
+{
+	float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	weights[channel] = 1.0f;
+
+	// Range of all values, and of those the six value mode can't take from 0 and 255
+	int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+	for (int t = 0; t < 16; ++t)
+	{
+		int value = (int)block.texels[channel][t];
+		low = std::min(low, value);
+		high = std::max(high, value);
+		if (value != 0 && value != 255)
+		{
+			innerLow = std::min(innerLow, value);
+			innerHigh = std::max(innerHigh, value);
+		}
+	}
+	if (innerLow > innerHigh)
+		innerLow = innerHigh = low;
+
+	// Small search around the extremes in both modes; quantization makes the exact
+	// extremes not always the best pair
+	float bestError = FLT_MAX;
+	int best0 = high, best1 = low;
+	unsigned char bestIndices[16] = { 0 };
+	for (int mode = 0; mode < 2 && bestError > 0.0f; ++mode)
+	{
+		int lowEnd = mode == 0 ? low : innerLow, highEnd = mode == 0 ? high : innerHigh;
+		for (int dl = -1; dl <= 2; ++dl)
+		{
+			for (int dh = -2; dh <= 1; ++dh)
+			{
+				int a = std::min(std::max(lowEnd + dl, 0), 255), b = std::min(std::max(highEnd + dh, 0), 255);
+				if (a > b)
+					continue;
+				// Eight value mode needs e0 > e1; a flat block uses e0 == e1 in six value mode
+				int e0 = mode == 0 ? b : a, e1 = mode == 0 ? a : b;
+				if (mode == 0 && e0 == e1)
+					continue;
+				int values[8];
+				BCValuePalette(e0, e1, values);
+				float palette[8][4];
+				for (int i = 0; i < 8; ++i)
+					palette[i][0] = palette[i][1] = palette[i][2] = palette[i][3] = (float)values[i];
+				unsigned char indices[16];
+				float error = BCSelectIndices(block, palette, 8, weights, indices);
+				if (error < bestError)
+				{
+					bestError = error;
+					best0 = e0;
+					best1 = e1;
+					memcpy(bestIndices, indices, 16);
+				}
+			}
+		}
+	}
+
+	out[0] = (unsigned char)best0;
+	out[1] = (unsigned char)best1;
+	unsigned long long bits = 0;
+	for (int t = 0; t < 16; ++t)
+		bits |= (unsigned long long)bestIndices[t] << (t * 3);
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (unsigned char)(bits >> (i * 8));
+}
+
+inline void EncodeBC3Block(const BCBlock& block, unsigned char out[16])
+{
+	EncodeBC4Block(block, 3, out);
+	EncodeBC1Block(block, out + 8);
+}
+
+inline void EncodeBC5Block(const BCBlock& block, unsigned char out[16])
+{
+	EncodeBC4Block(block, 0, out);
+	EncodeBC4Block(block, 1, out + 8);
+}
+
+//--------------------------------------------------------------------------------------
+// BC7 mode 6
+//--------------------------------------------------------------------------------------
+static const int BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+inline int BC7Interpolate(int e0, int e1, int weight)
+{
+	return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+inline void BC7WriteBits(unsigned char* out, int* position, unsigned int value, int count)
+{
+	for (int i = 0; i < count; ++i, ++*position)
+		out[*position >> 3] |= (unsigned char)(((value >> i) & 1) << (*position & 7));
+}
+
+inline int BC7ReadBits(const unsigned char* in, int* position, int count)
+{
+	int value = 0;
+	for (int i = 0; i < count; ++i, ++*position)
+		value |= ((in[*position >> 3] >> (*position & 7)) & 1) << i;
+	return value;
+}
+
+// Quantizes an endpoint to 7 bits with the given p-bit, returns the 8 bit value
+inline void BC7QuantizeEndpoint(const float color[4], int pBit, int quantized[4], int expanded[4])
+{
+	for (int c = 0; c < 4; ++c)
+	{
+		int q = (int)floorf((color[c] - pBit) * 0.5f + 0.5f);
+		quantized[c] = std::min(std::max(q, 0), 127);
+		expanded[c] = (quantized[c] << 1) | pBit;
+	}
+}
+
+inline void EncodeBC7Block(const BCBlock& block, unsigned char out[16])
+{
+	static const float weights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	float positions[16];
+	for (int i = 0; i < 16; ++i)
+		positions[i] = BC7Weights4[i] / 64.0f;
+
+	float start[4], end[4];
+	BCPrincipalEndpoints(block, weights, start, end);
+
+	float bestError = FLT_MAX;
+	int bestQuantized[2][4] = { { 0 } }, bestP[2] = { 0, 0 };
+	unsigned char bestIndices[16] = { 0 };
+	for (int pass = 0; pass < BC_REFINE_PASSES && bestError > 0.0f; ++pass)
+	{
+		float passError = FLT_MAX;
+		unsigned char passIndices[16] = { 0 };
+		for (int p = 0; p < 4; ++p)
+		{
+			int quantized[2][4], expanded[2][4];
+			BC7QuantizeEndpoint(start, p & 1, quantized[0], expanded[0]);
+			BC7QuantizeEndpoint(end, p >> 1, quantized[1], expanded[1]);
+			float palette[16][4];
+			for (int i = 0; i < 16; ++i)
+				for (int c = 0; c < 4; ++c)
+					palette[i][c] = (float)BC7Interpolate(expanded[0][c], expanded[1][c], BC7Weights4[i]);
+			unsigned char indices[16];
+			float error = BCSelectIndices(block, palette, 16, weights, indices);
+			if (error < passError)
+			{
+				passError = error;
+				memcpy(passIndices, indices, 16);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(bestQuantized, quantized, sizeof(quantized));
+				bestP[0] = p & 1;
+				bestP[1] = p >> 1;
+				memcpy(bestIndices, indices, 16);
+			}
+		}
+		if (!BCLeastSquaresEndpoints(block, passIndices, positions, start, end))
+			break;
+	}
+
+	// The anchor index is stored without its top bit, so it must be below 8
+	if (bestIndices[0] >= 8)
+	{
+		for (int c = 0; c < 4; ++c)
+			std::swap(bestQuantized[0][c], bestQuantized[1][c]);
+		std::swap(bestP[0], bestP[1]);
+		for (int t = 0; t < 16; ++t)
+			bestIndices[t] = (unsigned char)(15 - bestIndices[t]);
+	}
+
+	// Fields from the least significant bit: mode, R0 R1 G0 G1 B0 B1 A0 A1, P0 P1, indices
+	memset(out, 0, 16);
+	int position = 0;
+	BC7WriteBits(out, &position, 1 << 6, 7);
+	for (int c = 0; c < 4; ++c)
+	{
+		BC7WriteBits(out, &position, bestQuantized[0][c], 7);
+		BC7WriteBits(out, &position, bestQuantized[1][c], 7);
+	}
+	BC7WriteBits(out, &position, bestP[0], 1);
+	BC7WriteBits(out, &position, bestP[1], 1);
+	BC7WriteBits(out, &position, bestIndices[0], 3);
+	for (int t = 1; t < 16; ++t)
+		BC7WriteBits(out, &position, bestIndices[t], 4);
+}
+
+//--------------------------------------------------------------------------------------
+// Decoders, RGBA8 out
+//--------------------------------------------------------------------------------------
+// BC2 and BC3 colour blocks are always in four colour mode
+inline void DecodeBC1Block(const unsigned char* in, unsigned char rgba[16][4], bool fourColorOnly)
+{
+	unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8)), c1 = (unsigned short)(in[2] | (in[3] << 8));
+	int colors[4][3];
+	BCColorPalette(c0, c1, colors);
+	int alpha[4] = { 255, 255, 255, 255 };
+	if (c0 <= c1 && !fourColorOnly)
+	{
+		// Three colour mode: midpoint and transparent black
+		for (int c = 0; c < 3; ++c)
+		{
+			colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+			colors[3][c] = 0;
+		}
+		alpha[3] = 0;
+	}
+	unsigned int bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+	for (int t = 0; t < 16; ++t)
+	{
+		int index = (bits >> (t * 2)) & 3;
+		rgba[t][0] = (unsigned char)colors[index][0];
+		rgba[t][1] = (unsigned char)colors[index][1];
+		rgba[t][2] = (unsigned char)colors[index][2];
+		rgba[t][3] = (unsigned char)alpha[index];
+	}
+}
+
+inline void DecodeBC4Block(const unsigned char* in, unsigned char rgba[16][4], int channel)
+{
+	int values[8];
+	BCValuePalette(in[0], in[1], values);
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; ++i)
+		bits |= (unsigned long long)in[2 + i] << (i * 8);
+	for (int t = 0; t < 16; ++t)
+		rgba[t][channel] = (unsigned char)values[(bits >> (t * 3)) & 7];
+}
+
+inline void DecodeBC7Block(const unsigned char* in, unsigned char rgba[16][4])
+{
+	// Only mode 6 is understood; other modes decode as black, as the tools never write them
+	if ((in[0] & 0x7f) != 0x40)
+	{
+		memset(rgba, 0, 64);
+		return;
+	}
+	int position = 7;
+	int endpoints[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		endpoints[0][c] = BC7ReadBits(in, &position, 7) << 1;
+		endpoints[1][c] = BC7ReadBits(in, &position, 7) << 1;
+	}
+	int p0 = BC7ReadBits(in, &position, 1), p1 = BC7ReadBits(in, &position, 1);
+	for (int c = 0; c < 4; ++c)
+	{
+		endpoints[0][c] |= p0;
+		endpoints[1][c] |= p1;
+	}
+	for (int t = 0; t < 16; ++t)
+	{
+		int index = BC7ReadBits(in, &position, t == 0 ? 3 : 4);
+		for (int c = 0; c < 4; ++c)
+			rgba[t][c] = (unsigned char)BC7Interpolate(endpoints[0][c], endpoints[1][c], BC7Weights4[index]);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Surfaces
+//--------------------------------------------------------------------------------------
+struct BCSurfaceJob
+{
+	unsigned int format;
+	int width;
+	int height;
+	int blocksX;
+	unsigned int blockBytes;
+	const unsigned char* rgba;
+	unsigned char* blocks;
+};
+
+inline void BCCompressBlockRow(void* context, int blockY)
+{
+	const BCSurfaceJob* job = (const BCSurfaceJob*)context;
+	for (int blockX = 0; blockX < job->blocksX; ++blockX)
+	{
+		BCBlock block;
+		BCLoadBlock(job->rgba, job->width, job->height, blockX, blockY, &block);
+		unsigned char* out = job->blocks + ((size_t)blockY * job->blocksX + blockX) * job->blockBytes;
+		switch (job->format)
+		{
+		case DDS_FORMAT_BC1_UNORM: EncodeBC1Block(block, out); break;
+		case DDS_FORMAT_BC3_UNORM: EncodeBC3Block(block, out); break;
+		case DDS_FORMAT_BC4_UNORM: EncodeBC4Block(block, 0, out); break;
+		case DDS_FORMAT_BC5_UNORM: EncodeBC5Block(block, out); break;
+		case DDS_FORMAT_BC7_UNORM: EncodeBC7Block(block, out); break;
+		}
+	}
+}
+
+inline bool BCIsSupportedFormat(unsigned int format)
+{
+	return format == DDS_FORMAT_BC1_UNORM || format == DDS_FORMAT_BC3_UNORM || format == DDS_FORMAT_BC4_UNORM ||
+		format == DDS_FORMAT_BC5_UNORM || format == DDS_FORMAT_BC7_UNORM;
+}
+
+// blocks receives ceil(width/4) * ceil(height/4) blocks in row order
+inline bool BCCompressSurface(unsigned int format, int width, int height, const unsigned char* rgba, SoftThreadPool* pool, std::vector<unsigned char>* blocks)
+{
+	if (!BCIsSupportedFormat(format) || width <= 0 || height <= 0)
+		return false;
+	BCSurfaceJob job;
+	job.format = format;
+	job.width = width;
+	job.height = height;
+	job.blocksX = (width + 3) / 4;
+	job.blockBytes = DDSBlockBytes(format);
+	job.rgba = rgba;
+	int blocksY = (height + 3) / 4;
+	blocks->resize((size_t)job.blocksX * blocksY * job.blockBytes);
+	job.blocks = &(*blocks)[0];
+	pool->ParallelFor(blocksY, BCCompressBlockRow, &job);
+	return true;
+}
+
+// Back to R8G8B8A8 the way the sampler returns it: BC4 as (r, 0, 0, 1), BC5 as (r, g, 0, 1)
+inline bool BCDecompressSurface(unsigned int format, int width, int height, const unsigned char* blocks, std::vector<unsigned char>* rgba)
+{
+	if (!BCIsSupportedFormat(format) || width <= 0 || height <= 0)
+		return false;
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int blockBytes = DDSBlockBytes(format);
+	rgba->assign((size_t)width * height * 4, 0);
+	for (int blockY = 0; blockY < blocksY; ++blockY)
+	{
+		for (int blockX = 0; blockX < blocksX; ++blockX)
+		{
+			const unsigned char* in = blocks + ((size_t)blockY * blocksX + blockX) * blockBytes;
+			unsigned char texels[16][4];
+			memset(texels, 0, sizeof(texels));
+			for (int t = 0; t < 16; ++t)
+				texels[t][3] = 255;
+			switch (format)
+			{
+			case DDS_FORMAT_BC1_UNORM: DecodeBC1Block(in, texels, false); break;
+			case DDS_FORMAT_BC3_UNORM: DecodeBC1Block(in + 8, texels, true); DecodeBC4Block(in, texels, 3); break;
+			case DDS_FORMAT_BC4_UNORM: DecodeBC4Block(in, texels, 0); break;
+			case DDS_FORMAT_BC5_UNORM: DecodeBC4Block(in, texels, 0); DecodeBC4Block(in + 8, texels, 1); break;
+			case DDS_FORMAT_BC7_UNORM: DecodeBC7Block(in, texels); break;
+			}
+			for (int y = 0; y < 4 && blockY * 4 + y < height; ++y)
+				for (int x = 0; x < 4 && blockX * 4 + x < width; ++x)
+					memcpy(&(*rgba)[((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4], texels[y * 4 + x], 4);
+		}
+	}
+	return true;
+}
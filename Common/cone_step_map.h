@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------------------
+// File: cone_step_map.h
+//
+// Relaxed cone step maps (Policarpo and Oliveira, "Relaxed Cone Stepping for Relief
+// Mapping", GPU Gems 3 chapter 18) for NORMALMAP_CONE_PS in Tutorial05_Parallax.
+//
+// Heights are in [0, 1] with 1 at the top, as in the alpha of four_NM_height.png. The
+// baker works with depth = 1 - height in texture space, where the shader's view ray
+// moves by (vParallaxOffsetTS, 1) per unit of depth, so one map serves every
+// HeightMapScale and texture repeat.
+//
+// The relaxed cone of a texel S is bounded by rays from the top of S through every
+// other surface point D: each ray is followed past D while it is inside the height
+// field, and the point where it comes out must stay outside the cone. A ray marching
+// from cone edge to cone edge then crosses the surface at most once per step, so it
+// either stays above the surface or ends up below it right after the crossing, and a
+// binary search over the last step finds the hit. The ratio is texture units per unit
+// of depth, capped at 1, and the map is wrapped like the sampler that reads it.
+//
+// EncodeConeStepMap packs height and cone into R8G8: height in r, sqrt(ratio) in g
+// for more precision on narrow cones, rounded down so quantization never widens a
+// cone. Each mip averages the heights and keeps the narrowest cone of the 2x2 texels
+// it covers.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "thread_pool.h"
+
+// One mip level of an encoded map, width*height R8G8 texels
+struct ConeStepLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> texels;
+};
+
+//--------------------------------------------------------------------------------------
+// Baker
+//--------------------------------------------------------------------------------------
+class ConeStepBaker
+{
+public:
+	ConeStepBaker(const float* heights, int width, int height)
+		: m_Width(width), m_Height(height), m_Depths((size_t)width * height), m_Cones(NULL)
+	{
+		for (size_t i = 0; i < m_Depths.size(); ++i)
+			m_Depths[i] = 1.0f - std::min(std::max(heights[i], 0.0f), 1.0f);
+
+		// Every offset a cone of ratio 1 from the bottom can reach, nearest first
+		int radius = std::max(width, height);
+		for (int y = -radius; y <= radius; ++y)
+		{
+			for (int x = -radius; x <= radius; ++x)
+			{
+				Offset offset;
+				offset.x = x;
+				offset.y = y;
+				offset.length = sqrtf((float)x * x / ((float)width * width) + (float)y * y / ((float)height * height));
+				if ((x || y) && offset.length <= 1.0f)
+					m_Offsets.push_back(offset);
+			}
+		}
+		std::sort(m_Offsets.begin(), m_Offsets.end());
+	}
+
+	// cones receives width*height ratios. Rows are spread over the pool.
+	void Bake(SoftThreadPool* pool, float* cones)
+	{
+		m_Cones = cones;
+		pool->ParallelFor(m_Height, BakeRowJob, this);
+		m_Cones = NULL;
+	}
+
+	float Cone(int x, int y) const
+	{
+		float depth = m_Depths[(size_t)y * m_Width + x];
+		float texel = 1.0f / std::max(m_Width, m_Height);
+		float best = 1.0f;
+
+		for (size_t i = 0; i < m_Offsets.size(); ++i)
+		{
+			// Every exit point is at least as far out as D and above S
+			const Offset& offset = m_Offsets[i];
+			if (offset.length >= best * depth)
+				break;
+			float targetDepth = m_Depths[Wrap(y + offset.y, m_Height) * m_Width + Wrap(x + offset.x, m_Width)];
+			if (targetDepth >= depth || targetDepth <= 0.0f)
+				continue;
+
+			// From the top of S through D, half a texel at a time, until the ray comes
+			// out of the height field or gets as deep as S
+			float du = offset.x / (float)m_Width, dv = offset.y / (float)m_Height;
+			float dirU = du / targetDepth, dirV = dv / targetDepth;
+			float step = 0.5f * texel / offset.length * targetDepth;
+			for (float z = targetDepth + step; z < depth; z += step)
+			{
+				float u = dirU * z, v = dirV * z;
+				float ratio = sqrtf(u * u + v * v) / (depth - z);
+				if (ratio >= best)
+					break;
+				if (DepthAt(x + 0.5f + u * m_Width, y + 0.5f + v * m_Height) > z)
+				{
+					best = ratio;
+					break;
+				}
+			}
+		}
+		return best;
+	}
+
+private:
+	struct Offset
+	{
+		int x;
+		int y;
+		float length;		// texture units
+		bool operator<(const Offset& other) const { return length < other.length; }
+	};
+
+	static int Wrap(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	// Bilinear depth at a position in texels, texel centres at +0.5
+	float DepthAt(float x, float y) const
+	{
+		x -= 0.5f;
+		y -= 0.5f;
+		float fx = floorf(x), fy = floorf(y);
+		int x0 = Wrap((int)fx, m_Width), y0 = Wrap((int)fy, m_Height);
+		int x1 = x0 + 1 < m_Width ? x0 + 1 : 0, y1 = y0 + 1 < m_Height ? y0 + 1 : 0;
+		float ax = x - fx, ay = y - fy;
+		const float* row0 = &m_Depths[(size_t)y0 * m_Width];
+		const float* row1 = &m_Depths[(size_t)y1 * m_Width];
+		float top = row0[x0] + (row0[x1] - row0[x0]) * ax;
+		float bottom = row1[x0] + (row1[x1] - row1[x0]) * ax;
+		return top + (bottom - top) * ay;
+	}
+
+	static void BakeRowJob(void* context, int y)
+	{
+		ConeStepBaker* baker = (ConeStepBaker*)context;
+		for (int x = 0; x < baker->m_Width; ++x)
+			baker->m_Cones[(size_t)y * baker->m_Width + x] = baker->Cone(x, y);
+	}
+
+	int m_Width;
+	int m_Height;
+	std::vector<float> m_Depths;
+	std::vector<Offset> m_Offsets;
+	float* m_Cones;
+};
+
+//--------------------------------------------------------------------------------------
+// Encoding
+//--------------------------------------------------------------------------------------
+// Mip chain down to 1x1, halving like SoftMipTexture and D3D11 do
+inline void EncodeConeStepMap(const float* heights, const float* cones, int width, int height, std::vector<ConeStepLevel>* levels)
+{
+	levels->assign(1, ConeStepLevel());
+	ConeStepLevel& top = (*levels)[0];
+	top.width = width;
+	top.height = height;
+	top.texels.resize((size_t)width * height * 2);
+	for (size_t i = 0; i < (size_t)width * height; ++i)
+	{
+		float h = std::min(std::max(heights[i], 0.0f), 1.0f);
+		float c = std::min(std::max(cones[i], 0.0f), 1.0f);
+		top.texels[i * 2] = (unsigned char)(h * 255.0f + 0.5f);
+		top.texels[i * 2 + 1] = (unsigned char)(sqrtf(c) * 255.0f);
+	}
+
+	while (levels->back().width > 1 || levels->back().height > 1)
+	{
+		ConeStepLevel level;
+		const ConeStepLevel& src = levels->back();
+		level.width = std::max(src.width >> 1, 1);
+		level.height = std::max(src.height >> 1, 1);
+		level.texels.resize((size_t)level.width * level.height * 2);
+		for (int y = 0; y < level.height; ++y)
+		{
+			int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+			for (int x = 0; x < level.width; ++x)
+			{
+				int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+				const unsigned char* a = &src.texels[((size_t)y0 * src.width + x0) * 2];
+				const unsigned char* b = &src.texels[((size_t)y0 * src.width + x1) * 2];
+				const unsigned char* c = &src.texels[((size_t)y1 * src.width + x0) * 2];
+				const unsigned char* d = &src.texels[((size_t)y1 * src.width + x1) * 2];
+				unsigned char* out = &level.texels[((size_t)y * level.width + x) * 2];
+				out[0] = (unsigned char)((a[0] + b[0] + c[0] + d[0] + 2) / 4);
+				out[1] = std::min(std::min(a[1], b[1]), std::min(c[1], d[1]));
+			}
+		}
+		levels->push_back(level);
+	}
+}
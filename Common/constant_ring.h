@@ -0,0 +1,127 @@
+//--------------------------------------------------------------------------------------
+// File: constant_ring.h
+//
+// Per-frame constant buffer allocator for per-draw data.
+//
+// Upload() hands out the next constant block of the current frame, with its size
+// rounded up to 256 bytes, and fills it with one Map(WRITE_DISCARD). Blocks are
+// dynamic buffers reused every frame. Every block is written at most once per frame, so
+// the driver never has to rename a buffer several times in one frame the way repeated
+// UpdateSubresource calls on one buffer do. WRITE_DISCARD is what makes the reuse safe:
+// the driver hands out fresh memory for a block the GPU may still be reading, so the
+// CPU never waits on the frames in flight.
+//
+// Direct3D 11.0 can't bind a range of one large buffer (VSSetConstantBuffers1 needs
+// 11.1 and a newer SDK than the one these samples build with), so the ring holds one
+// small buffer per block. Each block is created on first use and reused every frame.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+#include <string.h>
+#include <vector>
+
+#define CONSTANT_BLOCK_ALIGN	256
+
+struct ConstantRingStats
+{
+	UINT allocations;
+	UINT bytesUploaded;		// what the callers asked for
+	UINT bytesReserved;		// after rounding up to CONSTANT_BLOCK_ALIGN
+	UINT buffersCreated;
+};
+
+class ConstantRing
+{
+public:
+	ConstantRing() : m_Device(NULL)
+	{
+		ZeroMemory(&m_Stats, sizeof(m_Stats));
+		ZeroMemory(&m_LastStats, sizeof(m_LastStats));
+	}
+
+	HRESULT Init(ID3D11Device* device)
+	{
+		m_Device = device;
+		return S_OK;
+	}
+
+	void Release()
+	{
+		for (size_t c = 0; c < m_SizeClasses.size(); ++c)
+		{
+			for (size_t b = 0; b < m_SizeClasses[c].buffers.size(); ++b)
+				m_SizeClasses[c].buffers[b]->Release();
+		}
+		m_SizeClasses.clear();
+		m_Device = NULL;
+	}
+
+	// Start handing out the blocks from the first one again
+	void BeginFrame(ID3D11DeviceContext* context)
+	{
+		m_LastStats = m_Stats;
+		ZeroMemory(&m_Stats, sizeof(m_Stats));
+		for (size_t c = 0; c < m_SizeClasses.size(); ++c)
+			m_SizeClasses[c].used = 0;
+	}
+
+	// Copy size bytes into a fresh constant block and return the buffer to bind, NULL on failure
+	ID3D11Buffer* Upload(ID3D11DeviceContext* context, const void* data, UINT size)
+	{
+		UINT blocks = (size + CONSTANT_BLOCK_ALIGN - 1) / CONSTANT_BLOCK_ALIGN;
+		if (blocks == 0)
+			return NULL;
+
+		if (m_SizeClasses.size() < blocks)
+			m_SizeClasses.resize(blocks);
+		SizeClass& sizeClass = m_SizeClasses[blocks - 1];
+		if (sizeClass.used == sizeClass.buffers.size())
+		{
+			D3D11_BUFFER_DESC bd;
+			ZeroMemory(&bd, sizeof(bd));
+			bd.Usage = D3D11_USAGE_DYNAMIC;
+			bd.ByteWidth = blocks * CONSTANT_BLOCK_ALIGN;
+			bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			ID3D11Buffer* buffer = NULL;
+			if (FAILED(m_Device->CreateBuffer(&bd, NULL, &buffer)))
+				return NULL;
+			sizeClass.buffers.push_back(buffer);
+			m_Stats.buffersCreated++;
+		}
+
+		ID3D11Buffer* buffer = sizeClass.buffers[sizeClass.used++];
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return NULL;
+		memcpy(mapped.pData, data, size);
+		context->Unmap(buffer, 0);
+
+		m_Stats.allocations++;
+		m_Stats.bytesUploaded += size;
+		m_Stats.bytesReserved += blocks * CONSTANT_BLOCK_ALIGN;
+		return buffer;
+	}
+
+	// Totals of the last finished frame
+	const ConstantRingStats& LastFrameStats() const { return m_LastStats; }
+
+private:
+	struct SizeClass
+	{
+		SizeClass() : used(0) {}
+
+		std::vector<ID3D11Buffer*> buffers;
+		size_t used;
+	};
+
+	ID3D11Device* m_Device;
+	std::vector<SizeClass> m_SizeClasses;	// indexed by block count - 1
+	ConstantRingStats m_Stats;
+	ConstantRingStats m_LastStats;
+};
@@ -0,0 +1,534 @@
+//--------------------------------------------------------------------------------------
+// File: dds_reader.h
+//
+// Minimal DDS reader replacing the D3DX11 texture loaders for .dds files.
+//
+// ParseDDS understands the legacy header and the DX10 extension: 1D/2D/3D textures,
+// arrays, cube maps and full or partial mip chains, in any format with a fixed block
+// size. It does not allocate pixel memory. Every subresource it returns points into
+// the caller's buffer, normally a memory-mapped file, in D3D11 subresource order
+// (array slice major, mip minor).
+//
+// The parser only needs the standard library, so it also builds off Windows.
+// CreateDDSTextureFromFile (Windows only) maps the file, parses it and hands the
+// mapped pointers straight to CreateTexture*, so the upload makes no intermediate copy.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#define DDS_MAGIC					0x20534444	// "DDS "
+
+#define DDS_HEADER_FLAGS_DEPTH		0x00800000
+#define DDS_PIXELFORMAT_ALPHA		0x00000002
+#define DDS_PIXELFORMAT_FOURCC		0x00000004
+#define DDS_PIXELFORMAT_RGB			0x00000040
+#define DDS_PIXELFORMAT_LUMINANCE	0x00020000
+#define DDS_CAPS2_CUBEMAP			0x00000200
+#define DDS_CAPS2_CUBEMAP_ALLFACES	0x0000FC00
+#define DDS_CAPS2_VOLUME			0x00200000
+#define DDS_RESOURCE_MISC_CUBE		0x00000004
+
+#define DDS_DIMENSION_TEXTURE1D		2
+#define DDS_DIMENSION_TEXTURE2D		3
+#define DDS_DIMENSION_TEXTURE3D		4
+
+#define DDS_FOURCC(a, b, c, d)		((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+// DXGI_FORMAT values the reader produces, spelled out so the parser needs no Windows headers
+enum DDSFormat
+{
+	DDS_FORMAT_UNKNOWN = 0,
+	DDS_FORMAT_R32G32B32A32_FLOAT = 2,
+	DDS_FORMAT_R16G16B16A16_FLOAT = 10,
+	DDS_FORMAT_R16G16B16A16_UNORM = 11,
+	DDS_FORMAT_R16G16B16A16_SNORM = 13,
+	DDS_FORMAT_R32G32_FLOAT = 16,
+	DDS_FORMAT_R10G10B10A2_UNORM = 24,
+	DDS_FORMAT_R8G8B8A8_UNORM = 28,
+	DDS_FORMAT_R16G16_FLOAT = 34,
+	DDS_FORMAT_R16G16_UNORM = 35,
+	DDS_FORMAT_R32_FLOAT = 41,
+	DDS_FORMAT_R8G8_UNORM = 49,
+	DDS_FORMAT_R16_FLOAT = 54,
+	DDS_FORMAT_R16_UNORM = 56,
+	DDS_FORMAT_R8_UNORM = 61,
+	DDS_FORMAT_A8_UNORM = 65,
+	DDS_FORMAT_BC1_UNORM = 71,
+	DDS_FORMAT_BC2_UNORM = 74,
+	DDS_FORMAT_BC3_UNORM = 77,
+	DDS_FORMAT_BC4_UNORM = 80,
+	DDS_FORMAT_BC4_SNORM = 81,
+	DDS_FORMAT_BC5_UNORM = 83,
+	DDS_FORMAT_BC5_SNORM = 84,
+	DDS_FORMAT_BC7_UNORM = 98,
+	DDS_FORMAT_B5G6R5_UNORM = 85,
+	DDS_FORMAT_B5G5R5A1_UNORM = 86,
+	DDS_FORMAT_B8G8R8A8_UNORM = 87,
+	DDS_FORMAT_B8G8R8X8_UNORM = 88,
+	DDS_FORMAT_B4G4R4A4_UNORM = 115,
+};
+
+struct DDSPixelFormat
+{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int fourCC;
+	unsigned int rgbBitCount;
+	unsigned int rBitMask;
+	unsigned int gBitMask;
+	unsigned int bBitMask;
+	unsigned int aBitMask;
+};
+
+struct DDSHeader
+{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	DDSPixelFormat ddspf;
+	unsigned int caps;
+	unsigned int caps2;
+	unsigned int caps3;
+	unsigned int caps4;
+	unsigned int reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	unsigned int dxgiFormat;
+	unsigned int resourceDimension;
+	unsigned int miscFlag;
+	unsigned int arraySize;
+	unsigned int miscFlags2;
+};
+
+// One mip level of one array slice (one cube face), laid out like D3D11_SUBRESOURCE_DATA
+struct DDSSubresource
+{
+	const unsigned char* data;
+	unsigned int rowPitch;
+	unsigned int slicePitch;
+	unsigned int width;
+	unsigned int height;
+	unsigned int depth;
+};
+
+struct DDSImage
+{
+	unsigned int format;		// DXGI_FORMAT
+	unsigned int dimension;		// DDS_DIMENSION_TEXTURE1D/2D/3D
+	unsigned int width;
+	unsigned int height;
+	unsigned int depth;
+	unsigned int mipLevels;
+	unsigned int arraySize;		// number of cubes for cube maps, not faces
+	bool isCube;
+	// Legacy X8B8G8R8 files are returned as R8G8B8A8; the caller must set alpha to 255
+	bool forceOpaqueAlpha;
+	std::vector<DDSSubresource> subresources;
+};
+
+//--------------------------------------------------------------------------------------
+// Format helpers
+//--------------------------------------------------------------------------------------
+inline unsigned int DDSBlockBytes(unsigned int format)
+{
+	// 4x4 block compressed formats, 0 for everything else
+	if (format >= 70 && format <= 72) return 8;		// BC1
+	if (format >= 79 && format <= 81) return 8;		// BC4
+	if (format >= 73 && format <= 84) return 16;	// BC2, BC3, BC5
+	if (format >= 94 && format <= 99) return 16;	// BC6H, BC7
+	return 0;
+}
+
+inline unsigned int DDSBitsPerPixel(unsigned int format)
+{
+	if (format >= 1 && format <= 4) return 128;
+	if (format >= 5 && format <= 8) return 96;
+	if (format >= 9 && format <= 22) return 64;
+	if (format >= 23 && format <= 47) return 32;
+	if (format >= 48 && format <= 59) return 16;
+	if (format >= 60 && format <= 65) return 8;
+	if (format == 66) return 1;
+	if (format >= 67 && format <= 69) return 32;
+	if (format >= 85 && format <= 86) return 16;
+	if (format >= 87 && format <= 93) return 32;
+	if (format == 115) return 16;
+	return 0;
+}
+
+inline void DDSSurfaceInfo(unsigned int format, unsigned int width, unsigned int height, unsigned int* rowPitch, unsigned int* rowCount)
+{
+	unsigned int blockBytes = DDSBlockBytes(format);
+	if (blockBytes)
+	{
+		*rowPitch = ((width + 3) / 4 > 1 ? (width + 3) / 4 : 1) * blockBytes;
+		*rowCount = (height + 3) / 4 > 1 ? (height + 3) / 4 : 1;
+	}
+	else if (format == 68 || format == 69)
+	{
+		// R8G8_B8G8 / G8R8_G8B8 pack two pixels into 32 bits
+		*rowPitch = ((width + 1) / 2) * 4;
+		*rowCount = height;
+	}
+	else
+	{
+		*rowPitch = (width * DDSBitsPerPixel(format) + 7) / 8;
+		*rowCount = height;
+	}
+}
+
+inline unsigned int DDSFormatFromPixelFormat(const DDSPixelFormat& pf, bool* forceOpaqueAlpha)
+{
+#define DDS_ISBITMASK(r, g, b, a) (pf.rBitMask == (r) && pf.gBitMask == (g) && pf.bBitMask == (b) && pf.aBitMask == (a))
+	*forceOpaqueAlpha = false;
+	if (pf.flags & DDS_PIXELFORMAT_RGB)
+	{
+		if (pf.rgbBitCount == 32)
+		{
+			if (DDS_ISBITMASK(0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)) return DDS_FORMAT_R8G8B8A8_UNORM;
+			if (DDS_ISBITMASK(0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000)) return DDS_FORMAT_B8G8R8A8_UNORM;
+			if (DDS_ISBITMASK(0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000)) return DDS_FORMAT_B8G8R8X8_UNORM;
+			if (DDS_ISBITMASK(0x000000ff, 0x0000ff00, 0x00ff0000, 0x00000000))
+			{
+				// X8B8G8R8 has no DXGI twin, the padding byte becomes an opaque alpha
+				*forceOpaqueAlpha = true;
+				return DDS_FORMAT_R8G8B8A8_UNORM;
+			}
+			// D3DX wrote 10:10:10:2 with the red and blue masks swapped, accept both
+			if (DDS_ISBITMASK(0x000003ff, 0x000ffc00, 0x3ff00000, 0xc0000000)) return DDS_FORMAT_R10G10B10A2_UNORM;
+			if (DDS_ISBITMASK(0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000)) return DDS_FORMAT_R10G10B10A2_UNORM;
+			if (DDS_ISBITMASK(0x0000ffff, 0xffff0000, 0x00000000, 0x00000000)) return DDS_FORMAT_R16G16_UNORM;
+			if (DDS_ISBITMASK(0xffffffff, 0x00000000, 0x00000000, 0x00000000)) return DDS_FORMAT_R32_FLOAT;
+		}
+		else if (pf.rgbBitCount == 16)
+		{
+			if (DDS_ISBITMASK(0xf800, 0x07e0, 0x001f, 0x0000)) return DDS_FORMAT_B5G6R5_UNORM;
+			if (DDS_ISBITMASK(0x7c00, 0x03e0, 0x001f, 0x8000)) return DDS_FORMAT_B5G5R5A1_UNORM;
+			if (DDS_ISBITMASK(0x0f00, 0x00f0, 0x000f, 0xf000)) return DDS_FORMAT_B4G4R4A4_UNORM;
+		}
+		// 24 bit RGB has no DXGI format
+	}
+	else if (pf.flags & DDS_PIXELFORMAT_LUMINANCE)
+	{
+		if (pf.rgbBitCount == 8 && DDS_ISBITMASK(0xff, 0, 0, 0)) return DDS_FORMAT_R8_UNORM;
+		if (pf.rgbBitCount == 16 && DDS_ISBITMASK(0xffff, 0, 0, 0)) return DDS_FORMAT_R16_UNORM;
+		if (pf.rgbBitCount == 16 && DDS_ISBITMASK(0x00ff, 0, 0, 0xff00)) return DDS_FORMAT_R8G8_UNORM;
+	}
+	else if (pf.flags & DDS_PIXELFORMAT_ALPHA)
+	{
+		if (pf.rgbBitCount == 8) return DDS_FORMAT_A8_UNORM;
+	}
+	else if (pf.flags & DDS_PIXELFORMAT_FOURCC)
+	{
+		switch (pf.fourCC)
+		{
+		case DDS_FOURCC('D', 'X', 'T', '1'): return DDS_FORMAT_BC1_UNORM;
+		case DDS_FOURCC('D', 'X', 'T', '2'):
+		case DDS_FOURCC('D', 'X', 'T', '3'): return DDS_FORMAT_BC2_UNORM;
+		case DDS_FOURCC('D', 'X', 'T', '4'):
+		case DDS_FOURCC('D', 'X', 'T', '5'): return DDS_FORMAT_BC3_UNORM;
+		case DDS_FOURCC('A', 'T', 'I', '1'):
+		case DDS_FOURCC('B', 'C', '4', 'U'): return DDS_FORMAT_BC4_UNORM;
+		case DDS_FOURCC('B', 'C', '4', 'S'): return DDS_FORMAT_BC4_SNORM;
+		case DDS_FOURCC('A', 'T', 'I', '2'):
+		case DDS_FOURCC('B', 'C', '5', 'U'): return DDS_FORMAT_BC5_UNORM;
+		case DDS_FOURCC('B', 'C', '5', 'S'): return DDS_FORMAT_BC5_SNORM;
+		// D3DFORMAT values stored as a FourCC
+		case 36: return DDS_FORMAT_R16G16B16A16_UNORM;
+		case 110: return DDS_FORMAT_R16G16B16A16_SNORM;
+		case 111: return DDS_FORMAT_R16_FLOAT;
+		case 112: return DDS_FORMAT_R16G16_FLOAT;
+		case 113: return DDS_FORMAT_R16G16B16A16_FLOAT;
+		case 114: return DDS_FORMAT_R32_FLOAT;
+		case 115: return DDS_FORMAT_R32G32_FLOAT;
+		case 116: return DDS_FORMAT_R32G32B32A32_FLOAT;
+		}
+	}
+	return DDS_FORMAT_UNKNOWN;
+#undef DDS_ISBITMASK
+}
+
+//--------------------------------------------------------------------------------------
+// Parse a DDS file held in memory. Returns false for anything malformed, truncated or in
+// a format without a DXGI equivalent.
+//--------------------------------------------------------------------------------------
+inline bool ParseDDS(const unsigned char* data, size_t size, DDSImage* image)
+{
+	image->subresources.clear();
+	if (size < 4 + sizeof(DDSHeader))
+		return false;
+
+	unsigned int magic;
+	memcpy(&magic, data, sizeof(magic));
+	DDSHeader header;
+	memcpy(&header, data + 4, sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.ddspf.size != sizeof(DDSPixelFormat))
+		return false;
+
+	size_t offset = 4 + sizeof(DDSHeader);
+	image->width = header.width;
+	image->height = header.height > 0 ? header.height : 1;
+	image->depth = 1;
+	image->mipLevels = header.mipMapCount > 0 ? header.mipMapCount : 1;
+	image->arraySize = 1;
+	image->isCube = false;
+	image->forceOpaqueAlpha = false;
+
+	if ((header.ddspf.flags & DDS_PIXELFORMAT_FOURCC) && header.ddspf.fourCC == DDS_FOURCC('D', 'X', '1', '0'))
+	{
+		DDSHeaderDX10 dx10;
+		if (size < offset + sizeof(dx10))
+			return false;
+		memcpy(&dx10, data + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+
+		image->format = dx10.dxgiFormat;
+		image->dimension = dx10.resourceDimension;
+		image->arraySize = dx10.arraySize;
+		if (image->arraySize == 0)
+			return false;
+		switch (image->dimension)
+		{
+		case DDS_DIMENSION_TEXTURE1D:
+			image->height = 1;
+			break;
+		case DDS_DIMENSION_TEXTURE2D:
+			image->isCube = (dx10.miscFlag & DDS_RESOURCE_MISC_CUBE) != 0;
+			break;
+		case DDS_DIMENSION_TEXTURE3D:
+			if (!(header.flags & DDS_HEADER_FLAGS_DEPTH) || image->arraySize != 1)
+				return false;
+			image->depth = header.depth;
+			break;
+		default:
+			return false;
+		}
+	}
+	else
+	{
+		image->format = DDSFormatFromPixelFormat(header.ddspf, &image->forceOpaqueAlpha);
+		if (header.flags & DDS_HEADER_FLAGS_DEPTH)
+		{
+			image->dimension = DDS_DIMENSION_TEXTURE3D;
+			image->depth = header.depth;
+		}
+		else
+		{
+			image->dimension = DDS_DIMENSION_TEXTURE2D;
+			if (header.caps2 & DDS_CAPS2_CUBEMAP)
+			{
+				// Partial cube maps can't be expressed in D3D11
+				if ((header.caps2 & DDS_CAPS2_CUBEMAP_ALLFACES) != DDS_CAPS2_CUBEMAP_ALLFACES)
+					return false;
+				image->isCube = true;
+			}
+		}
+	}
+
+	if (image->format == DDS_FORMAT_UNKNOWN || image->width == 0 || image->depth == 0 ||
+		(DDSBitsPerPixel(image->format) == 0 && DDSBlockBytes(image->format) == 0) || image->mipLevels > 32)
+		return false;
+
+	unsigned int slices = image->arraySize * (image->isCube ? 6 : 1);
+	image->subresources.reserve(slices * image->mipLevels);
+	for (unsigned int slice = 0; slice < slices; ++slice)
+	{
+		unsigned int width = image->width, height = image->height, depth = image->depth;
+		for (unsigned int mip = 0; mip < image->mipLevels; ++mip)
+		{
+			DDSSubresource subresource;
+			unsigned int rowCount;
+			DDSSurfaceInfo(image->format, width, height, &subresource.rowPitch, &rowCount);
+			subresource.slicePitch = subresource.rowPitch * rowCount;
+			subresource.width = width;
+			subresource.height = height;
+			subresource.depth = depth;
+
+			size_t bytes = (size_t)subresource.slicePitch * depth;
+			if (bytes > size - offset)
+			{
+				image->subresources.clear();
+				return false;
+			}
+			subresource.data = data + offset;
+			image->subresources.push_back(subresource);
+			offset += bytes;
+
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			depth = depth > 1 ? depth / 2 : 1;
+		}
+	}
+	return true;
+}
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+
+//--------------------------------------------------------------------------------------
+// Create a texture and its shader resource view from a .dds file. Cube maps come back as
+// TEXTURECUBE (or TEXTURECUBEARRAY) views, everything else with the matching dimension.
+//--------------------------------------------------------------------------------------
+inline HRESULT CreateDDSTextureFromFile(ID3D11Device* device, const wchar_t* fileName, ID3D11Resource** texture, ID3D11ShaderResourceView** textureView)
+{
+	if (texture)
+		*texture = NULL;
+	if (textureView)
+		*textureView = NULL;
+
+	HANDLE file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return E_FAIL;
+	}
+
+	// Copy-on-write, so the X8B8G8R8 alpha fix-up only copies the pages it touches
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	unsigned char* data = mapping ? (unsigned char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : NULL;
+	if (data == NULL)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return E_FAIL;
+	}
+
+	HRESULT hr = E_FAIL;
+	DDSImage image;
+	if (ParseDDS(data, (size_t)fileSize.QuadPart, &image))
+	{
+		std::vector<D3D11_SUBRESOURCE_DATA> initData(image.subresources.size());
+		for (size_t i = 0; i < image.subresources.size(); ++i)
+		{
+			const DDSSubresource& subresource = image.subresources[i];
+			if (image.forceOpaqueAlpha)
+			{
+				unsigned char* pixels = (unsigned char*)subresource.data;
+				for (size_t p = 3; p < (size_t)subresource.slicePitch * subresource.depth; p += 4)
+					pixels[p] = 0xff;
+			}
+			initData[i].pSysMem = subresource.data;
+			initData[i].SysMemPitch = subresource.rowPitch;
+			initData[i].SysMemSlicePitch = subresource.slicePitch;
+		}
+
+		DXGI_FORMAT format = (DXGI_FORMAT)image.format;
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		ZeroMemory(&viewDesc, sizeof(viewDesc));
+		viewDesc.Format = format;
+
+		ID3D11Resource* resource = NULL;
+		if (image.dimension == DDS_DIMENSION_TEXTURE1D)
+		{
+			D3D11_TEXTURE1D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = image.width;
+			desc.MipLevels = image.mipLevels;
+			desc.ArraySize = image.arraySize;
+			desc.Format = format;
+			desc.Usage = D3D11_USAGE_IMMUTABLE;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			hr = device->CreateTexture1D(&desc, &initData[0], (ID3D11Texture1D**)&resource);
+
+			if (image.arraySize > 1)
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE1DARRAY;
+				viewDesc.Texture1DArray.MipLevels = image.mipLevels;
+				viewDesc.Texture1DArray.ArraySize = image.arraySize;
+			}
+			else
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE1D;
+				viewDesc.Texture1D.MipLevels = image.mipLevels;
+			}
+		}
+		else if (image.dimension == DDS_DIMENSION_TEXTURE2D)
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = image.width;
+			desc.Height = image.height;
+			desc.MipLevels = image.mipLevels;
+			desc.ArraySize = image.arraySize * (image.isCube ? 6 : 1);
+			desc.Format = format;
+			desc.SampleDesc.Count = 1;
+			desc.Usage = D3D11_USAGE_IMMUTABLE;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			desc.MiscFlags = image.isCube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+			hr = device->CreateTexture2D(&desc, &initData[0], (ID3D11Texture2D**)&resource);
+
+			if (image.isCube && image.arraySize > 1)
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+				viewDesc.TextureCubeArray.MipLevels = image.mipLevels;
+				viewDesc.TextureCubeArray.NumCubes = image.arraySize;
+			}
+			else if (image.isCube)
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+				viewDesc.TextureCube.MipLevels = image.mipLevels;
+			}
+			else if (image.arraySize > 1)
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+				viewDesc.Texture2DArray.MipLevels = image.mipLevels;
+				viewDesc.Texture2DArray.ArraySize = image.arraySize;
+			}
+			else
+			{
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+				viewDesc.Texture2D.MipLevels = image.mipLevels;
+			}
+		}
+		else
+		{
+			D3D11_TEXTURE3D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = image.width;
+			desc.Height = image.height;
+			desc.Depth = image.depth;
+			desc.MipLevels = image.mipLevels;
+			desc.Format = format;
+			desc.Usage = D3D11_USAGE_IMMUTABLE;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			hr = device->CreateTexture3D(&desc, &initData[0], (ID3D11Texture3D**)&resource);
+
+			viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+			viewDesc.Texture3D.MipLevels = image.mipLevels;
+		}
+
+		if (SUCCEEDED(hr) && textureView)
+			hr = device->CreateShaderResourceView(resource, &viewDesc, textureView);
+		if (SUCCEEDED(hr) && texture)
+			*texture = resource;
+		else if (resource)
+			resource->Release();
+	}
+
+	// The device owns a copy of the pixels now
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	return hr;
+}
+
+#endif
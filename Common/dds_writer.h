@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------------------
+// File: dds_writer.h
+//
+// Counterpart of dds_reader.h for the offline tools. WriteDDS takes a DDSImage filled
+// in the way ParseDDS returns one (subresources in D3D11 order, array slice major, mip
+// minor) and writes it with the DX10 header extension, so any DXGI format the reader
+// knows can be stored without a legacy pixel format mapping. Rows are written tightly
+// packed whatever the subresources' rowPitch.
+//
+// 1D and 3D textures are not supported; the tools only produce 2D textures and cubes.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include "dds_reader.h"
+
+#define DDS_HEADER_FLAGS_TEXTURE	0x00001007	// CAPS | HEIGHT | WIDTH | PIXELFORMAT
+#define DDS_HEADER_FLAGS_MIPMAP		0x00020000
+#define DDS_HEADER_FLAGS_PITCH		0x00000008
+#define DDS_HEADER_FLAGS_LINEARSIZE	0x00080000
+#define DDS_SURFACE_FLAGS_TEXTURE	0x00001000
+#define DDS_SURFACE_FLAGS_MIPMAP	0x00400008	// MIPMAP | COMPLEX
+#define DDS_SURFACE_FLAGS_CUBEMAP	0x00000008	// COMPLEX
+
+// Size of what WriteDDSHeader writes; the texels follow
+#define DDS_HEADER_BYTES	(sizeof(unsigned int) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10))
+
+// Magic and headers for the image's description; its subresources are not used, so a
+// tool can stream the texels after it
+inline bool WriteDDSHeader(FILE* file, const DDSImage& image)
+{
+	if (image.dimension != DDS_DIMENSION_TEXTURE2D || image.width == 0 || image.height == 0 || image.mipLevels == 0 ||
+		image.arraySize == 0)
+		return false;
+
+	unsigned int rowPitch, rowCount;
+	DDSSurfaceInfo(image.format, image.width, image.height, &rowPitch, &rowCount);
+	if (rowPitch == 0)
+		return false;
+
+	DDSHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(DDSHeader);
+	header.flags = DDS_HEADER_FLAGS_TEXTURE | (image.mipLevels > 1 ? DDS_HEADER_FLAGS_MIPMAP : 0) |
+		(DDSBlockBytes(image.format) ? DDS_HEADER_FLAGS_LINEARSIZE : DDS_HEADER_FLAGS_PITCH);
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = DDSBlockBytes(image.format) ? rowPitch * rowCount : rowPitch;
+	header.depth = 1;
+	header.mipMapCount = image.mipLevels;
+	header.ddspf.size = sizeof(DDSPixelFormat);
+	header.ddspf.flags = DDS_PIXELFORMAT_FOURCC;
+	header.ddspf.fourCC = DDS_FOURCC('D', 'X', '1', '0');
+	header.caps = DDS_SURFACE_FLAGS_TEXTURE | (image.mipLevels > 1 ? DDS_SURFACE_FLAGS_MIPMAP : 0) |
+		(image.isCube ? DDS_SURFACE_FLAGS_CUBEMAP : 0);
+	header.caps2 = image.isCube ? DDS_CAPS2_CUBEMAP | DDS_CAPS2_CUBEMAP_ALLFACES : 0;
+
+	DDSHeaderDX10 dx10;
+	dx10.dxgiFormat = image.format;
+	dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.miscFlag = image.isCube ? DDS_RESOURCE_MISC_CUBE : 0;
+	dx10.arraySize = image.arraySize;
+	dx10.miscFlags2 = 0;
+
+	unsigned int magic = DDS_MAGIC;
+	fwrite(&magic, sizeof(magic), 1, file);
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&dx10, sizeof(dx10), 1, file);
+	return ferror(file) == 0;
+}
+
+inline bool WriteDDS(const char* fileName, const DDSImage& image)
+{
+	unsigned int slices = image.arraySize * (image.isCube ? 6 : 1);
+	if (image.subresources.size() != slices * image.mipLevels)
+		return false;
+
+	FILE* file = fopen(fileName, "wb");
+	if (file == NULL)
+		return false;
+	if (!WriteDDSHeader(file, image))
+	{
+		fclose(file);
+		return false;
+	}
+	unsigned int rowPitch, rowCount;
+	for (size_t i = 0; i < image.subresources.size(); ++i)
+	{
+		const DDSSubresource& sub = image.subresources[i];
+		DDSSurfaceInfo(image.format, sub.width, sub.height, &rowPitch, &rowCount);
+		for (unsigned int row = 0; row < rowCount; ++row)
+			fwrite(sub.data + (size_t)row * sub.rowPitch, rowPitch, 1, file);
+	}
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
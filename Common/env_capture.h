@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------------------------
+// File: env_capture.h
+//
+// Dynamic environment capture: the scene rendered into the six faces of a cube map from
+// a reflective object's position, so its reflection shows the objects around it and not
+// just the sky.
+//
+// A full capture is six extra scene passes. EnvCaptureSchedule spreads them over frames:
+// it hands out facesPerFrame faces each frame in a fixed rotation, so with 1 a face is at
+// most five frames old and the capture costs one extra pass instead of six. Invalidate()
+// (the object moved, or the first frame) renders all six at once. CubeFaceSeesBox culls
+// objects per face against the 90 degree face frustum.
+//
+// Face orientation follows the Direct3D cube layout, so CubeFaceView renders straight
+// into array slice `face` of a TEXTURECUBE resource. EnvCaptureTarget (Windows only) is
+// that cube: an R8G8B8A8_UNORM render target with one view per face, a shared depth
+// buffer and a full mip chain made by GenerateMips for rough reflections.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <algorithm>
+#include "xnamath_portable.h"
+
+#define ENV_CAPTURE_FACES	6
+
+//--------------------------------------------------------------------------------------
+// Face cameras
+//--------------------------------------------------------------------------------------
+// +X, -X, +Y, -Y, +Z, -Z with the up vectors of the D3D cube layout
+inline void CubeFaceBasis(int face, XMFLOAT3* forward, XMFLOAT3* up)
+{
+	static const float forwards[ENV_CAPTURE_FACES][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const float ups[ENV_CAPTURE_FACES][3] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+	*forward = XMFLOAT3(forwards[face][0], forwards[face][1], forwards[face][2]);
+	*up = XMFLOAT3(ups[face][0], ups[face][1], ups[face][2]);
+}
+
+inline XMMATRIX CubeFaceView(int face, FXMVECTOR eye)
+{
+	XMFLOAT3 forward, up;
+	CubeFaceBasis(face, &forward, &up);
+	return XMMatrixLookToLH(eye, XMLoadFloat3(&forward), XMLoadFloat3(&up));
+}
+
+inline XMMATRIX CubeFaceProjection(float nearZ, float farZ)
+{
+	return XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearZ, farZ);
+}
+
+// Conservative: false only when the box is entirely outside one plane of the face's
+// frustum. The side planes of a 90 degree face are forward +- right and forward +- up.
+inline bool CubeFaceSeesBox(int face, const XMFLOAT3& eye, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float nearZ, float farZ)
+{
+	XMFLOAT3 f, u;
+	CubeFaceBasis(face, &f, &u);
+	float r[3] = { u.y * f.z - u.z * f.y, u.z * f.x - u.x * f.z, u.x * f.y - u.y * f.x };	// cross(up, forward)
+	float forward[3] = { f.x, f.y, f.z }, up[3] = { u.x, u.y, u.z };
+	float lo[3] = { boxMin.x - eye.x, boxMin.y - eye.y, boxMin.z - eye.z };
+	float hi[3] = { boxMax.x - eye.x, boxMax.y - eye.y, boxMax.z - eye.z };
+
+	// Each plane is dot(n, p) >= d; test the box corner furthest along n
+	float planes[6][4];
+	for (int c = 0; c < 3; ++c)
+	{
+		planes[0][c] = forward[c];
+		planes[1][c] = -forward[c];
+		planes[2][c] = forward[c] + r[c];
+		planes[3][c] = forward[c] - r[c];
+		planes[4][c] = forward[c] + up[c];
+		planes[5][c] = forward[c] - up[c];
+	}
+	planes[0][3] = nearZ;
+	planes[1][3] = -farZ;
+	planes[2][3] = planes[3][3] = planes[4][3] = planes[5][3] = 0.0f;
+	for (int p = 0; p < 6; ++p)
+	{
+		float distance = 0.0f;
+		for (int c = 0; c < 3; ++c)
+			distance += planes[p][c] * (planes[p][c] >= 0.0f ? hi[c] : lo[c]);
+		if (distance < planes[p][3])
+			return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Amortized schedule
+//--------------------------------------------------------------------------------------
+class EnvCaptureSchedule
+{
+public:
+	EnvCaptureSchedule() : m_FacesPerFrame(1), m_NextFace(0), m_Invalid(true) {}
+
+	// 0 freezes the capture, ENV_CAPTURE_FACES renders every face every frame
+	void SetFacesPerFrame(int faces) { m_FacesPerFrame = std::min(std::max(faces, 0), ENV_CAPTURE_FACES); }
+	int FacesPerFrame() const { return m_FacesPerFrame; }
+
+	// All six faces next frame, whatever the rate
+	void Invalidate() { m_Invalid = true; }
+
+	// Faces to render this frame, returns how many were written to faces
+	int Next(int faces[ENV_CAPTURE_FACES])
+	{
+		int count = m_Invalid ? ENV_CAPTURE_FACES : m_FacesPerFrame;
+		if (m_Invalid)
+			m_NextFace = 0;
+		m_Invalid = false;
+		for (int i = 0; i < count; ++i)
+		{
+			faces[i] = m_NextFace;
+			m_NextFace = (m_NextFace + 1) % ENV_CAPTURE_FACES;
+		}
+		return count;
+	}
+
+private:
+	int m_FacesPerFrame;
+	int m_NextFace;
+	bool m_Invalid;
+};
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+
+//--------------------------------------------------------------------------------------
+// Cube render target
+//--------------------------------------------------------------------------------------
+class EnvCaptureTarget
+{
+public:
+	EnvCaptureTarget() : m_Texture(NULL), m_View(NULL), m_Depth(NULL), m_DepthView(NULL), m_Size(0)
+	{
+		for (int face = 0; face < ENV_CAPTURE_FACES; ++face)
+			m_FaceViews[face] = NULL;
+	}
+
+	~EnvCaptureTarget()
+	{
+		Release();
+	}
+
+	HRESULT Init(ID3D11Device* device, UINT size)
+	{
+		Release();
+		m_Size = size;
+
+		// GenerateMips needs RENDER_TARGET binding and the GENERATE_MIPS flag
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = size;
+		desc.Height = size;
+		desc.MipLevels = 0;
+		desc.ArraySize = ENV_CAPTURE_FACES;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+		HRESULT hr = device->CreateTexture2D(&desc, NULL, &m_Texture);
+		if (FAILED(hr))
+			return hr;
+
+		hr = device->CreateShaderResourceView(m_Texture, NULL, &m_View);
+		for (int face = 0; face < ENV_CAPTURE_FACES && SUCCEEDED(hr); ++face)
+		{
+			D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
+			ZeroMemory(&rtvDesc, sizeof(rtvDesc));
+			rtvDesc.Format = desc.Format;
+			rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+			rtvDesc.Texture2DArray.MipSlice = 0;
+			rtvDesc.Texture2DArray.FirstArraySlice = face;
+			rtvDesc.Texture2DArray.ArraySize = 1;
+			hr = device->CreateRenderTargetView(m_Texture, &rtvDesc, &m_FaceViews[face]);
+		}
+		if (FAILED(hr))
+			return hr;
+
+		// One depth buffer, cleared for each face
+		D3D11_TEXTURE2D_DESC depthDesc = desc;
+		depthDesc.MipLevels = 1;
+		depthDesc.ArraySize = 1;
+		depthDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		depthDesc.MiscFlags = 0;
+		hr = device->CreateTexture2D(&depthDesc, NULL, &m_Depth);
+		if (SUCCEEDED(hr))
+			hr = device->CreateDepthStencilView(m_Depth, NULL, &m_DepthView);
+		return hr;
+	}
+
+	void Release()
+	{
+		for (int face = 0; face < ENV_CAPTURE_FACES; ++face)
+		{
+			if (m_FaceViews[face])
+				m_FaceViews[face]->Release();
+			m_FaceViews[face] = NULL;
+		}
+		if (m_DepthView)
+			m_DepthView->Release();
+		if (m_Depth)
+			m_Depth->Release();
+		if (m_View)
+			m_View->Release();
+		if (m_Texture)
+			m_Texture->Release();
+		m_DepthView = NULL;
+		m_Depth = NULL;
+		m_View = NULL;
+		m_Texture = NULL;
+	}
+
+	// Binds and clears the face with a matching viewport. The caller restores its own
+	// render target and viewport afterwards, and must not have View() bound meanwhile.
+	void BeginFace(ID3D11DeviceContext* context, int face, const float clearColor[4])
+	{
+		D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (float)m_Size, (float)m_Size, 0.0f, 1.0f };
+		context->OMSetRenderTargets(1, &m_FaceViews[face], m_DepthView);
+		context->RSSetViewports(1, &viewport);
+		context->ClearRenderTargetView(m_FaceViews[face], clearColor);
+		context->ClearDepthStencilView(m_DepthView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	}
+
+	// Rebuilds the mips from the updated faces; the render target must be unbound
+	void Finish(ID3D11DeviceContext* context)
+	{
+		context->GenerateMips(m_View);
+	}
+
+	ID3D11ShaderResourceView* View() const { return m_View; }
+	UINT Size() const { return m_Size; }
+
+private:
+	ID3D11Texture2D* m_Texture;
+	ID3D11ShaderResourceView* m_View;
+	ID3D11RenderTargetView* m_FaceViews[ENV_CAPTURE_FACES];
+	ID3D11Texture2D* m_Depth;
+	ID3D11DepthStencilView* m_DepthView;
+	UINT m_Size;
+};
+
+#endif
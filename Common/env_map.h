@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------------
+// File: env_map.h
+//
+// Environment map layouts and the pieces the offline converter (Headless/env_convert)
+// and the shaders share:
+//   equirectangular  longitude along u with +Z in the middle, +Y at the top row
+//   cube             D3D11 faces +X, -X, +Y, -Y, +Z, -Z (SoftMipCube::FaceDirection)
+//   octahedral       one square: the upper hemisphere in the centre diamond with +Y in
+//                    the middle and +Z at the top, the lower hemisphere folded into the
+//                    corners, -Y at all four of them
+//
+// The octahedral square keeps a one texel border holding the texels across each edge,
+// so bilinear filtering is seamless without any wrap logic in the shader; OctahedralUV
+// here and in D3D11_sky_mapping/Effects.fx maps into the inner (size - 2)^2 texels. A
+// square of side 2F has two thirds of the texels of a cube with F*F faces at a
+// comparable resolution, and a 2D fetch is cheaper than a cube one.
+//
+// RadianceReader streams the scanlines of a Radiance .hdr (RGBE) file, so a panorama
+// never has to be in memory as a whole.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "soft_sampler.h"
+
+#define ENV_PI	3.14159265358979f
+
+enum EnvLayout
+{
+	ENV_LAYOUT_EQUIRECT,
+	ENV_LAYOUT_CUBE,
+	ENV_LAYOUT_OCTAHEDRAL,
+};
+
+//--------------------------------------------------------------------------------------
+// Mappings; directions need not be normalized, returned ones are
+//--------------------------------------------------------------------------------------
+inline void EquirectDirection(float u, float v, float dir[3])
+{
+	float phi = (u - 0.5f) * 2.0f * ENV_PI, theta = v * ENV_PI;
+	dir[0] = sinf(theta) * sinf(phi);
+	dir[1] = cosf(theta);
+	dir[2] = sinf(theta) * cosf(phi);
+}
+
+inline void EquirectUV(const float dir[3], float* u, float* v)
+{
+	float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	float y = length > 0.0f ? dir[1] / length : 1.0f;
+	*u = 0.5f + atan2f(dir[0], dir[2]) / (2.0f * ENV_PI);
+	*v = acosf(std::min(std::max(y, -1.0f), 1.0f)) / ENV_PI;
+}
+
+// Octahedral point p in [-1, 1]^2 of a direction
+inline void OctahedralEncode(const float dir[3], float p[2])
+{
+	float l1 = fabsf(dir[0]) + fabsf(dir[1]) + fabsf(dir[2]);
+	float x = dir[0] / l1, z = dir[2] / l1;
+	if (dir[1] < 0.0f)
+	{
+		p[0] = (1.0f - fabsf(z)) * (x >= 0.0f ? 1.0f : -1.0f);
+		p[1] = (1.0f - fabsf(x)) * (z >= 0.0f ? 1.0f : -1.0f);
+	}
+	else
+	{
+		p[0] = x;
+		p[1] = z;
+	}
+}
+
+// Points beyond an edge continue on the other half of the same edge, which mirrors
+// about the edge's midpoint; that is what the border texels hold
+inline void OctahedralDecode(float px, float pz, float dir[3])
+{
+	if (px > 1.0f || px < -1.0f)
+		px = (px > 0.0f ? 2.0f : -2.0f) - px, pz = -pz;
+	if (pz > 1.0f || pz < -1.0f)
+		pz = (pz > 0.0f ? 2.0f : -2.0f) - pz, px = -px;
+	float y = 1.0f - fabsf(px) - fabsf(pz);
+	float x = px, z = pz;
+	if (y < 0.0f)
+	{
+		x = (1.0f - fabsf(pz)) * (px >= 0.0f ? 1.0f : -1.0f);
+		z = (1.0f - fabsf(px)) * (pz >= 0.0f ? 1.0f : -1.0f);
+	}
+	float length = sqrtf(x * x + y * y + z * z);
+	dir[0] = x / length;
+	dir[1] = y / length;
+	dir[2] = z / length;
+}
+
+// Texture coordinates in a size*size octahedral map with its border
+inline void OctahedralUV(const float dir[3], int size, float* u, float* v)
+{
+	float p[2];
+	OctahedralEncode(dir, p);
+	*u = ((0.5f + 0.5f * p[0]) * (size - 2) + 1.0f) / size;
+	*v = ((0.5f - 0.5f * p[1]) * (size - 2) + 1.0f) / size;
+}
+
+// Direction at texel coordinates (x, y) of face, so the texel centre of (i, j) is at
+// (i + 0.5, j + 0.5); width and height are the face's
+inline void EnvTexelDirection(EnvLayout layout, int face, int width, int height, float x, float y, float dir[3])
+{
+	if (layout == ENV_LAYOUT_EQUIRECT)
+		EquirectDirection(x / width, y / height, dir);
+	else if (layout == ENV_LAYOUT_OCTAHEDRAL)
+		OctahedralDecode(2.0f * (x - 1.0f) / (width - 2) - 1.0f, 1.0f - 2.0f * (y - 1.0f) / (height - 2), dir);
+	else
+	{
+		SoftMipCube::FaceDirection(face, 2.0f * x / width - 1.0f, 2.0f * y / height - 1.0f, dir);
+		float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		dir[0] /= length, dir[1] /= length, dir[2] /= length;
+	}
+}
+
+// Average angle a texel spans, to match filter widths between layouts
+inline float EnvTexelAngle(EnvLayout layout, int width, int height)
+{
+	if (layout == ENV_LAYOUT_EQUIRECT)
+		return ENV_PI / height;
+	if (layout == ENV_LAYOUT_OCTAHEDRAL)
+		return sqrtf(4.0f * ENV_PI) / std::max(width - 2, 1);
+	return 0.5f * ENV_PI / width;
+}
+
+//--------------------------------------------------------------------------------------
+// Half floats, for R16G16B16A16_FLOAT; round to nearest even
+//--------------------------------------------------------------------------------------
+inline unsigned short FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000, exponent = (bits >> 23) & 0xff, mantissa = bits & 0x7fffff;
+	if (exponent == 0xff)
+		return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	int e = (int)exponent - 127 + 15;
+	if (e >= 31)
+		return (unsigned short)(sign | 0x7c00);
+
+	unsigned int shift = 13, half;
+	if (e <= 0)
+	{
+		if (e < -10)
+			return (unsigned short)sign;
+		mantissa |= 0x800000;
+		shift = 14 - e;
+		half = mantissa >> shift;
+	}
+	else
+		half = ((unsigned int)e << 10) | (mantissa >> 13);
+	// A carry out of the mantissa correctly bumps the exponent, up to infinity
+	unsigned int rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+	if (rest > halfway || (rest == halfway && (half & 1)))
+		half++;
+	return (unsigned short)(sign | half);
+}
+
+inline float HalfToFloat(unsigned short value)
+{
+	unsigned int sign = (value & 0x8000u) << 16, exponent = (value >> 10) & 0x1f, mantissa = value & 0x3ff;
+	if (exponent == 0)
+	{
+		float f = mantissa * 5.9604644775390625e-8f;	// 2^-24
+		return sign ? -f : f;
+	}
+	unsigned int bits = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+//--------------------------------------------------------------------------------------
+// Radiance .hdr scanline reader
+//--------------------------------------------------------------------------------------
+// Reads rows in any order. File offsets of the rows are recorded as decoding passes
+// them, so going back costs a seek and going forward decodes the rows in between once.
+// Only the standard -Y H +X W orientation and RGBE (not XYZE) data are supported, in
+// flat or run length encoded scanlines.
+class RadianceReader
+{
+public:
+	RadianceReader() : m_File(NULL), m_Width(0), m_Height(0)
+	{
+		for (int e = 0; e < 256; ++e)
+			m_Scale[e] = e ? ldexpf(1.0f, e - 136) : 0.0f;
+	}
+
+	~RadianceReader()
+	{
+		if (m_File != NULL)
+			fclose(m_File);
+	}
+
+	bool Open(const char* fileName)
+	{
+		m_File = fopen(fileName, "rb");
+		if (m_File == NULL)
+			return false;
+
+		char line[256];
+		if (fgets(line, sizeof(line), m_File) == NULL || line[0] != '#' || line[1] != '?')
+			return false;
+		while (fgets(line, sizeof(line), m_File) != NULL && line[0] != '\n' && line[0] != '\r')
+		{
+			if (!strncmp(line, "FORMAT=", 7) && strncmp(line + 7, "32-bit_rle_rgbe", 15))
+				return false;
+		}
+		if (fgets(line, sizeof(line), m_File) == NULL || sscanf(line, "-Y %d +X %d", &m_Height, &m_Width) != 2 ||
+			m_Width <= 0 || m_Height <= 0)
+			return false;
+
+		m_RowOffsets.assign(1, ftell(m_File));
+		m_Scratch.resize((size_t)m_Width * 4);
+		return true;
+	}
+
+	int Width() const { return m_Width; }
+	int Height() const { return m_Height; }
+
+	// One row as linear RGBA floats, alpha 1
+	bool ReadRow(int row, float* rgba)
+	{
+		if (row < 0 || row >= m_Height)
+			return false;
+		while ((int)m_RowOffsets.size() <= row)
+		{
+			fseek(m_File, m_RowOffsets.back(), SEEK_SET);
+			if (!DecodeRow(&m_Scratch[0]))
+				return false;
+			m_RowOffsets.push_back(ftell(m_File));
+		}
+		fseek(m_File, m_RowOffsets[row], SEEK_SET);
+		if (!DecodeRow(&m_Scratch[0]))
+			return false;
+		if (row + 1 == (int)m_RowOffsets.size() && row + 1 < m_Height)
+			m_RowOffsets.push_back(ftell(m_File));
+
+		for (int x = 0; x < m_Width; ++x, rgba += 4)
+		{
+			const unsigned char* p = &m_Scratch[(size_t)x * 4];
+			float scale = m_Scale[p[3]];
+			rgba[0] = p[0] * scale;
+			rgba[1] = p[1] * scale;
+			rgba[2] = p[2] * scale;
+			rgba[3] = 1.0f;
+		}
+		return true;
+	}
+
+private:
+	bool DecodeRow(unsigned char* rgbe)
+	{
+		unsigned char start[4];
+		if (fread(start, 4, 1, m_File) != 1)
+			return false;
+
+		// Flat scanline, or too narrow or wide for run length encoding
+		if (m_Width < 8 || m_Width > 0x7fff || start[0] != 2 || start[1] != 2 || (start[2] & 0x80))
+		{
+			memcpy(rgbe, start, 4);
+			if (start[0] == 1 && start[1] == 1 && start[2] == 1)
+				return false;		// old style runs
+			return m_Width == 1 || fread(rgbe + 4, (size_t)(m_Width - 1) * 4, 1, m_File) == 1;
+		}
+		if (((start[2] << 8) | start[3]) != m_Width)
+			return false;
+
+		// Each channel on its own: runs of one value or literal bytes
+		for (int c = 0; c < 4; ++c)
+		{
+			int x = 0;
+			while (x < m_Width)
+			{
+				int count = getc(m_File);
+				if (count == EOF || count == 0)
+					return false;
+				if (count > 128)
+				{
+					count -= 128;
+					int value = getc(m_File);
+					if (value == EOF || x + count > m_Width)
+						return false;
+					for (int i = 0; i < count; ++i)
+						rgbe[(size_t)(x++) * 4 + c] = (unsigned char)value;
+				}
+				else
+				{
+					if (x + count > m_Width)
+						return false;
+					for (int i = 0; i < count; ++i)
+					{
+						int value = getc(m_File);
+						if (value == EOF)
+							return false;
+						rgbe[(size_t)(x++) * 4 + c] = (unsigned char)value;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	FILE* m_File;
+	int m_Width;
+	int m_Height;
+	std::vector<long> m_RowOffsets;		// start of every row decoded so far, plus the next one
+	std::vector<unsigned char> m_Scratch;
+	float m_Scale[256];
+};
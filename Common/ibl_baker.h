@@ -0,0 +1,289 @@
+//--------------------------------------------------------------------------------------
+// File: ibl_baker.h
+//
+// Image based lighting from a cube map for the offline tools: a GGX prefiltered mip
+// chain for glossy reflections and SH irradiance (sh_irradiance.h) for diffuse ambient.
+//
+// Prefiltering follows the split sum approximation (Karis, "Real Shading in Unreal
+// Engine 4"): mip m of the output holds the environment convolved with the GGX lobe
+// of roughness m / (mips - 1), assuming view = normal = reflection, so a shader picks
+// the mip from the roughness and makes a single fetch. Mip 0 is the environment itself.
+//
+// Each output texel importance samples the lobe with a Hammersley sequence. Samples
+// read the source at the mip whose texel covers the sample's share of the lobe
+// (filtered importance sampling, Krivanek and Colbert, GPU Gems 3 chapter 20), so a
+// few dozen samples give a smooth result. The source is a SoftMipCube, whose border
+// texels make bilinear taps blend across face edges, so the output has no seams at
+// any roughness. Sample directions for a texel are rotated into its tangent frame
+// and fetched four at a time with SoftMipCube::SampleLevel4.
+//
+// Texels are treated as linear radiance; callers convert from sRGB first if needed.
+// Work is spread over a SoftThreadPool by rows of every face and mip.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#include "soft_sampler.h"
+#include "sh_irradiance.h"
+
+#define IBL_PI	3.14159265358979f
+
+// One mip of a cube map: six faces of size*size RGBA float texels, D3D11 face order
+struct IBLCubeLevel
+{
+	int size;
+	std::vector<float> faces[6];
+};
+
+//--------------------------------------------------------------------------------------
+// GGX prefilter
+//--------------------------------------------------------------------------------------
+class GGXPrefilter
+{
+public:
+	// Builds a chain of mipCount levels starting at size with sampleCount samples per
+	// texel (rounded up to a multiple of 4)
+	GGXPrefilter(const SoftMipCube* source, int size, int mipCount, int sampleCount)
+		: m_Source(source), m_Levels(NULL)
+	{
+		m_Sampler = SoftLinearWrapSamplerDesc();
+		m_Sizes.resize(mipCount);
+		m_Samples.resize(mipCount);
+		for (int m = 0; m < mipCount; ++m)
+		{
+			m_Sizes[m] = std::max(size >> m, 1);
+			float roughness = mipCount > 1 ? (float)m / (mipCount - 1) : 0.0f;
+			BuildSamples(roughness, (sampleCount + 3) & ~3, &m_Samples[m]);
+		}
+	}
+
+	static float Roughness(int mip, int mipCount)
+	{
+		return mipCount > 1 ? (float)mip / (mipCount - 1) : 0.0f;
+	}
+
+	void Run(SoftThreadPool* pool, std::vector<IBLCubeLevel>* levels)
+	{
+		levels->resize(m_Sizes.size());
+		m_Rows.clear();
+		for (size_t m = 0; m < m_Sizes.size(); ++m)
+		{
+			IBLCubeLevel& level = (*levels)[m];
+			level.size = m_Sizes[m];
+			for (int f = 0; f < 6; ++f)
+			{
+				level.faces[f].resize((size_t)level.size * level.size * 4);
+				for (int y = 0; y < level.size; ++y)
+				{
+					Row row = { (int)m, f, y };
+					m_Rows.push_back(row);
+				}
+			}
+		}
+		m_Levels = &(*levels)[0];
+		pool->ParallelFor((int)m_Rows.size(), RowJob, this);
+		m_Levels = NULL;
+	}
+
+private:
+	// Tangent space light directions for view = normal = (0, 0, 1), with their weight
+	// (n.l) and source LOD; weight 0 pads to a multiple of 4
+	struct SampleSet
+	{
+		std::vector<float> x, y, z, weight, lod;
+		bool mirror;		// roughness 0: a single fetch along the normal
+	};
+
+	struct Row
+	{
+		int mip;
+		int face;
+		int y;
+	};
+
+	static float RadicalInverse(unsigned int bits)
+	{
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		return bits * 2.3283064365386963e-10f;
+	}
+
+	void BuildSamples(float roughness, int count, SampleSet* set) const
+	{
+		set->mirror = roughness <= 0.0f;
+		if (set->mirror)
+			return;
+
+		float alpha = roughness * roughness, alpha2 = alpha * alpha;
+		int sourceSize = m_Source->Size();
+		float texelSolidAngle = 4.0f * IBL_PI / (6.0f * sourceSize * sourceSize);
+		for (int i = 0; i < count; ++i)
+		{
+			// GGX distributed half vector
+			float u = (i + 0.5f) / count, v = RadicalInverse(i);
+			float phi = 2.0f * IBL_PI * u;
+			float cosTheta = sqrtf((1.0f - v) / (1.0f + (alpha2 - 1.0f) * v));
+			float sinTheta = sqrtf(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+			float h[3] = { sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta };
+
+			// Reflect the view (0, 0, 1) about h
+			float l[3] = { 2.0f * cosTheta * h[0], 2.0f * cosTheta * h[1], 2.0f * cosTheta * h[2] - 1.0f };
+			if (l[2] <= 0.0f)
+				continue;
+
+			// pdf of l is D(h) / 4 when view = normal; the sample covers 1 / (count * pdf)
+			float d = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+			float pdf = alpha2 / (IBL_PI * d * d) * 0.25f;
+			float sampleSolidAngle = 1.0f / (count * pdf);
+			set->x.push_back(l[0]);
+			set->y.push_back(l[1]);
+			set->z.push_back(l[2]);
+			set->weight.push_back(l[2]);
+			set->lod.push_back(std::max(0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f));
+		}
+		while (set->x.size() & 3)
+		{
+			set->x.push_back(0.0f);
+			set->y.push_back(0.0f);
+			set->z.push_back(1.0f);
+			set->weight.push_back(0.0f);
+			set->lod.push_back(0.0f);
+		}
+	}
+
+	void FilterTexel(const SampleSet& set, const float n[3], float color[4]) const
+	{
+		if (set.mirror)
+		{
+			m_Source->SampleLevel(m_Sampler, n, 0.0f, color);
+			return;
+		}
+
+		// Tangent frame around the normal
+		float up[3] = { 0.0f, 0.0f, 1.0f };
+		if (fabsf(n[2]) > 0.999f)
+			up[0] = 1.0f, up[2] = 0.0f;
+		float t[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+		float length = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+		t[0] /= length, t[1] /= length, t[2] /= length;
+		float b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, weightSum = 0.0f;
+		for (size_t i = 0; i < set.x.size(); i += 4)
+		{
+			float dir[3][4];
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				float x = set.x[i + lane], y = set.y[i + lane], z = set.z[i + lane];
+				for (int c = 0; c < 3; ++c)
+					dir[c][lane] = x * t[c] + y * b[c] + z * n[c];
+			}
+			float colors[4][4];
+			m_Source->SampleLevel4(m_Sampler, dir, &set.lod[i], colors);
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				float weight = set.weight[i + lane];
+				for (int c = 0; c < 4; ++c)
+					sum[c] += colors[lane][c] * weight;
+				weightSum += weight;
+			}
+		}
+		for (int c = 0; c < 4; ++c)
+			color[c] = weightSum > 0.0f ? sum[c] / weightSum : 0.0f;
+	}
+
+	static void RowJob(void* context, int index)
+	{
+		const GGXPrefilter* prefilter = (const GGXPrefilter*)context;
+		const Row& row = prefilter->m_Rows[index];
+		IBLCubeLevel& level = prefilter->m_Levels[row.mip];
+		int size = level.size;
+		float* out = &level.faces[row.face][(size_t)row.y * size * 4];
+		for (int x = 0; x < size; ++x, out += 4)
+		{
+			float n[3];
+			SoftMipCube::FaceDirection(row.face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (row.y + 0.5f) / size - 1.0f, n);
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			n[0] /= length, n[1] /= length, n[2] /= length;
+			prefilter->FilterTexel(prefilter->m_Samples[row.mip], n, out);
+		}
+	}
+
+	const SoftMipCube* m_Source;
+	SoftSamplerDesc m_Sampler;
+	std::vector<int> m_Sizes;
+	std::vector<SampleSet> m_Samples;
+	std::vector<Row> m_Rows;
+	IBLCubeLevel* m_Levels;
+};
+
+//--------------------------------------------------------------------------------------
+// SH irradiance
+//--------------------------------------------------------------------------------------
+// Solid angle of the face texel (x, y) of a size*size face, from the area of its
+// projection on the unit sphere
+inline float IBLTexelSolidAngle(int x, int y, int size)
+{
+	struct Local
+	{
+		static float AreaElement(float s, float t) { return atan2f(s * t, sqrtf(s * s + t * t + 1.0f)); }
+	};
+	float s0 = 2.0f * x / size - 1.0f, s1 = 2.0f * (x + 1) / size - 1.0f;
+	float t0 = 2.0f * y / size - 1.0f, t1 = 2.0f * (y + 1) / size - 1.0f;
+	return Local::AreaElement(s0, t0) - Local::AreaElement(s0, t1) - Local::AreaElement(s1, t0) + Local::AreaElement(s1, t1);
+}
+
+struct IBLProjectJob
+{
+	const IBLCubeLevel* cube;
+	std::vector<float> partial;		// per face row: 9 RGB coefficients and the solid angle
+};
+
+inline void IBLProjectRow(void* context, int index)
+{
+	IBLProjectJob* job = (IBLProjectJob*)context;
+	int size = job->cube->size, face = index / size, y = index % size;
+	float* sums = &job->partial[(size_t)index * (SH_COEFFICIENTS * 3 + 1)];
+	const float* texel = &job->cube->faces[face][(size_t)y * size * 4];
+	for (int x = 0; x < size; ++x, texel += 4)
+	{
+		float n[3];
+		SoftMipCube::FaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, n);
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		n[0] /= length, n[1] /= length, n[2] /= length;
+		float basis[SH_COEFFICIENTS];
+		SHBasis(n, basis);
+		float solidAngle = IBLTexelSolidAngle(x, y, size);
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			for (int c = 0; c < 3; ++c)
+				sums[i * 3 + c] += texel[c] * basis[i] * solidAngle;
+		sums[SH_COEFFICIENTS * 3] += solidAngle;
+	}
+}
+
+// Projects the radiance of a cube level on the SH basis, then convolves with the
+// clamped cosine and divides by pi (sh_irradiance.h)
+inline void ProjectSHIrradiance(const IBLCubeLevel& cube, SoftThreadPool* pool, SHIrradiance* sh)
+{
+	IBLProjectJob job;
+	job.cube = &cube;
+	job.partial.assign((size_t)6 * cube.size * (SH_COEFFICIENTS * 3 + 1), 0.0f);
+	pool->ParallelFor(6 * cube.size, IBLProjectRow, &job);
+
+	double sums[SH_COEFFICIENTS * 3 + 1] = { 0 };
+	for (size_t i = 0; i < job.partial.size(); ++i)
+		sums[i % (SH_COEFFICIENTS * 3 + 1)] += job.partial[i];
+
+	// The solid angles add up to 4 pi up to rounding; renormalize to that
+	static const float bandScale[SH_COEFFICIENTS] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	double normalize = 4.0 * IBL_PI / sums[SH_COEFFICIENTS * 3];
+	for (int i = 0; i < SH_COEFFICIENTS; ++i)
+		for (int c = 0; c < 3; ++c)
+			sh->rgb[i][c] = (float)(sums[i * 3 + c] * normalize * bandScale[i]);
+}
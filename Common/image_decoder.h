@@ -0,0 +1,345 @@
+//--------------------------------------------------------------------------------------
+// File: image_decoder.h
+//
+// Startup image decode stage: decodes a set of PNG and JPEG files concurrently on worker
+// threads and hands them back in the order they finish, so each texture can be uploaded
+// as soon as its pixels are ready instead of after a serial decode of all of them.
+//
+// Queue the files with Add(), call Start(), then call Next() until it returns false.
+// Next() blocks until another image is done. Give every image back with Recycle() once
+// it is uploaded: its pixels return to an ImagePixelPool and the next decode of a
+// similar size reuses the allocation. Workers size their buffer from the file header
+// before decoding, so DecodePNG/DecodeJPEG write into it without growing it. A queue can
+// be reused for another batch once Next() has returned false.
+//
+// CreateTextureFromImage (Windows only) uploads an image as R8G8B8A8_UNORM with a full
+// mip chain made by GenerateMips, which is what D3DX11CreateShaderResourceViewFromFile
+// creates for these files.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "png_reader.h"
+#include "jpeg_reader.h"
+
+struct DecodedImage
+{
+	std::string fileName;
+	int tag;					// caller's value from Add()
+	bool ok;					// false when the file is missing or can't be decoded
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> rgba;	// width * height * 4 bytes, rows top to bottom
+};
+
+//--------------------------------------------------------------------------------------
+// Width and height from a PNG IHDR or the first JPEG frame header
+//--------------------------------------------------------------------------------------
+inline bool ImageDimensions(const unsigned char* data, size_t size, unsigned int* width, unsigned int* height)
+{
+	if (size >= 24 && data[0] == 0x89 && !memcmp(data + 1, "PNG", 3) && !memcmp(data + 12, "IHDR", 4))
+	{
+		*width = PNGReadU32(data + 16);
+		*height = PNGReadU32(data + 20);
+		return true;
+	}
+	if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+		return false;
+
+	size_t pos = 2;
+	while (pos + 4 <= size)
+	{
+		if (data[pos] != 0xff)
+			return false;
+		unsigned char marker = data[pos + 1];
+		if (marker == 0xff)
+		{
+			pos++;
+			continue;
+		}
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+		// SOF0..SOF15, except DHT, JPG and DAC which share the range
+		if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+		{
+			if (pos + 9 > size)
+				return false;
+			*height = (data[pos + 5] << 8) | data[pos + 6];
+			*width = (data[pos + 7] << 8) | data[pos + 8];
+			return true;
+		}
+		if (marker == 0xda || marker == 0xd9)
+			return false;
+		pos += 2 + length;
+	}
+	return false;
+}
+
+//--------------------------------------------------------------------------------------
+// Recycled pixel buffers
+//--------------------------------------------------------------------------------------
+// Acquire hands out the smallest free buffer that holds the requested bytes, or grows
+// the largest one when none does. Thread safe.
+class ImagePixelPool
+{
+public:
+	ImagePixelPool() : m_Allocations(0) {}
+
+	// pixels comes back empty with at least bytes of capacity
+	void Acquire(size_t bytes, std::vector<unsigned char>* pixels)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			size_t best = m_Free.size();
+			for (size_t i = 0; i < m_Free.size(); ++i)
+			{
+				if (best == m_Free.size())
+				{
+					best = i;
+					continue;
+				}
+				size_t capacity = m_Free[i].capacity(), bestCapacity = m_Free[best].capacity();
+				bool fits = capacity >= bytes, bestFits = bestCapacity >= bytes;
+				if (fits != bestFits ? fits : (fits ? capacity < bestCapacity : capacity > bestCapacity))
+					best = i;
+			}
+			pixels->clear();
+			if (best < m_Free.size())
+			{
+				pixels->swap(m_Free[best]);
+				m_Free.erase(m_Free.begin() + best);
+			}
+			if (pixels->capacity() < bytes)
+				m_Allocations++;
+		}
+		pixels->reserve(bytes);
+	}
+
+	void Release(std::vector<unsigned char>* pixels)
+	{
+		if (pixels->capacity() == 0)
+			return;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Free.push_back(std::vector<unsigned char>());
+		m_Free.back().swap(*pixels);
+		m_Free.back().clear();
+	}
+
+	// Number of Acquire calls that had to allocate
+	unsigned int Allocations() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Allocations;
+	}
+
+private:
+	mutable std::mutex m_Mutex;
+	std::vector<std::vector<unsigned char> > m_Free;
+	unsigned int m_Allocations;
+};
+
+//--------------------------------------------------------------------------------------
+// Decode queue
+//--------------------------------------------------------------------------------------
+class ImageDecodeQueue
+{
+public:
+	ImageDecodeQueue() : m_NextJob(0), m_Returned(0) {}
+
+	~ImageDecodeQueue()
+	{
+		Join();
+	}
+
+	void Add(const char* fileName, int tag)
+	{
+		DecodedImage job;
+		job.fileName = fileName;
+		job.tag = tag;
+		job.ok = false;
+		job.width = job.height = 0;
+		m_Jobs.push_back(job);
+	}
+
+	// Starts decoding everything added so far on threadCount workers, 0 for one per
+	// hardware thread; never more workers than images
+	void Start(int threadCount)
+	{
+		Join();
+		m_NextJob = 0;
+		m_Returned = 0;
+		if (threadCount <= 0)
+			threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+		threadCount = std::min(threadCount, (int)m_Jobs.size());
+		for (int i = 0; i < threadCount; ++i)
+			m_Workers.push_back(std::thread(&ImageDecodeQueue::WorkerLoop, this));
+	}
+
+	// Waits for the next finished image; false once every image was returned
+	bool Next(DecodedImage* image)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_Returned == m_Jobs.size())
+		{
+			lock.unlock();
+			Join();
+			m_Jobs.clear();
+			return false;
+		}
+		while (m_Done.empty())
+			m_Finished.wait(lock);
+		*image = DecodedImage();
+		std::swap(*image, m_Jobs[m_Done.front()]);
+		m_Done.pop_front();
+		m_Returned++;
+		return true;
+	}
+
+	void Recycle(DecodedImage* image)
+	{
+		m_Pool.Release(&image->rgba);
+	}
+
+	ImagePixelPool& Pool() { return m_Pool; }
+
+private:
+	void Join()
+	{
+		for (size_t i = 0; i < m_Workers.size(); ++i)
+			m_Workers[i].join();
+		m_Workers.clear();
+	}
+
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			size_t index;
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (m_NextJob == m_Jobs.size())
+					return;
+				index = m_NextJob++;
+			}
+
+			// Only this worker touches the job until it is queued as done
+			Decode(&m_Jobs[index]);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Done.push_back(index);
+			}
+			m_Finished.notify_one();
+		}
+	}
+
+	void Decode(DecodedImage* image)
+	{
+		std::vector<unsigned char> data;
+		FILE* file = fopen(image->fileName.c_str(), "rb");
+		if (file == NULL)
+			return;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		if (size > 0)
+		{
+			data.resize(size);
+			if (fread(&data[0], size, 1, file) != 1)
+				data.clear();
+		}
+		fclose(file);
+
+		unsigned int width, height;
+		if (data.empty() || !ImageDimensions(&data[0], data.size(), &width, &height))
+			return;
+
+		// The decoders resize rgba to exactly this, which keeps the pooled allocation
+		std::vector<unsigned char> pixels;
+		m_Pool.Acquire((size_t)width * height * 4, &pixels);
+		if (data[0] == 0x89)
+		{
+			PNGImage png;
+			png.rgba.swap(pixels);
+			image->ok = DecodePNG(&data[0], data.size(), &png);
+			image->width = png.width;
+			image->height = png.height;
+			image->rgba.swap(png.rgba);
+		}
+		else
+		{
+			JPEGImage jpeg;
+			jpeg.rgba.swap(pixels);
+			image->ok = DecodeJPEG(&data[0], data.size(), &jpeg);
+			image->width = jpeg.width;
+			image->height = jpeg.height;
+			image->rgba.swap(jpeg.rgba);
+		}
+		if (!image->ok)
+			m_Pool.Release(&image->rgba);
+	}
+
+	std::vector<DecodedImage> m_Jobs;		// sized before Start, so workers can hold pointers
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_Finished;
+	std::deque<size_t> m_Done;				// finished jobs not yet returned by Next
+	size_t m_NextJob;
+	size_t m_Returned;
+	ImagePixelPool m_Pool;
+};
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+
+//--------------------------------------------------------------------------------------
+// Upload a decoded image as an R8G8B8A8_UNORM texture with a full mip chain
+//--------------------------------------------------------------------------------------
+inline HRESULT CreateTextureFromImage(ID3D11Device* device, ID3D11DeviceContext* context, const DecodedImage& image,
+	ID3D11ShaderResourceView** textureView)
+{
+	*textureView = NULL;
+	if (!image.ok)
+		return E_FAIL;
+
+	// GenerateMips needs a render target bindable default usage texture
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = image.width;
+	desc.Height = image.height;
+	desc.MipLevels = 0;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	ID3D11Texture2D* texture = NULL;
+	HRESULT hr = device->CreateTexture2D(&desc, NULL, &texture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = device->CreateShaderResourceView(texture, NULL, textureView);
+	if (SUCCEEDED(hr))
+	{
+		context->UpdateSubresource(texture, 0, NULL, &image.rgba[0], image.width * 4, 0);
+		context->GenerateMips(*textureView);
+	}
+	texture->Release();
+	return hr;
+}
+
+#endif
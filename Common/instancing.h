@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// File: instancing.h
+//
+// Per-instance vertex streams, so many copies of one mesh go out in one
+// DrawIndexedInstanced call instead of a constant buffer update and a draw each.
+//
+// An instance is one of two formats:
+//   INSTANCE_FORMAT_MATRIX	 the first three columns of the world matrix, 48 bytes. Any
+//							 affine transform; the shader does three dot products.
+//   INSTANCE_FORMAT_COMPACT position and uniform scale, then a rotation quaternion, 32
+//							 bytes. The shader rotates with two cross products.
+// AppendInstanceLayout adds the matching elements to a mesh's input layout: vertex
+// buffer slot 1, per-instance data, semantic INSTANCE0..2. The shaders read them as
+//   MATRIX:  float4 column0 : INSTANCE0, float4 column1 : INSTANCE1, float4 column2 : INSTANCE2
+//   COMPACT: float4 positionScale : INSTANCE0, float4 rotation : INSTANCE1
+//
+// InstanceBuffer (Windows only) is the dynamic vertex buffer behind slot 1. Map() hands
+// out WRITE_DISCARD memory for count instances to pack into directly, growing the buffer
+// in powers of two when count is larger than it.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include "xnamath_portable.h"
+
+enum InstanceFormat
+{
+	INSTANCE_FORMAT_MATRIX,
+	INSTANCE_FORMAT_COMPACT,
+};
+
+struct InstanceMatrix
+{
+	XMFLOAT4 column[3];
+};
+
+struct InstanceCompact
+{
+	XMFLOAT4 positionScale;
+	XMFLOAT4 rotation;		// unit quaternion, xyz axis * sin(angle / 2), w cos(angle / 2)
+};
+
+inline unsigned int InstanceStride(InstanceFormat format)
+{
+	return format == INSTANCE_FORMAT_MATRIX ? sizeof(InstanceMatrix) : sizeof(InstanceCompact);
+}
+
+// world's last column must be (0, 0, 0, 1), as it is for any affine transform
+inline void PackInstanceMatrix(CXMMATRIX world, InstanceMatrix* instance)
+{
+	XMMATRIX columns = XMMatrixTranspose(world);
+	XMStoreFloat4(&instance->column[0], columns.r[0]);
+	XMStoreFloat4(&instance->column[1], columns.r[1]);
+	XMStoreFloat4(&instance->column[2], columns.r[2]);
+}
+
+// Scale, then a rotation by angle about the unit axis, then the translation: the same
+// transform as XMMatrixScaling * XMMatrixRotationAxis * XMMatrixTranslation
+inline void PackInstanceCompact(float x, float y, float z, float scale, const XMFLOAT3& axis, float angle, InstanceCompact* instance)
+{
+	float s = sinf(angle * 0.5f), c = cosf(angle * 0.5f);
+	instance->positionScale = XMFLOAT4(x, y, z, scale);
+	instance->rotation = XMFLOAT4(axis.x * s, axis.y * s, axis.z * s, c);
+}
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+
+#define INSTANCE_SLOT	1
+
+// Copies the mesh's elements to layout and appends the instance elements; layout needs
+// room for meshElementCount + 3. Returns the element count to pass to CreateInputLayout.
+inline UINT AppendInstanceLayout(InstanceFormat format, const D3D11_INPUT_ELEMENT_DESC* meshElements, UINT meshElementCount,
+	D3D11_INPUT_ELEMENT_DESC* layout)
+{
+	UINT count = 0;
+	for (; count < meshElementCount; ++count)
+		layout[count] = meshElements[count];
+	UINT columns = format == INSTANCE_FORMAT_MATRIX ? 3 : 2;
+	for (UINT i = 0; i < columns; ++i, ++count)
+	{
+		D3D11_INPUT_ELEMENT_DESC element = { "INSTANCE", i, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCE_SLOT, i * 16,
+			D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+		layout[count] = element;
+	}
+	return count;
+}
+
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() : m_Device(NULL), m_Buffer(NULL), m_Format(INSTANCE_FORMAT_MATRIX), m_Capacity(0), m_Count(0) {}
+
+	~InstanceBuffer()
+	{
+		Release();
+	}
+
+	HRESULT Init(ID3D11Device* device, InstanceFormat format, UINT capacity)
+	{
+		Release();
+		m_Device = device;
+		m_Format = format;
+		return Reserve(capacity);
+	}
+
+	void Release()
+	{
+		if (m_Buffer)
+			m_Buffer->Release();
+		m_Buffer = NULL;
+		m_Capacity = 0;
+		m_Count = 0;
+	}
+
+	// Room for count instances of this frame, or NULL; Unmap before drawing
+	void* Map(ID3D11DeviceContext* context, UINT count)
+	{
+		if (count > m_Capacity)
+		{
+			UINT capacity = m_Capacity ? m_Capacity : 1;
+			while (capacity < count)
+				capacity *= 2;
+			if (FAILED(Reserve(capacity)))
+				return NULL;
+		}
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(context->Map(m_Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return NULL;
+		m_Count = count;
+		return mapped.pData;
+	}
+
+	void Unmap(ID3D11DeviceContext* context)
+	{
+		context->Unmap(m_Buffer, 0);
+	}
+
+	// Map, copy and Unmap in one, for instances packed elsewhere
+	HRESULT Upload(ID3D11DeviceContext* context, const void* instances, UINT count)
+	{
+		void* data = Map(context, count);
+		if (!data)
+			return E_FAIL;
+		memcpy(data, instances, (size_t)count * InstanceStride(m_Format));
+		Unmap(context);
+		return S_OK;
+	}
+
+	// The mesh's vertex and index buffers stay bound in slot 0 and the index slot
+	void DrawIndexed(ID3D11DeviceContext* context, UINT indexCount, UINT startIndex, INT baseVertex)
+	{
+		if (m_Count == 0)
+			return;
+		UINT stride = InstanceStride(m_Format);
+		UINT offset = 0;
+		context->IASetVertexBuffers(INSTANCE_SLOT, 1, &m_Buffer, &stride, &offset);
+		context->DrawIndexedInstanced(indexCount, m_Count, startIndex, baseVertex, 0);
+	}
+
+	InstanceFormat Format() const { return m_Format; }
+	UINT Count() const { return m_Count; }
+	UINT Capacity() const { return m_Capacity; }
+
+private:
+	HRESULT Reserve(UINT capacity)
+	{
+		if (m_Buffer)
+			m_Buffer->Release();
+		m_Buffer = NULL;
+		m_Capacity = 0;
+
+		D3D11_BUFFER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = capacity * InstanceStride(m_Format);
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		HRESULT hr = m_Device->CreateBuffer(&desc, NULL, &m_Buffer);
+		if (SUCCEEDED(hr))
+			m_Capacity = capacity;
+		return hr;
+	}
+
+	ID3D11Device* m_Device;
+	ID3D11Buffer* m_Buffer;
+	InstanceFormat m_Format;
+	UINT m_Capacity;
+	UINT m_Count;
+};
+
+#endif
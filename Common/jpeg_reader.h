@@ -0,0 +1,575 @@
+//--------------------------------------------------------------------------------------
+// File: jpeg_reader.h
+//
+// Minimal baseline JPEG decoder for CPU-side tools, the counterpart of png_reader.h.
+//
+// DecodeJPEG handles sequential Huffman coded files with 8 bit samples (SOF0/SOF1):
+// grayscale or YCbCr, interleaved or one scan per component, any sampling factors up
+// to 4 and restart intervals. It returns R8G8B8A8 rows with opaque alpha, like D3DX.
+// Progressive, arithmetic coded, 12 bit and CMYK files are rejected. Chroma is
+// upsampled by replication and the IDCT is a separable float transform, so results
+// can differ from libjpeg's by a step or two.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+struct JPEGImage
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int components;	// as stored in the file, 1 or 3
+	std::vector<unsigned char> rgba;	// width * height * 4 bytes, rows top to bottom
+};
+
+// Natural order index of each zigzag position
+static const unsigned char JPEGZigzag[64] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+#define JPEG_FAST_BITS	9
+
+// Canonical Huffman table (ITU T.81 annex C) with a lookup for codes up to 9 bits
+struct JPEGHuffman
+{
+	unsigned char symbols[256];
+	int minCode[17];
+	int maxCode[18];
+	int valPtr[17];
+	unsigned char fastLength[1 << JPEG_FAST_BITS];	// 0 when the code is longer
+	unsigned char fastSymbol[1 << JPEG_FAST_BITS];
+	bool defined;
+
+	bool Build(const unsigned char counts[16], const unsigned char* values, int valueCount)
+	{
+		memset(fastLength, 0, sizeof(fastLength));
+		int code = 0, k = 0;
+		for (int length = 1; length <= 16; ++length)
+		{
+			int count = counts[length - 1];
+			valPtr[length] = k;
+			minCode[length] = code;
+			for (int i = 0; i < count; ++i, ++code, ++k)
+			{
+				if (k >= valueCount || k >= 256 || code >= (1 << length))
+					return false;
+				symbols[k] = values[k];
+				if (length <= JPEG_FAST_BITS)
+				{
+					int first = code << (JPEG_FAST_BITS - length), last = (code + 1) << (JPEG_FAST_BITS - length);
+					for (int j = first; j < last; ++j)
+					{
+						fastLength[j] = (unsigned char)length;
+						fastSymbol[j] = values[k];
+					}
+				}
+			}
+			maxCode[length] = count ? code - 1 : -1;
+			code <<= 1;
+		}
+		maxCode[17] = 0x7fffffff;
+		defined = true;
+		return true;
+	}
+};
+
+//--------------------------------------------------------------------------------------
+// Decoder
+//--------------------------------------------------------------------------------------
+class JPEGDecoder
+{
+public:
+	JPEGDecoder(const unsigned char* data, size_t size)
+		: m_Data(data), m_Size(size), m_Pos(0), m_Bits(0), m_BitCount(0), m_Marker(false),
+		m_Width(0), m_Height(0), m_ComponentCount(0), m_RestartInterval(0), m_FrameSeen(false)
+	{
+		memset(m_Quant, 0, sizeof(m_Quant));
+		for (int i = 0; i < 4; ++i)
+			m_DC[i].defined = m_AC[i].defined = false;
+
+		// cos((2x + 1) u pi / 16) with the C(u) scale of the IDCT folded in
+		for (int x = 0; x < 8; ++x)
+			for (int u = 0; u < 8; ++u)
+				m_Cos[x][u] = (float)(cos((2 * x + 1) * u * 3.14159265358979323846 / 16.0) * (u == 0 ? sqrt(0.5) : 1.0) * 0.5);
+	}
+
+	bool Decode(JPEGImage* image)
+	{
+		if (m_Size < 4 || m_Data[0] != 0xff || m_Data[1] != 0xd8)
+			return false;
+		m_Pos = 2;
+
+		for (;;)
+		{
+			// Markers may be padded with any number of 0xff
+			if (m_Pos >= m_Size || m_Data[m_Pos] != 0xff)
+				return false;
+			while (m_Pos < m_Size && m_Data[m_Pos] == 0xff)
+				m_Pos++;
+			if (m_Pos >= m_Size)
+				return false;
+			unsigned char marker = m_Data[m_Pos++];
+			if (marker == 0xd9)
+				break;
+			if (marker >= 0xd0 && marker <= 0xd7)
+				continue;
+			if (m_Pos + 2 > m_Size)
+				return false;
+			size_t length = (m_Data[m_Pos] << 8) | m_Data[m_Pos + 1];
+			if (length < 2 || m_Pos + length > m_Size)
+				return false;
+			const unsigned char* segment = m_Data + m_Pos + 2;
+			size_t segmentSize = length - 2;
+			m_Pos += length;
+
+			bool ok = true;
+			switch (marker)
+			{
+			case 0xdb: ok = ReadQuantTables(segment, segmentSize); break;
+			case 0xc4: ok = ReadHuffmanTables(segment, segmentSize); break;
+			case 0xc0:
+			case 0xc1: ok = ReadFrame(segment, segmentSize); break;
+			case 0xdd: ok = segmentSize >= 2; m_RestartInterval = ok ? (segment[0] << 8) | segment[1] : 0; break;
+			case 0xda: ok = ReadScan(segment, segmentSize); break;
+			default:
+				// Progressive, lossless, hierarchical and arithmetic coded frames
+				if ((marker >= 0xc2 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc))
+					ok = false;
+				break;
+			}
+			if (!ok)
+				return false;
+		}
+		if (!m_FrameSeen)
+			return false;
+
+		ConvertToRGBA(image);
+		return true;
+	}
+
+private:
+	struct Component
+	{
+		int id;
+		int h;
+		int v;
+		int quant;
+		int dcTable;
+		int acTable;
+		int blocksX;			// blocks per row of the component plane, MCU padded
+		int blocksY;
+		int dcPredictor;
+		std::vector<unsigned char> plane;
+	};
+
+	bool ReadQuantTables(const unsigned char* p, size_t size)
+	{
+		while (size > 0)
+		{
+			int precision = p[0] >> 4, id = p[0] & 15;
+			size_t bytes = 1 + 64 * (precision ? 2 : 1);
+			if (id > 3 || size < bytes)
+				return false;
+			for (int k = 0; k < 64; ++k)
+				m_Quant[id][k] = precision ? (p[1 + k * 2] << 8) | p[2 + k * 2] : p[1 + k];
+			p += bytes;
+			size -= bytes;
+		}
+		return true;
+	}
+
+	bool ReadHuffmanTables(const unsigned char* p, size_t size)
+	{
+		while (size > 0)
+		{
+			if (size < 17)
+				return false;
+			int tableClass = p[0] >> 4, id = p[0] & 15;
+			int count = 0;
+			for (int i = 0; i < 16; ++i)
+				count += p[1 + i];
+			if (tableClass > 1 || id > 3 || size < 17 + (size_t)count)
+				return false;
+			JPEGHuffman& table = tableClass ? m_AC[id] : m_DC[id];
+			if (!table.Build(p + 1, p + 17, count))
+				return false;
+			p += 17 + count;
+			size -= 17 + count;
+		}
+		return true;
+	}
+
+	bool ReadFrame(const unsigned char* p, size_t size)
+	{
+		if (m_FrameSeen || size < 6 || p[0] != 8)
+			return false;
+		m_Height = (p[1] << 8) | p[2];
+		m_Width = (p[3] << 8) | p[4];
+		m_ComponentCount = p[5];
+		if (m_Width == 0 || m_Height == 0 || (m_ComponentCount != 1 && m_ComponentCount != 3) || size < 6 + 3 * (size_t)m_ComponentCount)
+			return false;
+
+		m_MaxH = m_MaxV = 1;
+		for (int i = 0; i < m_ComponentCount; ++i)
+		{
+			Component& c = m_Components[i];
+			c.id = p[6 + i * 3];
+			c.h = p[7 + i * 3] >> 4;
+			c.v = p[7 + i * 3] & 15;
+			c.quant = p[8 + i * 3];
+			if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.quant > 3)
+				return false;
+			m_MaxH = std::max(m_MaxH, c.h);
+			m_MaxV = std::max(m_MaxV, c.v);
+		}
+		m_McusX = (m_Width + 8 * m_MaxH - 1) / (8 * m_MaxH);
+		m_McusY = (m_Height + 8 * m_MaxV - 1) / (8 * m_MaxV);
+		for (int i = 0; i < m_ComponentCount; ++i)
+		{
+			Component& c = m_Components[i];
+			c.blocksX = m_McusX * c.h;
+			c.blocksY = m_McusY * c.v;
+			c.plane.assign((size_t)c.blocksX * c.blocksY * 64, 0);
+		}
+		m_FrameSeen = true;
+		return true;
+	}
+
+	bool ReadScan(const unsigned char* p, size_t size)
+	{
+		if (!m_FrameSeen || size < 1)
+			return false;
+		int count = p[0];
+		if (count < 1 || count > m_ComponentCount || size < 4 + 2 * (size_t)count)
+			return false;
+		Component* scan[4];
+		for (int i = 0; i < count; ++i)
+		{
+			scan[i] = NULL;
+			for (int j = 0; j < m_ComponentCount; ++j)
+				if (m_Components[j].id == p[1 + i * 2])
+					scan[i] = &m_Components[j];
+			if (scan[i] == NULL)
+				return false;
+			scan[i]->dcTable = p[2 + i * 2] >> 4;
+			scan[i]->acTable = p[2 + i * 2] & 15;
+			if (scan[i]->dcTable > 3 || scan[i]->acTable > 3 || !m_DC[scan[i]->dcTable].defined || !m_AC[scan[i]->acTable].defined)
+				return false;
+			scan[i]->dcPredictor = 0;
+		}
+
+		// Entropy coded data follows the header up to the next marker
+		ResetBits();
+		short coefficients[64];
+		if (count == 1)
+		{
+			// A single component scan codes its blocks in raster order, unpadded
+			Component& c = *scan[0];
+			int blocksX = (m_Width * c.h / m_MaxH + 7) / 8, blocksY = (m_Height * c.v / m_MaxV + 7) / 8;
+			int todo = m_RestartInterval;
+			for (int by = 0; by < blocksY; ++by)
+			{
+				for (int bx = 0; bx < blocksX; ++bx)
+				{
+					if (!DecodeBlock(c, coefficients))
+						return false;
+					StoreBlock(c, bx, by, coefficients);
+					if (m_RestartInterval && --todo == 0 && !(by == blocksY - 1 && bx == blocksX - 1))
+					{
+						if (!Restart(scan, count))
+							return false;
+						todo = m_RestartInterval;
+					}
+				}
+			}
+		}
+		else
+		{
+			int todo = m_RestartInterval;
+			for (int my = 0; my < m_McusY; ++my)
+			{
+				for (int mx = 0; mx < m_McusX; ++mx)
+				{
+					for (int i = 0; i < count; ++i)
+					{
+						Component& c = *scan[i];
+						for (int y = 0; y < c.v; ++y)
+						{
+							for (int x = 0; x < c.h; ++x)
+							{
+								if (!DecodeBlock(c, coefficients))
+									return false;
+								StoreBlock(c, mx * c.h + x, my * c.v + y, coefficients);
+							}
+						}
+					}
+					if (m_RestartInterval && --todo == 0 && !(my == m_McusY - 1 && mx == m_McusX - 1))
+					{
+						if (!Restart(scan, count))
+							return false;
+						todo = m_RestartInterval;
+					}
+				}
+			}
+		}
+
+		// Skip to the marker that ends the scan
+		while (m_Pos + 1 < m_Size && !(m_Data[m_Pos] == 0xff && m_Data[m_Pos + 1] != 0 && !(m_Data[m_Pos + 1] >= 0xd0 && m_Data[m_Pos + 1] <= 0xd7)))
+			m_Pos++;
+		return m_Pos + 1 < m_Size;
+	}
+
+	//----------------------------------------------------------------------------------
+	// Entropy decoding
+	//----------------------------------------------------------------------------------
+	void ResetBits()
+	{
+		m_Bits = 0;
+		m_BitCount = 0;
+		m_Marker = false;
+	}
+
+	// Keeps at least 25 bits left aligned in m_Bits; past a marker it shifts in zeros
+	void FillBits()
+	{
+		while (m_BitCount <= 24)
+		{
+			unsigned int byte = 0;
+			if (!m_Marker && m_Pos < m_Size)
+			{
+				byte = m_Data[m_Pos];
+				if (byte == 0xff)
+				{
+					unsigned int next = m_Pos + 1 < m_Size ? m_Data[m_Pos + 1] : 0xd9;
+					if (next == 0)
+						m_Pos += 2;
+					else
+					{
+						m_Marker = true;
+						byte = 0;
+					}
+				}
+				else
+					m_Pos++;
+			}
+			m_Bits |= byte << (24 - m_BitCount);
+			m_BitCount += 8;
+		}
+	}
+
+	int DecodeSymbol(const JPEGHuffman& table)
+	{
+		FillBits();
+		unsigned int peek = m_Bits >> (32 - JPEG_FAST_BITS);
+		int length = table.fastLength[peek];
+		if (length)
+		{
+			m_Bits <<= length;
+			m_BitCount -= length;
+			return table.fastSymbol[peek];
+		}
+		for (length = JPEG_FAST_BITS + 1; length <= 16; ++length)
+		{
+			int code = (int)(m_Bits >> (32 - length));
+			if (code <= table.maxCode[length])
+			{
+				m_Bits <<= length;
+				m_BitCount -= length;
+				return table.symbols[table.valPtr[length] + code - table.minCode[length]];
+			}
+		}
+		return -1;
+	}
+
+	// RECEIVE and EXTEND of T.81 F.2.2
+	int ReceiveExtend(int bits)
+	{
+		if (bits == 0)
+			return 0;
+		FillBits();
+		int value = (int)(m_Bits >> (32 - bits));
+		m_Bits <<= bits;
+		m_BitCount -= bits;
+		return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+	}
+
+	bool DecodeBlock(Component& c, short coefficients[64])
+	{
+		memset(coefficients, 0, 64 * sizeof(short));
+		const unsigned short* quant = m_Quant[c.quant];
+
+		int category = DecodeSymbol(m_DC[c.dcTable]);
+		if (category < 0 || category > 11)
+			return false;
+		c.dcPredictor += ReceiveExtend(category);
+		coefficients[0] = (short)(c.dcPredictor * quant[0]);
+
+		for (int k = 1; k < 64;)
+		{
+			int rs = DecodeSymbol(m_AC[c.acTable]);
+			if (rs < 0)
+				return false;
+			int run = rs >> 4, bits = rs & 15;
+			if (bits == 0)
+			{
+				if (run != 15)
+					break;
+				k += 16;
+				continue;
+			}
+			k += run;
+			if (k > 63)
+				return false;
+			coefficients[JPEGZigzag[k]] = (short)(ReceiveExtend(bits) * quant[k]);
+			k++;
+		}
+		return true;
+	}
+
+	bool Restart(Component** scan, int count)
+	{
+		ResetBits();
+		if (m_Pos + 1 >= m_Size || m_Data[m_Pos] != 0xff || m_Data[m_Pos + 1] < 0xd0 || m_Data[m_Pos + 1] > 0xd7)
+			return false;
+		m_Pos += 2;
+		for (int i = 0; i < count; ++i)
+			scan[i]->dcPredictor = 0;
+		return true;
+	}
+
+	// Separable float IDCT, level shift and clamp into the component plane
+	void StoreBlock(Component& c, int bx, int by, const short coefficients[64])
+	{
+		float rows[64];
+		for (int y = 0; y < 8; ++y)
+		{
+			const short* in = coefficients + y * 8;
+			for (int x = 0; x < 8; ++x)
+			{
+				float sum = 0.0f;
+				for (int u = 0; u < 8; ++u)
+					sum += m_Cos[x][u] * in[u];
+				rows[y * 8 + x] = sum;
+			}
+		}
+		unsigned char* out = &c.plane[((size_t)by * 8 * c.blocksX + bx) * 8];
+		size_t pitch = (size_t)c.blocksX * 8;
+		for (int x = 0; x < 8; ++x)
+		{
+			for (int y = 0; y < 8; ++y)
+			{
+				float sum = 128.0f;
+				for (int v = 0; v < 8; ++v)
+					sum += m_Cos[y][v] * rows[v * 8 + x];
+				int value = (int)floorf(sum + 0.5f);
+				out[y * pitch + x] = (unsigned char)std::min(std::max(value, 0), 255);
+			}
+		}
+	}
+
+	// JFIF YCbCr to RGB, chroma replicated to full resolution
+	void ConvertToRGBA(JPEGImage* image)
+	{
+		image->width = m_Width;
+		image->height = m_Height;
+		image->components = m_ComponentCount;
+		image->rgba.resize((size_t)m_Width * m_Height * 4);
+		for (int y = 0; y < m_Height; ++y)
+		{
+			unsigned char* out = &image->rgba[(size_t)y * m_Width * 4];
+			for (int x = 0; x < m_Width; ++x, out += 4)
+			{
+				float sample[3];
+				for (int i = 0; i < m_ComponentCount; ++i)
+				{
+					const Component& c = m_Components[i];
+					int sx = x * c.h / m_MaxH, sy = y * c.v / m_MaxV;
+					sample[i] = c.plane[(size_t)sy * c.blocksX * 8 + sx];
+				}
+				if (m_ComponentCount == 1)
+					out[0] = out[1] = out[2] = (unsigned char)sample[0];
+				else
+				{
+					float cb = sample[1] - 128.0f, cr = sample[2] - 128.0f;
+					float rgb[3] = { sample[0] + 1.402f * cr, sample[0] - 0.344136f * cb - 0.714136f * cr, sample[0] + 1.772f * cb };
+					for (int k = 0; k < 3; ++k)
+						out[k] = (unsigned char)std::min(std::max((int)floorf(rgb[k] + 0.5f), 0), 255);
+				}
+				out[3] = 255;
+			}
+		}
+	}
+
+	const unsigned char* m_Data;
+	size_t m_Size;
+	size_t m_Pos;
+	unsigned int m_Bits;
+	int m_BitCount;
+	bool m_Marker;
+
+	int m_Width;
+	int m_Height;
+	int m_ComponentCount;
+	int m_MaxH;
+	int m_MaxV;
+	int m_McusX;
+	int m_McusY;
+	int m_RestartInterval;
+	bool m_FrameSeen;
+	Component m_Components[3];
+	unsigned short m_Quant[4][64];		// zigzag order
+	JPEGHuffman m_DC[4];
+	JPEGHuffman m_AC[4];
+	float m_Cos[8][8];
+};
+
+// Width and height from the first SOFn marker, without decoding anything
+inline bool ReadJPEGSize(const unsigned char* data, size_t size, unsigned int* width, unsigned int* height)
+{
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return false;
+	size_t pos = 2;
+	while (pos + 4 <= size)
+	{
+		if (data[pos] != 0xFF)
+			return false;
+		unsigned char marker = data[pos + 1];
+		if (marker == 0xFF)
+		{
+			pos++;		// fill byte
+			continue;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+		{
+			pos += 2;	// no length
+			continue;
+		}
+		if (marker == 0xD9 || marker == 0xDA)
+			return false;	// EOI or SOS before any frame header
+		size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+		{
+			if (length < 7 || pos + 9 > size)
+				return false;
+			*height = ((unsigned int)data[pos + 5] << 8) | data[pos + 6];
+			*width = ((unsigned int)data[pos + 7] << 8) | data[pos + 8];
+			return true;
+		}
+		pos += 2 + length;
+	}
+	return false;
+}
+
+inline bool DecodeJPEG(const unsigned char* data, size_t size, JPEGImage* image)
+{
+	JPEGDecoder decoder(data, size);
+	return decoder.Decode(image);
+}
@@ -0,0 +1,243 @@
+//--------------------------------------------------------------------------------------
+// File: mesh_cache.h
+//
+// Binary cache for post-processed models, shared by the Tutorial05 samples.
+//
+// A model is packed into a MeshPool: every mesh back to back in one vertex and one 16 bit
+// index array, cut into Submesh draw ranges. The pool is written next to the source file as
+//   MeshCacheHeader | Submesh[submeshCount] | Vertex[vertexCount] | WORD[indexCount]
+// and keyed by a hash of the source file plus the importer's post-process flags. On a hit
+// the file is mapped copy-on-write and the pool pointers point straight into the view.
+//
+// The vertex layout is the sample's, so the pool and the cache functions are templates;
+// the header only records its stride. Common/mesh_import.h fills a pool with assimp. This
+// part needs no assimp or Direct3D, so Headless tools can read and write caches too.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "xnamath_portable.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MESH_CACHE_MAGIC	0x4853454D	// "MESH"
+#define MESH_CACHE_VERSION	4
+
+struct MappedFile
+{
+#ifdef _WIN32
+	MappedFile() : file(INVALID_HANDLE_VALUE), mapping(NULL), data(NULL), size(0) {}
+
+	HANDLE file;
+	HANDLE mapping;
+#else
+	MappedFile() : data(NULL), size(0) {}
+#endif
+	unsigned char* data;
+	unsigned long long size;
+};
+
+// One draw range inside the shared vertex/index buffers, indices are relative to baseVertex
+struct Submesh
+{
+	unsigned int baseVertex;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int materialIndex;
+	XMFLOAT3 boundsMin;
+	XMFLOAT3 boundsMax;
+};
+
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long sourceHash;
+	unsigned int postProcessFlags;
+	unsigned int vertexStride;
+	unsigned int submeshCount;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int pad;
+};
+
+// Every mesh of a model packed back to back. vertices/indices point either into the storage
+// vectors (fresh import) or into the mapped cache file, so they stay valid until ReleaseMeshPool.
+template <typename Vertex>
+struct MeshPool
+{
+	MeshPool() : vertices(NULL), indices(NULL), verticesNum(0), indicesNum(0) {}
+
+	Vertex* vertices;
+	unsigned short* indices;
+	int verticesNum;
+	int indicesNum;
+	std::vector<Submesh> submeshes;
+
+	std::vector<Vertex> vertexStorage;
+	std::vector<unsigned short> indexStorage;
+	MappedFile cacheFile;
+};
+
+inline void UnmapFile(MappedFile* mapped)
+{
+#ifdef _WIN32
+	if (mapped->data)
+		UnmapViewOfFile(mapped->data);
+	if (mapped->mapping)
+		CloseHandle(mapped->mapping);
+	if (mapped->file != INVALID_HANDLE_VALUE)
+		CloseHandle(mapped->file);
+#else
+	if (mapped->data)
+		munmap(mapped->data, (size_t)mapped->size);
+#endif
+	*mapped = MappedFile();
+}
+
+inline bool MapFile(const std::string& path, MappedFile* mapped)
+{
+#ifdef _WIN32
+	mapped->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mapped->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(mapped->file);
+		mapped->file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	mapped->size = size.QuadPart;
+
+	// Copy-on-write, so callers may patch the data in place without touching the file
+	mapped->mapping = CreateFileMapping(mapped->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapped->mapping != NULL)
+		mapped->data = (unsigned char*)MapViewOfFile(mapped->mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (mapped->data == NULL)
+	{
+		UnmapFile(mapped);
+		return false;
+	}
+	return true;
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+
+	// MAP_PRIVATE is copy-on-write like FILE_MAP_COPY; the view outlives the descriptor
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return false;
+	mapped->data = (unsigned char*)data;
+	mapped->size = (unsigned long long)info.st_size;
+	return true;
+#endif
+}
+
+// 64-bit FNV-1a
+inline unsigned long long HashBytes(const unsigned char* data, unsigned long long size, unsigned long long hash = 14695981039346656037ULL)
+{
+	for (unsigned long long i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+template <typename Vertex>
+void ReleaseMeshPool(MeshPool<Vertex>* pool)
+{
+	UnmapFile(&pool->cacheFile);
+	pool->vertexStorage.clear();
+	pool->indexStorage.clear();
+	pool->submeshes.clear();
+	pool->vertices = NULL;
+	pool->indices = NULL;
+	pool->verticesNum = 0;
+	pool->indicesNum = 0;
+}
+
+template <typename Vertex>
+bool LoadMeshCache(const std::string& cacheFile, unsigned long long sourceHash, unsigned int postProcessFlags, MeshPool<Vertex>* pool)
+{
+	if (!MapFile(cacheFile, &pool->cacheFile))
+		return false;
+
+	const unsigned char* data = pool->cacheFile.data;
+	const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+	if (pool->cacheFile.size < sizeof(MeshCacheHeader) ||
+		header->magic != MESH_CACHE_MAGIC ||
+		header->version != MESH_CACHE_VERSION ||
+		header->sourceHash != sourceHash ||
+		header->postProcessFlags != postProcessFlags ||
+		header->vertexStride != sizeof(Vertex) ||
+		pool->cacheFile.size != sizeof(MeshCacheHeader) +
+			(unsigned long long)header->submeshCount * sizeof(Submesh) +
+			(unsigned long long)header->vertexCount * sizeof(Vertex) +
+			(unsigned long long)header->indexCount * sizeof(unsigned short))
+	{
+		UnmapFile(&pool->cacheFile);
+		return false;
+	}
+
+	const Submesh* submeshes = (const Submesh*)(data + sizeof(MeshCacheHeader));
+	pool->submeshes.assign(submeshes, submeshes + header->submeshCount);
+	pool->vertices = (Vertex*)(submeshes + header->submeshCount);
+	pool->indices = (unsigned short*)(pool->vertices + header->vertexCount);
+	pool->verticesNum = header->vertexCount;
+	pool->indicesNum = header->indexCount;
+	return true;
+}
+
+template <typename Vertex>
+bool SaveMeshCache(const std::string& cacheFile, unsigned long long sourceHash, unsigned int postProcessFlags, const MeshPool<Vertex>& pool)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.postProcessFlags = postProcessFlags;
+	header.vertexStride = sizeof(Vertex);
+	header.submeshCount = (unsigned int)pool.submeshes.size();
+	header.vertexCount = pool.verticesNum;
+	header.indexCount = pool.indicesNum;
+
+	FILE* file = fopen(cacheFile.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&pool.submeshes[0], sizeof(Submesh), header.submeshCount, file) == header.submeshCount &&
+		fwrite(pool.vertices, sizeof(Vertex), header.vertexCount, file) == header.vertexCount &&
+		fwrite(pool.indices, sizeof(unsigned short), header.indexCount, file) == header.indexCount;
+	ok = fclose(file) == 0 && ok;
+
+	// Never leave a truncated cache behind, the size check would reject it anyway
+	if (!ok)
+		remove(cacheFile.c_str());
+	return ok;
+}
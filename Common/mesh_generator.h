@@ -0,0 +1,742 @@
+//--------------------------------------------------------------------------------------
+// File: mesh_generator.h
+//
+// Procedural meshes with position, normal, UV and tangent per vertex: UV sphere,
+// icosphere, cube sphere, box, plane grid, cylinder and torus.
+//
+// Conventions are the samples' (Direct3D defaults): left-handed, triangles clockwise
+// seen from the outside, v growing downwards in the texture. Tangents point along +u,
+// and w is the sign of the bitangent, so bitangent = cross(normal, tangent.xyz) * w runs
+// along +v. Spheres use the equirectangular u of Common/env_map.h, with +Z at u = 0.5.
+//
+// Sphere, cylinder and torus are surfaces of revolution about +Y. Their sines and cosines
+// come from a MeshRingTable, computed once per mesh in double precision instead of once
+// per vertex, and every ring is evaluated four vertices at a time with SSE2 where
+// available (define MESH_GENERATOR_SCALAR to compare). The planar and cube faces
+// evaluate their rows the same way. Grid indices are emitted in vertical bands
+// MESH_CACHE_BAND quads wide, so the vertices shared with the previous row are still in a
+// 16 entry post-transform cache. That gives an ACMR close to 0.6 triangles per vertex
+// miss, against about 1.0 for row order.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)) && !defined(MESH_GENERATOR_SCALAR)
+#include <emmintrin.h>
+#define MESH_GENERATOR_SSE2
+#endif
+
+#define MESH_PI				3.14159265358979323846
+#define MESH_CACHE_BAND		7		// quads per band; (band + 1) * 2 vertices fit a 16 entry FIFO
+
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+	float tangent[4];		// xyz along +u, w the sign of the bitangent
+};
+
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+//--------------------------------------------------------------------------------------
+// Shared pieces
+//--------------------------------------------------------------------------------------
+// cos, sin and u of count + 1 evenly spaced angles from start over span. The arrays are
+// padded to a multiple of four with the last entry, so SIMD loads never run past them.
+struct MeshRingTable
+{
+	std::vector<float> cosines;
+	std::vector<float> sines;
+	std::vector<float> u;
+
+	void Build(int count, double start, double span)
+	{
+		size_t padded = (count + 4) & ~3;
+		cosines.resize(padded);
+		sines.resize(padded);
+		u.resize(padded);
+		for (size_t i = 0; i < padded; ++i)
+		{
+			int j = std::min((int)i, count);
+			double angle = start + span * j / count;
+			cosines[i] = (float)cos(angle);
+			sines[i] = (float)sin(angle);
+			u[i] = (float)j / count;
+		}
+	}
+};
+
+// +1 when cross(normal, tangent) runs along dPdv, -1 otherwise
+inline float MeshTangentSign(const float normal[3], const float tangent[3], const float dPdv[3])
+{
+	float b[3] =
+	{
+		normal[1] * tangent[2] - normal[2] * tangent[1],
+		normal[2] * tangent[0] - normal[0] * tangent[2],
+		normal[0] * tangent[1] - normal[1] * tangent[0],
+	};
+	return b[0] * dPdv[0] + b[1] * dPdv[1] + b[2] * dPdv[2] >= 0.0f ? 1.0f : -1.0f;
+}
+
+#ifdef MESH_GENERATOR_SSE2
+// Writes count (up to 4) vertices from 12 attribute lanes in MeshVertex order
+inline void MeshStore4(__m128 lanes[12], MeshVertex* out, int count)
+{
+	_MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+	_MM_TRANSPOSE4_PS(lanes[4], lanes[5], lanes[6], lanes[7]);
+	_MM_TRANSPOSE4_PS(lanes[8], lanes[9], lanes[10], lanes[11]);
+	for (int k = 0; k < count; ++k)
+	{
+		float* f = out[k].position;
+		_mm_storeu_ps(f, lanes[k]);
+		_mm_storeu_ps(f + 4, lanes[4 + k]);
+		_mm_storeu_ps(f + 8, lanes[8 + k]);
+	}
+}
+#endif
+
+// Indices of a (rows + 1) x (columns + 1) vertex grid starting at base, in cache bands.
+// Quad (i, j) is split into (i, j+1), (i, j), (i+1, j) and (i, j+1), (i+1, j), (i+1, j+1),
+// clockwise from the outside when the tangent sign is -1; flip reverses their winding.
+// A pole row collapses to one point, so its degenerate triangles are left out.
+inline void MeshGridIndices(unsigned int base, int rows, int columns, bool flip, bool poleTop, bool poleBottom,
+	std::vector<unsigned int>* indices)
+{
+	size_t start = indices->size();
+	size_t triangles = (size_t)rows * columns * 2 - (poleTop ? columns : 0) - (poleBottom ? columns : 0);
+	indices->resize(start + triangles * 3);
+	unsigned int* out = &(*indices)[start];
+	unsigned int stride = columns + 1;
+	for (int band = 0; band < columns; band += MESH_CACHE_BAND)
+	{
+		int bandEnd = std::min(band + MESH_CACHE_BAND, columns);
+		for (int i = 0; i < rows; ++i)
+		{
+			for (int j = band; j < bandEnd; ++j)
+			{
+				unsigned int a = base + i * stride + j, b = a + 1, c = a + stride, d = c + 1;
+				// Flipped, the first triangle starts at a so both row i vertices are used
+				// before row i + 1 pushes them out of the FIFO
+				if (!(poleTop && i == 0))
+				{
+					out[0] = flip ? a : b;
+					out[1] = flip ? b : a;
+					out[2] = c;
+					out += 3;
+				}
+				if (!(poleBottom && i == rows - 1))
+				{
+					out[0] = b;
+					out[1] = flip ? d : c;
+					out[2] = flip ? c : d;
+					out += 3;
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Surfaces of revolution
+//--------------------------------------------------------------------------------------
+// One ring: the profile point (radius, y) turned about +Y, with the profile normal
+// (normalRadius, normalY). Angle phi of the table gives (sin phi, cos phi) in x and z.
+struct MeshRing
+{
+	float radius;
+	float y;
+	float normalRadius;
+	float normalY;
+	float v;
+	float uOffset;		// added to the table's u, half a segment for pole rings
+	float tangentW;
+};
+
+inline void MeshEmitRing(const MeshRing& ring, const MeshRingTable& table, int segments, MeshVertex* out)
+{
+	int count = segments + 1;
+#ifdef MESH_GENERATOR_SSE2
+	__m128 radius = _mm_set1_ps(ring.radius), y = _mm_set1_ps(ring.y);
+	__m128 normalRadius = _mm_set1_ps(ring.normalRadius), normalY = _mm_set1_ps(ring.normalY);
+	__m128 v = _mm_set1_ps(ring.v), uOffset = _mm_set1_ps(ring.uOffset), w = _mm_set1_ps(ring.tangentW);
+	__m128 zero = _mm_setzero_ps();
+	for (int j = 0; j < count; j += 4)
+	{
+		__m128 c = _mm_loadu_ps(&table.cosines[j]), s = _mm_loadu_ps(&table.sines[j]);
+		__m128 lanes[12] =
+		{
+			_mm_mul_ps(radius, s), y, _mm_mul_ps(radius, c),
+			_mm_mul_ps(normalRadius, s), normalY, _mm_mul_ps(normalRadius, c),
+			_mm_add_ps(_mm_loadu_ps(&table.u[j]), uOffset), v,
+			c, zero, _mm_sub_ps(zero, s), w,
+		};
+		MeshStore4(lanes, out + j, std::min(count - j, 4));
+	}
+#else
+	for (int j = 0; j < count; ++j)
+	{
+		float c = table.cosines[j], s = table.sines[j];
+		MeshVertex& vertex = out[j];
+		vertex.position[0] = ring.radius * s;
+		vertex.position[1] = ring.y;
+		vertex.position[2] = ring.radius * c;
+		vertex.normal[0] = ring.normalRadius * s;
+		vertex.normal[1] = ring.normalY;
+		vertex.normal[2] = ring.normalRadius * c;
+		vertex.uv[0] = table.u[j] + ring.uOffset;
+		vertex.uv[1] = ring.v;
+		vertex.tangent[0] = c;
+		vertex.tangent[1] = 0.0f;
+		vertex.tangent[2] = -s;
+		vertex.tangent[3] = ring.tangentW;
+	}
+#endif
+}
+
+// rings + 1 rows from top (v = 0) to bottom; consecutive rings must not swap orientation
+inline void MeshEmitRevolution(const std::vector<MeshRing>& rings, int segments, bool poles, MeshData* mesh)
+{
+	MeshRingTable table;
+	table.Build(segments, -MESH_PI, 2.0 * MESH_PI);
+	unsigned int base = (unsigned int)mesh->vertices.size();
+	mesh->vertices.resize(base + rings.size() * (segments + 1));
+	for (size_t i = 0; i < rings.size(); ++i)
+		MeshEmitRing(rings[i], table, segments, &mesh->vertices[base + i * (segments + 1)]);
+	MeshGridIndices(base, (int)rings.size() - 1, segments, rings[0].tangentW > 0.0f, poles, poles, &mesh->indices);
+}
+
+// Sphere with rings latitude bands and segments longitude slices
+inline void GenerateUVSphere(float radius, int rings, int segments, MeshData* mesh)
+{
+	rings = std::max(rings, 2);
+	segments = std::max(segments, 3);
+	std::vector<MeshRing> profile(rings + 1);
+	for (int i = 0; i <= rings; ++i)
+	{
+		double theta = MESH_PI * i / rings;
+		MeshRing& ring = profile[i];
+		ring.normalRadius = (float)sin(theta);
+		ring.normalY = (float)cos(theta);
+		ring.radius = radius * ring.normalRadius;
+		ring.y = radius * ring.normalY;
+		ring.v = (float)i / rings;
+		ring.uOffset = i == 0 || i == rings ? 0.5f / segments : 0.0f;
+		ring.tangentW = -1.0f;		// v runs down the profile
+	}
+	MeshEmitRevolution(profile, segments, true, mesh);
+}
+
+// Open or capped cylinder along Y, centred on the origin
+inline void GenerateCylinder(float radius, float height, int segments, int stacks, bool caps, MeshData* mesh)
+{
+	segments = std::max(segments, 3);
+	stacks = std::max(stacks, 1);
+	std::vector<MeshRing> profile(stacks + 1);
+	for (int i = 0; i <= stacks; ++i)
+	{
+		MeshRing& ring = profile[i];
+		ring.radius = radius;
+		ring.y = 0.5f * height - height * i / stacks;
+		ring.normalRadius = 1.0f;
+		ring.normalY = 0.0f;
+		ring.v = (float)i / stacks;
+		ring.uOffset = 0.0f;
+		ring.tangentW = -1.0f;
+	}
+	MeshEmitRevolution(profile, segments, false, mesh);
+	if (!caps)
+		return;
+
+	// Fans with planar UVs; few vertices, so no SIMD
+	MeshRingTable table;
+	table.Build(segments, -MESH_PI, 2.0 * MESH_PI);
+	for (int cap = 0; cap < 2; ++cap)
+	{
+		float side = cap == 0 ? 1.0f : -1.0f;
+		float normal[3] = { 0.0f, side, 0.0f }, tangent[3] = { 1.0f, 0.0f, 0.0f }, dPdv[3] = { 0.0f, 0.0f, -side };
+		float w = MeshTangentSign(normal, tangent, dPdv);
+		unsigned int center = (unsigned int)mesh->vertices.size();
+		for (int j = -1; j <= segments; ++j)
+		{
+			float s = j < 0 ? 0.0f : table.sines[j], c = j < 0 ? 0.0f : table.cosines[j];
+			MeshVertex vertex =
+			{
+				{ radius * s, 0.5f * side * height, radius * c },
+				{ 0.0f, side, 0.0f },
+				{ 0.5f + 0.5f * s, 0.5f - 0.5f * side * c },
+				{ 1.0f, 0.0f, 0.0f, w },
+			};
+			mesh->vertices.push_back(vertex);
+		}
+		for (int j = 0; j < segments; ++j)
+		{
+			unsigned int a = center + 1 + j, b = a + 1;
+			mesh->indices.push_back(center);
+			mesh->indices.push_back(cap == 0 ? a : b);
+			mesh->indices.push_back(cap == 0 ? b : a);
+		}
+	}
+}
+
+// Ring of majorRadius about Y with a tube of minorRadius
+inline void GenerateTorus(float majorRadius, float minorRadius, int majorSegments, int minorSegments, MeshData* mesh)
+{
+	majorSegments = std::max(majorSegments, 3);
+	minorSegments = std::max(minorSegments, 3);
+	MeshRingTable tube;
+	tube.Build(minorSegments, 0.0, 2.0 * MESH_PI);
+	std::vector<MeshRing> profile(minorSegments + 1);
+	for (int i = 0; i <= minorSegments; ++i)
+	{
+		MeshRing& ring = profile[i];
+		ring.normalRadius = tube.cosines[i];
+		ring.normalY = tube.sines[i];
+		ring.radius = majorRadius + minorRadius * ring.normalRadius;
+		ring.y = minorRadius * ring.normalY;
+		ring.v = tube.u[i];
+		ring.uOffset = 0.0f;
+		ring.tangentW = 1.0f;		// v runs up the outside of the tube
+	}
+	MeshEmitRevolution(profile, majorSegments, false, mesh);
+}
+
+//--------------------------------------------------------------------------------------
+// Faces: planar grids and the cube sphere
+//--------------------------------------------------------------------------------------
+// A face seen from outside: right is +u, up is -v
+struct MeshFace
+{
+	float center[3];
+	float normal[3];
+	float right[3];
+	float up[3];
+};
+
+// The six faces of a cube, with Y up on the sides; top and bottom have +Z and -Z up
+inline void MeshCubeFace(int face, MeshFace* out)
+{
+	static const float normals[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const float ups[6][3] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+	const float* n = normals[face];
+	const float* u = ups[face];
+	for (int c = 0; c < 3; ++c)
+	{
+		out->center[c] = n[c];
+		out->normal[c] = n[c];
+		out->up[c] = u[c];
+	}
+	// right = cross(up, -normal), the screen right of a left-handed view of the face
+	out->right[0] = -(u[1] * n[2] - u[2] * n[1]);
+	out->right[1] = -(u[2] * n[0] - u[0] * n[2]);
+	out->right[2] = -(u[0] * n[1] - u[1] * n[0]);
+}
+
+// One row of a face: center + right * s[j] - up * t for the columns + 1 values of s. With
+// spherize the point is projected onto a sphere of radius, which becomes the normal, and
+// the tangent is right made orthogonal to it.
+inline void MeshEmitFaceRow(const MeshFace& face, const float* s, const float* u, float t, float v, bool spherize, float radius,
+	float tangentW, int columns, MeshVertex* out)
+{
+	int count = columns + 1;
+	float base[3] = { face.center[0] - face.up[0] * t, face.center[1] - face.up[1] * t, face.center[2] - face.up[2] * t };
+#ifdef MESH_GENERATOR_SSE2
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	for (int j = 0; j < count; j += 4)
+	{
+		__m128 sj = _mm_loadu_ps(s + j);
+		__m128 p[3], n[3], tangent[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			p[c] = _mm_add_ps(_mm_set1_ps(base[c]), _mm_mul_ps(_mm_set1_ps(face.right[c]), sj));
+			n[c] = _mm_set1_ps(face.normal[c]);
+			tangent[c] = _mm_set1_ps(face.right[c]);
+		}
+		if (spherize)
+		{
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0], p[0]), _mm_mul_ps(p[1], p[1])), _mm_mul_ps(p[2], p[2])));
+			__m128 inverse = _mm_div_ps(one, length), scale = _mm_set1_ps(radius);
+			__m128 d = zero;
+			for (int c = 0; c < 3; ++c)
+			{
+				n[c] = _mm_mul_ps(p[c], inverse);
+				p[c] = _mm_mul_ps(n[c], scale);
+				d = _mm_add_ps(d, _mm_mul_ps(n[c], tangent[c]));
+			}
+			__m128 tangentLength = zero;
+			for (int c = 0; c < 3; ++c)
+			{
+				tangent[c] = _mm_sub_ps(tangent[c], _mm_mul_ps(n[c], d));
+				tangentLength = _mm_add_ps(tangentLength, _mm_mul_ps(tangent[c], tangent[c]));
+			}
+			__m128 tangentInverse = _mm_div_ps(one, _mm_sqrt_ps(tangentLength));
+			for (int c = 0; c < 3; ++c)
+				tangent[c] = _mm_mul_ps(tangent[c], tangentInverse);
+		}
+		__m128 lanes[12] =
+		{
+			p[0], p[1], p[2], n[0], n[1], n[2], _mm_loadu_ps(u + j), _mm_set1_ps(v),
+			tangent[0], tangent[1], tangent[2], _mm_set1_ps(tangentW),
+		};
+		MeshStore4(lanes, out + j, std::min(count - j, 4));
+	}
+#else
+	for (int j = 0; j < count; ++j)
+	{
+		MeshVertex& vertex = out[j];
+		float d = 0.0f, tangentLength = 0.0f, length = 0.0f;
+		for (int c = 0; c < 3; ++c)
+		{
+			vertex.position[c] = base[c] + face.right[c] * s[j];
+			vertex.normal[c] = face.normal[c];
+			vertex.tangent[c] = face.right[c];
+			length += vertex.position[c] * vertex.position[c];
+		}
+		if (spherize)
+		{
+			float inverse = 1.0f / sqrtf(length);
+			for (int c = 0; c < 3; ++c)
+			{
+				vertex.normal[c] = vertex.position[c] * inverse;
+				vertex.position[c] = vertex.normal[c] * radius;
+				d += vertex.normal[c] * vertex.tangent[c];
+			}
+			for (int c = 0; c < 3; ++c)
+			{
+				vertex.tangent[c] -= vertex.normal[c] * d;
+				tangentLength += vertex.tangent[c] * vertex.tangent[c];
+			}
+			float tangentInverse = 1.0f / sqrtf(tangentLength);
+			for (int c = 0; c < 3; ++c)
+				vertex.tangent[c] *= tangentInverse;
+		}
+		vertex.uv[0] = u[j];
+		vertex.uv[1] = v;
+		vertex.tangent[3] = tangentW;
+	}
+#endif
+}
+
+// A (rows + 1) x (columns + 1) grid over face, with s and t from the tables' entries
+inline void MeshEmitFace(const MeshFace& face, const std::vector<float>& s, const std::vector<float>& t, const MeshRingTable& uTable,
+	const MeshRingTable& vTable, int columns, int rows, bool spherize, float radius, MeshData* mesh)
+{
+	// v runs along -up, so the tangent sign and winding follow from the face's frame
+	float down[3] = { -face.up[0], -face.up[1], -face.up[2] };
+	float w = MeshTangentSign(face.normal, face.right, down);
+	unsigned int base = (unsigned int)mesh->vertices.size();
+	mesh->vertices.resize(base + (size_t)(rows + 1) * (columns + 1));
+	for (int i = 0; i <= rows; ++i)
+		MeshEmitFaceRow(face, &s[0], &uTable.u[0], t[i], vTable.u[i], spherize, radius, w, columns, &mesh->vertices[base + i * (columns + 1)]);
+	MeshGridIndices(base, rows, columns, w > 0.0f, false, false, &mesh->indices);
+}
+
+// Grid in the XZ plane facing +Y, +Z at the top of the texture
+inline void GeneratePlaneGrid(float width, float depth, int columns, int rows, MeshData* mesh)
+{
+	columns = std::max(columns, 1);
+	rows = std::max(rows, 1);
+	MeshFace face;
+	MeshCubeFace(2, &face);
+	face.center[1] = 0.0f;
+	MeshRingTable uTable, vTable;
+	uTable.Build(columns, 0.0, 1.0);
+	vTable.Build(rows, 0.0, 1.0);
+	std::vector<float> s(uTable.u.size()), t(vTable.u.size());
+	for (size_t j = 0; j < s.size(); ++j)
+		s[j] = (uTable.u[j] - 0.5f) * width;
+	for (size_t i = 0; i < t.size(); ++i)
+		t[i] = (vTable.u[i] - 0.5f) * depth;
+	MeshEmitFace(face, s, t, uTable, vTable, columns, rows, false, 1.0f, mesh);
+}
+
+// Box centred on the origin, each face divided into divisions x divisions quads with its
+// own 0..1 UVs
+inline void GenerateBox(float width, float height, float depth, int divisions, MeshData* mesh)
+{
+	divisions = std::max(divisions, 1);
+	float extent[3] = { 0.5f * width, 0.5f * height, 0.5f * depth };
+	MeshRingTable table;
+	table.Build(divisions, 0.0, 1.0);
+	for (int f = 0; f < 6; ++f)
+	{
+		MeshFace face;
+		MeshCubeFace(f, &face);
+		float rightExtent = 0.0f, upExtent = 0.0f;
+		for (int c = 0; c < 3; ++c)
+		{
+			face.center[c] *= extent[c];
+			rightExtent += fabsf(face.right[c]) * extent[c];
+			upExtent += fabsf(face.up[c]) * extent[c];
+		}
+		std::vector<float> s(table.u.size()), t(table.u.size());
+		for (size_t j = 0; j < s.size(); ++j)
+		{
+			s[j] = (2.0f * table.u[j] - 1.0f) * rightExtent;
+			t[j] = (2.0f * table.u[j] - 1.0f) * upExtent;
+		}
+		MeshEmitFace(face, s, t, table, table, divisions, divisions, false, 1.0f, mesh);
+	}
+}
+
+// Cube faces of divisions x divisions quads projected onto the sphere. The grid is
+// spaced by equal angles, so quads vary in area by about 1.4x rather than 5x.
+inline void GenerateCubeSphere(float radius, int divisions, MeshData* mesh)
+{
+	divisions = std::max(divisions, 1);
+	MeshRingTable table;
+	table.Build(divisions, 0.0, 1.0);
+	std::vector<float> s(table.u.size());
+	for (size_t j = 0; j < s.size(); ++j)
+		s[j] = (float)tan(MESH_PI * (table.u[j] - 0.5) * 0.5);
+	for (int f = 0; f < 6; ++f)
+	{
+		MeshFace face;
+		MeshCubeFace(f, &face);
+		MeshEmitFace(face, s, s, table, table, divisions, divisions, true, radius, mesh);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Icosphere
+//--------------------------------------------------------------------------------------
+// Every icosahedron face split into frequency^2 triangles, projected onto the sphere.
+// Vertices on the icosahedron's edges are shared between faces; the UVs are the
+// equirectangular ones of the UV sphere, so vertices are duplicated along the u seam
+// and at the poles, where each triangle gets its own u.
+inline void GenerateIcosphere(float radius, int frequency, MeshData* mesh)
+{
+	int n = std::max(frequency, 1);
+	const float g = 1.61803398875f;
+	const float corners[12][3] =
+	{
+		{ -1, g, 0 }, { 1, g, 0 }, { -1, -g, 0 }, { 1, -g, 0 },
+		{ 0, -1, g }, { 0, 1, g }, { 0, -1, -g }, { 0, 1, -g },
+		{ g, 0, -1 }, { g, 0, 1 }, { -g, 0, -1 }, { -g, 0, 1 },
+	};
+	int faces[20][3] =
+	{
+		{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+		{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+		{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+		{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+	};
+
+	// Clockwise from outside: cross(b - a, c - a) along a + b + c
+	int edgeIndex[12][12];
+	int edgeCount = 0;
+	memset(edgeIndex, -1, sizeof(edgeIndex));
+	for (int f = 0; f < 20; ++f)
+	{
+		const float* a = corners[faces[f][0]];
+		const float* b = corners[faces[f][1]];
+		const float* c = corners[faces[f][2]];
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		if (cross[0] * (a[0] + b[0] + c[0]) + cross[1] * (a[1] + b[1] + c[1]) + cross[2] * (a[2] + b[2] + c[2]) < 0.0f)
+			std::swap(faces[f][1], faces[f][2]);
+		for (int e = 0; e < 3; ++e)
+		{
+			int from = std::min(faces[f][e], faces[f][(e + 1) % 3]), to = std::max(faces[f][e], faces[f][(e + 1) % 3]);
+			if (edgeIndex[from][to] < 0)
+				edgeIndex[from][to] = edgeCount++;
+		}
+	}
+
+	// Point (i, j) of a face, 0 <= j <= i <= n, is a + (b - a) * (i - j) / n + (c - a) * j / n.
+	// Ids: corners, then n - 1 per edge from its lower corner, then the face interiors.
+	int interiorPerFace = (n - 1) * (n - 2) / 2;
+	int vertexCount = 12 + 30 * (n - 1) + 20 * interiorPerFace;
+	std::vector<float> px(vertexCount), py(vertexCount), pz(vertexCount);
+	std::vector<int> faceIds((size_t)20 * (n + 1) * (n + 2) / 2);
+	for (int f = 0; f < 20; ++f)
+	{
+		int* ids = &faceIds[(size_t)f * (n + 1) * (n + 2) / 2];
+		for (int i = 0, k = 0; i <= n; ++i)
+		{
+			for (int j = 0; j <= i; ++j, ++k)
+			{
+				// Which corners the point lies between, and how far along
+				int from = -1, to = -1, step = 0;
+				if (i == 0)
+					from = faces[f][0];
+				else if (i == n && j == 0)
+					from = faces[f][1];
+				else if (i == n && j == n)
+					from = faces[f][2];
+				else if (j == 0)
+					from = faces[f][0], to = faces[f][1], step = i;
+				else if (j == i)
+					from = faces[f][0], to = faces[f][2], step = i;
+				else if (i == n)
+					from = faces[f][1], to = faces[f][2], step = j;
+
+				int id;
+				double weights[3];
+				int corner[3] = { faces[f][0], faces[f][1], faces[f][2] };
+				if (from >= 0 && to < 0)
+				{
+					id = from;
+					corner[0] = corner[1] = corner[2] = from;
+					weights[0] = 1.0, weights[1] = weights[2] = 0.0;
+				}
+				else if (from >= 0)
+				{
+					if (from > to)
+						std::swap(from, to), step = n - step;
+					id = 12 + edgeIndex[from][to] * (n - 1) + step - 1;
+					corner[0] = from, corner[1] = to;
+					weights[0] = (double)(n - step) / n, weights[1] = (double)step / n, weights[2] = 0.0;
+				}
+				else
+				{
+					// Interior rows 1..n-1 hold j = 1..i-1
+					id = 12 + 30 * (n - 1) + f * interiorPerFace + (i - 1) * (i - 2) / 2 + j - 1;
+					weights[0] = (double)(n - i) / n, weights[1] = (double)(i - j) / n, weights[2] = (double)j / n;
+				}
+				ids[k] = id;
+				double p[3] = { 0.0, 0.0, 0.0 };
+				for (int w = 0; w < 3; ++w)
+					for (int c = 0; c < 3; ++c)
+						p[c] += weights[w] * corners[corner[w]][c];
+				px[id] = (float)p[0], py[id] = (float)p[1], pz[id] = (float)p[2];
+			}
+		}
+	}
+
+	// Project onto the sphere, four at a time
+	unsigned int base = (unsigned int)mesh->vertices.size();
+	mesh->vertices.resize(base + vertexCount);
+	MeshVertex* out = &mesh->vertices[base];
+	int j = 0;
+#ifdef MESH_GENERATOR_SSE2
+	__m128 scale = _mm_set1_ps(radius), zero = _mm_setzero_ps();
+	for (; j + 4 <= vertexCount; j += 4)
+	{
+		__m128 x = _mm_loadu_ps(&px[j]), y = _mm_loadu_ps(&py[j]), z = _mm_loadu_ps(&pz[j]);
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))));
+		x = _mm_mul_ps(x, inverse), y = _mm_mul_ps(y, inverse), z = _mm_mul_ps(z, inverse);
+		__m128 lanes[12] =
+		{
+			_mm_mul_ps(x, scale), _mm_mul_ps(y, scale), _mm_mul_ps(z, scale), x, y, z, zero, zero, zero, zero, zero, zero,
+		};
+		MeshStore4(lanes, out + j, 4);
+	}
+#endif
+	for (; j < vertexCount; ++j)
+	{
+		float inverse = 1.0f / sqrtf(px[j] * px[j] + py[j] * py[j] + pz[j] * pz[j]);
+		float normal[3] = { px[j] * inverse, py[j] * inverse, pz[j] * inverse };
+		for (int c = 0; c < 3; ++c)
+		{
+			out[j].normal[c] = normal[c];
+			out[j].position[c] = normal[c] * radius;
+		}
+	}
+
+	// u, v and the tangent along u from the direction; the tangent of +-Y is left to the
+	// pole fix-up below. u and the pole flag are also kept apart, so the per-triangle pass
+	// doesn't pull whole vertices through the cache.
+	const float pole = 1e-6f;
+	std::vector<float> vertexU(vertexCount);
+	std::vector<unsigned char> isPoleVertex(vertexCount);
+	for (int k = 0; k < vertexCount; ++k)
+	{
+		MeshVertex& vertex = out[k];
+		const float* d = vertex.normal;
+		vertex.uv[0] = 0.5f + atan2f(d[0], d[2]) * (float)(0.5 / MESH_PI);
+		vertex.uv[1] = acosf(std::min(std::max(d[1], -1.0f), 1.0f)) * (float)(1.0 / MESH_PI);
+		float length = sqrtf(d[0] * d[0] + d[2] * d[2]);
+		vertex.tangent[0] = length > pole ? d[2] / length : 1.0f;
+		vertex.tangent[1] = 0.0f;
+		vertex.tangent[2] = length > pole ? -d[0] / length : 0.0f;
+		vertex.tangent[3] = -1.0f;
+		vertexU[k] = vertex.uv[0];
+		isPoleVertex[k] = length <= pole;
+	}
+
+	// Faces in cache bands like the grids: cell (i, j) owns the triangle below it and,
+	// unless it ends its row, the one to its right
+	std::vector<unsigned int> triangles;
+	triangles.reserve((size_t)60 * n * n);
+	for (int f = 0; f < 20; ++f)
+	{
+		const int* ids = &faceIds[(size_t)f * (n + 1) * (n + 2) / 2];
+		for (int band = 0; band < n; band += MESH_CACHE_BAND)
+		{
+			for (int i = band; i < n; ++i)
+			{
+				const int* row = ids + i * (i + 1) / 2;
+				const int* next = ids + (i + 1) * (i + 2) / 2;
+				for (int c = band; c <= std::min(i, band + MESH_CACHE_BAND - 1); ++c)
+				{
+					triangles.push_back(base + row[c]);
+					triangles.push_back(base + next[c]);
+					triangles.push_back(base + next[c + 1]);
+					if (c < i)
+					{
+						triangles.push_back(base + row[c]);
+						triangles.push_back(base + next[c + 1]);
+						triangles.push_back(base + row[c + 1]);
+					}
+				}
+			}
+		}
+	}
+
+	// Seam triangles get copies of their low-u vertices at u + 1, pole vertices a copy
+	// per triangle with the other two vertices' mean u
+	std::map<unsigned int, unsigned int> seamCopies;
+	for (size_t t = 0; t < triangles.size(); t += 3)
+	{
+		unsigned int* tri = &triangles[t];
+		float u[3], minU = 2.0f, maxU = -1.0f;
+		bool isPole[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			isPole[k] = isPoleVertex[tri[k] - base] != 0;
+			u[k] = vertexU[tri[k] - base];
+			if (!isPole[k])
+				minU = std::min(minU, u[k]), maxU = std::max(maxU, u[k]);
+		}
+		if (maxU - minU > 0.5f)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				if (isPole[k] || u[k] >= 0.5f)
+					continue;
+				std::map<unsigned int, unsigned int>::iterator copy = seamCopies.find(tri[k]);
+				if (copy == seamCopies.end())
+				{
+					MeshVertex vertex = mesh->vertices[tri[k]];
+					vertex.uv[0] += 1.0f;
+					copy = seamCopies.insert(std::make_pair(tri[k], (unsigned int)mesh->vertices.size())).first;
+					mesh->vertices.push_back(vertex);
+				}
+				tri[k] = copy->second;
+				u[k] += 1.0f;
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			if (!isPole[k])
+				continue;
+			MeshVertex vertex = mesh->vertices[tri[k]];
+			vertex.uv[0] = 0.5f * (u[(k + 1) % 3] + u[(k + 2) % 3]);
+			double phi = (vertex.uv[0] - 0.5) * 2.0 * MESH_PI;
+			vertex.tangent[0] = (float)cos(phi);
+			vertex.tangent[2] = (float)-sin(phi);
+			tri[k] = (unsigned int)mesh->vertices.size();
+			mesh->vertices.push_back(vertex);
+		}
+	}
+	mesh->indices.insert(mesh->indices.end(), triangles.begin(), triangles.end());
+}
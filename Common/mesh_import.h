@@ -0,0 +1,199 @@
+//--------------------------------------------------------------------------------------
+// File: mesh_import.h
+//
+// Fills a MeshPool (Common/mesh_cache.h) from any file assimp reads, going through the
+// binary mesh cache first.
+//
+// Every mesh referenced by the node hierarchy is appended with its node transform baked
+// into the vertices. The index buffer is 16 bit, so a mesh with more vertices than a WORD
+// can address is cut into consecutive submeshes of at most MAX_SUBMESH_VERTICES each;
+// indices stay local to their submesh and the draw call adds baseVertex.
+//
+// The sample supplies the vertex layout through MeshImportHooks: convertVertex builds one
+// vertex, finishSubmesh (optional) post-processes a finished submesh, e.g. reorders it or
+// generates tangents. Bounds are taken afterwards.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <float.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <assimp/Importer.hpp>      // C++ importer interface
+#include <assimp/scene.h>           // Output data structure
+#include <assimp/postprocess.h>     // Post processing flags
+#include "mesh_cache.h"
+
+#define MAX_SUBMESH_VERTICES	65536
+
+const unsigned int g_MeshPostProcessFlags =
+	aiProcess_CalcTangentSpace |
+	//aiProcess_MakeLeftHanded|
+	aiProcess_Triangulate |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_SortByPType;
+
+template <typename Vertex>
+struct MeshImportHooks
+{
+	Vertex (*convertVertex)(const aiMesh* mesh, unsigned i, const aiMatrix4x4& transform, const aiMatrix3x3& normalMatrix,
+		const aiMatrix3x3& tangentMatrix);
+	void (*finishSubmesh)(const aiMesh* mesh, int submeshIndex, Vertex* vertices, int verticesNum, unsigned short* indices, int indicesNum);
+};
+
+struct MeshLoadStats
+{
+	bool cacheHit;
+	double milliseconds;
+};
+
+template <typename Vertex>
+void EndSubmesh(const aiMesh* mesh, const MeshImportHooks<Vertex>& hooks, Submesh* submesh, MeshPool<Vertex>* pool)
+{
+	submesh->indexCount = (unsigned int)pool->indexStorage.size() - submesh->firstIndex;
+	if (submesh->indexCount == 0)
+	{
+		pool->vertexStorage.resize(submesh->baseVertex);
+		return;
+	}
+
+	int verticesNum = (int)pool->vertexStorage.size() - submesh->baseVertex;
+	Vertex* vertices = &pool->vertexStorage[submesh->baseVertex];
+	unsigned short* indices = &pool->indexStorage[submesh->firstIndex];
+	if (hooks.finishSubmesh)
+		hooks.finishSubmesh(mesh, (int)pool->submeshes.size(), vertices, verticesNum, indices, submesh->indexCount);
+
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < verticesNum; ++i)
+	{
+		XMVECTOR position = XMLoadFloat3(&vertices[i].Pos);
+		boundsMin = XMVectorMin(boundsMin, position);
+		boundsMax = XMVectorMax(boundsMax, position);
+	}
+	XMStoreFloat3(&submesh->boundsMin, boundsMin);
+	XMStoreFloat3(&submesh->boundsMax, boundsMax);
+
+	pool->submeshes.push_back(*submesh);
+}
+
+template <typename Vertex>
+void AppendMesh(const aiMesh* mesh, const aiMatrix4x4& transform, const MeshImportHooks<Vertex>& hooks, MeshPool<Vertex>* pool)
+{
+	// aiProcess_SortByPType leaves point and line primitives in meshes of their own
+	if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE) || !mesh->HasPositions())
+		return;
+
+	aiMatrix3x3 tangentMatrix(transform);
+	aiMatrix4x4 inverseTranspose = transform;
+	inverseTranspose.Inverse().Transpose();
+	aiMatrix3x3 normalMatrix(inverseTranspose);
+
+	Submesh submesh;
+	memset(&submesh, 0, sizeof(submesh));
+	submesh.baseVertex = (unsigned int)pool->vertexStorage.size();
+	submesh.firstIndex = (unsigned int)pool->indexStorage.size();
+	submesh.materialIndex = mesh->mMaterialIndex;
+
+	// Position of each source vertex inside the current submesh, -1 until it is first used
+	std::vector<int> remap(mesh->mNumVertices, -1);
+	for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+	{
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3)
+			continue;
+
+		unsigned int newVertices = 0;
+		for (unsigned j = 0; j < 3; ++j)
+			newVertices += remap[face.mIndices[j]] < 0 ? 1 : 0;
+		if (pool->vertexStorage.size() - submesh.baseVertex + newVertices > MAX_SUBMESH_VERTICES)
+		{
+			EndSubmesh(mesh, hooks, &submesh, pool);
+			submesh.baseVertex = (unsigned int)pool->vertexStorage.size();
+			submesh.firstIndex = (unsigned int)pool->indexStorage.size();
+			std::fill(remap.begin(), remap.end(), -1);
+		}
+
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			int& local = remap[face.mIndices[j]];
+			if (local < 0)
+			{
+				local = (int)(pool->vertexStorage.size() - submesh.baseVertex);
+				pool->vertexStorage.push_back(hooks.convertVertex(mesh, face.mIndices[j], transform, normalMatrix, tangentMatrix));
+			}
+			pool->indexStorage.push_back((unsigned short)local);
+		}
+	}
+	EndSubmesh(mesh, hooks, &submesh, pool);
+}
+
+template <typename Vertex>
+void AppendNode(const aiScene* scene, const aiNode* node, const aiMatrix4x4& parentTransform, const MeshImportHooks<Vertex>& hooks,
+	MeshPool<Vertex>* pool)
+{
+	aiMatrix4x4 transform = parentTransform * node->mTransformation;
+	for (unsigned i = 0; i < node->mNumMeshes; ++i)
+		AppendMesh(scene->mMeshes[node->mMeshes[i]], transform, hooks, pool);
+	for (unsigned i = 0; i < node->mNumChildren; ++i)
+		AppendNode(scene, node->mChildren[i], transform, hooks, pool);
+}
+
+//--------------------------------------------------------------------------------------
+// Import every mesh referenced by the node hierarchy into one vertex and one index pool
+//--------------------------------------------------------------------------------------
+template <typename Vertex>
+bool ImportMesh(const std::string& pFile, const MeshImportHooks<Vertex>& hooks, MeshPool<Vertex>* pool)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(pFile, g_MeshPostProcessFlags);
+	if (scene == NULL || scene->mRootNode == NULL || !scene->HasMeshes())
+		return false;
+
+	AppendNode(scene, scene->mRootNode, aiMatrix4x4(), hooks, pool);
+	if (pool->submeshes.empty())
+		return false;
+
+	pool->vertices = &pool->vertexStorage[0];
+	pool->indices = &pool->indexStorage[0];
+	pool->verticesNum = (int)pool->vertexStorage.size();
+	pool->indicesNum = (int)pool->indexStorage.size();
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Map cacheFile if it was written from the same source bytes and flags, otherwise import
+// pFile and write cacheFile for the next run
+//--------------------------------------------------------------------------------------
+template <typename Vertex>
+bool LoadMeshPool(const std::string& pFile, const std::string& cacheFile, const MeshImportHooks<Vertex>& hooks, MeshPool<Vertex>* pool,
+	MeshLoadStats* stats = NULL)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// Key the cache on the source bytes so an edited asset is imported again
+	MappedFile source;
+	if (!MapFile(pFile, &source))
+		return false;
+	unsigned long long sourceHash = HashBytes(source.data, source.size);
+	UnmapFile(&source);
+
+	bool cacheHit = LoadMeshCache(cacheFile, sourceHash, g_MeshPostProcessFlags, pool);
+	if (!cacheHit)
+	{
+		if (!ImportMesh(pFile, hooks, pool))
+		{
+			ReleaseMeshPool(pool);
+			return false;
+		}
+		SaveMeshCache(cacheFile, sourceHash, g_MeshPostProcessFlags, *pool);
+	}
+
+	if (stats)
+	{
+		stats->cacheHit = cacheHit;
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	return true;
+}
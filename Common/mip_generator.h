@@ -0,0 +1,423 @@
+//--------------------------------------------------------------------------------------
+// File: mip_generator.h
+//
+// Mip chain generation for the offline texture tools, in place of the 2x2 box filter
+// in gamma space that D3DX applies when it loads a JPEG or PNG.
+//
+// Every level is filtered straight from the top level with the kernel stretched to the
+// level's scale, so levels don't depend on each other and errors don't pile up down
+// the chain. The filters are separable. Each job takes a band of MIP_BAND_ROWS rows of
+// one level: it runs the horizontal pass over just the source rows under the band's
+// vertical taps, into a float strip of its own, then the vertical pass out of that
+// strip. The bands of every level go to a SoftThreadPool at once. Texels are RGBA float
+// and the taps are accumulated four channels at a time, in one SSE2 register where
+// available.
+//
+// Memory, per source texel: 16 bytes for the linear float copy of the top level and
+// about 5.3 for the float levels, which the alpha coverage pass needs whole before
+// encoding, plus the 8 bit output. A strip holds the source rows under one band at the
+// level's width, about (MIP_BAND_ROWS + 6) * 16 bytes per source column whatever the
+// level, and lives only while its job runs. The horizontal pass repeats the rows that
+// neighbouring bands share, about 6 / MIP_BAND_ROWS extra work with the 3 texel kernels.
+//
+// Kernels, radius in texels of the destination level:
+//   box      1/2, the exact area average (2x2 at every power of two step)
+//   kaiser   3, windowed sinc with alpha 4, sharper than box without visible ringing
+//   lanczos  3, windowed sinc, the sharpest, with some ringing on hard edges
+// Negative lobes can overshoot, results are clamped to [0, 1].
+//
+// Options:
+//   srgb          the colour channels are sRGB and are filtered in linear space
+//   normalMap     rgb is a unit vector packed as 0.5 * n + 0.5, renormalized per texel
+//   wrap          WRAP addressing at the edges (tiling textures), otherwise CLAMP
+//   alphaCoverage for alpha tested textures, the alpha test reference: the alpha of
+//                 every level is scaled so the fraction of texels passing the test is
+//                 the same as in the top level. 0 disables it.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+#define MIP_BAND_ROWS	32
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER,
+	MIP_FILTER_LANCZOS,
+};
+
+struct MipOptions
+{
+	MipFilter filter;
+	bool srgb;
+	bool normalMap;
+	bool wrap;
+	float alphaCoverage;
+
+	MipOptions() : filter(MIP_FILTER_KAISER), srgb(false), normalMap(false), wrap(true), alphaCoverage(0.0f) {}
+};
+
+// One R8G8B8A8 level, rows tightly packed
+struct MipSurface
+{
+	int width;
+	int height;
+	std::vector<unsigned char> rgba;
+};
+
+//--------------------------------------------------------------------------------------
+// Kernels
+//--------------------------------------------------------------------------------------
+inline float MipSinc(float x)
+{
+	if (fabsf(x) < 1e-5f)
+		return 1.0f;
+	x *= 3.14159265f;
+	return sinf(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window
+inline float MipBesselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f, half = 0.5f * x;
+	for (int k = 1; k < 32 && term > sum * 1e-7f; ++k)
+	{
+		term *= (half / k) * (half / k);
+		sum += term;
+	}
+	return sum;
+}
+
+inline float MipFilterRadius(MipFilter filter)
+{
+	return filter == MIP_FILTER_BOX ? 0.5f : 3.0f;
+}
+
+inline float MipFilterWeight(MipFilter filter, float t)
+{
+	float radius = MipFilterRadius(filter);
+	if (fabsf(t) >= radius)
+		return 0.0f;
+	if (filter == MIP_FILTER_LANCZOS)
+		return MipSinc(t) * MipSinc(t / radius);
+	const float alpha = 4.0f;
+	float r = t / radius;
+	return MipSinc(t) * MipBesselI0(alpha * sqrtf(1.0f - r * r)) / MipBesselI0(alpha);
+}
+
+// Taps of one axis of one level: destination texel i reads source texels
+// indices[i * taps + k] with weights[i * taps + k], which sum to 1
+struct MipFilterAxis
+{
+	int taps;
+	std::vector<int> indices;
+	std::vector<float> weights;
+
+	void Build(MipFilter filter, int sourceSize, int destSize, bool wrap)
+	{
+		float scale = (float)sourceSize / destSize;
+		float support = MipFilterRadius(filter) * scale;
+		taps = (int)ceilf(2.0f * support) + 2;
+		indices.assign((size_t)destSize * taps, 0);
+		weights.assign((size_t)destSize * taps, 0.0f);
+		for (int i = 0; i < destSize; ++i)
+		{
+			float center = (i + 0.5f) * scale;
+			int first = (int)floorf(center - support);
+			float sum = 0.0f;
+			for (int k = 0; k < taps; ++k)
+			{
+				int s = first + k;
+				float weight;
+				if (filter == MIP_FILTER_BOX)
+				{
+					// Overlap of source texel [s, s + 1) with the destination footprint
+					float low = std::max((float)s, center - support), high = std::min((float)s + 1.0f, center + support);
+					weight = std::max(high - low, 0.0f);
+				}
+				else
+					weight = MipFilterWeight(filter, (s + 0.5f - center) / scale);
+				if (wrap)
+					s = ((s % sourceSize) + sourceSize) % sourceSize;
+				else
+					s = std::min(std::max(s, 0), sourceSize - 1);
+				indices[(size_t)i * taps + k] = s;
+				weights[(size_t)i * taps + k] = weight;
+				sum += weight;
+			}
+			for (int k = 0; k < taps; ++k)
+				weights[(size_t)i * taps + k] /= sum;
+		}
+	}
+};
+
+//--------------------------------------------------------------------------------------
+// Colour space
+//--------------------------------------------------------------------------------------
+inline float MipSRGBToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float MipLinearToSRGB(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+inline unsigned char MipToUnorm8(float c)
+{
+	return (unsigned char)(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Accumulates weight * texel over the taps into out, four channels at a time
+inline void MipAccumulate(const float* source, const int* indices, const float* weights, int taps, int stride, float* out)
+{
+#ifdef MIP_GENERATOR_SSE2
+	__m128 sum = _mm_setzero_ps();
+	for (int k = 0; k < taps; ++k)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(source + (size_t)indices[k] * stride)));
+	_mm_storeu_ps(out, sum);
+#else
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int k = 0; k < taps; ++k)
+	{
+		const float* texel = source + (size_t)indices[k] * stride;
+		for (int c = 0; c < 4; ++c)
+			sum[c] += weights[k] * texel[c];
+	}
+	memcpy(out, sum, sizeof(sum));
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Generator
+//--------------------------------------------------------------------------------------
+class MipGenerator
+{
+public:
+	explicit MipGenerator(const MipOptions& options) : m_Options(options), m_Width(0), m_Height(0) {}
+
+	// levels receives the full chain down to 1x1, levels[0] being a copy of the input
+	void Generate(int width, int height, const unsigned char* rgba, SoftThreadPool* pool, std::vector<MipSurface>* levels)
+	{
+		m_Width = width;
+		m_Height = height;
+		levels->assign(1, MipSurface());
+		(*levels)[0].width = width;
+		(*levels)[0].height = height;
+		(*levels)[0].rgba.assign(rgba, rgba + (size_t)width * height * 4);
+
+		float toLinear[256];
+		for (int i = 0; i < 256; ++i)
+			toLinear[i] = m_Options.srgb ? MipSRGBToLinear(i / 255.0f) : i / 255.0f;
+		m_Source.resize((size_t)width * height * 4);
+		for (size_t i = 0; i < m_Source.size(); i += 4)
+		{
+			for (int c = 0; c < 3; ++c)
+				m_Source[i + c] = toLinear[rgba[i + c]];
+			m_Source[i + 3] = rgba[i + 3] / 255.0f;
+		}
+		m_TopCoverage = m_Options.alphaCoverage > 0.0f ? AlphaCoverage(&m_Source[0], m_Source.size() / 4, 1.0f) : 0.0f;
+
+		// Level sizes and filter taps
+		m_Levels.clear();
+		int w = width, h = height;
+		while (w > 1 || h > 1)
+		{
+			w = std::max(w >> 1, 1);
+			h = std::max(h >> 1, 1);
+			Level level;
+			level.width = w;
+			level.height = h;
+			level.alphaScale = 1.0f;
+			m_Levels.push_back(level);
+		}
+		for (size_t i = 0; i < m_Levels.size(); ++i)
+		{
+			Level& level = m_Levels[i];
+			level.horizontal.Build(m_Options.filter, width, level.width, m_Options.wrap);
+			level.vertical.Build(m_Options.filter, height, level.height, m_Options.wrap);
+			level.texels.resize((size_t)level.height * level.width * 4);
+		}
+
+		// Bands of destination rows, every level in the same batch
+		MakeBands();
+		pool->ParallelFor((int)m_Bands.size(), FilterJob, this);
+		if (m_Options.alphaCoverage > 0.0f)
+			pool->ParallelFor((int)m_Levels.size(), CoverageJob, this);
+
+		for (size_t i = 0; i < m_Levels.size(); ++i)
+		{
+			MipSurface surface;
+			surface.width = m_Levels[i].width;
+			surface.height = m_Levels[i].height;
+			surface.rgba.resize((size_t)surface.width * surface.height * 4);
+			levels->push_back(surface);
+		}
+		for (size_t i = 0; i < m_Levels.size(); ++i)
+			m_Levels[i].output = &(*levels)[i + 1].rgba[0];
+		pool->ParallelFor((int)m_Bands.size(), EncodeJob, this);
+	}
+
+private:
+	struct Level
+	{
+		int width;
+		int height;
+		MipFilterAxis horizontal;
+		MipFilterAxis vertical;
+		std::vector<float> texels;			// level height x level width, linear
+		float alphaScale;
+		unsigned char* output;
+	};
+
+	struct Band
+	{
+		int level;
+		int firstRow;
+		int rowCount;
+	};
+
+	void MakeBands()
+	{
+		m_Bands.clear();
+		for (size_t i = 0; i < m_Levels.size(); ++i)
+		{
+			int rows = m_Levels[i].height;
+			for (int row = 0; row < rows; row += MIP_BAND_ROWS)
+			{
+				Band band;
+				band.level = (int)i;
+				band.firstRow = row;
+				band.rowCount = std::min(MIP_BAND_ROWS, rows - row);
+				m_Bands.push_back(band);
+			}
+		}
+	}
+
+	// Fraction of texels whose alpha, scaled, passes the alpha test
+	float AlphaCoverage(const float* texels, size_t count, float scale) const
+	{
+		size_t passed = 0;
+		for (size_t i = 0; i < count; ++i)
+			passed += std::min(texels[i * 4 + 3] * scale, 1.0f) > m_Options.alphaCoverage;
+		return (float)passed / count;
+	}
+
+	// Horizontal pass over the source rows the band's vertical taps read, then the
+	// vertical pass of the band's rows out of that strip
+	static void FilterJob(void* context, int index)
+	{
+		MipGenerator* generator = (MipGenerator*)context;
+		const Band& band = generator->m_Bands[index];
+		Level& level = generator->m_Levels[band.level];
+		const MipFilterAxis& horizontal = level.horizontal;
+		const MipFilterAxis& vertical = level.vertical;
+		int stride = level.width * 4;
+
+		// Strip row of every source row the band reads; WRAP can reach the other edge,
+		// so the rows need not be contiguous
+		size_t tapCount = (size_t)band.rowCount * vertical.taps;
+		const int* sourceRows = &vertical.indices[(size_t)band.firstRow * vertical.taps];
+		std::vector<int> stripRow(generator->m_Height, -1);
+		std::vector<int> rows;
+		std::vector<int> indices(tapCount);
+		for (size_t i = 0; i < tapCount; ++i)
+		{
+			int& slot = stripRow[sourceRows[i]];
+			if (slot < 0)
+			{
+				slot = (int)rows.size();
+				rows.push_back(sourceRows[i]);
+			}
+			indices[i] = slot;
+		}
+
+		std::vector<float> strip(rows.size() * stride);
+		for (size_t r = 0; r < rows.size(); ++r)
+		{
+			const float* row = &generator->m_Source[(size_t)rows[r] * generator->m_Width * 4];
+			float* out = &strip[r * stride];
+			for (int x = 0; x < level.width; ++x)
+				MipAccumulate(row, &horizontal.indices[(size_t)x * horizontal.taps], &horizontal.weights[(size_t)x * horizontal.taps],
+					horizontal.taps, 4, out + x * 4);
+		}
+
+		for (int y = 0; y < band.rowCount; ++y)
+		{
+			const int* rowIndices = &indices[(size_t)y * vertical.taps];
+			const float* weights = &vertical.weights[(size_t)(band.firstRow + y) * vertical.taps];
+			float* out = &level.texels[(size_t)(band.firstRow + y) * stride];
+			for (int x = 0; x < level.width; ++x)
+				MipAccumulate(&strip[x * 4], rowIndices, weights, vertical.taps, stride, out + x * 4);
+		}
+	}
+
+	// Bisection on the alpha scale, coverage grows with it
+	static void CoverageJob(void* context, int index)
+	{
+		MipGenerator* generator = (MipGenerator*)context;
+		Level& level = generator->m_Levels[index];
+		size_t count = (size_t)level.width * level.height;
+		float low = 0.0f, high = 4.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float middle = 0.5f * (low + high);
+			if (generator->AlphaCoverage(&level.texels[0], count, middle) < generator->m_TopCoverage)
+				low = middle;
+			else
+				high = middle;
+		}
+		level.alphaScale = high;
+	}
+
+	static void EncodeJob(void* context, int index)
+	{
+		MipGenerator* generator = (MipGenerator*)context;
+		const MipOptions& options = generator->m_Options;
+		const Band& band = generator->m_Bands[index];
+		Level& level = generator->m_Levels[band.level];
+		size_t first = (size_t)band.firstRow * level.width, last = first + (size_t)band.rowCount * level.width;
+		for (size_t i = first; i < last; ++i)
+		{
+			const float* texel = &level.texels[i * 4];
+			unsigned char* out = level.output + i * 4;
+			float rgb[3] = { texel[0], texel[1], texel[2] };
+			if (options.normalMap)
+			{
+				float n[3] = { rgb[0] * 2.0f - 1.0f, rgb[1] * 2.0f - 1.0f, rgb[2] * 2.0f - 1.0f };
+				float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length < 1e-6f)
+					n[0] = n[1] = 0.0f, n[2] = length = 1.0f;
+				for (int c = 0; c < 3; ++c)
+					rgb[c] = n[c] / length * 0.5f + 0.5f;
+			}
+			for (int c = 0; c < 3; ++c)
+				out[c] = MipToUnorm8(options.srgb ? MipLinearToSRGB(std::max(rgb[c], 0.0f)) : rgb[c]);
+			out[3] = MipToUnorm8(texel[3] * level.alphaScale);
+		}
+	}
+
+	MipOptions m_Options;
+	int m_Width;
+	int m_Height;
+	std::vector<float> m_Source;		// top level, linear RGBA
+	float m_TopCoverage;
+	std::vector<Level> m_Levels;		// levels 1 and down
+	std::vector<Band> m_Bands;
+};
+
+inline void GenerateMips(const MipOptions& options, int width, int height, const unsigned char* rgba, SoftThreadPool* pool, std::vector<MipSurface>* levels)
+{
+	MipGenerator generator(options);
+	generator.Generate(width, height, rgba, pool, levels);
+}
@@ -0,0 +1,452 @@
+//--------------------------------------------------------------------------------------
+// File: png_reader.h
+//
+// Minimal PNG decoder for CPU-side tools (bakers, benchmarks, the headless renderer),
+// which have no D3DX11CreateShaderResourceViewFromFile to lean on.
+//
+// DecodePNG handles non-interlaced images of every color type at bit depth 8, 16-bit
+// channels (keeping the high byte) and palettes with tRNS transparency, and always
+// returns R8G8B8A8 rows like D3DX does for these files. Adam7 interlacing and bit
+// depths below 8 for non-palette images are rejected. Chunk CRCs and the zlib Adler-32
+// are not verified. The inflater follows RFC 1951 with canonical Huffman decoding.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#define PNG_COLOR_GRAY			0
+#define PNG_COLOR_RGB			2
+#define PNG_COLOR_PALETTE		3
+#define PNG_COLOR_GRAY_ALPHA	4
+#define PNG_COLOR_RGBA			6
+
+struct PNGImage
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int colorType;		// as stored in the file, PNG_COLOR_*
+	unsigned int bitDepth;
+	std::vector<unsigned char> rgba;	// width * height * 4 bytes, rows top to bottom
+};
+
+//--------------------------------------------------------------------------------------
+// Inflate
+//--------------------------------------------------------------------------------------
+class PNGInflater
+{
+public:
+	PNGInflater(const unsigned char* data, size_t size)
+		: m_Data(data), m_Size(size), m_Pos(0), m_BitBuffer(0), m_BitCount(0), m_Overrun(false) {}
+
+	// Decompresses a zlib stream (2 byte header, deflate blocks) into output
+	bool InflateZlib(std::vector<unsigned char>* output)
+	{
+		if (m_Size < 2 || (m_Data[0] & 0x0f) != 8 || ((m_Data[0] << 8) | m_Data[1]) % 31 != 0 || (m_Data[1] & 0x20))
+			return false;
+		m_Pos = 2;
+
+		bool last = false;
+		while (!last)
+		{
+			last = Bits(1) != 0;
+			unsigned int type = Bits(2);
+			bool ok;
+			if (type == 0)
+				ok = Stored(output);
+			else if (type == 1)
+				ok = FixedBlock(output);
+			else if (type == 2)
+				ok = DynamicBlock(output);
+			else
+				ok = false;
+			if (!ok || m_Overrun)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	enum { MAX_BITS = 15, MAX_LITERALS = 288, MAX_DISTANCES = 30 };
+
+	// Canonical code: number of codes of each length and the symbols in code order
+	struct Huffman
+	{
+		short count[MAX_BITS + 1];
+		short symbol[MAX_LITERALS];
+	};
+
+	unsigned int Bits(int need)
+	{
+		while (m_BitCount < need)
+		{
+			if (m_Pos >= m_Size)
+			{
+				m_Overrun = true;
+				return 0;
+			}
+			m_BitBuffer |= (unsigned int)m_Data[m_Pos++] << m_BitCount;
+			m_BitCount += 8;
+		}
+		unsigned int value = m_BitBuffer & ((1u << need) - 1);
+		m_BitBuffer >>= need;
+		m_BitCount -= need;
+		return value;
+	}
+
+	bool Stored(std::vector<unsigned char>* output)
+	{
+		m_BitBuffer = 0;
+		m_BitCount = 0;
+		if (m_Pos + 4 > m_Size)
+			return false;
+		unsigned int length = m_Data[m_Pos] | (m_Data[m_Pos + 1] << 8);
+		unsigned int check = m_Data[m_Pos + 2] | (m_Data[m_Pos + 3] << 8);
+		m_Pos += 4;
+		if (length != (~check & 0xffff) || m_Pos + length > m_Size)
+			return false;
+		output->insert(output->end(), m_Data + m_Pos, m_Data + m_Pos + length);
+		m_Pos += length;
+		return true;
+	}
+
+	// Returns false for an over-subscribed code; incomplete codes are allowed
+	static bool Build(Huffman* h, const unsigned char* lengths, int n)
+	{
+		memset(h->count, 0, sizeof(h->count));
+		for (int i = 0; i < n; ++i)
+			h->count[lengths[i]]++;
+		if (h->count[0] == n)
+			return true;
+
+		int left = 1;
+		for (int len = 1; len <= MAX_BITS; ++len)
+		{
+			left <<= 1;
+			left -= h->count[len];
+			if (left < 0)
+				return false;
+		}
+
+		short offsets[MAX_BITS + 1];
+		offsets[1] = 0;
+		for (int len = 1; len < MAX_BITS; ++len)
+			offsets[len + 1] = offsets[len] + h->count[len];
+		for (int i = 0; i < n; ++i)
+			if (lengths[i] != 0)
+				h->symbol[offsets[lengths[i]]++] = (short)i;
+		return true;
+	}
+
+	int Decode(const Huffman& h)
+	{
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len <= MAX_BITS; ++len)
+		{
+			code |= (int)Bits(1);
+			int count = h.count[len];
+			if (code - count < first)
+				return h.symbol[index + (code - first)];
+			index += count;
+			first += count;
+			first <<= 1;
+			code <<= 1;
+			if (m_Overrun)
+				break;
+		}
+		return -1;
+	}
+
+	bool Codes(std::vector<unsigned char>* output, const Huffman& lengthCode, const Huffman& distanceCode)
+	{
+		static const short lengthBase[29] = {
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const short lengthExtra[29] = {
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const short distanceBase[30] = {
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const short distanceExtra[30] = {
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		for (;;)
+		{
+			int symbol = Decode(lengthCode);
+			if (symbol < 0 || m_Overrun)
+				return false;
+			if (symbol < 256)
+				output->push_back((unsigned char)symbol);
+			else if (symbol == 256)
+				return true;
+			else
+			{
+				symbol -= 257;
+				if (symbol >= 29)
+					return false;
+				size_t length = lengthBase[symbol] + Bits(lengthExtra[symbol]);
+				int distanceSymbol = Decode(distanceCode);
+				if (distanceSymbol < 0 || distanceSymbol >= 30)
+					return false;
+				size_t distance = distanceBase[distanceSymbol] + Bits(distanceExtra[distanceSymbol]);
+				if (distance > output->size())
+					return false;
+				// Byte by byte: the source may overlap what is being written
+				size_t from = output->size() - distance;
+				for (size_t i = 0; i < length; ++i)
+					output->push_back((*output)[from + i]);
+			}
+		}
+	}
+
+	bool FixedBlock(std::vector<unsigned char>* output)
+	{
+		unsigned char lengths[MAX_LITERALS];
+		int i = 0;
+		for (; i < 144; ++i) lengths[i] = 8;
+		for (; i < 256; ++i) lengths[i] = 9;
+		for (; i < 280; ++i) lengths[i] = 7;
+		for (; i < 288; ++i) lengths[i] = 8;
+		Huffman lengthCode, distanceCode;
+		Build(&lengthCode, lengths, 288);
+		for (i = 0; i < 30; ++i)
+			lengths[i] = 5;
+		Build(&distanceCode, lengths, 30);
+		return Codes(output, lengthCode, distanceCode);
+	}
+
+	bool DynamicBlock(std::vector<unsigned char>* output)
+	{
+		static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int literalCount = Bits(5) + 257;
+		int distanceCount = Bits(5) + 1;
+		int codeCount = Bits(4) + 4;
+		if (literalCount > 286 || distanceCount > 30)
+			return false;
+
+		unsigned char lengths[MAX_LITERALS + MAX_DISTANCES];
+		memset(lengths, 0, sizeof(lengths));
+		for (int i = 0; i < codeCount; ++i)
+			lengths[order[i]] = (unsigned char)Bits(3);
+		Huffman lengthCode, distanceCode;
+		if (!Build(&lengthCode, lengths, 19))
+			return false;
+
+		int index = 0;
+		while (index < literalCount + distanceCount)
+		{
+			int symbol = Decode(lengthCode);
+			if (symbol < 0 || m_Overrun)
+				return false;
+			if (symbol < 16)
+			{
+				lengths[index++] = (unsigned char)symbol;
+				continue;
+			}
+			unsigned char repeat = 0;
+			int times;
+			if (symbol == 16)
+			{
+				if (index == 0)
+					return false;
+				repeat = lengths[index - 1];
+				times = 3 + Bits(2);
+			}
+			else if (symbol == 17)
+				times = 3 + Bits(3);
+			else
+				times = 11 + Bits(7);
+			if (index + times > literalCount + distanceCount)
+				return false;
+			while (times--)
+				lengths[index++] = repeat;
+		}
+		if (lengths[256] == 0)
+			return false;
+
+		if (!Build(&lengthCode, lengths, literalCount) || !Build(&distanceCode, lengths + literalCount, distanceCount))
+			return false;
+		return Codes(output, lengthCode, distanceCode);
+	}
+
+	const unsigned char* m_Data;
+	size_t m_Size;
+	size_t m_Pos;
+	unsigned int m_BitBuffer;
+	int m_BitCount;
+	bool m_Overrun;
+};
+
+//--------------------------------------------------------------------------------------
+// Decoder
+//--------------------------------------------------------------------------------------
+inline unsigned int PNGReadU32(const unsigned char* p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+inline unsigned char PNGPaeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = p > a ? p - a : a - p;
+	int pb = p > b ? p - b : b - p;
+	int pc = p > c ? p - c : c - p;
+	if (pa <= pb && pa <= pc)
+		return (unsigned char)a;
+	return (unsigned char)(pb <= pc ? b : c);
+}
+
+// Undoes the per-row filters in place; rows are 1 filter byte plus rowBytes
+inline bool PNGUnfilter(unsigned char* data, unsigned int rows, size_t rowBytes, unsigned int bytesPerPixel)
+{
+	const unsigned char* previous = NULL;
+	for (unsigned int y = 0; y < rows; ++y)
+	{
+		unsigned char* row = data + y * (rowBytes + 1);
+		unsigned char filter = row[0];
+		unsigned char* p = row + 1;
+		for (size_t x = 0; x < rowBytes; ++x)
+		{
+			int a = x >= bytesPerPixel ? p[x - bytesPerPixel] : 0;
+			int b = previous ? previous[x] : 0;
+			int c = previous && x >= bytesPerPixel ? previous[x - bytesPerPixel] : 0;
+			switch (filter)
+			{
+			case 0: break;
+			case 1: p[x] = (unsigned char)(p[x] + a); break;
+			case 2: p[x] = (unsigned char)(p[x] + b); break;
+			case 3: p[x] = (unsigned char)(p[x] + ((a + b) >> 1)); break;
+			case 4: p[x] = (unsigned char)(p[x] + PNGPaeth(a, b, c)); break;
+			default: return false;
+			}
+		}
+		previous = p;
+	}
+	return true;
+}
+
+// Width and height from the IHDR chunk, without decoding anything
+inline bool ReadPNGSize(const unsigned char* data, size_t size, unsigned int* width, unsigned int* height)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (size < 8 + 8 + 13 || memcmp(data, signature, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0)
+		return false;
+	*width = PNGReadU32(data + 16);
+	*height = PNGReadU32(data + 20);
+	return true;
+}
+
+inline bool DecodePNG(const unsigned char* data, size_t size, PNGImage* image)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (size < 8 || memcmp(data, signature, 8) != 0)
+		return false;
+
+	std::vector<unsigned char> compressed;
+	unsigned char palette[256][4];
+	memset(palette, 255, sizeof(palette));
+	bool haveHeader = false;
+	unsigned int interlace = 0;
+
+	size_t pos = 8;
+	while (pos + 12 <= size)
+	{
+		unsigned int length = PNGReadU32(data + pos);
+		const unsigned char* type = data + pos + 4;
+		const unsigned char* chunk = data + pos + 8;
+		if (length > size - pos - 12)
+			return false;
+
+		if (!memcmp(type, "IHDR", 4) && length >= 13)
+		{
+			image->width = PNGReadU32(chunk);
+			image->height = PNGReadU32(chunk + 4);
+			image->bitDepth = chunk[8];
+			image->colorType = chunk[9];
+			interlace = chunk[12];
+			haveHeader = true;
+		}
+		else if (!memcmp(type, "PLTE", 4))
+		{
+			for (unsigned int i = 0; i < length / 3 && i < 256; ++i)
+			{
+				palette[i][0] = chunk[i * 3];
+				palette[i][1] = chunk[i * 3 + 1];
+				palette[i][2] = chunk[i * 3 + 2];
+			}
+		}
+		else if (!memcmp(type, "tRNS", 4) && haveHeader && image->colorType == PNG_COLOR_PALETTE)
+		{
+			for (unsigned int i = 0; i < length && i < 256; ++i)
+				palette[i][3] = chunk[i];
+		}
+		else if (!memcmp(type, "IDAT", 4))
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		else if (!memcmp(type, "IEND", 4))
+			break;
+		pos += 12 + length;
+	}
+
+	if (!haveHeader || interlace != 0 || image->width == 0 || image->height == 0 || compressed.empty())
+		return false;
+
+	unsigned int channels;
+	switch (image->colorType)
+	{
+	case PNG_COLOR_GRAY: channels = 1; break;
+	case PNG_COLOR_RGB: channels = 3; break;
+	case PNG_COLOR_PALETTE: channels = 1; break;
+	case PNG_COLOR_GRAY_ALPHA: channels = 2; break;
+	case PNG_COLOR_RGBA: channels = 4; break;
+	default: return false;
+	}
+	bool palettized = image->colorType == PNG_COLOR_PALETTE;
+	if (palettized ? image->bitDepth > 8 : (image->bitDepth != 8 && image->bitDepth != 16))
+		return false;
+
+	size_t rowBytes = ((size_t)image->width * channels * image->bitDepth + 7) / 8;
+	unsigned int bytesPerPixel = std::max(1u, channels * image->bitDepth / 8);
+
+	std::vector<unsigned char> raw;
+	raw.reserve((rowBytes + 1) * image->height);
+	PNGInflater inflater(&compressed[0], compressed.size());
+	if (!inflater.InflateZlib(&raw) || raw.size() < (rowBytes + 1) * image->height)
+		return false;
+	if (!PNGUnfilter(&raw[0], image->height, rowBytes, bytesPerPixel))
+		return false;
+
+	image->rgba.resize((size_t)image->width * image->height * 4);
+	unsigned int sampleBytes = image->bitDepth == 16 ? 2 : 1;
+	for (unsigned int y = 0; y < image->height; ++y)
+	{
+		const unsigned char* row = &raw[y * (rowBytes + 1) + 1];
+		unsigned char* out = &image->rgba[(size_t)y * image->width * 4];
+		for (unsigned int x = 0; x < image->width; ++x, out += 4)
+		{
+			if (palettized)
+			{
+				unsigned int bit = x * image->bitDepth;
+				unsigned int index = (row[bit >> 3] >> (8 - image->bitDepth - (bit & 7))) & ((1u << image->bitDepth) - 1);
+				memcpy(out, palette[index], 4);
+				continue;
+			}
+			// High byte of 16 bit samples, PNG is big endian
+			const unsigned char* p = row + (size_t)x * channels * sampleBytes;
+			unsigned char c[4];
+			for (unsigned int i = 0; i < channels; ++i)
+				c[i] = p[i * sampleBytes];
+			switch (channels)
+			{
+			case 1: out[0] = out[1] = out[2] = c[0]; out[3] = 255; break;
+			case 2: out[0] = out[1] = out[2] = c[0]; out[3] = c[1]; break;
+			case 3: out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = 255; break;
+			default: memcpy(out, c, 4); break;
+			}
+		}
+	}
+	return true;
+}
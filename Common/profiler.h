@@ -0,0 +1,348 @@
+//--------------------------------------------------------------------------------------
+// File: profiler.h
+//
+// Scoped CPU markers for finding out where each frame's milliseconds go.
+//
+// PROFILE_SCOPE("Name") times the enclosing block. Markers nest. Each thread writes
+// finished markers into its own ring buffer, so recording a marker takes no lock; only
+// the first marker on a thread registers its ring with the profiler. When a ring is
+// full the oldest markers are overwritten, so a long session keeps its most recent
+// PROFILER_RING_EVENTS markers per thread.
+//
+// WriteChromeTrace() saves the rings as Chrome trace_event JSON (open it in
+// chrome://tracing or Perfetto). SummaryTable() lists count, min, avg, p99 and max for
+// every marker name. Both read every ring, so call them while no other thread records
+// markers, e.g. at shutdown.
+//
+// Timestamps come from QueryPerformanceCounter on Windows, like the samples' frame
+// timer, and from clock_gettime(CLOCK_MONOTONIC) elsewhere. Define PROFILER_DISABLED to
+// compile the markers out.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define PROFILER_RING_EVENTS	65536
+
+// Visual C++ 2013 has no thread_local keyword
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL	__declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL	__thread
+#endif
+
+struct ProfileEvent
+{
+	const char* name;		// must outlive the profiler, normally a string literal
+	long long begin;		// in ticks of Profiler::Now()
+	long long end;
+	unsigned int depth;		// number of enclosing markers on the same thread
+};
+
+struct ProfileMarkerStats
+{
+	std::string name;
+	unsigned int count;
+	double minMs;
+	double avgMs;
+	double p99Ms;
+	double maxMs;
+	double totalMs;
+};
+
+class ProfileThread
+{
+public:
+	explicit ProfileThread(unsigned int threadId)
+		: m_Events(PROFILER_RING_EVENTS), m_Written(0), m_ThreadId(threadId), m_Depth(0)
+	{
+	}
+
+	unsigned int Enter() { return m_Depth++; }
+
+	void Leave(const char* name, long long begin, long long end, unsigned int depth)
+	{
+		ProfileEvent& event = m_Events[(size_t)(m_Written % PROFILER_RING_EVENTS)];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		event.depth = depth;
+		m_Written++;
+		m_Depth--;
+	}
+
+	unsigned int ThreadId() const { return m_ThreadId; }
+
+	// Markers still in the ring, oldest first
+	size_t EventCount() const { return (size_t)std::min<unsigned long long>(m_Written, PROFILER_RING_EVENTS); }
+	const ProfileEvent& Event(size_t i) const
+	{
+		return m_Events[(size_t)((m_Written - EventCount() + i) % PROFILER_RING_EVENTS)];
+	}
+
+private:
+	std::vector<ProfileEvent> m_Events;
+	unsigned long long m_Written;
+	unsigned int m_ThreadId;
+	unsigned int m_Depth;
+};
+
+class Profiler
+{
+public:
+	static Profiler& Instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	static long long Now()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+#else
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+	}
+
+	static double TicksPerSecond()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return double(frequency.QuadPart);
+#else
+		return 1000000000.0;
+#endif
+	}
+
+	// The calling thread's ring, created on its first marker
+	static ProfileThread* ThisThread()
+	{
+		static PROFILER_THREAD_LOCAL ProfileThread* thread = NULL;
+		if (thread == NULL)
+			thread = Instance().Register();
+		return thread;
+	}
+
+	bool WriteChromeTrace(const char* fileName) const
+	{
+		FILE* file = fopen(fileName, "w");
+		if (file == NULL)
+			return false;
+
+		// Chrome wants microseconds, relative to the first marker keeps the numbers short
+		double usPerTick = 1000000.0 / TicksPerSecond();
+		long long origin = FirstTimestamp();
+
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		for (size_t t = 0; t < m_Threads.size(); ++t)
+		{
+			const ProfileThread& thread = *m_Threads[t];
+			for (size_t i = 0; i < thread.EventCount(); ++i)
+			{
+				const ProfileEvent& event = thread.Event(i);
+				fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+				WriteEscaped(file, event.name);
+				fprintf(file, "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+					thread.ThreadId(), (event.begin - origin) * usPerTick, (event.end - event.begin) * usPerTick, event.depth);
+				first = false;
+			}
+		}
+		fprintf(file, "\n]}\n");
+
+		bool ok = ferror(file) == 0;
+		fclose(file);
+		return ok;
+	}
+
+	// One entry per marker name, sorted by total time, largest first
+	std::vector<ProfileMarkerStats> MarkerStats() const
+	{
+		double msPerTick = 1000.0 / TicksPerSecond();
+		std::map<std::string, std::vector<double> > durations;
+		for (size_t t = 0; t < m_Threads.size(); ++t)
+		{
+			const ProfileThread& thread = *m_Threads[t];
+			for (size_t i = 0; i < thread.EventCount(); ++i)
+			{
+				const ProfileEvent& event = thread.Event(i);
+				durations[event.name].push_back((event.end - event.begin) * msPerTick);
+			}
+		}
+
+		std::vector<ProfileMarkerStats> result;
+		for (std::map<std::string, std::vector<double> >::iterator it = durations.begin(); it != durations.end(); ++it)
+		{
+			std::vector<double>& times = it->second;
+			std::sort(times.begin(), times.end());
+
+			ProfileMarkerStats stats;
+			stats.name = it->first;
+			stats.count = (unsigned int)times.size();
+			stats.totalMs = 0.0;
+			for (size_t i = 0; i < times.size(); ++i)
+				stats.totalMs += times[i];
+			stats.minMs = times.front();
+			stats.maxMs = times.back();
+			stats.avgMs = stats.totalMs / times.size();
+			// Nearest rank: the smallest time that at least 99% of the markers don't exceed
+			size_t rank = (times.size() * 99 + 99) / 100;
+			stats.p99Ms = times[rank - 1];
+			result.push_back(stats);
+		}
+		std::sort(result.begin(), result.end(), LargerTotal);
+		return result;
+	}
+
+	std::string SummaryTable() const
+	{
+		std::vector<ProfileMarkerStats> markers = MarkerStats();
+		std::string table;
+		char line[256];
+		sprintf(line, "%-32s %8s %10s %10s %10s %10s %12s\n", "marker", "count", "min ms", "avg ms", "p99 ms", "max ms", "total ms");
+		table += line;
+		for (size_t i = 0; i < markers.size(); ++i)
+		{
+			const ProfileMarkerStats& m = markers[i];
+			sprintf(line, "%-32.32s %8u %10.3f %10.3f %10.3f %10.3f %12.3f\n",
+				m.name.c_str(), m.count, m.minMs, m.avgMs, m.p99Ms, m.maxMs, m.totalMs);
+			table += line;
+		}
+		return table;
+	}
+
+	~Profiler()
+	{
+		for (size_t t = 0; t < m_Threads.size(); ++t)
+			delete m_Threads[t];
+#ifdef _WIN32
+		DeleteCriticalSection(&m_Lock);
+#else
+		pthread_mutex_destroy(&m_Lock);
+#endif
+	}
+
+private:
+	Profiler()
+	{
+#ifdef _WIN32
+		InitializeCriticalSection(&m_Lock);
+#else
+		pthread_mutex_init(&m_Lock, NULL);
+#endif
+	}
+
+	ProfileThread* Register()
+	{
+#ifdef _WIN32
+		ProfileThread* thread = new ProfileThread(GetCurrentThreadId());
+		EnterCriticalSection(&m_Lock);
+		m_Threads.push_back(thread);
+		LeaveCriticalSection(&m_Lock);
+#else
+		ProfileThread* thread = new ProfileThread((unsigned int)syscall(SYS_gettid));
+		pthread_mutex_lock(&m_Lock);
+		m_Threads.push_back(thread);
+		pthread_mutex_unlock(&m_Lock);
+#endif
+		return thread;
+	}
+
+	long long FirstTimestamp() const
+	{
+		long long first = 0;
+		bool found = false;
+		for (size_t t = 0; t < m_Threads.size(); ++t)
+		{
+			const ProfileThread& thread = *m_Threads[t];
+			for (size_t i = 0; i < thread.EventCount(); ++i)
+			{
+				if (!found || thread.Event(i).begin < first)
+					first = thread.Event(i).begin;
+				found = true;
+			}
+		}
+		return first;
+	}
+
+	static void WriteEscaped(FILE* file, const char* text)
+	{
+		for (; *text; ++text)
+		{
+			if (*text == '"' || *text == '\\')
+				fputc('\\', file);
+			fputc(*text, file);
+		}
+	}
+
+	static bool LargerTotal(const ProfileMarkerStats& a, const ProfileMarkerStats& b)
+	{
+		return a.totalMs > b.totalMs;
+	}
+
+	Profiler(const Profiler&);
+	Profiler& operator=(const Profiler&);
+
+	std::vector<ProfileThread*> m_Threads;
+#ifdef _WIN32
+	CRITICAL_SECTION m_Lock;
+#else
+	pthread_mutex_t m_Lock;
+#endif
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name)
+		: m_Thread(Profiler::ThisThread()), m_Name(name)
+	{
+		m_Depth = m_Thread->Enter();
+		m_Begin = Profiler::Now();
+	}
+
+	~ProfileScope()
+	{
+		m_Thread->Leave(m_Name, m_Begin, Profiler::Now(), m_Depth);
+	}
+
+private:
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+
+	ProfileThread* m_Thread;
+	const char* m_Name;
+	long long m_Begin;
+	unsigned int m_Depth;
+};
+
+#define PROFILE_CONCAT_(a, b)	a##b
+#define PROFILE_CONCAT(a, b)	PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name)		ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#endif
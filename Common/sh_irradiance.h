@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// File: sh_irradiance.h
+//
+// Diffuse ambient from an environment map as 9 spherical harmonics coefficients
+// (bands 0-2, Ramamoorthi and Hanrahan, "An Efficient Representation for Irradiance
+// Environment Maps").
+//
+// The coefficients are stored already convolved with the clamped cosine and divided
+// by pi, so for a normal n, ShIrradiance(n) is what a white Lambertian surface
+// reflects: multiply by the albedo and it is the ambient term. Order and constants
+// match ShIrradiance in D3D11_sky_mapping/Effects.fx:
+//   0: 1, 1: y, 2: z, 3: x, 4: xy, 5: yz, 6: 3z^2 - 1, 7: xz, 8: x^2 - y^2
+//
+// The sidecar written next to a baked cube map is text: '#' comment lines, then 9
+// lines of "r g b".
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+
+#define SH_COEFFICIENTS	9
+
+struct SHIrradiance
+{
+	float rgb[SH_COEFFICIENTS][3];
+};
+
+inline void SHBasis(const float n[3], float basis[SH_COEFFICIENTS])
+{
+	float x = n[0], y = n[1], z = n[2];
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * y;
+	basis[2] = 0.488603f * z;
+	basis[3] = 0.488603f * x;
+	basis[4] = 1.092548f * x * y;
+	basis[5] = 1.092548f * y * z;
+	basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	basis[7] = 1.092548f * x * z;
+	basis[8] = 0.546274f * (x * x - y * y);
+}
+
+// n must be normalized
+inline void EvaluateSHIrradiance(const SHIrradiance& sh, const float n[3], float rgb[3])
+{
+	float basis[SH_COEFFICIENTS];
+	SHBasis(n, basis);
+	rgb[0] = rgb[1] = rgb[2] = 0.0f;
+	for (int i = 0; i < SH_COEFFICIENTS; ++i)
+		for (int c = 0; c < 3; ++c)
+			rgb[c] += sh.rgb[i][c] * basis[i];
+}
+
+// A constant ambient colour, for when there is no sidecar
+inline void SetSHConstant(const float rgb[3], SHIrradiance* sh)
+{
+	for (int i = 0; i < SH_COEFFICIENTS; ++i)
+		for (int c = 0; c < 3; ++c)
+			sh->rgb[i][c] = i == 0 ? rgb[c] / 0.282095f : 0.0f;
+}
+
+inline bool WriteSHIrradiance(const char* fileName, const SHIrradiance& sh, const char* source)
+{
+	FILE* file = fopen(fileName, "w");
+	if (file == NULL)
+		return false;
+	fprintf(file, "# SH irradiance / pi of %s, see Common/sh_irradiance.h\n", source);
+	for (int i = 0; i < SH_COEFFICIENTS; ++i)
+		fprintf(file, "%.6f %.6f %.6f\n", sh.rgb[i][0], sh.rgb[i][1], sh.rgb[i][2]);
+	return fclose(file) == 0;
+}
+
+inline bool ReadSHIrradiance(const char* fileName, SHIrradiance* sh)
+{
+	FILE* file = fopen(fileName, "r");
+	if (file == NULL)
+		return false;
+	char line[256];
+	int count = 0;
+	while (count < SH_COEFFICIENTS && fgets(line, sizeof(line), file) != NULL)
+	{
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%f %f %f", &sh->rgb[count][0], &sh->rgb[count][1], &sh->rgb[count][2]) != 3)
+			break;
+		count++;
+	}
+	fclose(file);
+	return count == SH_COEFFICIENTS;
+}
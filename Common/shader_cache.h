@@ -0,0 +1,304 @@
+//--------------------------------------------------------------------------------------
+// File: shader_cache.h
+//
+// Persistent cache for compiled shader bytecode.
+//
+// An entry is keyed by a hash of the preprocessed source (so every #include counts),
+// plus the entry point, profile, compile flags and defines. Each entry is stored in
+// its own file in the cache directory. A launch with unchanged sources preprocesses
+// each effect file once and then reads bytecode from disk. Only entries whose inputs
+// changed are compiled again.
+//
+// The compiler is a ShaderCompiler implementation, so the cache logic itself needs no
+// Direct3D. D3DShaderCompiler (Windows only) wraps D3DX11 preprocessing and D3DCompile.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define SHADER_CACHE_MAGIC		0x43444853	// "SHDC"
+#define SHADER_CACHE_VERSION	1
+
+// Same layout as D3D10_SHADER_MACRO, arrays end with a { NULL, NULL } entry
+struct ShaderDefine
+{
+	const char* name;
+	const char* definition;
+};
+
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() {}
+
+	// Expand #include directives and defines; the result is what the cache hashes
+	virtual bool Preprocess(const wchar_t* fileName, const ShaderDefine* defines, std::string* text, std::string* errors) = 0;
+	virtual bool Compile(const std::string& text, const char* sourceName, const char* entryPoint, const char* profile,
+		unsigned int flags, std::vector<unsigned char>* bytecode, std::string* errors) = 0;
+};
+
+struct ShaderCacheStats
+{
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int failures;
+	double preprocessMs;
+	double loadMs;
+	double compileMs;
+};
+
+struct ShaderCacheFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int bytecodeSize;
+	unsigned int pad;
+};
+
+class ShaderCache
+{
+public:
+	ShaderCache(ShaderCompiler* compiler, const std::string& directory)
+		: m_Compiler(compiler), m_Directory(directory)
+	{
+		memset(&m_Stats, 0, sizeof(m_Stats));
+	}
+
+	const ShaderCacheStats& Stats() const { return m_Stats; }
+
+	bool GetBytecode(const wchar_t* fileName, const char* entryPoint, const char* profile, unsigned int flags,
+		const ShaderDefine* defines, std::vector<unsigned char>* bytecode, std::string* errors)
+	{
+		// Effects usually hold several entry points, preprocess each file/define set only once
+		std::wstring sourceKey = fileName;
+		for (const ShaderDefine* define = defines; define && define->name; ++define)
+		{
+			std::string text = std::string("|") + define->name + "=" + (define->definition ? define->definition : "");
+			sourceKey.append(text.begin(), text.end());
+		}
+
+		std::map<std::wstring, std::string>::iterator source = m_Sources.find(sourceKey);
+		if (source == m_Sources.end())
+		{
+			Clock::time_point start = Clock::now();
+			std::string text;
+			if (!m_Compiler->Preprocess(fileName, defines, &text, errors))
+			{
+				m_Stats.failures++;
+				return false;
+			}
+			m_Stats.preprocessMs += Milliseconds(start);
+			source = m_Sources.insert(std::make_pair(sourceKey, text)).first;
+		}
+
+		unsigned long long key = Hash(source->second.data(), source->second.size());
+		key = Hash(entryPoint, strlen(entryPoint) + 1, key);
+		key = Hash(profile, strlen(profile) + 1, key);
+		key = Hash(&flags, sizeof(flags), key);
+		for (const ShaderDefine* define = defines; define && define->name; ++define)
+		{
+			key = Hash(define->name, strlen(define->name) + 1, key);
+			if (define->definition)
+				key = Hash(define->definition, strlen(define->definition) + 1, key);
+		}
+
+		char name[32];
+		sprintf(name, "/%016llx.cso", key);
+		std::string cacheFile = m_Directory + name;
+
+		Clock::time_point start = Clock::now();
+		if (Load(cacheFile, key, bytecode))
+		{
+			m_Stats.hits++;
+			m_Stats.loadMs += Milliseconds(start);
+			return true;
+		}
+
+		std::string sourceName(fileName, fileName + wcslen(fileName));
+		if (!m_Compiler->Compile(source->second, sourceName.c_str(), entryPoint, profile, flags, bytecode, errors))
+		{
+			m_Stats.failures++;
+			return false;
+		}
+		m_Stats.misses++;
+		m_Stats.compileMs += Milliseconds(start);
+
+		Save(cacheFile, key, *bytecode);
+		return true;
+	}
+
+	static unsigned long long Hash(const void* data, size_t size, unsigned long long hash = 14695981039346656037ULL)
+	{
+		// FNV-1a
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	static double Milliseconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	bool Load(const std::string& cacheFile, unsigned long long key, std::vector<unsigned char>* bytecode)
+	{
+		FILE* file = fopen(cacheFile.c_str(), "rb");
+		if (file == NULL)
+			return false;
+
+		ShaderCacheFileHeader header;
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+			header.magic == SHADER_CACHE_MAGIC &&
+			header.version == SHADER_CACHE_VERSION &&
+			header.key == key &&
+			header.bytecodeSize > 0;
+		if (ok)
+		{
+			bytecode->resize(header.bytecodeSize);
+			ok = fread(&(*bytecode)[0], header.bytecodeSize, 1, file) == 1;
+		}
+		fclose(file);
+		return ok;
+	}
+
+	void Save(const std::string& cacheFile, unsigned long long key, const std::vector<unsigned char>& bytecode)
+	{
+		if (bytecode.empty())
+			return;
+#ifdef _WIN32
+		CreateDirectoryA(m_Directory.c_str(), NULL);
+#else
+		mkdir(m_Directory.c_str(), 0755);
+#endif
+		FILE* file = fopen(cacheFile.c_str(), "wb");
+		if (file == NULL)
+			return;
+
+		ShaderCacheFileHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = SHADER_CACHE_MAGIC;
+		header.version = SHADER_CACHE_VERSION;
+		header.key = key;
+		header.bytecodeSize = (unsigned int)bytecode.size();
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(&bytecode[0], bytecode.size(), 1, file) == 1;
+		fclose(file);
+
+		// A short entry would only be rejected on load, don't leave it around
+		if (!ok)
+			remove(cacheFile.c_str());
+	}
+
+	ShaderCompiler* m_Compiler;
+	std::string m_Directory;
+	std::map<std::wstring, std::string> m_Sources;
+	ShaderCacheStats m_Stats;
+};
+
+#ifdef _WIN32
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <d3dcompiler.h>
+#pragma comment(lib, "d3dcompiler.lib")
+
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	virtual bool Preprocess(const wchar_t* fileName, const ShaderDefine* defines, std::string* text, std::string* errors)
+	{
+		ID3D10Blob* textBlob = NULL;
+		ID3D10Blob* errorBlob = NULL;
+		HRESULT hr = D3DX11PreprocessShaderFromFileW(fileName, (const D3D10_SHADER_MACRO*)defines, NULL, NULL, &textBlob, &errorBlob, NULL);
+		return Finish(hr, textBlob, errorBlob, true, text, errors);
+	}
+
+	virtual bool Compile(const std::string& text, const char* sourceName, const char* entryPoint, const char* profile,
+		unsigned int flags, std::vector<unsigned char>* bytecode, std::string* errors)
+	{
+		// The text is already preprocessed, so no defines or include handler are needed
+		ID3D10Blob* codeBlob = NULL;
+		ID3D10Blob* errorBlob = NULL;
+		HRESULT hr = D3DCompile(text.data(), text.size(), sourceName, NULL, NULL, entryPoint, profile, flags, 0, &codeBlob, &errorBlob);
+		std::string code;
+		bool ok = Finish(hr, codeBlob, errorBlob, false, &code, errors);
+		bytecode->assign(code.begin(), code.end());
+		return ok;
+	}
+
+private:
+	static bool Finish(HRESULT hr, ID3D10Blob* result, ID3D10Blob* errorBlob, bool isText, std::string* output, std::string* errors)
+	{
+		if (errorBlob)
+		{
+			if (errors)
+				errors->assign((const char*)errorBlob->GetBufferPointer(), errorBlob->GetBufferSize());
+			errorBlob->Release();
+		}
+		if (result)
+		{
+			const char* data = (const char*)result->GetBufferPointer();
+			size_t size = result->GetBufferSize();
+			// Preprocessed text carries its terminating zero, keep it out of the hash
+			if (isText && size > 0 && data[size - 1] == '\0')
+				size--;
+			output->assign(data, size);
+			result->Release();
+		}
+		return SUCCEEDED(hr);
+	}
+};
+
+//--------------------------------------------------------------------------------------
+// Drop-in for D3DX11CompileFromFile: returns the bytecode as a blob, from the cache if possible
+//--------------------------------------------------------------------------------------
+inline HRESULT CompileShaderCached(ShaderCache* cache, const wchar_t* fileName, const char* entryPoint, const char* profile,
+	unsigned int flags, ID3D10Blob** ppBlobOut)
+{
+	std::vector<unsigned char> bytecode;
+	std::string errors;
+	if (!cache->GetBytecode(fileName, entryPoint, profile, flags, NULL, &bytecode, &errors))
+	{
+		if (!errors.empty())
+			OutputDebugStringA(errors.c_str());
+		return E_FAIL;
+	}
+
+	HRESULT hr = D3DCreateBlob(bytecode.size(), ppBlobOut);
+	if (FAILED(hr))
+		return hr;
+	memcpy((*ppBlobOut)->GetBufferPointer(), &bytecode[0], bytecode.size());
+	return S_OK;
+}
+
+inline void ReportShaderCacheStats(const ShaderCache& cache)
+{
+	const ShaderCacheStats& stats = cache.Stats();
+	char text_buffer[256] = { 0 }; //temporary buffer
+	sprintf_s(text_buffer, _countof(text_buffer), "ShaderCache: %u hits, %u misses, %u failures, preprocess %.3f ms, load %.3f ms, compile %.3f ms\n",
+		stats.hits, stats.misses, stats.failures, stats.preprocessMs, stats.loadMs, stats.compileMs);
+	OutputDebugStringA(text_buffer);
+}
+
+#endif
@@ -0,0 +1,812 @@
+//--------------------------------------------------------------------------------------
+// File: soft_rasterizer.h
+//
+// CPU implementation of the part of the Direct3D 11 pipeline the samples use, so their
+// scenes can be rendered without a device (headless builds, image regression runs).
+//
+// Covered: indexed TRIANGLELIST draws with 16 or 32 bit indices, any vertex layout
+// (the vertex shader reads its own struct), cull none/front/back with either winding,
+// depth tests with every comparison function, and blending with the usual
+// factors and BLEND_OP_ADD. State enums use the D3D11 values, so D3D11 descs can be
+// converted with casts.
+//
+// Shaders are C++ functions. A draw copies the caller's constants (the cbuffer plus
+// any texture pointers), so they can be changed between draws like UpdateSubresource.
+// Draws are deferred. Each one shades its vertices in parallel, clips to the near, far
+// and guard-band planes, snaps to a 1/16 pixel grid and bins the triangles into
+// SOFT_TILE_SIZE screen tiles. Flush() then rasterizes every tile on the thread pool.
+// Triangles in a tile are processed in submission order, so depth and blending
+// results match the API order. Coverage uses integer edge functions with the D3D
+// top-left fill rule, evaluated four pixels at a time with SSE2 where available.
+//
+// The render target is R8G8B8A8_UNORM and the depth buffer is 32 bit float. Pixel
+// shaders run after the depth test (none of the sample shaders discard or write depth).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_RASTERIZER_SSE2
+#endif
+
+#define SOFT_TILE_SIZE			64
+#define SOFT_MAX_VARYINGS		12
+#define SOFT_MAX_TARGET_SIZE	8192
+#define SOFT_SUBPIXEL_BITS		4
+#define SOFT_GUARD_BAND			2.0f	// clip-space x and y are clipped to +-2w
+
+//--------------------------------------------------------------------------------------
+// Pipeline state, values match D3D11_CULL_MODE, D3D11_COMPARISON_FUNC and D3D11_BLEND
+//--------------------------------------------------------------------------------------
+enum SoftCullMode
+{
+	SOFT_CULL_NONE = 1,
+	SOFT_CULL_FRONT = 2,
+	SOFT_CULL_BACK = 3,
+};
+
+enum SoftComparison
+{
+	SOFT_COMPARISON_NEVER = 1,
+	SOFT_COMPARISON_LESS = 2,
+	SOFT_COMPARISON_EQUAL = 3,
+	SOFT_COMPARISON_LESS_EQUAL = 4,
+	SOFT_COMPARISON_GREATER = 5,
+	SOFT_COMPARISON_NOT_EQUAL = 6,
+	SOFT_COMPARISON_GREATER_EQUAL = 7,
+	SOFT_COMPARISON_ALWAYS = 8,
+};
+
+enum SoftBlend
+{
+	SOFT_BLEND_ZERO = 1,
+	SOFT_BLEND_ONE = 2,
+	SOFT_BLEND_SRC_COLOR = 3,
+	SOFT_BLEND_INV_SRC_COLOR = 4,
+	SOFT_BLEND_SRC_ALPHA = 5,
+	SOFT_BLEND_INV_SRC_ALPHA = 6,
+	SOFT_BLEND_DEST_ALPHA = 7,
+	SOFT_BLEND_INV_DEST_ALPHA = 8,
+	SOFT_BLEND_DEST_COLOR = 9,
+	SOFT_BLEND_INV_DEST_COLOR = 10,
+};
+
+struct SoftRasterizerDesc
+{
+	SoftCullMode cullMode;
+	bool frontCounterClockwise;
+};
+
+struct SoftDepthStencilDesc
+{
+	bool depthEnable;
+	bool depthWriteEnable;
+	SoftComparison depthFunc;
+};
+
+// Render target 0 only, BLEND_OP_ADD for color and alpha
+struct SoftBlendDesc
+{
+	bool blendEnable;
+	SoftBlend srcBlend;
+	SoftBlend destBlend;
+	SoftBlend srcBlendAlpha;
+	SoftBlend destBlendAlpha;
+};
+
+// The states D3D11 uses when NULL is bound
+inline SoftRasterizerDesc SoftDefaultRasterizerDesc()
+{
+	SoftRasterizerDesc desc = { SOFT_CULL_BACK, false };
+	return desc;
+}
+
+inline SoftDepthStencilDesc SoftDefaultDepthStencilDesc()
+{
+	SoftDepthStencilDesc desc = { true, true, SOFT_COMPARISON_LESS };
+	return desc;
+}
+
+inline SoftBlendDesc SoftDefaultBlendDesc()
+{
+	SoftBlendDesc desc = { false, SOFT_BLEND_ONE, SOFT_BLEND_ZERO, SOFT_BLEND_ONE, SOFT_BLEND_ZERO };
+	return desc;
+}
+
+//--------------------------------------------------------------------------------------
+// Shader interface
+//--------------------------------------------------------------------------------------
+struct SoftVertexOutput
+{
+	float position[4];		// SV_POSITION, clip space
+	float varyings[SOFT_MAX_VARYINGS];
+};
+
+struct SoftPixelInput
+{
+	float position[4];		// SV_POSITION: pixel center x/y, depth, clip-space w
+	float varyings[SOFT_MAX_VARYINGS];
+};
+
+typedef void (*SoftVertexShader)(const void* constants, const void* vertex, SoftVertexOutput* output);
+typedef void (*SoftPixelShader)(const void* constants, const SoftPixelInput& input, float color[4]);
+
+//--------------------------------------------------------------------------------------
+// Renderer
+//--------------------------------------------------------------------------------------
+struct SoftRenderStats
+{
+	unsigned int draws;
+	unsigned int trianglesSubmitted;
+	unsigned int trianglesCulled;		// back/front face culled or zero area
+	unsigned int trianglesClipped;		// needed clipping against at least one plane
+	unsigned int trianglesBinned;		// after clipping, culling and off-screen rejection
+	unsigned int tileEntries;			// sum over triangles of the tiles they touch
+	unsigned long long pixelsShaded;
+	unsigned long long queryPixelsShaded;	// by draws between BeginQuery and EndQuery
+};
+
+class SoftRenderer
+{
+public:
+	// threadCount as for SoftThreadPool, 0 uses every hardware thread
+	SoftRenderer(int width, int height, int threadCount)
+		: m_Pool(threadCount), m_VertexShader(NULL), m_PixelShader(NULL), m_VaryingCount(0),
+		m_VertexData(NULL), m_VertexStride(0), m_IndexData(NULL), m_IndexIs16Bit(false), m_Querying(false)
+	{
+		m_Width = std::min(std::max(width, 1), SOFT_MAX_TARGET_SIZE);
+		m_Height = std::min(std::max(height, 1), SOFT_MAX_TARGET_SIZE);
+		m_TilesX = (m_Width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		m_TilesY = (m_Height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		m_Color.assign((size_t)m_Width * m_Height, 0);
+		m_Depth.assign((size_t)m_Width * m_Height, 1.0f);
+		m_Tiles.resize(m_TilesX * m_TilesY);
+		m_TileShaded.assign(m_TilesX * m_TilesY, 0);
+		m_TileQueryShaded.assign(m_TilesX * m_TilesY, 0);
+		m_Rasterizer = SoftDefaultRasterizerDesc();
+		m_DepthStencil = SoftDefaultDepthStencilDesc();
+		m_Blend = SoftDefaultBlendDesc();
+		memset(&m_Stats, 0, sizeof(m_Stats));
+	}
+
+	int Width() const { return m_Width; }
+	int Height() const { return m_Height; }
+	int ThreadCount() const { return m_Pool.ThreadCount(); }
+
+	// NULL restores the default state, like binding NULL in D3D11
+	void SetRasterizerState(const SoftRasterizerDesc* desc) { m_Rasterizer = desc ? *desc : SoftDefaultRasterizerDesc(); }
+	void SetDepthStencilState(const SoftDepthStencilDesc* desc) { m_DepthStencil = desc ? *desc : SoftDefaultDepthStencilDesc(); }
+	void SetBlendState(const SoftBlendDesc* desc) { m_Blend = desc ? *desc : SoftDefaultBlendDesc(); }
+
+	// varyingCount is how many floats of SoftVertexOutput::varyings the shader writes
+	void SetVertexShader(SoftVertexShader shader, int varyingCount)
+	{
+		m_VertexShader = shader;
+		m_VaryingCount = std::min(std::max(varyingCount, 0), SOFT_MAX_VARYINGS);
+	}
+	void SetPixelShader(SoftPixelShader shader) { m_PixelShader = shader; }
+
+	// Pixels shaded by the draws in between also go to queryPixelsShaded, like the
+	// PSInvocations of a D3D11 pipeline statistics query around them
+	void BeginQuery() { m_Querying = true; }
+	void EndQuery() { m_Querying = false; }
+
+	// Copied at every draw, so the caller's struct can change between draws
+	void SetConstants(const void* data, size_t size)
+	{
+		m_Constants.assign((const unsigned char*)data, (const unsigned char*)data + size);
+	}
+
+	void SetVertexBuffer(const void* data, unsigned int stride)
+	{
+		m_VertexData = (const unsigned char*)data;
+		m_VertexStride = stride;
+	}
+
+	void SetIndexBuffer(const void* data, bool is16Bit)
+	{
+		m_IndexData = data;
+		m_IndexIs16Bit = is16Bit;
+	}
+
+	void ClearRenderTarget(const float color[4])
+	{
+		Flush();
+		std::fill(m_Color.begin(), m_Color.end(), PackColor(color));
+	}
+
+	void ClearDepth(float depth)
+	{
+		Flush();
+		std::fill(m_Depth.begin(), m_Depth.end(), depth);
+	}
+
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+	{
+		if (m_VertexShader == NULL || m_PixelShader == NULL || m_VertexData == NULL || m_IndexData == NULL)
+			return;
+
+		unsigned int triangleCount = indexCount / 3;
+		m_Stats.draws++;
+		m_Stats.trianglesSubmitted += triangleCount;
+		if (triangleCount == 0)
+			return;
+
+		// Snapshot the state for the tiles to use at Flush()
+		DrawCall draw;
+		draw.rasterizer = m_Rasterizer;
+		draw.depthStencil = m_DepthStencil;
+		draw.blend = m_Blend;
+		draw.pixelShader = m_PixelShader;
+		draw.varyingCount = m_VaryingCount;
+		draw.queried = m_Querying;
+		draw.constants.resize(m_Constants.size() + 16);
+		if (!m_Constants.empty())
+			memcpy(draw.Constants(), &m_Constants[0], m_Constants.size());
+		m_Draws.push_back(draw);
+		int drawIndex = (int)m_Draws.size() - 1;
+
+		// Shade every vertex the draw references, in parallel blocks
+		unsigned int minIndex = 0xffffffff, maxIndex = 0;
+		for (unsigned int i = 0; i < triangleCount * 3; ++i)
+		{
+			unsigned int index = FetchIndex(startIndex + i);
+			minIndex = std::min(minIndex, index);
+			maxIndex = std::max(maxIndex, index);
+		}
+		VertexJob job;
+		job.renderer = this;
+		job.constants = m_Draws[drawIndex].Constants();
+		job.firstVertex = (int)minIndex + baseVertex;
+		job.count = (int)(maxIndex - minIndex + 1);
+		m_Shaded.resize(job.count);
+		m_Pool.ParallelFor((job.count + VERTEX_BLOCK - 1) / VERTEX_BLOCK, ShadeVertexBlock, &job);
+
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			const SoftVertexOutput* v[3];
+			for (int k = 0; k < 3; ++k)
+				v[k] = &m_Shaded[FetchIndex(startIndex + t * 3 + k) - minIndex];
+			ClipAndSetup(drawIndex, v);
+		}
+	}
+
+	// Rasterize everything drawn since the last flush
+	void Flush()
+	{
+		if (m_Triangles.empty())
+		{
+			m_Draws.clear();
+			return;
+		}
+
+		m_Pool.ParallelFor(m_TilesX * m_TilesY, RasterizeTileJob, this);
+
+		for (size_t i = 0; i < m_Tiles.size(); ++i)
+		{
+			m_Stats.pixelsShaded += m_TileShaded[i];
+			m_Stats.queryPixelsShaded += m_TileQueryShaded[i];
+			m_TileShaded[i] = 0;
+			m_TileQueryShaded[i] = 0;
+			m_Tiles[i].clear();
+		}
+		m_Triangles.clear();
+		m_Draws.clear();
+	}
+
+	// R8G8B8A8 pixels, rows top to bottom; call Flush() first
+	const unsigned int* ColorBuffer() const { return &m_Color[0]; }
+	const float* DepthBuffer() const { return &m_Depth[0]; }
+
+	const SoftRenderStats& Stats() const { return m_Stats; }
+	void ResetStats() { memset(&m_Stats, 0, sizeof(m_Stats)); }
+
+private:
+	enum { VERTEX_BLOCK = 256 };
+
+	struct DrawCall
+	{
+		SoftRasterizerDesc rasterizer;
+		SoftDepthStencilDesc depthStencil;
+		SoftBlendDesc blend;
+		SoftPixelShader pixelShader;
+		int varyingCount;
+		bool queried;
+		std::vector<unsigned char> constants;		// 16 bytes of slack to align the copy
+
+		// Constants often hold XMMATRIX, which needs 16 byte alignment
+		unsigned char* Constants() { return &constants[0] + ((16 - ((size_t)&constants[0] & 15)) & 15); }
+		const unsigned char* Constants() const { return &constants[0] + ((16 - ((size_t)&constants[0] & 15)) & 15); }
+	};
+
+	struct Triangle
+	{
+		int draw;
+		int x[3], y[3];				// fixed point, SOFT_SUBPIXEL_BITS fraction bits
+		int minX, minY, maxX, maxY;	// pixel bounds, inclusive
+		long long area;				// twice the signed area in fixed point, always > 0
+		float z[3];
+		float invW[3];
+		float varyings[3][SOFT_MAX_VARYINGS];	// premultiplied by invW
+	};
+
+	struct VertexJob
+	{
+		SoftRenderer* renderer;
+		const void* constants;
+		int firstVertex;
+		int count;
+	};
+
+	unsigned int FetchIndex(unsigned int i) const
+	{
+		return m_IndexIs16Bit ? ((const unsigned short*)m_IndexData)[i] : ((const unsigned int*)m_IndexData)[i];
+	}
+
+	static void ShadeVertexBlock(void* context, int block)
+	{
+		VertexJob* job = (VertexJob*)context;
+		SoftRenderer* r = job->renderer;
+		int begin = block * VERTEX_BLOCK;
+		int end = std::min(begin + VERTEX_BLOCK, job->count);
+		for (int i = begin; i < end; ++i)
+		{
+			const unsigned char* vertex = r->m_VertexData + (size_t)(job->firstVertex + i) * r->m_VertexStride;
+			r->m_VertexShader(job->constants, vertex, &r->m_Shaded[i]);
+		}
+	}
+
+	//----------------------------------------------------------------------------------
+	// Clipping and triangle setup
+	//----------------------------------------------------------------------------------
+	enum { CLIP_PLANES = 6, MAX_CLIPPED_VERTICES = 3 + CLIP_PLANES };
+
+	// Distance to each clip plane, inside when >= 0: z >= 0, z <= w, |x| and |y| within the guard band
+	static float PlaneDistance(const SoftVertexOutput& v, int plane)
+	{
+		const float* p = v.position;
+		switch (plane)
+		{
+		case 0: return p[2];
+		case 1: return p[3] - p[2];
+		case 2: return SOFT_GUARD_BAND * p[3] + p[0];
+		case 3: return SOFT_GUARD_BAND * p[3] - p[0];
+		case 4: return SOFT_GUARD_BAND * p[3] + p[1];
+		default: return SOFT_GUARD_BAND * p[3] - p[1];
+		}
+	}
+
+	void ClipAndSetup(int drawIndex, const SoftVertexOutput* v[3])
+	{
+		int varyingCount = m_Draws[drawIndex].varyingCount;
+
+		unsigned int outside[3] = { 0, 0, 0 };
+		for (int k = 0; k < 3; ++k)
+		{
+			for (int plane = 0; plane < CLIP_PLANES; ++plane)
+			{
+				if (PlaneDistance(*v[k], plane) < 0.0f)
+					outside[k] |= 1u << plane;
+			}
+		}
+		if (outside[0] & outside[1] & outside[2])
+			return;		// entirely outside one plane
+		if ((outside[0] | outside[1] | outside[2]) == 0)
+		{
+			SetupTriangle(drawIndex, *v[0], *v[1], *v[2]);
+			return;
+		}
+
+		m_Stats.trianglesClipped++;
+		SoftVertexOutput buffers[2][MAX_CLIPPED_VERTICES];
+		int count = 3;
+		for (int k = 0; k < 3; ++k)
+			buffers[0][k] = *v[k];
+
+		int current = 0;
+		unsigned int planesToClip = outside[0] | outside[1] | outside[2];
+		for (int plane = 0; plane < CLIP_PLANES && count >= 3; ++plane)
+		{
+			if (!(planesToClip & (1u << plane)))
+				continue;
+			const SoftVertexOutput* in = buffers[current];
+			SoftVertexOutput* out = buffers[current ^ 1];
+			int outCount = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const SoftVertexOutput& a = in[i];
+				const SoftVertexOutput& b = in[(i + 1) % count];
+				float da = PlaneDistance(a, plane);
+				float db = PlaneDistance(b, plane);
+				if (da >= 0.0f)
+					out[outCount++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float t = da / (da - db);
+					SoftVertexOutput& o = out[outCount++];
+					for (int c = 0; c < 4; ++c)
+						o.position[c] = a.position[c] + (b.position[c] - a.position[c]) * t;
+					for (int c = 0; c < varyingCount; ++c)
+						o.varyings[c] = a.varyings[c] + (b.varyings[c] - a.varyings[c]) * t;
+				}
+			}
+			count = outCount;
+			current ^= 1;
+		}
+
+		for (int i = 1; i + 1 < count; ++i)
+			SetupTriangle(drawIndex, buffers[current][0], buffers[current][i], buffers[current][i + 1]);
+	}
+
+	void SetupTriangle(int drawIndex, const SoftVertexOutput& v0, const SoftVertexOutput& v1, const SoftVertexOutput& v2)
+	{
+		const DrawCall& draw = m_Draws[drawIndex];
+		const SoftVertexOutput* v[3] = { &v0, &v1, &v2 };
+
+		Triangle tri;
+		tri.draw = drawIndex;
+		const float scale = (float)(1 << SOFT_SUBPIXEL_BITS);
+		for (int k = 0; k < 3; ++k)
+		{
+			const float* p = v[k]->position;
+			if (p[3] <= 0.0f)
+				return;		// only reachable for w == z == 0
+			tri.invW[k] = 1.0f / p[3];
+			float sx = (p[0] * tri.invW[k] * 0.5f + 0.5f) * m_Width;
+			float sy = (0.5f - p[1] * tri.invW[k] * 0.5f) * m_Height;
+			tri.x[k] = (int)floorf(sx * scale + 0.5f);
+			tri.y[k] = (int)floorf(sy * scale + 0.5f);
+			tri.z[k] = std::min(std::max(p[2] * tri.invW[k], 0.0f), 1.0f);
+		}
+
+		// Positive area is clockwise on screen (y points down)
+		long long area = (long long)(tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (long long)(tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+		bool clockwise = area > 0;
+		bool frontFacing = draw.rasterizer.frontCounterClockwise ? !clockwise : clockwise;
+		if (area == 0 ||
+			(draw.rasterizer.cullMode == SOFT_CULL_BACK && !frontFacing) ||
+			(draw.rasterizer.cullMode == SOFT_CULL_FRONT && frontFacing))
+		{
+			m_Stats.trianglesCulled++;
+			return;
+		}
+
+		// Rasterize everything clockwise
+		int order[3] = { 0, 1, 2 };
+		if (!clockwise)
+		{
+			order[1] = 2;
+			order[2] = 1;
+			area = -area;
+		}
+		Triangle sorted = tri;
+		for (int k = 0; k < 3; ++k)
+		{
+			int s = order[k];
+			sorted.x[k] = tri.x[s];
+			sorted.y[k] = tri.y[s];
+			sorted.z[k] = tri.z[s];
+			sorted.invW[k] = tri.invW[s];
+			for (int c = 0; c < draw.varyingCount; ++c)
+				sorted.varyings[k][c] = v[s]->varyings[c] * tri.invW[s];
+		}
+		sorted.area = area;
+
+		// Pixel bounds of the pixel centers the triangle can cover
+		const int half = 1 << (SOFT_SUBPIXEL_BITS - 1);
+		int minX = std::min(std::min(sorted.x[0], sorted.x[1]), sorted.x[2]);
+		int maxX = std::max(std::max(sorted.x[0], sorted.x[1]), sorted.x[2]);
+		int minY = std::min(std::min(sorted.y[0], sorted.y[1]), sorted.y[2]);
+		int maxY = std::max(std::max(sorted.y[0], sorted.y[1]), sorted.y[2]);
+		sorted.minX = std::max((minX - half + (1 << SOFT_SUBPIXEL_BITS) - 1) >> SOFT_SUBPIXEL_BITS, 0);
+		sorted.minY = std::max((minY - half + (1 << SOFT_SUBPIXEL_BITS) - 1) >> SOFT_SUBPIXEL_BITS, 0);
+		sorted.maxX = std::min((maxX - half) >> SOFT_SUBPIXEL_BITS, m_Width - 1);
+		sorted.maxY = std::min((maxY - half) >> SOFT_SUBPIXEL_BITS, m_Height - 1);
+		if (sorted.minX > sorted.maxX || sorted.minY > sorted.maxY)
+		{
+			m_Stats.trianglesCulled++;
+			return;
+		}
+
+		int triangleIndex = (int)m_Triangles.size();
+		m_Triangles.push_back(sorted);
+		m_Stats.trianglesBinned++;
+		for (int ty = sorted.minY / SOFT_TILE_SIZE; ty <= sorted.maxY / SOFT_TILE_SIZE; ++ty)
+		{
+			for (int tx = sorted.minX / SOFT_TILE_SIZE; tx <= sorted.maxX / SOFT_TILE_SIZE; ++tx)
+			{
+				m_Tiles[ty * m_TilesX + tx].push_back(triangleIndex);
+				m_Stats.tileEntries++;
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------------
+	// Tile rasterization
+	//----------------------------------------------------------------------------------
+	struct Edge
+	{
+		long long a, b, c;		// E(x, y) = a * x + b * y + c at fixed-point (x, y)
+		int bias;				// 0 on top/left edges, -1 elsewhere, so E + bias >= 0 is inside
+	};
+
+	static Edge MakeEdge(int xa, int ya, int xb, int yb)
+	{
+		Edge edge;
+		edge.a = (long long)ya - yb;
+		edge.b = (long long)xb - xa;
+		edge.c = -(edge.a * xa + edge.b * ya);
+		bool top = ya == yb && xb > xa;
+		bool left = yb < ya;
+		edge.bias = (top || left) ? 0 : -1;
+		return edge;
+	}
+
+	static void RasterizeTileJob(void* context, int tile)
+	{
+		SoftRenderer* r = (SoftRenderer*)context;
+		const std::vector<int>& triangles = r->m_Tiles[tile];
+
+		int tileX0 = (tile % r->m_TilesX) * SOFT_TILE_SIZE;
+		int tileY0 = (tile / r->m_TilesX) * SOFT_TILE_SIZE;
+		int tileX1 = std::min(tileX0 + SOFT_TILE_SIZE, r->m_Width) - 1;
+		int tileY1 = std::min(tileY0 + SOFT_TILE_SIZE, r->m_Height) - 1;
+
+		unsigned int shaded = 0, queryShaded = 0;
+		for (size_t i = 0; i < triangles.size(); ++i)
+		{
+			const Triangle& tri = r->m_Triangles[triangles[i]];
+			unsigned int triangleShaded = r->RasterizeTriangle(tri, tileX0, tileY0, tileX1, tileY1);
+			shaded += triangleShaded;
+			if (r->m_Draws[tri.draw].queried)
+				queryShaded += triangleShaded;
+		}
+		r->m_TileShaded[tile] = shaded;
+		r->m_TileQueryShaded[tile] = queryShaded;
+	}
+
+	unsigned int RasterizeTriangle(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1)
+	{
+		// Start on a multiple of four pixels so each group of four stays inside the tile
+		int x0 = std::max(tri.minX, tileX0) & ~3;
+		int y0 = std::max(tri.minY, tileY0);
+		int x1 = std::min(tri.maxX, tileX1);
+		int y1 = std::min(tri.maxY, tileY1);
+		if (x0 > x1 || y0 > y1)
+			return 0;
+
+		const int one = 1 << SOFT_SUBPIXEL_BITS;
+		const int half = one >> 1;
+		Edge edges[3] = {
+			MakeEdge(tri.x[1], tri.y[1], tri.x[2], tri.y[2]),		// opposite vertex 0
+			MakeEdge(tri.x[2], tri.y[2], tri.x[0], tri.y[0]),		// opposite vertex 1
+			MakeEdge(tri.x[0], tri.y[0], tri.x[1], tri.y[1]),		// opposite vertex 2
+		};
+
+		// Coverage: edge values at the region corners. The guard band keeps the change
+		// across a tile below 2^30, so an edge that is negative at every corner rejects
+		// the triangle, one that is positive at every corner can be skipped, and the
+		// values of the others fit in 32 bits.
+		long long px0 = (long long)x0 * one + half, py0 = (long long)y0 * one + half;
+		long long px1 = (long long)(x1 | 3) * one + half, py1 = (long long)y1 * one + half;
+		int origin[3], stepX[3], stepY[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			const Edge& edge = edges[e];
+			long long c00 = edge.a * px0 + edge.b * py0 + edge.c + edge.bias;
+			long long c10 = edge.a * px1 + edge.b * py0 + edge.c + edge.bias;
+			long long c01 = edge.a * px0 + edge.b * py1 + edge.c + edge.bias;
+			long long c11 = edge.a * px1 + edge.b * py1 + edge.c + edge.bias;
+			if (std::max(std::max(c00, c10), std::max(c01, c11)) < 0)
+				return 0;
+			bool inside = std::min(std::min(c00, c10), std::min(c01, c11)) >= 0;
+			origin[e] = inside ? 0 : (int)c00;
+			stepX[e] = inside ? 0 : (int)(edge.a * one);
+			stepY[e] = inside ? 0 : (int)(edge.b * one);
+		}
+
+		// Interpolation: barycentric weights as float planes relative to the region origin
+		double invArea = 1.0 / (double)tri.area;
+		float weight[3], weightX[3], weightY[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			weight[e] = (float)((edges[e].a * px0 + edges[e].b * py0 + edges[e].c) * invArea);
+			weightX[e] = (float)(edges[e].a * one * invArea);
+			weightY[e] = (float)(edges[e].b * one * invArea);
+		}
+
+		const DrawCall& draw = m_Draws[tri.draw];
+		unsigned int shaded = 0;
+#if defined(SOFT_RASTERIZER_SSE2)
+		__m128i row[3], step4[3], stepRow[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			row[e] = _mm_add_epi32(_mm_set1_epi32(origin[e]), _mm_set_epi32(3 * stepX[e], 2 * stepX[e], stepX[e], 0));
+			step4[e] = _mm_set1_epi32(4 * stepX[e]);
+			stepRow[e] = _mm_set1_epi32(stepY[e]);
+		}
+#else
+		int row[3] = { origin[0], origin[1], origin[2] };
+#endif
+		for (int y = y0; y <= y1; ++y)
+		{
+#if defined(SOFT_RASTERIZER_SSE2)
+			__m128i e0 = row[0], e1 = row[1], e2 = row[2];
+#else
+			int e0 = row[0], e1 = row[1], e2 = row[2];
+#endif
+			for (int x = x0; x <= x1; x += 4)
+			{
+				// Bit i is set when pixel x + i is inside all three edges
+#if defined(SOFT_RASTERIZER_SSE2)
+				// Inside means no edge value is negative: the sign bit of their OR is clear
+				__m128i any = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+				int mask = ~_mm_movemask_ps(_mm_castsi128_ps(any)) & 0xf;
+				e0 = _mm_add_epi32(e0, step4[0]);
+				e1 = _mm_add_epi32(e1, step4[1]);
+				e2 = _mm_add_epi32(e2, step4[2]);
+#else
+				int mask = 0;
+				for (int i = 0; i < 4; ++i)
+				{
+					if (((e0 + stepX[0] * i) | (e1 + stepX[1] * i) | (e2 + stepX[2] * i)) >= 0)
+						mask |= 1 << i;
+				}
+				e0 += stepX[0] * 4;
+				e1 += stepX[1] * 4;
+				e2 += stepX[2] * 4;
+#endif
+				if (x + 3 > x1)
+					mask &= (1 << (x1 - x + 1)) - 1;
+
+				for (int i = 0; mask; ++i, mask >>= 1)
+				{
+					if (!(mask & 1))
+						continue;
+					float dx = (float)(x + i - x0), dy = (float)(y - y0);
+					float w0 = weight[0] + weightX[0] * dx + weightY[0] * dy;
+					float w1 = weight[1] + weightX[1] * dx + weightY[1] * dy;
+					float w2 = weight[2] + weightX[2] * dx + weightY[2] * dy;
+					shaded += ShadePixel(draw, tri, x + i, y, w0, w1, w2);
+				}
+			}
+#if defined(SOFT_RASTERIZER_SSE2)
+			row[0] = _mm_add_epi32(row[0], stepRow[0]);
+			row[1] = _mm_add_epi32(row[1], stepRow[1]);
+			row[2] = _mm_add_epi32(row[2], stepRow[2]);
+#else
+			row[0] += stepY[0];
+			row[1] += stepY[1];
+			row[2] += stepY[2];
+#endif
+		}
+		return shaded;
+	}
+
+	static bool DepthPasses(SoftComparison func, float z, float stored)
+	{
+		switch (func)
+		{
+		case SOFT_COMPARISON_NEVER: return false;
+		case SOFT_COMPARISON_LESS: return z < stored;
+		case SOFT_COMPARISON_EQUAL: return z == stored;
+		case SOFT_COMPARISON_LESS_EQUAL: return z <= stored;
+		case SOFT_COMPARISON_GREATER: return z > stored;
+		case SOFT_COMPARISON_NOT_EQUAL: return z != stored;
+		case SOFT_COMPARISON_GREATER_EQUAL: return z >= stored;
+		default: return true;
+		}
+	}
+
+	// Returns 1 when the pixel shader ran
+	unsigned int ShadePixel(const DrawCall& draw, const Triangle& tri, int x, int y, float w0, float w1, float w2)
+	{
+		size_t offset = (size_t)y * m_Width + x;
+		// Clamped to the viewport depth range like D3D11, which also keeps xyww geometry at
+		// exactly 1 when the weights don't quite sum to one
+		float z = std::min(std::max(w0 * tri.z[0] + w1 * tri.z[1] + w2 * tri.z[2], 0.0f), 1.0f);
+		if (draw.depthStencil.depthEnable && !DepthPasses(draw.depthStencil.depthFunc, z, m_Depth[offset]))
+			return 0;
+
+		// Perspective-correct varyings: interpolate v/w and 1/w linearly, then divide
+		SoftPixelInput input;
+		float invW = w0 * tri.invW[0] + w1 * tri.invW[1] + w2 * tri.invW[2];
+		float w = 1.0f / invW;
+		input.position[0] = x + 0.5f;
+		input.position[1] = y + 0.5f;
+		input.position[2] = z;
+		input.position[3] = w;
+		for (int c = 0; c < draw.varyingCount; ++c)
+			input.varyings[c] = (w0 * tri.varyings[0][c] + w1 * tri.varyings[1][c] + w2 * tri.varyings[2][c]) * w;
+
+		float color[4];
+		draw.pixelShader(draw.Constants(), input, color);
+
+		if (draw.depthStencil.depthEnable && draw.depthStencil.depthWriteEnable)
+			m_Depth[offset] = z;
+		if (draw.blend.blendEnable)
+			Blend(draw.blend, m_Color[offset], color);
+		m_Color[offset] = PackColor(color);
+		return 1;
+	}
+
+	static float BlendFactor(SoftBlend blend, const float src[4], const float dest[4], int channel)
+	{
+		switch (blend)
+		{
+		case SOFT_BLEND_ZERO: return 0.0f;
+		case SOFT_BLEND_SRC_COLOR: return src[channel];
+		case SOFT_BLEND_INV_SRC_COLOR: return 1.0f - src[channel];
+		case SOFT_BLEND_SRC_ALPHA: return src[3];
+		case SOFT_BLEND_INV_SRC_ALPHA: return 1.0f - src[3];
+		case SOFT_BLEND_DEST_ALPHA: return dest[3];
+		case SOFT_BLEND_INV_DEST_ALPHA: return 1.0f - dest[3];
+		case SOFT_BLEND_DEST_COLOR: return dest[channel];
+		case SOFT_BLEND_INV_DEST_COLOR: return 1.0f - dest[channel];
+		default: return 1.0f;
+		}
+	}
+
+	// The *_COLOR factors read the alpha channel when used for alpha, as in D3D11
+	static void Blend(const SoftBlendDesc& desc, unsigned int packedDest, float color[4])
+	{
+		float src[4] = { color[0], color[1], color[2], color[3] };
+		float dest[4];
+		UnpackColor(packedDest, dest);
+		for (int c = 0; c < 4; ++c)
+		{
+			SoftBlend srcBlend = c < 3 ? desc.srcBlend : desc.srcBlendAlpha;
+			SoftBlend destBlend = c < 3 ? desc.destBlend : desc.destBlendAlpha;
+			color[c] = src[c] * BlendFactor(srcBlend, src, dest, c) + dest[c] * BlendFactor(destBlend, src, dest, c);
+		}
+	}
+
+	static unsigned int PackColor(const float color[4])
+	{
+		unsigned int packed = 0;
+		for (int c = 0; c < 4; ++c)
+		{
+			float v = std::min(std::max(color[c], 0.0f), 1.0f);
+			packed |= (unsigned int)(v * 255.0f + 0.5f) << (c * 8);
+		}
+		return packed;
+	}
+
+	static void UnpackColor(unsigned int packed, float color[4])
+	{
+		for (int c = 0; c < 4; ++c)
+			color[c] = ((packed >> (c * 8)) & 0xff) / 255.0f;
+	}
+
+	SoftThreadPool m_Pool;
+	int m_Width, m_Height;
+	int m_TilesX, m_TilesY;
+	std::vector<unsigned int> m_Color;
+	std::vector<float> m_Depth;
+
+	SoftRasterizerDesc m_Rasterizer;
+	SoftDepthStencilDesc m_DepthStencil;
+	SoftBlendDesc m_Blend;
+	SoftVertexShader m_VertexShader;
+	SoftPixelShader m_PixelShader;
+	int m_VaryingCount;
+	std::vector<unsigned char> m_Constants;
+	const unsigned char* m_VertexData;
+	unsigned int m_VertexStride;
+	const void* m_IndexData;
+	bool m_IndexIs16Bit;
+
+	std::vector<SoftVertexOutput> m_Shaded;
+	std::vector<DrawCall> m_Draws;
+	std::vector<Triangle> m_Triangles;
+	std::vector<std::vector<int> > m_Tiles;
+	std::vector<unsigned int> m_TileShaded;
+	std::vector<unsigned int> m_TileQueryShaded;
+	bool m_Querying;
+	SoftRenderStats m_Stats;
+};
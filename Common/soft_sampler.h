@@ -0,0 +1,805 @@
+//--------------------------------------------------------------------------------------
+// File: soft_sampler.h
+//
+// Texture sampling for CPU code paths (the software rasterizer, bakers, reference
+// implementations of the sample shaders). Mirrors what the samples' sampler states ask
+// of the hardware: Sample/SampleLevel/SampleGrad on mipmapped 2D textures and cube
+// maps, WRAP and CLAMP addressing, point, bilinear and trilinear filtering.
+//
+// Texels are RGBA float, stored in 4x4 tiles (256 bytes, four cache lines) so the
+// 2x2 footprint of a bilinear tap stays within one tile most of the time, whatever
+// the direction of travel across the texture.
+//
+// Every entry point has a scalar version, which is also the reference, and a 4-wide
+// version that takes and returns 4 lanes at once. With SSE2 the 4-wide versions do the
+// LOD, face selection, addressing and filtering for all lanes in vector registers;
+// without it they fall back to the scalar code.
+//
+// Cube maps store a one texel border around every face level, filled from the
+// neighbouring faces, so bilinear taps at a face edge blend across the seam the way
+// D3D11 hardware does. The three texels meeting at a corner are not averaged; the
+// border corner takes the nearest neighbouring face.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_SAMPLER_SSE2
+#endif
+
+//--------------------------------------------------------------------------------------
+// Sampler state, values match D3D11_FILTER and D3D11_TEXTURE_ADDRESS_MODE
+//--------------------------------------------------------------------------------------
+enum SoftFilter
+{
+	SOFT_FILTER_MIN_MAG_MIP_POINT = 0,
+	SOFT_FILTER_MIN_MAG_LINEAR_MIP_POINT = 0x14,
+	SOFT_FILTER_MIN_MAG_MIP_LINEAR = 0x15,
+};
+
+enum SoftAddressMode
+{
+	SOFT_ADDRESS_WRAP = 1,
+	SOFT_ADDRESS_CLAMP = 3,
+};
+
+// Cube maps ignore the address modes: they always filter across faces
+struct SoftSamplerDesc
+{
+	SoftFilter filter;
+	SoftAddressMode addressU;
+	SoftAddressMode addressV;
+	float maxLOD;
+};
+
+// CubesTexSamplerState / ObjSamplerState as every sample creates it
+inline SoftSamplerDesc SoftLinearWrapSamplerDesc()
+{
+	SoftSamplerDesc desc = { SOFT_FILTER_MIN_MAG_MIP_LINEAR, SOFT_ADDRESS_WRAP, SOFT_ADDRESS_WRAP, 3.402823466e+38f };
+	return desc;
+}
+
+//--------------------------------------------------------------------------------------
+// Mipmapped 2D texture
+//--------------------------------------------------------------------------------------
+#define SOFT_SAMPLER_TILE_SHIFT		2		// 4x4 texel storage tiles
+
+struct SoftMipLevel
+{
+	int width;
+	int height;
+	int tilesX;			// storage tiles per row, border included
+	size_t offset;		// first float of the level, from SoftMipTexture::Data()
+};
+
+class SoftMipTexture
+{
+public:
+	SoftMipTexture() : m_Border(0) {}
+
+	// rgba holds width*height RGBA texels, rows top to bottom. With mips the chain down
+	// to 1x1 is built with a 2x2 box filter. border adds a ring of texels around every
+	// level, addressable at -1 and width/height; SoftMipCube uses it for the seams.
+	void Create(int width, int height, const float* rgba, bool mips, int border = 0)
+	{
+		m_Border = border;
+		m_Levels.clear();
+
+		size_t total = 0;
+		int w = std::max(width, 1), h = std::max(height, 1);
+		for (;;)
+		{
+			SoftMipLevel level;
+			level.width = w;
+			level.height = h;
+			level.tilesX = (w + 2 * border + 3) >> SOFT_SAMPLER_TILE_SHIFT;
+			level.offset = total;
+			int tilesY = (h + 2 * border + 3) >> SOFT_SAMPLER_TILE_SHIFT;
+			total += (size_t)level.tilesX * tilesY * 64;
+			m_Levels.push_back(level);
+			if (!mips || (w == 1 && h == 1))
+				break;
+			w = std::max(w >> 1, 1);
+			h = std::max(h >> 1, 1);
+		}
+		// 4 floats of slack so Data() can be 16 byte aligned
+		m_Texels.assign(total + 4, 0.0f);
+
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+				memcpy(Texel(0, x, y), rgba + ((size_t)y * width + x) * 4, 4 * sizeof(float));
+
+		for (int i = 1; i < (int)m_Levels.size(); ++i)
+		{
+			const SoftMipLevel& src = m_Levels[i - 1];
+			const SoftMipLevel& dst = m_Levels[i];
+			for (int y = 0; y < dst.height; ++y)
+			{
+				int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+				for (int x = 0; x < dst.width; ++x)
+				{
+					int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+					const float* a = Texel(i - 1, x0, y0);
+					const float* b = Texel(i - 1, x1, y0);
+					const float* c = Texel(i - 1, x0, y1);
+					const float* d = Texel(i - 1, x1, y1);
+					float* out = Texel(i, x, y);
+					for (int k = 0; k < 4; ++k)
+						out[k] = 0.25f * (a[k] + b[k] + c[k] + d[k]);
+				}
+			}
+		}
+	}
+
+	int Width() const { return m_Levels.empty() ? 0 : m_Levels[0].width; }
+	int Height() const { return m_Levels.empty() ? 0 : m_Levels[0].height; }
+	int LevelCount() const { return (int)m_Levels.size(); }
+	int Border() const { return m_Border; }
+	const SoftMipLevel& Level(int level) const { return m_Levels[level]; }
+
+	const float* Data() const { return &m_Texels[0] + (((16 - ((size_t)&m_Texels[0] & 15)) & 15) >> 2); }
+	float* Data() { return &m_Texels[0] + (((16 - ((size_t)&m_Texels[0] & 15)) & 15) >> 2); }
+
+	// Float index of texel (x, y) within its level; x and y may reach into the border
+	static int TexelIndex(const SoftMipLevel& level, int border, int x, int y)
+	{
+		int sx = x + border, sy = y + border;
+		int tile = (sy >> SOFT_SAMPLER_TILE_SHIFT) * level.tilesX + (sx >> SOFT_SAMPLER_TILE_SHIFT);
+		return (tile * 16 + (sy & 3) * 4 + (sx & 3)) * 4;
+	}
+
+	float* Texel(int level, int x, int y) { return Data() + m_Levels[level].offset + TexelIndex(m_Levels[level], m_Border, x, y); }
+	const float* Texel(int level, int x, int y) const { return Data() + m_Levels[level].offset + TexelIndex(m_Levels[level], m_Border, x, y); }
+
+	// log2 of the larger footprint axis in level 0 texels, as D3D11 computes it
+	float ComputeLOD(float dudx, float dvdx, float dudy, float dvdy) const
+	{
+		float w = (float)Width(), h = (float)Height();
+		float x2 = dudx * dudx * w * w + dvdx * dvdx * h * h;
+		float y2 = dudy * dudy * w * w + dvdy * dvdy * h * h;
+		float rho2 = std::max(x2, y2);
+		return rho2 > 0.0f ? 0.5f * 1.44269504f * logf(rho2) : -128.0f;
+	}
+
+	// SampleLevel
+	void SampleLevel(const SoftSamplerDesc& sampler, float u, float v, float lod, float color[4]) const
+	{
+		if (m_Levels.empty())
+		{
+			color[0] = color[1] = color[2] = color[3] = 0.0f;
+			return;
+		}
+		bool linear = sampler.filter != SOFT_FILTER_MIN_MAG_MIP_POINT;
+		lod = std::min(std::max(std::min(lod, sampler.maxLOD), 0.0f), (float)(LevelCount() - 1));
+		if (sampler.filter != SOFT_FILTER_MIN_MAG_MIP_LINEAR)
+		{
+			SampleInLevel(sampler, (int)floorf(lod + 0.5f), u, v, linear, color);
+			return;
+		}
+
+		int level0 = (int)floorf(lod);
+		float blend = lod - level0;
+		SampleInLevel(sampler, level0, u, v, true, color);
+		if (blend > 0.0f)
+		{
+			float upper[4];
+			SampleInLevel(sampler, std::min(level0 + 1, LevelCount() - 1), u, v, true, upper);
+			for (int c = 0; c < 4; ++c)
+				color[c] += (upper[c] - color[c]) * blend;
+		}
+	}
+
+	// SampleGrad with the derivatives of u and v along screen x and y
+	void SampleGrad(const SoftSamplerDesc& sampler, float u, float v, float dudx, float dvdx, float dudy, float dvdy, float color[4]) const
+	{
+		SampleLevel(sampler, u, v, ComputeLOD(dudx, dvdx, dudy, dvdy), color);
+	}
+
+	// Point or bilinear lookup in one level
+	void SampleInLevel(const SoftSamplerDesc& sampler, int level, float u, float v, bool linear, float color[4]) const
+	{
+		const SoftMipLevel& l = m_Levels[level];
+		if (!linear)
+		{
+			int x = AddressPoint(u, l.width, sampler.addressU);
+			int y = AddressPoint(v, l.height, sampler.addressV);
+			memcpy(color, Texel(level, x, y), 4 * sizeof(float));
+			return;
+		}
+
+		int x0, x1, y0, y1;
+		float fx = AddressLinear(u, l.width, sampler.addressU, m_Border, &x0, &x1);
+		float fy = AddressLinear(v, l.height, sampler.addressV, m_Border, &y0, &y1);
+		const float* t00 = Texel(level, x0, y0);
+		const float* t10 = Texel(level, x1, y0);
+		const float* t01 = Texel(level, x0, y1);
+		const float* t11 = Texel(level, x1, y1);
+		for (int c = 0; c < 4; ++c)
+		{
+			float top = t00[c] + (t10[c] - t00[c]) * fx;
+			float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+			color[c] = top + (bottom - top) * fy;
+		}
+	}
+
+	// 4-wide SampleLevel and SampleGrad; coordinates and results are per lane
+	void SampleLevel4(const SoftSamplerDesc& sampler, const float uv[2][4], const float lod[4], float colors[4][4]) const;
+	void SampleGrad4(const SoftSamplerDesc& sampler, const float uv[2][4], const float ddx[2][4], const float ddy[2][4], float colors[4][4]) const;
+
+private:
+	static int AddressPoint(float c, int size, SoftAddressMode mode)
+	{
+		if (mode == SOFT_ADDRESS_WRAP)
+		{
+			int x = (int)floorf((c - floorf(c)) * size);
+			return x >= size ? x - size : x;
+		}
+		int x = (int)floorf(std::min(std::max(c, -1.0f), 2.0f) * size);
+		return std::min(std::max(x, 0), size - 1);
+	}
+
+	// Returns the weight of the second tap
+	static float AddressLinear(float c, int size, SoftAddressMode mode, int border, int* i0, int* i1)
+	{
+		c = mode == SOFT_ADDRESS_WRAP ? c - floorf(c) : std::min(std::max(c, -1.0f), 2.0f);
+		float x = c * size - 0.5f;
+		float fx = floorf(x);
+		int x0 = (int)fx, x1 = x0 + 1;
+		if (mode == SOFT_ADDRESS_WRAP)
+		{
+			*i0 = x0 < 0 ? x0 + size : x0;
+			*i1 = x1 >= size ? x1 - size : x1;
+		}
+		else
+		{
+			*i0 = std::min(std::max(x0, -border), size - 1 + border);
+			*i1 = std::min(std::max(x1, -border), size - 1 + border);
+		}
+		return x - fx;
+	}
+
+	int m_Border;
+	std::vector<SoftMipLevel> m_Levels;
+	std::vector<float> m_Texels;
+};
+
+//--------------------------------------------------------------------------------------
+// Mipmapped cube map, faces in D3D11 order: +X, -X, +Y, -Y, +Z, -Z
+//--------------------------------------------------------------------------------------
+class SoftMipCube
+{
+public:
+	// faces[i] holds size*size RGBA texels
+	void Create(int size, const float* const faces[6], bool mips)
+	{
+		for (int f = 0; f < 6; ++f)
+			m_Faces[f].Create(size, size, faces[f], mips, 1);
+		for (int level = 0; level < m_Faces[0].LevelCount(); ++level)
+			FillBorders(level);
+	}
+
+	int Size() const { return m_Faces[0].Width(); }
+	int LevelCount() const { return m_Faces[0].LevelCount(); }
+	const SoftMipTexture& Face(int face) const { return m_Faces[face]; }
+
+	// Major axis selection from the D3D11 spec; s and t in [-1, 1], returns |major| (0 for a
+	// zero vector)
+	static float SelectFace(float x, float y, float z, int* face, float* s, float* t)
+	{
+		float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az)
+		{
+			*face = x >= 0.0f ? 0 : 1;
+			sc = x >= 0.0f ? -z : z;
+			tc = -y;
+			ma = ax;
+		}
+		else if (ay >= az)
+		{
+			*face = y >= 0.0f ? 2 : 3;
+			sc = x;
+			tc = y >= 0.0f ? z : -z;
+			ma = ay;
+		}
+		else
+		{
+			*face = z >= 0.0f ? 4 : 5;
+			sc = z >= 0.0f ? x : -x;
+			tc = -y;
+			ma = az;
+		}
+		*s = ma > 0.0f ? sc / ma : 0.0f;
+		*t = ma > 0.0f ? tc / ma : 0.0f;
+		return ma;
+	}
+
+	// Inverse of SelectFace, the direction is not normalized
+	static void FaceDirection(int face, float s, float t, float dir[3])
+	{
+		switch (face)
+		{
+		case 0: dir[0] = 1.0f; dir[1] = -t; dir[2] = -s; break;
+		case 1: dir[0] = -1.0f; dir[1] = -t; dir[2] = s; break;
+		case 2: dir[0] = s; dir[1] = 1.0f; dir[2] = t; break;
+		case 3: dir[0] = s; dir[1] = -1.0f; dir[2] = -t; break;
+		case 4: dir[0] = s; dir[1] = -t; dir[2] = 1.0f; break;
+		default: dir[0] = -s; dir[1] = -t; dir[2] = -1.0f; break;
+		}
+	}
+
+	// Derivatives are of the direction along screen x and y, so LOD follows the face
+	// projection like it does on hardware
+	void SampleGrad(const SoftSamplerDesc& sampler, const float dir[3], const float ddx[3], const float ddy[3], float color[4]) const
+	{
+		int face;
+		float s, t, dsdx, dtdx, dsdy, dtdy;
+		if (!Project(dir, ddx, ddy, &face, &s, &t, &dsdx, &dtdx, &dsdy, &dtdy))
+		{
+			color[0] = color[1] = color[2] = color[3] = 0.0f;
+			return;
+		}
+		const SoftMipTexture& texture = m_Faces[face];
+		SoftSamplerDesc faceSampler = sampler;
+		faceSampler.addressU = faceSampler.addressV = SOFT_ADDRESS_CLAMP;
+		texture.SampleLevel(faceSampler, 0.5f * (s + 1.0f), 0.5f * (t + 1.0f),
+			texture.ComputeLOD(0.5f * dsdx, 0.5f * dtdx, 0.5f * dsdy, 0.5f * dtdy), color);
+	}
+
+	void SampleLevel(const SoftSamplerDesc& sampler, const float dir[3], float lod, float color[4]) const
+	{
+		int face;
+		float s, t;
+		if (SelectFace(dir[0], dir[1], dir[2], &face, &s, &t) == 0.0f || m_Faces[0].LevelCount() == 0)
+		{
+			color[0] = color[1] = color[2] = color[3] = 0.0f;
+			return;
+		}
+		SoftSamplerDesc faceSampler = sampler;
+		faceSampler.addressU = faceSampler.addressV = SOFT_ADDRESS_CLAMP;
+		m_Faces[face].SampleLevel(faceSampler, 0.5f * (s + 1.0f), 0.5f * (t + 1.0f), lod, color);
+	}
+
+	// 4-wide versions; dir, ddx and ddy are x, y, z rows of 4 lanes
+	void SampleLevel4(const SoftSamplerDesc& sampler, const float dir[3][4], const float lod[4], float colors[4][4]) const;
+	void SampleGrad4(const SoftSamplerDesc& sampler, const float dir[3][4], const float ddx[3][4], const float ddy[3][4], float colors[4][4]) const;
+
+private:
+	// Face, face coordinates and their derivatives, all in [-1, 1] units
+	bool Project(const float dir[3], const float ddx[3], const float ddy[3], int* face, float* s, float* t,
+		float* dsdx, float* dtdx, float* dsdy, float* dtdy) const
+	{
+		float ma = SelectFace(dir[0], dir[1], dir[2], face, s, t);
+		if (ma == 0.0f || m_Faces[0].LevelCount() == 0)
+			return false;
+
+		// d(sc/ma) = (dsc - s * dma) / ma, with the same axis and signs as the direction
+		float dsc[2], dtc[2], dma[2];
+		const float* d[2] = { ddx, ddy };
+		for (int i = 0; i < 2; ++i)
+		{
+			switch (*face)
+			{
+			case 0: dsc[i] = -d[i][2]; dtc[i] = -d[i][1]; dma[i] = d[i][0]; break;
+			case 1: dsc[i] = d[i][2]; dtc[i] = -d[i][1]; dma[i] = -d[i][0]; break;
+			case 2: dsc[i] = d[i][0]; dtc[i] = d[i][2]; dma[i] = d[i][1]; break;
+			case 3: dsc[i] = d[i][0]; dtc[i] = -d[i][2]; dma[i] = -d[i][1]; break;
+			case 4: dsc[i] = d[i][0]; dtc[i] = -d[i][1]; dma[i] = d[i][2]; break;
+			default: dsc[i] = -d[i][0]; dtc[i] = -d[i][1]; dma[i] = -d[i][2]; break;
+			}
+		}
+		*dsdx = (dsc[0] - *s * dma[0]) / ma;
+		*dtdx = (dtc[0] - *t * dma[0]) / ma;
+		*dsdy = (dsc[1] - *s * dma[1]) / ma;
+		*dtdy = (dtc[1] - *t * dma[1]) / ma;
+		return true;
+	}
+
+	// Border texels take the bilinear value of the neighbouring face at the same direction
+	void FillBorders(int level)
+	{
+		const SoftMipLevel& l = m_Faces[0].Level(level);
+		int size = l.width;
+		for (int f = 0; f < 6; ++f)
+		{
+			for (int y = -1; y <= size; ++y)
+			{
+				for (int x = -1; x <= size; x += (y < 0 || y == size) ? 1 : size + 1)
+				{
+					float dir[3];
+					FaceDirection(f, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, dir);
+					int face;
+					float s, t;
+					SelectFace(dir[0], dir[1], dir[2], &face, &s, &t);
+					SampleInterior(m_Faces[face], level, 0.5f * (s + 1.0f), 0.5f * (t + 1.0f), m_Faces[f].Texel(level, x, y));
+				}
+			}
+		}
+	}
+
+	static void SampleInterior(const SoftMipTexture& texture, int level, float u, float v, float color[4])
+	{
+		const SoftMipLevel& l = texture.Level(level);
+		float x = u * l.width - 0.5f, y = v * l.height - 0.5f;
+		float fx = floorf(x), fy = floorf(y);
+		int x0 = std::min(std::max((int)fx, 0), l.width - 1), x1 = std::min(std::max((int)fx + 1, 0), l.width - 1);
+		int y0 = std::min(std::max((int)fy, 0), l.height - 1), y1 = std::min(std::max((int)fy + 1, 0), l.height - 1);
+		float ax = x - fx, ay = y - fy;
+		const float* t00 = texture.Texel(level, x0, y0);
+		const float* t10 = texture.Texel(level, x1, y0);
+		const float* t01 = texture.Texel(level, x0, y1);
+		const float* t11 = texture.Texel(level, x1, y1);
+		for (int c = 0; c < 4; ++c)
+		{
+			float top = t00[c] + (t10[c] - t00[c]) * ax;
+			float bottom = t01[c] + (t11[c] - t01[c]) * ax;
+			color[c] = top + (bottom - top) * ay;
+		}
+	}
+
+	SoftMipTexture m_Faces[6];
+};
+
+//--------------------------------------------------------------------------------------
+// 4-wide sampling
+//--------------------------------------------------------------------------------------
+#ifdef SOFT_SAMPLER_SSE2
+
+#ifdef _MSC_VER
+#define SOFT_ALIGN16	__declspec(align(16))
+#else
+#define SOFT_ALIGN16	__attribute__((aligned(16)))
+#endif
+
+// Per lane texture and level, so one call can span cube faces
+struct SoftSampleLanes
+{
+	const SoftMipTexture* texture[4];
+	int level[4];
+};
+
+inline __m128 SoftFloor4(__m128 x)
+{
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+// log2 for positive x; exponent plus a degree 5 polynomial on the mantissa, within 3e-5,
+// well inside the 8 fractional LOD bits D3D11 requires
+inline __m128 SoftLog2_4(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+	__m128 t = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+	__m128 p = _mm_set1_ps(0.04587895f);
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.19440832f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(0.41541119f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.70867891f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.4418255f));
+	return _mm_add_ps(exponent, _mm_mul_ps(p, t));
+}
+
+inline __m128 SoftSelect4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Texel column/row of both taps (or the one point tap) for 4 lanes, as floats
+inline __m128 SoftAddress4(__m128 c, __m128 size, __m128 border, SoftAddressMode mode, bool linear, __m128* i0, __m128* i1)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	if (mode == SOFT_ADDRESS_WRAP)
+		c = _mm_sub_ps(c, SoftFloor4(c));
+	else
+		c = _mm_min_ps(_mm_max_ps(c, _mm_set1_ps(-1.0f)), _mm_set1_ps(2.0f));
+
+	if (!linear)
+	{
+		__m128 x = SoftFloor4(_mm_mul_ps(c, size));
+		if (mode == SOFT_ADDRESS_WRAP)
+			x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, size), size));
+		else
+			x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_sub_ps(size, one));
+		*i0 = *i1 = x;
+		return _mm_setzero_ps();
+	}
+
+	__m128 x = _mm_sub_ps(_mm_mul_ps(c, size), _mm_set1_ps(0.5f));
+	__m128 x0 = SoftFloor4(x);
+	__m128 x1 = _mm_add_ps(x0, one);
+	if (mode == SOFT_ADDRESS_WRAP)
+	{
+		x0 = _mm_add_ps(x0, _mm_and_ps(_mm_cmplt_ps(x0, _mm_setzero_ps()), size));
+		x1 = _mm_sub_ps(x1, _mm_and_ps(_mm_cmpge_ps(x1, size), size));
+	}
+	else
+	{
+		__m128 low = _mm_sub_ps(_mm_setzero_ps(), border);
+		__m128 high = _mm_add_ps(_mm_sub_ps(size, one), border);
+		x0 = _mm_min_ps(_mm_max_ps(x0, low), high);
+		x1 = _mm_min_ps(_mm_max_ps(x1, low), high);
+	}
+	*i0 = x0;
+	*i1 = x1;
+	return _mm_sub_ps(x, SoftFloor4(x));
+}
+
+// Float offsets of texels (x, y) within each lane's level, see SoftMipTexture::TexelIndex
+inline __m128i SoftTexelIndex4(__m128 x, __m128 y, __m128i border, __m128i tilesX)
+{
+	__m128i sx = _mm_add_epi32(_mm_cvttps_epi32(x), border);
+	__m128i sy = _mm_add_epi32(_mm_cvttps_epi32(y), border);
+	// Tile rows and tilesX stay below 32768 (SOFT_MAX_TARGET_SIZE sized textures), so
+	// the 16 bit multiply-add gives the exact 32 bit product
+	__m128i tile = _mm_add_epi32(_mm_madd_epi16(_mm_srli_epi32(sy, SOFT_SAMPLER_TILE_SHIFT), tilesX), _mm_srli_epi32(sx, SOFT_SAMPLER_TILE_SHIFT));
+	const __m128i three = _mm_set1_epi32(3);
+	__m128i inTile = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(sy, three), 2), _mm_and_si128(sx, three));
+	return _mm_slli_epi32(_mm_add_epi32(_mm_slli_epi32(tile, 4), inTile), 2);
+}
+
+// One point or bilinear lookup per lane
+inline void SoftFetch4(const SoftSampleLanes& lanes, __m128 u, __m128 v, SoftAddressMode addressU, SoftAddressMode addressV, bool linear, __m128 out[4])
+{
+	SOFT_ALIGN16 float width[4], height[4], border[4];
+	SOFT_ALIGN16 int tilesX[4], borderInt[4];
+	const float* base[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		const SoftMipLevel& level = lanes.texture[i]->Level(lanes.level[i]);
+		width[i] = (float)level.width;
+		height[i] = (float)level.height;
+		borderInt[i] = lanes.texture[i]->Border();
+		border[i] = (float)borderInt[i];
+		tilesX[i] = level.tilesX;
+		base[i] = lanes.texture[i]->Data() + level.offset;
+	}
+	__m128 borderF = _mm_load_ps(border);
+	__m128i borderI = _mm_load_si128((const __m128i*)borderInt);
+	__m128i tilesXI = _mm_load_si128((const __m128i*)tilesX);
+
+	__m128 x0, x1, y0, y1;
+	SOFT_ALIGN16 float fx[4], fy[4];
+	_mm_store_ps(fx, SoftAddress4(u, _mm_load_ps(width), borderF, addressU, linear, &x0, &x1));
+	_mm_store_ps(fy, SoftAddress4(v, _mm_load_ps(height), borderF, addressV, linear, &y0, &y1));
+
+	SOFT_ALIGN16 int i00[4];
+	_mm_store_si128((__m128i*)i00, SoftTexelIndex4(x0, y0, borderI, tilesXI));
+	if (!linear)
+	{
+		for (int i = 0; i < 4; ++i)
+			out[i] = _mm_load_ps(base[i] + i00[i]);
+		return;
+	}
+
+	SOFT_ALIGN16 int i10[4], i01[4], i11[4];
+	_mm_store_si128((__m128i*)i10, SoftTexelIndex4(x1, y0, borderI, tilesXI));
+	_mm_store_si128((__m128i*)i01, SoftTexelIndex4(x0, y1, borderI, tilesXI));
+	_mm_store_si128((__m128i*)i11, SoftTexelIndex4(x1, y1, borderI, tilesXI));
+	for (int i = 0; i < 4; ++i)
+	{
+		__m128 t00 = _mm_load_ps(base[i] + i00[i]);
+		__m128 t10 = _mm_load_ps(base[i] + i10[i]);
+		__m128 t01 = _mm_load_ps(base[i] + i01[i]);
+		__m128 t11 = _mm_load_ps(base[i] + i11[i]);
+		__m128 ax = _mm_set1_ps(fx[i]);
+		__m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), ax));
+		__m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), ax));
+		out[i] = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(fy[i])));
+	}
+}
+
+// Mip selection and filtering for 4 lanes; lanes.level is filled in here
+inline void SoftSampleLevels4(const SoftSamplerDesc& sampler, SoftSampleLanes& lanes, __m128 u, __m128 v, __m128 lod,
+	SoftAddressMode addressU, SoftAddressMode addressV, float colors[4][4])
+{
+	SOFT_ALIGN16 float maxLevel[4];
+	for (int i = 0; i < 4; ++i)
+		maxLevel[i] = (float)(lanes.texture[i]->LevelCount() - 1);
+	__m128 top = _mm_load_ps(maxLevel);
+	lod = _mm_min_ps(lod, _mm_set1_ps(sampler.maxLOD));
+	lod = _mm_min_ps(_mm_max_ps(lod, _mm_setzero_ps()), top);
+
+	bool linear = sampler.filter != SOFT_FILTER_MIN_MAG_MIP_POINT;
+	__m128 out[4];
+	if (sampler.filter != SOFT_FILTER_MIN_MAG_MIP_LINEAR)
+	{
+		SOFT_ALIGN16 int level[4];
+		_mm_store_si128((__m128i*)level, _mm_cvttps_epi32(SoftFloor4(_mm_add_ps(lod, _mm_set1_ps(0.5f)))));
+		for (int i = 0; i < 4; ++i)
+			lanes.level[i] = level[i];
+		SoftFetch4(lanes, u, v, addressU, addressV, linear, out);
+	}
+	else
+	{
+		__m128 level0 = SoftFloor4(lod);
+		SOFT_ALIGN16 float blend[4];
+		SOFT_ALIGN16 int level[4];
+		_mm_store_ps(blend, _mm_sub_ps(lod, level0));
+		_mm_store_si128((__m128i*)level, _mm_cvttps_epi32(level0));
+		for (int i = 0; i < 4; ++i)
+			lanes.level[i] = level[i];
+		SoftFetch4(lanes, u, v, addressU, addressV, true, out);
+
+		// Second level only when some lane is between levels (magnification never is)
+		if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_load_ps(blend), _mm_setzero_ps())) != 0)
+		{
+			__m128 upper[4];
+			for (int i = 0; i < 4; ++i)
+				lanes.level[i] = std::min(level[i] + 1, (int)maxLevel[i]);
+			SoftFetch4(lanes, u, v, addressU, addressV, true, upper);
+			for (int i = 0; i < 4; ++i)
+				out[i] = _mm_add_ps(out[i], _mm_mul_ps(_mm_sub_ps(upper[i], out[i]), _mm_set1_ps(blend[i])));
+		}
+	}
+	for (int i = 0; i < 4; ++i)
+		_mm_storeu_ps(colors[i], out[i]);
+}
+
+inline void SoftMipTexture::SampleLevel4(const SoftSamplerDesc& sampler, const float uv[2][4], const float lod[4], float colors[4][4]) const
+{
+	if (m_Levels.empty())
+	{
+		memset(colors, 0, 16 * sizeof(float));
+		return;
+	}
+	SoftSampleLanes lanes;
+	for (int i = 0; i < 4; ++i)
+		lanes.texture[i] = this;
+	SoftSampleLevels4(sampler, lanes, _mm_loadu_ps(uv[0]), _mm_loadu_ps(uv[1]), _mm_loadu_ps(lod), sampler.addressU, sampler.addressV, colors);
+}
+
+inline void SoftMipTexture::SampleGrad4(const SoftSamplerDesc& sampler, const float uv[2][4], const float ddx[2][4], const float ddy[2][4], float colors[4][4]) const
+{
+	if (m_Levels.empty())
+	{
+		memset(colors, 0, 16 * sizeof(float));
+		return;
+	}
+	__m128 w = _mm_set1_ps((float)Width()), h = _mm_set1_ps((float)Height());
+	__m128 dux = _mm_mul_ps(_mm_loadu_ps(ddx[0]), w), dvx = _mm_mul_ps(_mm_loadu_ps(ddx[1]), h);
+	__m128 duy = _mm_mul_ps(_mm_loadu_ps(ddy[0]), w), dvy = _mm_mul_ps(_mm_loadu_ps(ddy[1]), h);
+	__m128 x2 = _mm_add_ps(_mm_mul_ps(dux, dux), _mm_mul_ps(dvx, dvx));
+	__m128 y2 = _mm_add_ps(_mm_mul_ps(duy, duy), _mm_mul_ps(dvy, dvy));
+	__m128 lod = _mm_mul_ps(_mm_set1_ps(0.5f), SoftLog2_4(_mm_max_ps(x2, y2)));
+
+	SoftSampleLanes lanes;
+	for (int i = 0; i < 4; ++i)
+		lanes.texture[i] = this;
+	SoftSampleLevels4(sampler, lanes, _mm_loadu_ps(uv[0]), _mm_loadu_ps(uv[1]), lod, sampler.addressU, sampler.addressV, colors);
+}
+
+// Face selection for 4 lanes, with the face coordinates' derivatives when d is given
+inline __m128 SoftSelectFace4(const float dir[3][4], const float (*d[2])[4], __m128i* face, __m128* s, __m128* t, __m128 ds[2], __m128 dt[2])
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 x = _mm_loadu_ps(dir[0]), y = _mm_loadu_ps(dir[1]), z = _mm_loadu_ps(dir[2]);
+	__m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y), az = _mm_andnot_ps(sign, z);
+	__m128 xMajor = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+	__m128 yMajor = _mm_andnot_ps(xMajor, _mm_cmpge_ps(ay, az));
+	__m128 xyMajor = _mm_or_ps(xMajor, yMajor);
+	__m128 major = SoftSelect4(xMajor, x, SoftSelect4(yMajor, y, z));
+	__m128 negative = _mm_cmplt_ps(major, _mm_setzero_ps());
+	__m128 positive = _mm_andnot_ps(negative, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+	// face = 2 * axis + (major < 0)
+	__m128i axis = _mm_add_epi32(_mm_and_si128(_mm_castps_si128(yMajor), _mm_set1_epi32(2)),
+		_mm_andnot_si128(_mm_castps_si128(xyMajor), _mm_set1_epi32(4)));
+	*face = _mm_sub_epi32(axis, _mm_castps_si128(negative));
+
+	// sc: +-z on X faces, x on Y faces, +-x on Z faces; tc: -y, +-z, -y
+	__m128 scSign = SoftSelect4(xMajor, _mm_and_ps(positive, sign), SoftSelect4(yMajor, _mm_setzero_ps(), _mm_and_ps(negative, sign)));
+	__m128 tcSign = SoftSelect4(yMajor, _mm_and_ps(negative, sign), sign);
+	__m128 ma = _mm_andnot_ps(sign, major);
+	__m128 invMa = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(ma, _mm_set1_ps(1e-30f)));
+	*s = _mm_mul_ps(_mm_xor_ps(SoftSelect4(xMajor, z, x), scSign), invMa);
+	*t = _mm_mul_ps(_mm_xor_ps(SoftSelect4(yMajor, z, y), tcSign), invMa);
+
+	if (d != NULL)
+	{
+		__m128 maSign = _mm_and_ps(negative, sign);
+		for (int i = 0; i < 2; ++i)
+		{
+			__m128 dx = _mm_loadu_ps(d[i][0]), dy = _mm_loadu_ps(d[i][1]), dz = _mm_loadu_ps(d[i][2]);
+			__m128 dsc = _mm_xor_ps(SoftSelect4(xMajor, dz, dx), scSign);
+			__m128 dtc = _mm_xor_ps(SoftSelect4(yMajor, dz, dy), tcSign);
+			__m128 dma = _mm_xor_ps(SoftSelect4(xMajor, dx, SoftSelect4(yMajor, dy, dz)), maSign);
+			ds[i] = _mm_mul_ps(_mm_sub_ps(dsc, _mm_mul_ps(*s, dma)), invMa);
+			dt[i] = _mm_mul_ps(_mm_sub_ps(dtc, _mm_mul_ps(*t, dma)), invMa);
+		}
+	}
+	return ma;
+}
+
+inline void SoftCubeSample4(const SoftMipTexture* faces, const SoftSamplerDesc& sampler, __m128i face, __m128 s, __m128 t, __m128 ma, __m128 lod, float colors[4][4])
+{
+	SOFT_ALIGN16 int faceIndex[4];
+	_mm_store_si128((__m128i*)faceIndex, face);
+	SoftSampleLanes lanes;
+	for (int i = 0; i < 4; ++i)
+		lanes.texture[i] = &faces[faceIndex[i]];
+
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 u = _mm_mul_ps(_mm_add_ps(s, _mm_set1_ps(1.0f)), half);
+	__m128 v = _mm_mul_ps(_mm_add_ps(t, _mm_set1_ps(1.0f)), half);
+	SoftSampleLevels4(sampler, lanes, u, v, lod, SOFT_ADDRESS_CLAMP, SOFT_ADDRESS_CLAMP, colors);
+
+	int zero = _mm_movemask_ps(_mm_cmpeq_ps(ma, _mm_setzero_ps()));
+	for (int i = 0; i < 4; ++i)
+		if (zero & (1 << i))
+			colors[i][0] = colors[i][1] = colors[i][2] = colors[i][3] = 0.0f;
+}
+
+inline void SoftMipCube::SampleLevel4(const SoftSamplerDesc& sampler, const float dir[3][4], const float lod[4], float colors[4][4]) const
+{
+	if (m_Faces[0].LevelCount() == 0)
+	{
+		memset(colors, 0, 16 * sizeof(float));
+		return;
+	}
+	__m128i face;
+	__m128 s, t;
+	__m128 ma = SoftSelectFace4(dir, NULL, &face, &s, &t, NULL, NULL);
+	SoftCubeSample4(m_Faces, sampler, face, s, t, ma, _mm_loadu_ps(lod), colors);
+}
+
+inline void SoftMipCube::SampleGrad4(const SoftSamplerDesc& sampler, const float dir[3][4], const float ddx[3][4], const float ddy[3][4], float colors[4][4]) const
+{
+	if (m_Faces[0].LevelCount() == 0)
+	{
+		memset(colors, 0, 16 * sizeof(float));
+		return;
+	}
+	__m128i face;
+	__m128 s, t, ds[2], dt[2];
+	const float (*d[2])[4] = { ddx, ddy };
+	__m128 ma = SoftSelectFace4(dir, d, &face, &s, &t, ds, dt);
+
+	// Face coordinates span 2 units per face, texels span 1/size of a unit
+	__m128 scale = _mm_set1_ps(0.5f * Size());
+	__m128 x2 = _mm_add_ps(_mm_mul_ps(ds[0], ds[0]), _mm_mul_ps(dt[0], dt[0]));
+	__m128 y2 = _mm_add_ps(_mm_mul_ps(ds[1], ds[1]), _mm_mul_ps(dt[1], dt[1]));
+	__m128 rho2 = _mm_mul_ps(_mm_max_ps(x2, y2), _mm_mul_ps(scale, scale));
+	__m128 lod = _mm_mul_ps(_mm_set1_ps(0.5f), SoftLog2_4(rho2));
+	SoftCubeSample4(m_Faces, sampler, face, s, t, ma, lod, colors);
+}
+
+#else
+
+inline void SoftMipTexture::SampleLevel4(const SoftSamplerDesc& sampler, const float uv[2][4], const float lod[4], float colors[4][4]) const
+{
+	for (int i = 0; i < 4; ++i)
+		SampleLevel(sampler, uv[0][i], uv[1][i], lod[i], colors[i]);
+}
+
+inline void SoftMipTexture::SampleGrad4(const SoftSamplerDesc& sampler, const float uv[2][4], const float ddx[2][4], const float ddy[2][4], float colors[4][4]) const
+{
+	for (int i = 0; i < 4; ++i)
+		SampleGrad(sampler, uv[0][i], uv[1][i], ddx[0][i], ddx[1][i], ddy[0][i], ddy[1][i], colors[i]);
+}
+
+inline void SoftMipCube::SampleLevel4(const SoftSamplerDesc& sampler, const float dir[3][4], const float lod[4], float colors[4][4]) const
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		float d[3] = { dir[0][i], dir[1][i], dir[2][i] };
+		SampleLevel(sampler, d, lod[i], colors[i]);
+	}
+}
+
+inline void SoftMipCube::SampleGrad4(const SoftSamplerDesc& sampler, const float dir[3][4], const float ddx[3][4], const float ddy[3][4], float colors[4][4]) const
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		float d[3] = { dir[0][i], dir[1][i], dir[2][i] };
+		float dx[3] = { ddx[0][i], ddx[1][i], ddx[2][i] };
+		float dy[3] = { ddy[0][i], ddy[1][i], ddy[2][i] };
+		SampleGrad(sampler, d, dx, dy, colors[i]);
+	}
+}
+
+#endif
@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------------------------
+// File: tangent_space.h
+//
+// Per-vertex tangents in linear time, for any vertex with Pos, Normal, UV and a float4
+// Tangent whose w receives the bitangent sign.
+//
+// Face tangents are computed once per triangle, a vertex->corner table is built with a
+// counting sort over the index buffer, and each vertex then gathers only the corners that
+// reference it. Given a SoftThreadPool, both passes run in TANGENT_CHUNK sized chunks on
+// it; without one they run on the calling thread. Like MikkTSpace, face tangents are
+// projected onto the vertex normal plane and weighted by the corner angle, faces with a
+// degenerate UV mapping are skipped, and Tangent.w stores the bitangent sign.
+//
+// Only needs the standard library and xnamath (or Common/xnamath_portable.h), so
+// Headless/tangent_bench.cpp runs the same code off Windows.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "xnamath_portable.h"
+#include "thread_pool.h"
+
+#define TANGENT_CHUNK	1024	// faces or vertices per pool job
+
+//--------------------------------------------------------------------------------------
+// Runs func(begin, end) over [0, count) in TANGENT_CHUNK pieces, on the pool if there is
+// more than one piece
+//--------------------------------------------------------------------------------------
+template <typename Func>
+struct TangentChunkJob
+{
+	Func* func;
+	int count;
+
+	static void Run(void* context, int index)
+	{
+		TangentChunkJob* job = (TangentChunkJob*)context;
+		(*job->func)(index * TANGENT_CHUNK, std::min(job->count, (index + 1) * TANGENT_CHUNK));
+	}
+};
+
+template <typename Func>
+inline void TangentParallelFor(SoftThreadPool* pool, int count, Func func)
+{
+	int chunks = (count + TANGENT_CHUNK - 1) / TANGENT_CHUNK;
+	if (pool == NULL || chunks <= 1)
+	{
+		func(0, count);
+		return;
+	}
+	TangentChunkJob<Func> job = { &func, count };
+	pool->ParallelFor(chunks, &TangentChunkJob<Func>::Run, &job);
+}
+
+// False, and nothing written, when an index is out of range or the mesh is empty
+template <typename Vertex, typename Index>
+bool ComputeTangentSpace(Vertex vertices[], int verticesCount, const Index indices[], int triangleCount, SoftThreadPool* pool = NULL)
+{
+	if (vertices == NULL || indices == NULL || verticesCount <= 0 || triangleCount <= 0)
+		return false;
+
+	int cornersCount = triangleCount * 3;
+
+	// Vertex -> corner table (CSR), cornerStart[v]..cornerStart[v+1] are the corners of v
+	std::vector<int> cornerStart(verticesCount + 1, 0);
+	for (int c = 0; c < cornersCount; ++c)
+	{
+		if ((int)indices[c] >= verticesCount)
+			return false;
+		++cornerStart[indices[c] + 1];
+	}
+	for (int i = 0; i < verticesCount; ++i)
+		cornerStart[i + 1] += cornerStart[i];
+
+	std::vector<int> cornerList(cornersCount);
+	std::vector<int> cursor(cornerStart.begin(), cornerStart.end() - 1);
+	for (int c = 0; c < cornersCount; ++c)
+		cornerList[cursor[indices[c]]++] = c;
+
+	// Normalized face tangent/bitangent, left at zero for degenerate UV triangles
+	std::vector<XMFLOAT3> faceTangent(triangleCount);
+	std::vector<XMFLOAT3> faceBitangent(triangleCount);
+
+	TangentParallelFor(pool, triangleCount, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const Vertex& v0 = vertices[indices[i * 3]];
+			const Vertex& v1 = vertices[indices[i * 3 + 1]];
+			const Vertex& v2 = vertices[indices[i * 3 + 2]];
+
+			XMVECTOR p0 = XMLoadFloat3(&v0.Pos);
+			XMVECTOR edge1 = XMVectorSubtract(XMLoadFloat3(&v1.Pos), p0);
+			XMVECTOR edge2 = XMVectorSubtract(XMLoadFloat3(&v2.Pos), p0);
+
+			float tcU1 = v1.UV.x - v0.UV.x;
+			float tcV1 = v1.UV.y - v0.UV.y;
+			float tcU2 = v2.UV.x - v0.UV.x;
+			float tcV2 = v2.UV.y - v0.UV.y;
+
+			XMVECTOR tangent = XMVectorZero();
+			XMVECTOR bitangent = XMVectorZero();
+			float det = tcU1 * tcV2 - tcU2 * tcV1;
+			if (fabsf(det) > 1e-20f)
+			{
+				// Only the sign of the determinant matters once the vectors are normalized
+				float sign = det > 0.0f ? 1.0f : -1.0f;
+				tangent = XMVectorSubtract(XMVectorScale(edge1, tcV2), XMVectorScale(edge2, tcV1));
+				bitangent = XMVectorSubtract(XMVectorScale(edge2, tcU1), XMVectorScale(edge1, tcU2));
+				tangent = XMVectorScale(XMVector3Normalize(tangent), sign);
+				bitangent = XMVectorScale(XMVector3Normalize(bitangent), sign);
+			}
+			XMStoreFloat3(&faceTangent[i], tangent);
+			XMStoreFloat3(&faceBitangent[i], bitangent);
+		}
+	});
+
+	TangentParallelFor(pool, verticesCount, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			XMVECTOR normal = XMVector3Normalize(XMLoadFloat3(&vertices[i].Normal));
+			XMVECTOR position = XMLoadFloat3(&vertices[i].Pos);
+			XMVECTOR tangentSum = XMVectorZero();
+			XMVECTOR bitangentSum = XMVectorZero();
+
+			for (int k = cornerStart[i]; k < cornerStart[i + 1]; ++k)
+			{
+				int c = cornerList[k];
+				int face = c / 3;
+				int corner = c % 3;
+
+				XMVECTOR tangent = XMLoadFloat3(&faceTangent[face]);
+				tangent = XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent)));
+				if (XMVectorGetX(XMVector3LengthSq(tangent)) < 1e-12f)
+					continue;
+
+				// Corner angle weight keeps the result independent of how the surface is triangulated
+				XMVECTOR next = XMLoadFloat3(&vertices[indices[face * 3 + (corner + 1) % 3]].Pos);
+				XMVECTOR prev = XMLoadFloat3(&vertices[indices[face * 3 + (corner + 2) % 3]].Pos);
+				XMVECTOR e0 = XMVector3Normalize(XMVectorSubtract(next, position));
+				XMVECTOR e1 = XMVector3Normalize(XMVectorSubtract(prev, position));
+				float cosAngle = XMVectorGetX(XMVector3Dot(e0, e1));
+				cosAngle = cosAngle < -1.0f ? -1.0f : (cosAngle > 1.0f ? 1.0f : cosAngle);
+				float angle = acosf(cosAngle);
+
+				tangentSum = XMVectorAdd(tangentSum, XMVectorScale(XMVector3Normalize(tangent), angle));
+				bitangentSum = XMVectorAdd(bitangentSum, XMVectorScale(XMLoadFloat3(&faceBitangent[face]), angle));
+			}
+
+			XMVECTOR tangent = XMVectorSubtract(tangentSum, XMVectorMultiply(normal, XMVector3Dot(normal, tangentSum)));
+			if (XMVectorGetX(XMVector3LengthSq(tangent)) < 1e-12f)
+			{
+				// No usable UV gradient around this vertex, any direction in the normal plane will do
+				XMVECTOR axis = fabsf(XMVectorGetX(normal)) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+				tangent = XMVector3Cross(axis, normal);
+			}
+			tangent = XMVector3Normalize(tangent);
+
+			float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), bitangentSum)) < 0.0f ? -1.0f : 1.0f;
+			XMStoreFloat4(&vertices[i].Tangent, XMVectorSetW(tangent, handedness));
+		}
+	});
+
+	return true;
+}
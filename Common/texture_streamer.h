@@ -0,0 +1,644 @@
+//--------------------------------------------------------------------------------------
+// File: texture_streamer.h
+//
+// Mip streaming for DDS textures under a memory budget.
+//
+// Load() memory-maps a DDS file and creates the texture from its smallest mips only
+// (those no larger than TEXTURE_STREAM_TAIL_SIZE), so a scene can render right after
+// startup. Every frame the caller reports how large each texture is on screen with
+// Request() and calls Update() once. Update() picks the textures that are most
+// undersampled on screen and has a worker thread create each one again with one more
+// detailed mip. Reading the mapped pages happens there, and so does CreateTexture2D,
+// since the device is free threaded. The finished texture replaces the old one at a
+// later Update(). Call View() every frame, because the view changes as mips come and go.
+//
+// Resident bytes stay within the budget. When a load would exceed it, the least
+// recently used textures that hold more mips than their last request needed lose
+// their top mips. Dropping mips is a copy on the GPU into a smaller texture, with no
+// file access. The tail is never evicted, so a budget below the sum of all tails is
+// overrun by those. Drawing with the view of a texture whose top mips are missing
+// starts its chain at ResidentMip(); shaders that pick mips by index have to add that
+// offset.
+//
+// TextureResidency makes all of these decisions and only needs the standard library.
+// TextureStreamer (Windows only) wraps it with the files, the worker and the device.
+// Only 2D textures, 2D arrays and cube maps can be streamed.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "dds_reader.h"
+
+#define TEXTURE_STREAM_TAIL_SIZE	64		// mips up to this size load with the texture
+#define TEXTURE_STREAM_MAX_LOADS	2		// loads queued on the worker at a time
+
+struct TextureStreamStats
+{
+	unsigned int mipLevels;
+	unsigned int residentMip;		// most detailed mip in memory
+	unsigned int wantedMip;			// what the last Request() asked for
+	unsigned int loadingMip;		// residentMip when nothing is loading
+	unsigned int tailMip;			// resident from Load() on, never evicted
+	unsigned long long residentBytes;
+	unsigned long long fullBytes;	// with every mip resident
+	unsigned int lastUsedFrame;
+};
+
+struct TextureStreamAction
+{
+	int texture;
+	unsigned int mip;	// the new most detailed mip
+	bool evict;			// drop mips above it now; otherwise load up to it
+};
+
+//--------------------------------------------------------------------------------------
+// Residency planner
+//--------------------------------------------------------------------------------------
+class TextureResidency
+{
+public:
+	TextureResidency() : m_Budget(0), m_Committed(0), m_Frame(0) {}
+
+	void SetBudget(unsigned long long bytes) { m_Budget = bytes; }
+	unsigned long long Budget() const { return m_Budget; }
+	// Resident bytes plus what queued loads will add
+	unsigned long long CommittedBytes() const { return m_Committed; }
+	unsigned int Frame() const { return m_Frame; }
+	int Count() const { return (int)m_Textures.size(); }
+
+	// The tail is resident from the start. chainBytes[m] is the size of mips m and up of
+	// every slice; a texture may start at mip m when validTop[m] is set, which mip 0 is.
+	int Add(unsigned int width, unsigned int height, const std::vector<unsigned long long>& chainBytes,
+		const std::vector<bool>& validTop)
+	{
+		Texture t;
+		t.width = width;
+		t.height = height;
+		t.chainBytes = chainBytes;
+		t.validTop = validTop;
+		t.minMip = 0;
+		t.tailMip = TailMip(width, height, validTop);
+		t.residentMip = t.loadingMip = t.wantedMip = t.tailMip;
+		t.screenSize = 0.0f;
+		t.lastUsed = 0;
+		m_Committed += t.chainBytes[t.tailMip];
+		m_Textures.push_back(t);
+		return (int)m_Textures.size() - 1;
+	}
+
+	// First mip no larger than TEXTURE_STREAM_TAIL_SIZE that can start a chain
+	static unsigned int TailMip(unsigned int width, unsigned int height, const std::vector<bool>& validTop)
+	{
+		unsigned int mip = 0;
+		while (mip + 1 < validTop.size() && std::max(width >> mip, height >> mip) > TEXTURE_STREAM_TAIL_SIZE)
+			mip++;
+		while (!validTop[mip])
+			mip--;
+		return mip;
+	}
+
+	// screenSize is the largest number of pixels the whole texture spans, along either
+	// axis, anywhere it is drawn this frame
+	void Request(int texture, float screenSize)
+	{
+		Texture& t = m_Textures[texture];
+		if (t.lastUsed != m_Frame || t.screenSize < screenSize)
+			t.screenSize = screenSize;
+		t.lastUsed = m_Frame;
+	}
+
+	// Ends the frame: appends the evictions and loads to carry out, in order, and counts
+	// them as done or in flight
+	void Plan(std::vector<TextureStreamAction>* actions)
+	{
+		int loads = 0;
+		std::vector<int> candidates;
+		for (size_t i = 0; i < m_Textures.size(); ++i)
+		{
+			Texture& t = m_Textures[i];
+			t.wantedMip = t.lastUsed == m_Frame ? WantedMip(t) : t.tailMip;
+			if (t.loadingMip != t.residentMip)
+				loads++;
+			else if (t.wantedMip < t.residentMip)
+				candidates.push_back((int)i);
+		}
+
+		// Most undersampled first
+		for (size_t i = 1; i < candidates.size(); ++i)
+		{
+			for (size_t j = i; j > 0 && Priority(m_Textures[candidates[j]]) > Priority(m_Textures[candidates[j - 1]]); --j)
+				std::swap(candidates[j], candidates[j - 1]);
+		}
+		for (size_t i = 0; i < candidates.size() && loads < TEXTURE_STREAM_MAX_LOADS; ++i)
+		{
+			Texture& t = m_Textures[candidates[i]];
+			unsigned int mip = t.residentMip - 1;
+			while (!t.validTop[mip])
+				mip--;
+			unsigned long long extra = t.chainBytes[mip] - t.chainBytes[t.residentMip];
+			if (!MakeRoom(extra, false, actions))
+				continue;
+			t.loadingMip = mip;
+			m_Committed += extra;
+			TextureStreamAction action = { candidates[i], mip, false };
+			actions->push_back(action);
+			loads++;
+		}
+
+		// A lowered budget evicts even what is in use
+		MakeRoom(0, true, actions);
+		m_Frame++;
+	}
+
+	// The load Plan() asked for has finished; after a failure the texture stays where it is
+	void LoadDone(int texture, bool ok)
+	{
+		Texture& t = m_Textures[texture];
+		if (ok)
+			t.residentMip = t.loadingMip;
+		else
+		{
+			m_Committed -= t.chainBytes[t.loadingMip] - t.chainBytes[t.residentMip];
+			t.loadingMip = t.minMip = t.residentMip;
+		}
+	}
+
+	unsigned int ResidentMip(int texture) const { return m_Textures[texture].residentMip; }
+
+	void Stats(int texture, TextureStreamStats* stats) const
+	{
+		const Texture& t = m_Textures[texture];
+		stats->mipLevels = (unsigned int)t.chainBytes.size();
+		stats->residentMip = t.residentMip;
+		stats->wantedMip = t.wantedMip;
+		stats->loadingMip = t.loadingMip;
+		stats->tailMip = t.tailMip;
+		stats->residentBytes = t.chainBytes[t.residentMip];
+		stats->fullBytes = t.chainBytes[0];
+		stats->lastUsedFrame = t.lastUsed;
+	}
+
+private:
+	struct Texture
+	{
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned long long> chainBytes;
+		std::vector<bool> validTop;
+		unsigned int minMip;		// most detailed mip to load, above 0 after a failed load
+		unsigned int tailMip;
+		unsigned int residentMip;
+		unsigned int loadingMip;
+		unsigned int wantedMip;
+		float screenSize;
+		unsigned int lastUsed;		// frame of the last Request()
+	};
+
+	// The least detailed mip that still has a texel per pixel
+	static unsigned int WantedMip(const Texture& t)
+	{
+		unsigned int mip = t.minMip;
+		while (mip < t.tailMip && (float)std::max(t.width >> (mip + 1), t.height >> (mip + 1)) >= t.screenSize)
+			mip++;
+		// Round to more detail where the chain can't start, or less below minMip
+		unsigned int valid = mip;
+		while (valid > t.minMip && !t.validTop[valid])
+			valid--;
+		if (!t.validTop[valid])
+			for (valid = mip; !t.validTop[valid]; ++valid) {}
+		return valid;
+	}
+
+	// Screen pixels per resident texel
+	static float Priority(const Texture& t)
+	{
+		return t.screenSize / (float)std::max(std::max(t.width >> t.residentMip, t.height >> t.residentMip), 1u);
+	}
+
+	// Evicts top mips, least recently used texture first, until extra bytes fit. Only
+	// textures holding more than they want are victims, unless force is set.
+	bool MakeRoom(unsigned long long extra, bool force, std::vector<TextureStreamAction>* actions)
+	{
+		while (m_Committed + extra > m_Budget)
+		{
+			int victim = -1;
+			for (size_t i = 0; i < m_Textures.size(); ++i)
+			{
+				const Texture& t = m_Textures[i];
+				if (t.loadingMip != t.residentMip || t.residentMip >= t.tailMip || (!force && t.residentMip >= t.wantedMip))
+					continue;
+				if (victim < 0)
+				{
+					victim = (int)i;
+					continue;
+				}
+				const Texture& v = m_Textures[victim];
+				if (t.lastUsed < v.lastUsed || (t.lastUsed == v.lastUsed && Priority(t) < Priority(v)))
+					victim = (int)i;
+			}
+			if (victim < 0)
+				return false;
+
+			Texture& t = m_Textures[victim];
+			unsigned int mip = t.residentMip + 1;
+			while (!t.validTop[mip])
+				mip++;
+			m_Committed -= t.chainBytes[t.residentMip] - t.chainBytes[mip];
+			t.residentMip = t.loadingMip = mip;
+			TextureStreamAction action = { victim, mip, true };
+			actions->push_back(action);
+		}
+		return true;
+	}
+
+	std::vector<Texture> m_Textures;
+	unsigned long long m_Budget;
+	unsigned long long m_Committed;
+	unsigned int m_Frame;
+};
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
+#endif
+#include <windows.h>
+#include <d3d11.h>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//--------------------------------------------------------------------------------------
+// Streamer
+//--------------------------------------------------------------------------------------
+class TextureStreamer
+{
+public:
+	TextureStreamer() : m_Device(NULL), m_Context(NULL), m_Quit(false) {}
+
+	~TextureStreamer()
+	{
+		Release();
+	}
+
+	void Init(ID3D11Device* device, ID3D11DeviceContext* context, unsigned long long budgetBytes)
+	{
+		m_Device = device;
+		m_Context = context;
+		m_Residency.SetBudget(budgetBytes);
+		m_Quit = false;
+		m_Worker = std::thread(&TextureStreamer::WorkerLoop, this);
+	}
+
+	void Release()
+	{
+		if (m_Worker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Quit = true;
+			}
+			m_Wake.notify_all();
+			m_Worker.join();
+		}
+		for (size_t i = 0; i < m_Done.size(); ++i)
+			ReleaseLevel(&m_Done[i]);
+		m_Jobs.clear();
+		m_Done.clear();
+		for (size_t i = 0; i < m_Textures.size(); ++i)
+		{
+			StreamedTexture* t = m_Textures[i];
+			ReleaseLevel(&t->level);
+			UnmapViewOfFile(t->data);
+			CloseHandle(t->mapping);
+			CloseHandle(t->file);
+			delete t;
+		}
+		m_Textures.clear();
+		m_Residency = TextureResidency();
+	}
+
+	// Returns the texture's handle, or -1 when the file can't be read or streamed
+	int Load(const wchar_t* fileName)
+	{
+		HANDLE file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return -1;
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = NULL;
+		unsigned char* data = NULL;
+		// Copy-on-write, for the X8B8G8R8 alpha fix-up like CreateDDSTextureFromFile
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+			mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping)
+			data = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+
+		StreamedTexture* t = new StreamedTexture;
+		t->name = fileName;
+		t->file = file;
+		t->mapping = mapping;
+		t->data = data;
+		t->level.texture = NULL;
+		t->level.view = NULL;
+		if (data == NULL || !ParseDDS(data, (size_t)fileSize.QuadPart, &t->image) ||
+			t->image.dimension != DDS_DIMENSION_TEXTURE2D)
+		{
+			if (data)
+				UnmapViewOfFile(data);
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			delete t;
+			return -1;
+		}
+
+		// Sizes of every partial chain, and where a chain may start
+		const DDSImage& image = t->image;
+		unsigned int slices = image.arraySize * (image.isCube ? 6 : 1);
+		std::vector<unsigned long long> chainBytes(image.mipLevels + 1, 0);
+		std::vector<bool> validTop(image.mipLevels);
+		for (int m = (int)image.mipLevels - 1; m >= 0; --m)
+		{
+			chainBytes[m] = chainBytes[m + 1];
+			for (unsigned int s = 0; s < slices; ++s)
+				chainBytes[m] += image.subresources[s * image.mipLevels + m].slicePitch;
+			const DDSSubresource& top = image.subresources[m];
+			validTop[m] = m == 0 || DDSBlockBytes(image.format) == 0 || (top.width % 4 == 0 && top.height % 4 == 0);
+		}
+		chainBytes.pop_back();
+
+		if (FAILED(CreateLevel(t, TextureResidency::TailMip(image.width, image.height, validTop), &t->level)))
+		{
+			UnmapViewOfFile(data);
+			CloseHandle(mapping);
+			CloseHandle(file);
+			delete t;
+			return -1;
+		}
+		m_Textures.push_back(t);
+		return m_Residency.Add(image.width, image.height, chainBytes, validTop);
+	}
+
+	ID3D11ShaderResourceView* View(int texture) const
+	{
+		return texture >= 0 ? m_Textures[texture]->level.view : NULL;
+	}
+
+	unsigned int ResidentMip(int texture) const
+	{
+		return texture >= 0 ? m_Residency.ResidentMip(texture) : 0;
+	}
+
+	// See TextureResidency::Request
+	void Request(int texture, float screenSize)
+	{
+		if (texture >= 0)
+			m_Residency.Request(texture, screenSize);
+	}
+
+	// Once a frame, before drawing: swaps in finished loads, evicts and queues new loads
+	void Update()
+	{
+		std::deque<StreamLevel> done;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			done.swap(m_Done);
+		}
+		for (size_t i = 0; i < done.size(); ++i)
+		{
+			StreamLevel& level = done[i];
+			bool ok = SUCCEEDED(level.hr);
+			if (ok)
+			{
+				ReleaseLevel(&m_Textures[level.handle]->level);
+				m_Textures[level.handle]->level = level;
+			}
+			m_Residency.LoadDone(level.handle, ok);
+		}
+
+		std::vector<TextureStreamAction> actions;
+		m_Residency.Plan(&actions);
+		for (size_t i = 0; i < actions.size(); ++i)
+		{
+			const TextureStreamAction& action = actions[i];
+			StreamedTexture* t = m_Textures[action.texture];
+			if (action.evict)
+			{
+				StreamLevel level;
+				if (SUCCEEDED(CopyLevel(t, action.mip, &level)))
+				{
+					ReleaseLevel(&t->level);
+					t->level = level;
+				}
+				continue;
+			}
+
+			StreamLevel job;
+			job.handle = action.texture;
+			job.source = t;
+			job.mip = action.mip;
+			job.texture = NULL;
+			job.view = NULL;
+			job.hr = E_PENDING;
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Jobs.push_back(job);
+			}
+			m_Wake.notify_one();
+		}
+	}
+
+	void SetBudget(unsigned long long bytes) { m_Residency.SetBudget(bytes); }
+	unsigned long long Budget() const { return m_Residency.Budget(); }
+	unsigned long long CommittedBytes() const { return m_Residency.CommittedBytes(); }
+	int Count() const { return m_Residency.Count(); }
+	const wchar_t* Name(int texture) const { return m_Textures[texture]->name.c_str(); }
+	void Stats(int texture, TextureStreamStats* stats) const { m_Residency.Stats(texture, stats); }
+
+private:
+	struct StreamedTexture;
+
+	// One texture made of mips [mip, mipLevels), or a request for one
+	struct StreamLevel
+	{
+		int handle;
+		StreamedTexture* source;
+		unsigned int mip;
+		ID3D11Texture2D* texture;
+		ID3D11ShaderResourceView* view;
+		HRESULT hr;
+	};
+
+	struct StreamedTexture
+	{
+		std::wstring name;
+		HANDLE file;
+		HANDLE mapping;
+		unsigned char* data;
+		DDSImage image;			// points into the mapping
+		StreamLevel level;		// what is resident
+	};
+
+	static void ReleaseLevel(StreamLevel* level)
+	{
+		if (level->view)
+			level->view->Release();
+		if (level->texture)
+			level->texture->Release();
+		level->view = NULL;
+		level->texture = NULL;
+	}
+
+	void DescribeLevel(const DDSImage& image, unsigned int mip, D3D11_TEXTURE2D_DESC* desc, D3D11_SHADER_RESOURCE_VIEW_DESC* viewDesc)
+	{
+		unsigned int mipLevels = image.mipLevels - mip;
+		ZeroMemory(desc, sizeof(*desc));
+		desc->Width = std::max(image.width >> mip, 1u);
+		desc->Height = std::max(image.height >> mip, 1u);
+		desc->MipLevels = mipLevels;
+		desc->ArraySize = image.arraySize * (image.isCube ? 6 : 1);
+		desc->Format = (DXGI_FORMAT)image.format;
+		desc->SampleDesc.Count = 1;
+		desc->Usage = D3D11_USAGE_IMMUTABLE;
+		desc->BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc->MiscFlags = image.isCube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+		ZeroMemory(viewDesc, sizeof(*viewDesc));
+		viewDesc->Format = desc->Format;
+		if (image.isCube && image.arraySize > 1)
+		{
+			viewDesc->ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+			viewDesc->TextureCubeArray.MipLevels = mipLevels;
+			viewDesc->TextureCubeArray.NumCubes = image.arraySize;
+		}
+		else if (image.isCube)
+		{
+			viewDesc->ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+			viewDesc->TextureCube.MipLevels = mipLevels;
+		}
+		else if (image.arraySize > 1)
+		{
+			viewDesc->ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			viewDesc->Texture2DArray.MipLevels = mipLevels;
+			viewDesc->Texture2DArray.ArraySize = image.arraySize;
+		}
+		else
+		{
+			viewDesc->ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			viewDesc->Texture2D.MipLevels = mipLevels;
+		}
+	}
+
+	// From the mapped file; on the worker, or on the caller's thread for the tail
+	HRESULT CreateLevel(StreamedTexture* t, unsigned int mip, StreamLevel* level)
+	{
+		const DDSImage& image = t->image;
+		D3D11_TEXTURE2D_DESC desc;
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		DescribeLevel(image, mip, &desc, &viewDesc);
+
+		std::vector<D3D11_SUBRESOURCE_DATA> initData;
+		for (unsigned int s = 0; s < desc.ArraySize; ++s)
+		{
+			for (unsigned int m = mip; m < image.mipLevels; ++m)
+			{
+				const DDSSubresource& subresource = image.subresources[s * image.mipLevels + m];
+				if (image.forceOpaqueAlpha)
+				{
+					unsigned char* pixels = (unsigned char*)subresource.data;
+					for (size_t p = 3; p < (size_t)subresource.slicePitch; p += 4)
+						pixels[p] = 0xff;
+				}
+				D3D11_SUBRESOURCE_DATA data;
+				data.pSysMem = subresource.data;
+				data.SysMemPitch = subresource.rowPitch;
+				data.SysMemSlicePitch = subresource.slicePitch;
+				initData.push_back(data);
+			}
+		}
+
+		level->mip = mip;
+		level->texture = NULL;
+		level->view = NULL;
+		HRESULT hr = m_Device->CreateTexture2D(&desc, &initData[0], &level->texture);
+		if (SUCCEEDED(hr))
+			hr = m_Device->CreateShaderResourceView(level->texture, &viewDesc, &level->view);
+		if (FAILED(hr))
+			ReleaseLevel(level);
+		return hr;
+	}
+
+	// Drops the top mips of what is resident with a copy on the GPU
+	HRESULT CopyLevel(StreamedTexture* t, unsigned int mip, StreamLevel* level)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		DescribeLevel(t->image, mip, &desc, &viewDesc);
+		desc.Usage = D3D11_USAGE_DEFAULT;
+
+		*level = t->level;
+		level->mip = mip;
+		level->texture = NULL;
+		level->view = NULL;
+		HRESULT hr = m_Device->CreateTexture2D(&desc, NULL, &level->texture);
+		if (SUCCEEDED(hr))
+			hr = m_Device->CreateShaderResourceView(level->texture, &viewDesc, &level->view);
+		if (FAILED(hr))
+		{
+			ReleaseLevel(level);
+			return hr;
+		}
+
+		unsigned int skip = mip - t->level.mip, sourceMips = desc.MipLevels + skip;
+		for (unsigned int s = 0; s < desc.ArraySize; ++s)
+		{
+			for (unsigned int m = 0; m < desc.MipLevels; ++m)
+			{
+				m_Context->CopySubresourceRegion(level->texture, D3D11CalcSubresource(m, s, desc.MipLevels), 0, 0, 0,
+					t->level.texture, D3D11CalcSubresource(m + skip, s, sourceMips), NULL);
+			}
+		}
+		return S_OK;
+	}
+
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			StreamLevel job;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				while (!m_Quit && m_Jobs.empty())
+					m_Wake.wait(lock);
+				if (m_Quit)
+					return;
+				job = m_Jobs.front();
+				m_Jobs.pop_front();
+			}
+
+			job.hr = CreateLevel(job.source, job.mip, &job);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Done.push_back(job);
+			}
+		}
+	}
+
+	ID3D11Device* m_Device;
+	ID3D11DeviceContext* m_Context;
+	std::vector<StreamedTexture*> m_Textures;	// indexed by handle; the worker gets pointers
+	TextureResidency m_Residency;				// main thread only
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::deque<StreamLevel> m_Jobs;
+	std::deque<StreamLevel> m_Done;
+	bool m_Quit;
+};
+
+#endif
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// File: thread_pool.h
+//
+// Fixed-size pool of worker threads; the calling thread joins in. ParallelFor hands out
+// indices one at a time, so jobs of uneven cost balance themselves. Shared by the
+// software rasterizer and the Common/ modules that split their work over threads, which
+// include this header rather than soft_rasterizer.h.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+typedef void (*SoftJobFunction)(void* context, int index);
+
+class SoftThreadPool
+{
+public:
+	// threadCount includes the calling thread, 0 uses every hardware thread
+	explicit SoftThreadPool(int threadCount)
+		: m_Function(NULL), m_Context(NULL), m_Count(0), m_Generation(0), m_Active(0), m_Quit(false)
+	{
+		m_Next = 0;
+		if (threadCount <= 0)
+			threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 1; i < threadCount; ++i)
+			m_Workers.push_back(std::thread(&SoftThreadPool::WorkerLoop, this));
+	}
+
+	~SoftThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_Wake.notify_all();
+		for (size_t i = 0; i < m_Workers.size(); ++i)
+			m_Workers[i].join();
+	}
+
+	int ThreadCount() const { return (int)m_Workers.size() + 1; }
+
+	// Calls function(context, i) for every i in [0, count) and returns when all are done
+	void ParallelFor(int count, SoftJobFunction function, void* context)
+	{
+		if (m_Workers.empty() || count <= 1)
+		{
+			for (int i = 0; i < count; ++i)
+				function(context, i);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Function = function;
+			m_Context = context;
+			m_Count = count;
+			m_Next = 0;
+			m_Active = (int)m_Workers.size();
+			m_Generation++;
+		}
+		m_Wake.notify_all();
+
+		RunJobs();
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (m_Active > 0)
+			m_Done.wait(lock);
+	}
+
+private:
+	void RunJobs()
+	{
+		for (;;)
+		{
+			int index = m_Next++;
+			if (index >= m_Count)
+				break;
+			m_Function(m_Context, index);
+		}
+	}
+
+	void WorkerLoop()
+	{
+		unsigned int seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				while (!m_Quit && m_Generation == seen)
+					m_Wake.wait(lock);
+				if (m_Quit)
+					return;
+				seen = m_Generation;
+			}
+
+			RunJobs();
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_Active == 0)
+				m_Done.notify_one();
+		}
+	}
+
+	SoftThreadPool(const SoftThreadPool&);
+	SoftThreadPool& operator=(const SoftThreadPool&);
+
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::condition_variable m_Done;
+	SoftJobFunction m_Function;
+	void* m_Context;
+	int m_Count;
+	std::atomic<int> m_Next;
+	unsigned int m_Generation;
+	int m_Active;
+	bool m_Quit;
+};
@@ -0,0 +1,302 @@
+//--------------------------------------------------------------------------------------
+// File: transform_store.h
+//
+// Object transforms kept as structure-of-arrays: positions, rotation quaternions and
+// scales in separate float arrays, so Compose() builds the world and world-view-
+// projection matrices of several objects at once, one object per SIMD lane. The
+// world matrix is the samples' Scale * Rotation * Translation.
+//
+// The view-projection matrix is passed in once per frame, and both results come out
+// already transposed, the column-major packing HLSL constant buffers use by default:
+// copying World(i) or WVP(i) into a constant buffer needs no XMMatrixTranspose.
+//
+// Lanes are eight objects with AVX2 (/arch:AVX2 or -mavx2), otherwise four with SSE2
+// where available; define TRANSFORM_STORE_SCALAR to compare with one object at a time.
+// Given a SoftThreadPool, stores with more than TRANSFORM_BATCH objects are composed
+// in batches of that many on its threads. ComposeWorld() skips the WVP matrices, for
+// callers that multiply by the view-projection in the shader (instanced draws).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "xnamath_portable.h"
+#include "thread_pool.h"
+#if !defined(TRANSFORM_STORE_SCALAR)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_STORE_AVX2
+#elif defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSFORM_STORE_SSE2
+#endif
+#endif
+
+#define TRANSFORM_PADDING	8		// arrays are padded to the widest lane count with identity transforms
+#define TRANSFORM_BATCH		4096	// objects per thread pool job, a multiple of TRANSFORM_PADDING
+
+// A matrix in the shader's packing: row i holds column i of the matrix
+struct TransformMatrix
+{
+	XMFLOAT4 row[4];
+};
+
+inline XMMATRIX LoadTransformMatrix(const TransformMatrix& matrix)
+{
+	return XMMATRIX(XMLoadFloat4(&matrix.row[0]), XMLoadFloat4(&matrix.row[1]), XMLoadFloat4(&matrix.row[2]),
+		XMLoadFloat4(&matrix.row[3]));
+}
+
+//--------------------------------------------------------------------------------------
+// Lane arithmetic: the same Compose code runs on each back-end
+//--------------------------------------------------------------------------------------
+#if defined(TRANSFORM_STORE_AVX2)
+
+#define TRANSFORM_LANES		8
+typedef __m256 TransformLane;
+
+inline TransformLane TransformLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline TransformLane TransformSet(float value) { return _mm256_set1_ps(value); }
+inline TransformLane TransformAdd(TransformLane a, TransformLane b) { return _mm256_add_ps(a, b); }
+inline TransformLane TransformSub(TransformLane a, TransformLane b) { return _mm256_sub_ps(a, b); }
+inline TransformLane TransformMul(TransformLane a, TransformLane b) { return _mm256_mul_ps(a, b); }
+
+// Writes row `row` of eight matrices from its four elements, one object per lane
+inline void TransformStoreRow(TransformMatrix* out, int row, TransformLane x, TransformLane y, TransformLane z, TransformLane w)
+{
+	// A 4x4 transpose in each 128-bit half: objects 0 to 3 in the low halves, 4 to 7 in the high
+	__m256 xy0 = _mm256_unpacklo_ps(x, y), xy1 = _mm256_unpackhi_ps(x, y);
+	__m256 zw0 = _mm256_unpacklo_ps(z, w), zw1 = _mm256_unpackhi_ps(z, w);
+	__m256 r[4] = { _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2)),
+		_mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2)) };
+	for (int i = 0; i < 4; ++i)
+	{
+		_mm_storeu_ps(&out[i].row[row].x, _mm256_castps256_ps128(r[i]));
+		_mm_storeu_ps(&out[i + 4].row[row].x, _mm256_extractf128_ps(r[i], 1));
+	}
+}
+
+#elif defined(TRANSFORM_STORE_SSE2)
+
+#define TRANSFORM_LANES		4
+typedef __m128 TransformLane;
+
+inline TransformLane TransformLoad(const float* p) { return _mm_loadu_ps(p); }
+inline TransformLane TransformSet(float value) { return _mm_set1_ps(value); }
+inline TransformLane TransformAdd(TransformLane a, TransformLane b) { return _mm_add_ps(a, b); }
+inline TransformLane TransformSub(TransformLane a, TransformLane b) { return _mm_sub_ps(a, b); }
+inline TransformLane TransformMul(TransformLane a, TransformLane b) { return _mm_mul_ps(a, b); }
+
+inline void TransformStoreRow(TransformMatrix* out, int row, TransformLane x, TransformLane y, TransformLane z, TransformLane w)
+{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(&out[0].row[row].x, x);
+	_mm_storeu_ps(&out[1].row[row].x, y);
+	_mm_storeu_ps(&out[2].row[row].x, z);
+	_mm_storeu_ps(&out[3].row[row].x, w);
+}
+
+#else
+
+#define TRANSFORM_LANES		1
+typedef float TransformLane;
+
+inline TransformLane TransformLoad(const float* p) { return *p; }
+inline TransformLane TransformSet(float value) { return value; }
+inline TransformLane TransformAdd(TransformLane a, TransformLane b) { return a + b; }
+inline TransformLane TransformSub(TransformLane a, TransformLane b) { return a - b; }
+inline TransformLane TransformMul(TransformLane a, TransformLane b) { return a * b; }
+
+inline void TransformStoreRow(TransformMatrix* out, int row, TransformLane x, TransformLane y, TransformLane z, TransformLane w)
+{
+	out->row[row] = XMFLOAT4(x, y, z, w);
+}
+
+#endif
+
+//--------------------------------------------------------------------------------------
+// Store
+//--------------------------------------------------------------------------------------
+class TransformStore
+{
+public:
+	TransformStore() : m_Count(0), m_ComposeWVP(true) {}
+
+	// A new identity transform, returns its index
+	int Add()
+	{
+		if (m_Count == (int)m_PositionX.size())
+		{
+			size_t size = m_Count + TRANSFORM_PADDING;
+			m_PositionX.resize(size, 0.0f);
+			m_PositionY.resize(size, 0.0f);
+			m_PositionZ.resize(size, 0.0f);
+			m_RotationX.resize(size, 0.0f);
+			m_RotationY.resize(size, 0.0f);
+			m_RotationZ.resize(size, 0.0f);
+			m_RotationW.resize(size, 1.0f);
+			m_ScaleX.resize(size, 1.0f);
+			m_ScaleY.resize(size, 1.0f);
+			m_ScaleZ.resize(size, 1.0f);
+			m_World.resize(size);
+			m_WVP.resize(size);
+		}
+		return m_Count++;
+	}
+
+	void Clear()
+	{
+		m_PositionX.clear();
+		m_PositionY.clear();
+		m_PositionZ.clear();
+		m_RotationX.clear();
+		m_RotationY.clear();
+		m_RotationZ.clear();
+		m_RotationW.clear();
+		m_ScaleX.clear();
+		m_ScaleY.clear();
+		m_ScaleZ.clear();
+		m_World.clear();
+		m_WVP.clear();
+		m_Count = 0;
+	}
+
+	int Count() const { return m_Count; }
+
+	void SetPosition(int i, float x, float y, float z)
+	{
+		m_PositionX[i] = x;
+		m_PositionY[i] = y;
+		m_PositionZ[i] = z;
+	}
+
+	void SetScale(int i, float x, float y, float z)
+	{
+		m_ScaleX[i] = x;
+		m_ScaleY[i] = y;
+		m_ScaleZ[i] = z;
+	}
+
+	// quaternion must be unit length
+	void SetRotation(int i, const XMFLOAT4& quaternion)
+	{
+		m_RotationX[i] = quaternion.x;
+		m_RotationY[i] = quaternion.y;
+		m_RotationZ[i] = quaternion.z;
+		m_RotationW[i] = quaternion.w;
+	}
+
+	// The same rotation as XMMatrixRotationAxis for a unit axis
+	void SetRotationAxis(int i, const XMFLOAT3& axis, float angle)
+	{
+		float s = sinf(angle * 0.5f), c = cosf(angle * 0.5f);
+		SetRotation(i, XMFLOAT4(axis.x * s, axis.y * s, axis.z * s, c));
+	}
+
+	XMFLOAT3 Position(int i) const { return XMFLOAT3(m_PositionX[i], m_PositionY[i], m_PositionZ[i]); }
+
+	// Rebuilds World() and WVP() of every transform. pool may be NULL.
+	void Compose(CXMMATRIX viewProjection, SoftThreadPool* pool)
+	{
+		for (int r = 0; r < 4; ++r)
+		{
+			XMFLOAT4 row;
+			XMStoreFloat4(&row, viewProjection.r[r]);
+			m_ViewProjection[r][0] = row.x;
+			m_ViewProjection[r][1] = row.y;
+			m_ViewProjection[r][2] = row.z;
+			m_ViewProjection[r][3] = row.w;
+		}
+		m_ComposeWVP = true;
+		Run(pool);
+	}
+
+	// Rebuilds World() only; WVP() keeps whatever the last Compose left. pool may be NULL.
+	void ComposeWorld(SoftThreadPool* pool)
+	{
+		m_ComposeWVP = false;
+		Run(pool);
+	}
+
+	// Both in the shader's packing, valid until the next Add or Compose
+	const TransformMatrix& World(int i) const { return m_World[i]; }
+	const TransformMatrix& WVP(int i) const { return m_WVP[i]; }
+
+private:
+	void Run(SoftThreadPool* pool)
+	{
+		// Whole lane groups; the padding past m_Count is identity and its results unused
+		int end = (m_Count + TRANSFORM_LANES - 1) / TRANSFORM_LANES * TRANSFORM_LANES;
+		int batches = (end + TRANSFORM_BATCH - 1) / TRANSFORM_BATCH;
+		if (pool && batches > 1)
+			pool->ParallelFor(batches, &TransformStore::ComposeJob, this);
+		else
+			ComposeRange(0, end);
+	}
+
+	static void ComposeJob(void* context, int index)
+	{
+		TransformStore* store = (TransformStore*)context;
+		int end = (store->m_Count + TRANSFORM_LANES - 1) / TRANSFORM_LANES * TRANSFORM_LANES;
+		store->ComposeRange(index * TRANSFORM_BATCH, std::min(end, (index + 1) * TRANSFORM_BATCH));
+	}
+
+	// begin and end are multiples of TRANSFORM_LANES
+	void ComposeRange(int begin, int end)
+	{
+		const TransformLane one = TransformSet(1.0f), two = TransformSet(2.0f), zero = TransformSet(0.0f);
+		TransformLane vp[4][4];
+		for (int r = 0; r < 4; ++r)
+			for (int c = 0; c < 4; ++c)
+				vp[r][c] = TransformSet(m_ViewProjection[r][c]);
+
+		for (int i = begin; i < end; i += TRANSFORM_LANES)
+		{
+			// Rotation matrix of the quaternion, as XMMatrixRotationQuaternion
+			TransformLane x = TransformLoad(&m_RotationX[i]), y = TransformLoad(&m_RotationY[i]);
+			TransformLane z = TransformLoad(&m_RotationZ[i]), w = TransformLoad(&m_RotationW[i]);
+			TransformLane x2 = TransformMul(x, two), y2 = TransformMul(y, two), z2 = TransformMul(z, two);
+			TransformLane xx = TransformMul(x, x2), yy = TransformMul(y, y2), zz = TransformMul(z, z2);
+			TransformLane xy = TransformMul(x, y2), xz = TransformMul(x, z2), yz = TransformMul(y, z2);
+			TransformLane wx = TransformMul(w, x2), wy = TransformMul(w, y2), wz = TransformMul(w, z2);
+
+			// world[r][c] for the upper 3x3, each row scaled; the fourth row is the position
+			TransformLane sx = TransformLoad(&m_ScaleX[i]), sy = TransformLoad(&m_ScaleY[i]), sz = TransformLoad(&m_ScaleZ[i]);
+			TransformLane world[4][3] = {
+				{ TransformMul(sx, TransformSub(one, TransformAdd(yy, zz))), TransformMul(sx, TransformAdd(xy, wz)), TransformMul(sx, TransformSub(xz, wy)) },
+				{ TransformMul(sy, TransformSub(xy, wz)), TransformMul(sy, TransformSub(one, TransformAdd(xx, zz))), TransformMul(sy, TransformAdd(yz, wx)) },
+				{ TransformMul(sz, TransformAdd(xz, wy)), TransformMul(sz, TransformSub(yz, wx)), TransformMul(sz, TransformSub(one, TransformAdd(xx, yy))) },
+				{ TransformLoad(&m_PositionX[i]), TransformLoad(&m_PositionY[i]), TransformLoad(&m_PositionZ[i]) } };
+
+			// Packed row c is column c: world[0..3][c], then (0, 0, 0, 1)
+			for (int c = 0; c < 3; ++c)
+				TransformStoreRow(&m_World[i], c, world[0][c], world[1][c], world[2][c], world[3][c]);
+			TransformStoreRow(&m_World[i], 3, zero, zero, zero, one);
+			if (!m_ComposeWVP)
+				continue;
+
+			// Column c of world * viewProjection; the world's fourth column is (0, 0, 0, 1)
+			for (int c = 0; c < 4; ++c)
+			{
+				TransformLane column[4];
+				for (int r = 0; r < 4; ++r)
+				{
+					column[r] = TransformAdd(TransformAdd(TransformMul(world[r][0], vp[0][c]), TransformMul(world[r][1], vp[1][c])),
+						TransformMul(world[r][2], vp[2][c]));
+				}
+				column[3] = TransformAdd(column[3], vp[3][c]);
+				TransformStoreRow(&m_WVP[i], c, column[0], column[1], column[2], column[3]);
+			}
+		}
+	}
+
+	std::vector<float> m_PositionX, m_PositionY, m_PositionZ;
+	std::vector<float> m_RotationX, m_RotationY, m_RotationZ, m_RotationW;
+	std::vector<float> m_ScaleX, m_ScaleY, m_ScaleZ;
+	std::vector<TransformMatrix> m_World;
+	std::vector<TransformMatrix> m_WVP;
+	float m_ViewProjection[4][4];
+	int m_Count;
+	bool m_ComposeWVP;		// Compose rather than ComposeWorld
+};
@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------------------
+// File: vertex_cache.h
+//
+// Post-transform vertex cache optimization, used by D3D11_sky_mapping and the Tutorial05
+// samples (through their mesh import hooks).
+//
+// OptimizeVertexCache is Tom Forsyth's linear-speed greedy reordering: the next triangle
+// is always the best scoring one touching the simulated LRU cache, where vertices score
+// high when they were used recently or have few triangles left. OptimizeVertexFetch then
+// renumbers the vertices in first-use order so the vertex fetch walks memory forwards.
+// CountVertexCacheMisses measures the result on a FIFO cache like the hardware's;
+// OptimizeVertexCache leaves the order alone when it cannot lower that count.
+//
+// Templates over the vertex and index types; only needs the standard library.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#define VERTEX_CACHE_SIZE	32
+#define FIFO_CACHE_SIZE		16
+
+inline float VertexCacheScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score, so the next one can't just reuse them
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (cachePosition - 3) * (1.0f / (VERTEX_CACHE_SIZE - 3)), 1.5f);
+	}
+
+	// Favour vertices with few triangles left so they get finished instead of lingering
+	score += 2.0f * powf((float)remainingTriangles, -0.5f);
+	return score;
+}
+
+// Misses of a FIFO post-transform cache, ACMR = misses / triangles, ATVR = misses / vertices
+template <typename Index>
+int CountVertexCacheMisses(const Index* indices, int indicesNum, int verticesNum)
+{
+	std::vector<int> insertedAt(verticesNum, -FIFO_CACHE_SIZE);
+	int misses = 0;
+	for (int i = 0; i < indicesNum; ++i)
+	{
+		if (misses - insertedAt[indices[i]] >= FIFO_CACHE_SIZE)
+		{
+			insertedAt[indices[i]] = misses;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+template <typename Index>
+void OptimizeVertexCache(Index* indices, int indicesNum, int verticesNum)
+{
+	int triangleCount = indicesNum / 3;
+	if (triangleCount < 2)
+		return;
+
+	// Vertex -> triangle adjacency, the first remaining[v] entries of each range are still live
+	std::vector<int> triangleStart(verticesNum + 1, 0);
+	for (int i = 0; i < indicesNum; ++i)
+		triangleStart[indices[i] + 1]++;
+	for (int v = 0; v < verticesNum; ++v)
+		triangleStart[v + 1] += triangleStart[v];
+	std::vector<int> triangleList(indicesNum);
+	std::vector<int> cursor(triangleStart.begin(), triangleStart.end() - 1);
+	for (int i = 0; i < indicesNum; ++i)
+		triangleList[cursor[indices[i]]++] = i / 3;
+
+	std::vector<int> remaining(verticesNum);
+	std::vector<int> cachePosition(verticesNum, -1);
+	std::vector<float> vertexScore(verticesNum);
+	for (int v = 0; v < verticesNum; ++v)
+	{
+		remaining[v] = triangleStart[v + 1] - triangleStart[v];
+		vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (int t = 0; t < triangleCount; ++t)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	std::vector<Index> output;
+	output.reserve(indicesNum);
+	int cache[VERTEX_CACHE_SIZE + 3];
+	int cacheSize = 0;
+	int scanPosition = 0;
+	int bestTriangle = -1;
+	for (int emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		// Nothing in the cache has a live triangle left, continue with the next unused one
+		if (bestTriangle < 0)
+		{
+			while (emitted[scanPosition])
+				++scanPosition;
+			bestTriangle = scanPosition;
+		}
+
+		emitted[bestTriangle] = true;
+		int triangle[3] = { (int)indices[bestTriangle * 3], (int)indices[bestTriangle * 3 + 1], (int)indices[bestTriangle * 3 + 2] };
+		int newCache[VERTEX_CACHE_SIZE + 3];
+		int newCacheSize = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			int v = triangle[j];
+			output.push_back((Index)v);
+			newCache[newCacheSize++] = v;
+
+			// Drop the triangle from the vertex's live range
+			int* live = &triangleList[triangleStart[v]];
+			for (int k = 0; k < remaining[v]; ++k)
+			{
+				if (live[k] == bestTriangle)
+				{
+					live[k] = live[remaining[v] - 1];
+					live[remaining[v] - 1] = bestTriangle;
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+		for (int i = 0; i < cacheSize; ++i)
+		{
+			int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCacheSize++] = v;
+		}
+
+		// Rescore everything that moved, including the vertices pushed out of the cache
+		for (int i = 0; i < newCacheSize; ++i)
+		{
+			int v = newCache[i];
+			cachePosition[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+			float score = VertexCacheScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (int k = 0; k < remaining[v]; ++k)
+				triangleScore[triangleList[triangleStart[v] + k]] += delta;
+		}
+		cacheSize = newCacheSize < VERTEX_CACHE_SIZE ? newCacheSize : VERTEX_CACHE_SIZE;
+		for (int i = 0; i < cacheSize; ++i)
+			cache[i] = newCache[i];
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheSize; ++i)
+		{
+			int v = cache[i];
+			for (int k = 0; k < remaining[v]; ++k)
+			{
+				int t = triangleList[triangleStart[v] + k];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	// The greedy order targets an LRU cache; an input that already does better on the FIFO one,
+	// e.g. a generated grid, is kept as it is
+	if (CountVertexCacheMisses(&output[0], (int)output.size(), verticesNum) < CountVertexCacheMisses(indices, (int)output.size(), verticesNum))
+		std::copy(output.begin(), output.end(), indices);
+}
+
+template <typename Vertex, typename Index>
+void OptimizeVertexFetch(Vertex* vertices, int verticesNum, Index* indices, int indicesNum)
+{
+	std::vector<int> remap(verticesNum, -1);
+	std::vector<Vertex> reordered;
+	reordered.reserve(verticesNum);
+	for (int i = 0; i < indicesNum; ++i)
+	{
+		int& v = remap[indices[i]];
+		if (v < 0)
+		{
+			v = (int)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = (Index)v;
+	}
+
+	// Unreferenced vertices keep their data, they just move to the end
+	for (int v = 0; v < verticesNum; ++v)
+	{
+		if (remap[v] < 0)
+			reordered.push_back(vertices[v]);
+	}
+	std::copy(reordered.begin(), reordered.end(), vertices);
+}
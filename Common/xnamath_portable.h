@@ -0,0 +1,422 @@
+//--------------------------------------------------------------------------------------
+// File: xnamath_portable.h
+//
+// Drop-in replacement for the part of xnamath.h the samples use on the CPU side, so the
+// Common/ headers the Headless tools include build without the legacy DirectX SDK.
+// Headless/xnamath_bench.cpp checks the SSE2 back-end against the scalar one.
+//
+// On Windows the real xnamath.h is used unless XM_PORTABLE is defined. Everywhere else
+// the functions below are provided with an SSE2 back-end (any x86-64 compiler) or a
+// scalar one (XM_NO_INTRINSICS_, other architectures). Conventions follow xnamath: row
+// vectors, row-major matrices, left-handed projection. Sine/cosine come from the C
+// runtime instead of xnamath's polynomial, so angles can differ in the last ulp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#if defined(_WIN32) && !defined(XM_PORTABLE)
+
+#include <xnamath.h>
+
+#else
+
+#include <math.h>
+#if !defined(XM_NO_INTRINSICS_) && (defined(__SSE2__) || defined(_M_X64) || defined(__x86_64__))
+#define XM_PORTABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define XMFINLINE inline
+
+#define XM_PI		3.141592654f
+#define XM_2PI		6.283185307f
+#define XM_1DIVPI	0.318309886f
+#define XM_PIDIV2	1.570796327f
+#define XM_PIDIV4	0.785398163f
+
+//--------------------------------------------------------------------------------------
+// Types
+//--------------------------------------------------------------------------------------
+#if defined(XM_PORTABLE_SSE2)
+typedef __m128 XMVECTOR;
+#else
+struct XMVECTOR
+{
+	float v[4];
+};
+#endif
+typedef const XMVECTOR FXMVECTOR;
+typedef const XMVECTOR& CXMVECTOR;
+
+struct XMMATRIX
+{
+	XMVECTOR r[4];
+
+	XMMATRIX() {}
+	XMMATRIX(FXMVECTOR r0, FXMVECTOR r1, FXMVECTOR r2, CXMVECTOR r3) { r[0] = r0; r[1] = r1; r[2] = r2; r[3] = r3; }
+	XMMATRIX operator* (const XMMATRIX& m) const;
+	XMMATRIX& operator*= (const XMMATRIX& m);
+};
+typedef const XMMATRIX& CXMMATRIX;
+
+struct XMFLOAT2
+{
+	float x, y;
+
+	XMFLOAT2() {}
+	XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+};
+
+struct XMFLOAT3
+{
+	float x, y, z;
+
+	XMFLOAT3() {}
+	XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+};
+
+struct XMFLOAT4
+{
+	float x, y, z, w;
+
+	XMFLOAT4() {}
+	XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+//--------------------------------------------------------------------------------------
+// Vector primitives, the only functions with one implementation per back-end
+//--------------------------------------------------------------------------------------
+#if defined(XM_PORTABLE_SSE2)
+
+#define XM_PERMUTE_PS(v, c) _mm_shuffle_ps(v, v, c)
+
+XMFINLINE XMVECTOR XMVectorSet(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+XMFINLINE XMVECTOR XMVectorZero() { return _mm_setzero_ps(); }
+XMFINLINE XMVECTOR XMVectorReplicate(float value) { return _mm_set_ps1(value); }
+XMFINLINE float XMVectorGetX(FXMVECTOR v) { return _mm_cvtss_f32(v); }
+XMFINLINE float XMVectorGetY(FXMVECTOR v) { return _mm_cvtss_f32(XM_PERMUTE_PS(v, _MM_SHUFFLE(1, 1, 1, 1))); }
+XMFINLINE float XMVectorGetZ(FXMVECTOR v) { return _mm_cvtss_f32(XM_PERMUTE_PS(v, _MM_SHUFFLE(2, 2, 2, 2))); }
+XMFINLINE float XMVectorGetW(FXMVECTOR v) { return _mm_cvtss_f32(XM_PERMUTE_PS(v, _MM_SHUFFLE(3, 3, 3, 3))); }
+XMFINLINE XMVECTOR XMVectorSplatX(FXMVECTOR v) { return XM_PERMUTE_PS(v, _MM_SHUFFLE(0, 0, 0, 0)); }
+XMFINLINE XMVECTOR XMVectorSplatY(FXMVECTOR v) { return XM_PERMUTE_PS(v, _MM_SHUFFLE(1, 1, 1, 1)); }
+XMFINLINE XMVECTOR XMVectorSplatZ(FXMVECTOR v) { return XM_PERMUTE_PS(v, _MM_SHUFFLE(2, 2, 2, 2)); }
+XMFINLINE XMVECTOR XMVectorSplatW(FXMVECTOR v) { return XM_PERMUTE_PS(v, _MM_SHUFFLE(3, 3, 3, 3)); }
+XMFINLINE XMVECTOR XMVectorAdd(FXMVECTOR a, FXMVECTOR b) { return _mm_add_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b) { return _mm_sub_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorMultiply(FXMVECTOR a, FXMVECTOR b) { return _mm_mul_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorDivide(FXMVECTOR a, FXMVECTOR b) { return _mm_div_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorScale(FXMVECTOR v, float scale) { return _mm_mul_ps(v, _mm_set_ps1(scale)); }
+XMFINLINE XMVECTOR XMVectorMin(FXMVECTOR a, FXMVECTOR b) { return _mm_min_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorMax(FXMVECTOR a, FXMVECTOR b) { return _mm_max_ps(a, b); }
+XMFINLINE XMVECTOR XMVectorSqrt(FXMVECTOR v) { return _mm_sqrt_ps(v); }
+
+XMFINLINE XMVECTOR XMVectorSetW(FXMVECTOR v, float w)
+{
+	// Move w into lane 3 while keeping x, y, z
+	XMVECTOR t = _mm_shuffle_ps(_mm_set_ss(w), v, _MM_SHUFFLE(2, 2, 0, 0)); // (w, w, z, z)
+	return _mm_shuffle_ps(v, t, _MM_SHUFFLE(0, 2, 1, 0));                   // (x, y, z, w)
+}
+
+XMFINLINE XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b)
+{
+	XMVECTOR product = _mm_mul_ps(a, b);
+	XMVECTOR sum = _mm_add_ss(product, XM_PERMUTE_PS(product, _MM_SHUFFLE(1, 1, 1, 1)));
+	sum = _mm_add_ss(sum, XM_PERMUTE_PS(product, _MM_SHUFFLE(2, 2, 2, 2)));
+	return XM_PERMUTE_PS(sum, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+XMFINLINE XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b)
+{
+	XMVECTOR result = _mm_mul_ps(XM_PERMUTE_PS(a, _MM_SHUFFLE(3, 0, 2, 1)), XM_PERMUTE_PS(b, _MM_SHUFFLE(3, 1, 0, 2)));
+	result = _mm_sub_ps(result, _mm_mul_ps(XM_PERMUTE_PS(a, _MM_SHUFFLE(3, 1, 0, 2)), XM_PERMUTE_PS(b, _MM_SHUFFLE(3, 0, 2, 1))));
+	// w is a*b - a*b, clear it like xnamath does
+	return _mm_and_ps(result, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+}
+
+XMFINLINE XMVECTOR XMLoadFloat3(const XMFLOAT3* source)
+{
+	return _mm_set_ps(0.0f, source->z, source->y, source->x);
+}
+
+XMFINLINE XMVECTOR XMLoadFloat4(const XMFLOAT4* source) { return _mm_loadu_ps(&source->x); }
+XMFINLINE void XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v) { _mm_storeu_ps(&destination->x, v); }
+
+XMFINLINE void XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v)
+{
+	_mm_store_ss(&destination->x, v);
+	_mm_store_ss(&destination->y, XM_PERMUTE_PS(v, _MM_SHUFFLE(1, 1, 1, 1)));
+	_mm_store_ss(&destination->z, XM_PERMUTE_PS(v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+#else // scalar
+
+XMFINLINE XMVECTOR XMVectorSet(float x, float y, float z, float w) { XMVECTOR r = { { x, y, z, w } }; return r; }
+XMFINLINE XMVECTOR XMVectorZero() { return XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f); }
+XMFINLINE XMVECTOR XMVectorReplicate(float value) { return XMVectorSet(value, value, value, value); }
+XMFINLINE float XMVectorGetX(FXMVECTOR v) { return v.v[0]; }
+XMFINLINE float XMVectorGetY(FXMVECTOR v) { return v.v[1]; }
+XMFINLINE float XMVectorGetZ(FXMVECTOR v) { return v.v[2]; }
+XMFINLINE float XMVectorGetW(FXMVECTOR v) { return v.v[3]; }
+XMFINLINE XMVECTOR XMVectorSplatX(FXMVECTOR v) { return XMVectorReplicate(v.v[0]); }
+XMFINLINE XMVECTOR XMVectorSplatY(FXMVECTOR v) { return XMVectorReplicate(v.v[1]); }
+XMFINLINE XMVECTOR XMVectorSplatZ(FXMVECTOR v) { return XMVectorReplicate(v.v[2]); }
+XMFINLINE XMVECTOR XMVectorSplatW(FXMVECTOR v) { return XMVectorReplicate(v.v[3]); }
+XMFINLINE XMVECTOR XMVectorSetW(FXMVECTOR v, float w) { return XMVectorSet(v.v[0], v.v[1], v.v[2], w); }
+
+XMFINLINE XMVECTOR XMVectorAdd(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorMultiply(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorDivide(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorScale(FXMVECTOR v, float scale)
+{
+	return XMVectorSet(v.v[0] * scale, v.v[1] * scale, v.v[2] * scale, v.v[3] * scale);
+}
+
+// Same operand order as minps/maxps, so NaN handling matches the SSE2 back-end
+XMFINLINE XMVECTOR XMVectorMin(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+		a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorMax(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+		a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]);
+}
+
+XMFINLINE XMVECTOR XMVectorSqrt(FXMVECTOR v)
+{
+	return XMVectorSet(sqrtf(v.v[0]), sqrtf(v.v[1]), sqrtf(v.v[2]), sqrtf(v.v[3]));
+}
+
+// Summed x, then y, then z, the order the SSE2 back-end uses
+XMFINLINE XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorReplicate(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]);
+}
+
+XMFINLINE XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorSet(a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0], 0.0f);
+}
+
+XMFINLINE XMVECTOR XMLoadFloat3(const XMFLOAT3* source) { return XMVectorSet(source->x, source->y, source->z, 0.0f); }
+XMFINLINE XMVECTOR XMLoadFloat4(const XMFLOAT4* source) { return XMVectorSet(source->x, source->y, source->z, source->w); }
+XMFINLINE void XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v) { *destination = XMFLOAT3(v.v[0], v.v[1], v.v[2]); }
+XMFINLINE void XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v) { *destination = XMFLOAT4(v.v[0], v.v[1], v.v[2], v.v[3]); }
+
+#endif
+
+//--------------------------------------------------------------------------------------
+// Everything below is written in terms of the primitives and shared by both back-ends
+//--------------------------------------------------------------------------------------
+XMFINLINE XMVECTOR XMVector3LengthSq(FXMVECTOR v) { return XMVector3Dot(v, v); }
+XMFINLINE XMVECTOR XMVector3Length(FXMVECTOR v) { return XMVectorSqrt(XMVector3Dot(v, v)); }
+
+XMFINLINE XMVECTOR XMVector3Normalize(FXMVECTOR v)
+{
+	// A zero vector stays zero instead of turning into NaNs
+	XMVECTOR length = XMVector3Length(v);
+	if (XMVectorGetX(length) == 0.0f)
+		return XMVectorZero();
+	return XMVectorDivide(v, length);
+}
+
+XMFINLINE XMVECTOR XMVector3Transform(FXMVECTOR v, CXMMATRIX m)
+{
+	XMVECTOR result = XMVectorMultiply(XMVectorSplatX(v), m.r[0]);
+	result = XMVectorAdd(result, XMVectorMultiply(XMVectorSplatY(v), m.r[1]));
+	result = XMVectorAdd(result, XMVectorMultiply(XMVectorSplatZ(v), m.r[2]));
+	return XMVectorAdd(result, m.r[3]);
+}
+
+XMFINLINE XMVECTOR XMVector3TransformCoord(FXMVECTOR v, CXMMATRIX m)
+{
+	XMVECTOR result = XMVector3Transform(v, m);
+	return XMVectorDivide(result, XMVectorSplatW(result));
+}
+
+XMFINLINE XMVECTOR XMVector3TransformNormal(FXMVECTOR v, CXMMATRIX m)
+{
+	XMVECTOR result = XMVectorMultiply(XMVectorSplatX(v), m.r[0]);
+	result = XMVectorAdd(result, XMVectorMultiply(XMVectorSplatY(v), m.r[1]));
+	return XMVectorAdd(result, XMVectorMultiply(XMVectorSplatZ(v), m.r[2]));
+}
+
+// GCC and Clang already give __m128 element-wise operators, including scalar broadcast
+#if !defined(XM_PORTABLE_SSE2) || defined(_MSC_VER)
+XMFINLINE XMVECTOR operator+ (FXMVECTOR a, FXMVECTOR b) { return XMVectorAdd(a, b); }
+XMFINLINE XMVECTOR operator- (FXMVECTOR a, FXMVECTOR b) { return XMVectorSubtract(a, b); }
+XMFINLINE XMVECTOR operator* (FXMVECTOR v, float s) { return XMVectorScale(v, s); }
+XMFINLINE XMVECTOR operator* (float s, FXMVECTOR v) { return XMVectorScale(v, s); }
+XMFINLINE XMVECTOR& operator+= (XMVECTOR& a, FXMVECTOR b) { a = XMVectorAdd(a, b); return a; }
+XMFINLINE XMVECTOR& operator-= (XMVECTOR& a, FXMVECTOR b) { a = XMVectorSubtract(a, b); return a; }
+#endif
+
+//--------------------------------------------------------------------------------------
+// Matrices
+//--------------------------------------------------------------------------------------
+XMFINLINE XMMATRIX XMMatrixIdentity()
+{
+	return XMMATRIX(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixMultiply(CXMMATRIX a, CXMMATRIX b)
+{
+	// Row i of the product is row i of a transformed by b
+	XMMATRIX result;
+	for (int i = 0; i < 4; ++i)
+	{
+		XMVECTOR row = XMVectorMultiply(XMVectorSplatX(a.r[i]), b.r[0]);
+		row = XMVectorAdd(row, XMVectorMultiply(XMVectorSplatY(a.r[i]), b.r[1]));
+		row = XMVectorAdd(row, XMVectorMultiply(XMVectorSplatZ(a.r[i]), b.r[2]));
+		result.r[i] = XMVectorAdd(row, XMVectorMultiply(XMVectorSplatW(a.r[i]), b.r[3]));
+	}
+	return result;
+}
+
+XMFINLINE XMMATRIX XMMATRIX::operator* (const XMMATRIX& m) const { return XMMatrixMultiply(*this, m); }
+XMFINLINE XMMATRIX& XMMATRIX::operator*= (const XMMATRIX& m) { *this = XMMatrixMultiply(*this, m); return *this; }
+
+XMFINLINE XMMATRIX XMMatrixTranspose(CXMMATRIX m)
+{
+#if defined(XM_PORTABLE_SSE2)
+	XMVECTOR t0 = _mm_unpacklo_ps(m.r[0], m.r[1]);
+	XMVECTOR t1 = _mm_unpacklo_ps(m.r[2], m.r[3]);
+	XMVECTOR t2 = _mm_unpackhi_ps(m.r[0], m.r[1]);
+	XMVECTOR t3 = _mm_unpackhi_ps(m.r[2], m.r[3]);
+	return XMMATRIX(_mm_movelh_ps(t0, t1), _mm_movehl_ps(t1, t0), _mm_movelh_ps(t2, t3), _mm_movehl_ps(t3, t2));
+#else
+	return XMMATRIX(XMVectorSet(m.r[0].v[0], m.r[1].v[0], m.r[2].v[0], m.r[3].v[0]),
+		XMVectorSet(m.r[0].v[1], m.r[1].v[1], m.r[2].v[1], m.r[3].v[1]),
+		XMVectorSet(m.r[0].v[2], m.r[1].v[2], m.r[2].v[2], m.r[3].v[2]),
+		XMVectorSet(m.r[0].v[3], m.r[1].v[3], m.r[2].v[3], m.r[3].v[3]));
+#endif
+}
+
+// Cofactor expansion; like xnamath, a singular matrix gives infinities and a zero determinant
+XMFINLINE XMMATRIX XMMatrixInverse(XMVECTOR* pDeterminant, CXMMATRIX m)
+{
+	XMFLOAT4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		XMStoreFloat4(&rows[i], m.r[i]);
+	const float* a = &rows[0].x;
+	float s0 = a[0] * a[5] - a[1] * a[4], s1 = a[0] * a[6] - a[2] * a[4], s2 = a[0] * a[7] - a[3] * a[4];
+	float s3 = a[1] * a[6] - a[2] * a[5], s4 = a[1] * a[7] - a[3] * a[5], s5 = a[2] * a[7] - a[3] * a[6];
+	float c5 = a[10] * a[15] - a[11] * a[14], c4 = a[9] * a[15] - a[11] * a[13], c3 = a[9] * a[14] - a[10] * a[13];
+	float c2 = a[8] * a[15] - a[11] * a[12], c1 = a[8] * a[14] - a[10] * a[12], c0 = a[8] * a[13] - a[9] * a[12];
+	float determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	if (pDeterminant)
+		*pDeterminant = XMVectorReplicate(determinant);
+	float d = 1.0f / determinant;
+	return XMMATRIX(
+		XMVectorSet((a[5] * c5 - a[6] * c4 + a[7] * c3) * d, (-a[1] * c5 + a[2] * c4 - a[3] * c3) * d,
+			(a[13] * s5 - a[14] * s4 + a[15] * s3) * d, (-a[9] * s5 + a[10] * s4 - a[11] * s3) * d),
+		XMVectorSet((-a[4] * c5 + a[6] * c2 - a[7] * c1) * d, (a[0] * c5 - a[2] * c2 + a[3] * c1) * d,
+			(-a[12] * s5 + a[14] * s2 - a[15] * s1) * d, (a[8] * s5 - a[10] * s2 + a[11] * s1) * d),
+		XMVectorSet((a[4] * c4 - a[5] * c2 + a[7] * c0) * d, (-a[0] * c4 + a[1] * c2 - a[3] * c0) * d,
+			(a[12] * s4 - a[13] * s2 + a[15] * s0) * d, (-a[8] * s4 + a[9] * s2 - a[11] * s0) * d),
+		XMVectorSet((-a[4] * c3 + a[5] * c1 - a[6] * c0) * d, (a[0] * c3 - a[1] * c1 + a[2] * c0) * d,
+			(-a[12] * s3 + a[13] * s1 - a[14] * s0) * d, (a[8] * s3 - a[9] * s1 + a[10] * s0) * d));
+}
+
+XMFINLINE XMMATRIX XMMatrixScaling(float x, float y, float z)
+{
+	return XMMATRIX(XMVectorSet(x, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, y, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, z, 0.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixTranslation(float x, float y, float z)
+{
+	return XMMATRIX(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(x, y, z, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixRotationX(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMATRIX(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, c, s, 0.0f),
+		XMVectorSet(0.0f, -s, c, 0.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixRotationY(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMATRIX(XMVectorSet(c, 0.0f, -s, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+		XMVectorSet(s, 0.0f, c, 0.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixRotationZ(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMATRIX(XMVectorSet(c, s, 0.0f, 0.0f), XMVectorSet(-s, c, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+// Roll about z first, then pitch about x, then yaw about y
+XMFINLINE XMMATRIX XMMatrixRotationRollPitchYaw(float pitch, float yaw, float roll)
+{
+	return XMMatrixMultiply(XMMatrixMultiply(XMMatrixRotationZ(roll), XMMatrixRotationX(pitch)), XMMatrixRotationY(yaw));
+}
+
+XMFINLINE XMMATRIX XMMatrixRotationNormal(FXMVECTOR normalAxis, float angle)
+{
+	float s = sinf(angle), c = cosf(angle), t = 1.0f - c;
+	float x = XMVectorGetX(normalAxis), y = XMVectorGetY(normalAxis), z = XMVectorGetZ(normalAxis);
+	return XMMATRIX(XMVectorSet(c + t * x * x, t * x * y + s * z, t * x * z - s * y, 0.0f),
+		XMVectorSet(t * x * y - s * z, c + t * y * y, t * y * z + s * x, 0.0f),
+		XMVectorSet(t * x * z + s * y, t * y * z - s * x, c + t * z * z, 0.0f),
+		XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+XMFINLINE XMMATRIX XMMatrixRotationAxis(FXMVECTOR axis, float angle)
+{
+	return XMMatrixRotationNormal(XMVector3Normalize(axis), angle);
+}
+
+XMFINLINE XMMATRIX XMMatrixLookToLH(FXMVECTOR eyePosition, FXMVECTOR eyeDirection, FXMVECTOR upDirection)
+{
+	XMVECTOR r2 = XMVector3Normalize(eyeDirection);
+	XMVECTOR r0 = XMVector3Normalize(XMVector3Cross(upDirection, r2));
+	XMVECTOR r1 = XMVector3Cross(r2, r0);
+	XMVECTOR negEye = XMVectorSubtract(XMVectorZero(), eyePosition);
+
+	XMMATRIX m(XMVectorSetW(r0, XMVectorGetX(XMVector3Dot(r0, negEye))),
+		XMVectorSetW(r1, XMVectorGetX(XMVector3Dot(r1, negEye))),
+		XMVectorSetW(r2, XMVectorGetX(XMVector3Dot(r2, negEye))),
+		XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+	return XMMatrixTranspose(m);
+}
+
+XMFINLINE XMMATRIX XMMatrixLookAtLH(FXMVECTOR eyePosition, FXMVECTOR focusPosition, FXMVECTOR upDirection)
+{
+	return XMMatrixLookToLH(eyePosition, XMVectorSubtract(focusPosition, eyePosition), upDirection);
+}
+
+XMFINLINE XMMATRIX XMMatrixPerspectiveFovLH(float fovAngleY, float aspectHByW, float nearZ, float farZ)
+{
+	float height = cosf(0.5f * fovAngleY) / sinf(0.5f * fovAngleY);
+	float width = height / aspectHByW;
+	float range = farZ / (farZ - nearZ);
+	return XMMATRIX(XMVectorSet(width, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, height, 0.0f, 0.0f),
+		XMVectorSet(0.0f, 0.0f, range, 1.0f), XMVectorSet(0.0f, 0.0f, -range * nearZ, 0.0f));
+}
+
+#endif
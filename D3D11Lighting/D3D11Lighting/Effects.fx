@@ -40,6 +40,23 @@ VS_OUTPUT VS(float4 inPos : POSITION, float2 inTexCoord : TEXCOORD, float3 norma
     return output;
 }
 
+// A matrix instance of Common/instancing.h: the world matrix's first three columns.
+// The world matrix is the instance's, so WVP holds only view * projection.
+VS_OUTPUT INSTANCED_VS(float4 inPos : POSITION, float2 inTexCoord : TEXCOORD, float3 normal : NORMAL,
+	float4 column0 : INSTANCE0, float4 column1 : INSTANCE1, float4 column2 : INSTANCE2)
+{
+    VS_OUTPUT output;
+
+    float4 worldPos = float4(dot(inPos, column0), dot(inPos, column1), dot(inPos, column2), 1.0f);
+    output.Pos = mul(worldPos, WVP);
+
+	output.normal = float3(dot(normal, column0.xyz), dot(normal, column1.xyz), dot(normal, column2.xyz));
+
+    output.TexCoord = inTexCoord;
+
+    return output;
+}
+
 float4 PS(VS_OUTPUT input) : SV_TARGET
 {
 	input.normal = normalize(input.normal);
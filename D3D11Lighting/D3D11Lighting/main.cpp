@@ -8,11 +8,15 @@
 #pragma comment (lib, "D2D1.lib")
 #pragma comment (lib, "dwrite.lib")
 
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
 #include <windows.h>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
-#include <xnamath.h>
+#include "../../Common/xnamath_portable.h"
+#include "../../Common/dds_reader.h"
+#include "../../Common/instancing.h"
+#include "../../Common/transform_store.h"
 #include <D3D10_1.h>
 #include <DXGI.h>
 #include <D2D1.h>
@@ -44,6 +48,12 @@ ID3D11Buffer* cbPerFrameBuffer;
 ID3D11PixelShader* D2D_PS;
 ID3D10Blob* D2D_PS_Buffer;
 ///////////////**************new**************////////////////////
+//Both cubes go out in one DrawIndexedInstanced, their world matrices packed into
+//cubeInstances (Common/instancing.h)
+InstanceBuffer cubeInstances;
+ID3D11VertexShader* INSTANCED_VS;
+ID3D10Blob* INSTANCED_VS_Buffer;
+ID3D11InputLayout* instancedLayout;
 
 ID3D10Device1 *d3d101Device;	
 IDXGIKeyedMutex *keyedMutex11;
@@ -69,8 +79,10 @@ const int Width  = 300;
 const int Height = 300;
 
 XMMATRIX WVP;
-XMMATRIX cube1World;
-XMMATRIX cube2World;
+//The cubes' positions, rotations and scales; UpdateScene composes their world matrices
+TransformStore transforms;
+int cube1Transform;
+int cube2Transform;
 XMMATRIX camView;
 XMMATRIX camProjection;
 
@@ -80,9 +92,6 @@ XMVECTOR camPosition;
 XMVECTOR camTarget;
 XMVECTOR camUp;
 
-XMMATRIX Rotation;
-XMMATRIX Scale;
-XMMATRIX Translation;
 float rot = 0.01f;
 
 double countsPerSecond = 0.0;
@@ -453,6 +462,10 @@ void CleanUp()
 	depthStencilView->Release();
 	depthStencilBuffer->Release();
 	cbPerObjectBuffer->Release();
+	cubeInstances.Release();
+	INSTANCED_VS->Release();
+	INSTANCED_VS_Buffer->Release();
+	instancedLayout->Release();
 	Transparency->Release();
 	CCWcullMode->Release();
 	CWcullMode->Release();
@@ -536,9 +549,11 @@ bool InitScene()
 	///////////////**************new**************////////////////////
 	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "D2D_PS", "ps_4_0", 0, 0, 0, &D2D_PS_Buffer, 0, 0);
 	///////////////**************new**************////////////////////
+	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "INSTANCED_VS", "vs_4_0", 0, 0, 0, &INSTANCED_VS_Buffer, 0, 0);
 
 	//Create the Shader Objects
 	hr = d3d11Device->CreateVertexShader(VS_Buffer->GetBufferPointer(), VS_Buffer->GetBufferSize(), NULL, &VS);
+	hr = d3d11Device->CreateVertexShader(INSTANCED_VS_Buffer->GetBufferPointer(), INSTANCED_VS_Buffer->GetBufferSize(), NULL, &INSTANCED_VS);
 	hr = d3d11Device->CreatePixelShader(PS_Buffer->GetBufferPointer(), PS_Buffer->GetBufferSize(), NULL, &PS);
 	///////////////**************new**************////////////////////
 	hr = d3d11Device->CreatePixelShader(D2D_PS_Buffer->GetBufferPointer(), D2D_PS_Buffer->GetBufferSize(), NULL, &D2D_PS);
@@ -654,6 +669,15 @@ bool InitScene()
 	hr = d3d11Device->CreateInputLayout( layout, numElements, VS_Buffer->GetBufferPointer(), 
 		VS_Buffer->GetBufferSize(), &vertLayout );
 
+	//The same vertices, plus a world matrix per instance in slot 1
+	D3D11_INPUT_ELEMENT_DESC instancedElements[ARRAYSIZE(layout) + 3];
+	UINT instancedElementCount = AppendInstanceLayout(INSTANCE_FORMAT_MATRIX, layout, numElements, instancedElements);
+	hr = d3d11Device->CreateInputLayout( instancedElements, instancedElementCount, INSTANCED_VS_Buffer->GetBufferPointer(), 
+		INSTANCED_VS_Buffer->GetBufferSize(), &instancedLayout );
+	hr = cubeInstances.Init(d3d11Device, INSTANCE_FORMAT_MATRIX, 2);
+	cube1Transform = transforms.Add();
+	cube2Transform = transforms.Add();
+
 	//Set the Input Layout
 	d3d11DevCon->IASetInputLayout( vertLayout );
 
@@ -728,8 +752,8 @@ bool InitScene()
 	blendDesc.AlphaToCoverageEnable = false;
 	blendDesc.RenderTarget[0] = rtbd;
 
-	hr = D3DX11CreateShaderResourceViewFromFile( d3d11Device, L"braynzar.jpg",
-		NULL, NULL, &CubesTexture, NULL );
+	// BC1 with mips, cooked from braynzar.jpg by Headless/texture_cooker
+	hr = CreateDDSTextureFromFile(d3d11Device, L"braynzar.dds", NULL, &CubesTexture);
 
 	// Describe the Sample State
 	D3D11_SAMPLER_DESC sampDesc;
@@ -803,13 +827,12 @@ void UpdateScene(double time)
 	if(rot > 6.28f)
 		rot = 0.0f;
 
-	//Reset cube1World
-	cube1World = XMMatrixIdentity();
-
-	//Define cube1's world space matrix
+	//Define cube1's world space transform: Translation(0, 0, 4) * Rotation, so it
+	//orbits the origin while it turns
 	XMVECTOR rotaxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	Rotation = XMMatrixRotationAxis( rotaxis, rot);
-	Translation = XMMatrixTranslation( 0.0f, 0.0f, 4.0f );
+	XMFLOAT3 yAxis(0.0f, 1.0f, 0.0f);
+	transforms.SetRotationAxis(cube1Transform, yAxis, rot);
+	transforms.SetPosition(cube1Transform, 4.0f * sinf(rot), 0.0f, 4.0f * cosf(rot));
     //Exercise:Make the Light spin around your scene, like the sun.
     lr += 5.0f * time;
     if (lr > 6.28f)
@@ -820,20 +843,14 @@ void UpdateScene(double time)
     XMStoreFloat3(&light.dir, v);
   //  light.dir.x = v[0]
 
-	//Set cube1's world space using the transformations
-	cube1World = Translation * Rotation;
-
  //   XMMATRIX m = XMVectorSet(light.dir.x, light.dir.y, light.dir.z, 0);
 
-	//Reset cube2World
-	cube2World = XMMatrixIdentity();
-
-	//Define cube2's world space matrix
-	Rotation = XMMatrixRotationAxis( rotaxis, -rot);
-	Scale = XMMatrixScaling( 1.3f, 1.3f, 1.3f );
+	//Define cube2's world space transform
+	transforms.SetRotationAxis(cube2Transform, yAxis, -rot);
+	transforms.SetScale(cube2Transform, 1.3f, 1.3f, 1.3f);
 
-	//Set cube2's world space matrix
-	cube2World = Rotation * Scale;
+	//Only the worlds: the instanced draw applies view * projection in the shader
+	transforms.ComposeWorld(NULL);
 }
 
 void RenderText(std::wstring text, int inInt)
@@ -946,28 +963,29 @@ void DrawScene()
 	d3d11DevCon->IASetVertexBuffers( 0, 1, &squareVertBuffer, &stride, &offset );
 
 	///////////////**************new**************////////////////////
-	//Set the WVP matrix and send it to the constant buffer in effect file
-	WVP = cube1World * camView * camProjection;    
-	cbPerObj.World = XMMatrixTranspose(cube1World);	
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
-	d3d11DevCon->PSSetShaderResources( 0, 1, &CubesTexture );
-	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
-
-	d3d11DevCon->RSSetState(CWcullMode);
-	d3d11DevCon->DrawIndexed( 36, 0, 0 );
-
-	WVP = cube2World * camView * camProjection;    
-	cbPerObj.World = XMMatrixTranspose(cube2World);	
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
+	//Both cubes in one draw, each with its world matrix from the instance stream
+	InstanceMatrix* instances = (InstanceMatrix*)cubeInstances.Map(d3d11DevCon, 2);
+	if (instances)
+	{
+		//The stored worlds are already transposed: their first three rows are the instance's columns
+		memcpy(&instances[0], &transforms.World(cube1Transform), sizeof(InstanceMatrix));
+		memcpy(&instances[1], &transforms.World(cube2Transform), sizeof(InstanceMatrix));
+		cubeInstances.Unmap(d3d11DevCon);
+	}
+	//The world matrix comes from the instance, so WVP is only the camera
+	cbPerObj.World = XMMatrixIdentity();
+	cbPerObj.WVP = XMMatrixTranspose(camView * camProjection);
 	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
 	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
 	d3d11DevCon->PSSetShaderResources( 0, 1, &CubesTexture );
 	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
 
 	d3d11DevCon->RSSetState(CWcullMode);
-	d3d11DevCon->DrawIndexed( 36, 0, 0 );
+	d3d11DevCon->IASetInputLayout( instancedLayout );
+	d3d11DevCon->VSSetShader( INSTANCED_VS, 0, 0 );
+	cubeInstances.DrawIndexed( d3d11DevCon, 36, 0, 0 );
+	d3d11DevCon->IASetInputLayout( vertLayout );
+	d3d11DevCon->VSSetShader( VS, 0, 0 );
 	///////////////**************new**************////////////////////
 
 	RenderText(L"FPS: ", fps);
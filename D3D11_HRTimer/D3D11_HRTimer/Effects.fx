@@ -23,6 +23,25 @@ VS_OUTPUT VS(float4 inPos : POSITION, float2 inTexCoord : TEXCOORD)
     return output;
 }
 
+// v turned by the unit quaternion q
+float3 RotateByQuaternion(float3 v, float4 q)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// A compact instance of Common/instancing.h: position and uniform scale, then rotation.
+// The world transform is the instance's, so WVP holds only view * projection.
+VS_OUTPUT INSTANCED_VS(float4 inPos : POSITION, float2 inTexCoord : TEXCOORD, float4 positionScale : INSTANCE0, float4 rotation : INSTANCE1)
+{
+    VS_OUTPUT output;
+
+    float3 worldPos = RotateByQuaternion(inPos.xyz * positionScale.w, rotation) + positionScale.xyz;
+    output.Pos = mul(float4(worldPos, 1.0f), WVP);
+    output.TexCoord = inTexCoord;
+
+    return output;
+}
+
 float4 PS(VS_OUTPUT input) : SV_TARGET
 {
     return ObjTexture.Sample( ObjSamplerState, input.TexCoord );
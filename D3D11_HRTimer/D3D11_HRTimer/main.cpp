@@ -12,12 +12,15 @@
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
-#include <xnamath.h>
+#include "../../Common/xnamath_portable.h"
+#include "../../Common/dds_reader.h"
+#include "../../Common/instancing.h"
 #include <D3D10_1.h>
 #include <DXGI.h>
 #include <D2D1.h>
 #include <sstream>
 #include <dwrite.h>
+#include <stdio.h>
 
 //Global Declarations - Interfaces//
 IDXGISwapChain* SwapChain;
@@ -53,6 +56,27 @@ ID3D11ShaderResourceView *d2dTexture;
 IDWriteFactory *DWriteFactory;
 IDWriteTextFormat *TextFormat;
 
+//The cubes are instances of one mesh: their compact transforms go into cubeInstances and
+//out in one DrawIndexedInstanced (Common/instancing.h)
+InstanceBuffer cubeInstances;
+InstanceCompact cubeTransforms[2];
+ID3D11VertexShader* INSTANCED_VS;
+ID3D10Blob* INSTANCED_VS_Buffer;
+ID3D11InputLayout* instancedLayout;
+
+//I starts the stress sweep: a grid of sweepCounts[step] cubes, first drawn instanced and
+//then with the per-object constant update and draw, sweepFrames frames each. The CPU
+//time to submit them is averaged per step and written to instancing_sweep.csv.
+const UINT sweepCounts[] = { 1, 3, 10, 30, 100, 300, 1000, 3000, 10000, 30000, 100000, 300000, 1000000 };
+//A per-object frame takes seconds beyond this
+const UINT sweepPerObjectLimit = 30000;
+const int sweepWarmupFrames = 2;
+const int sweepFrames = 30;
+int sweepStep = -1;
+int sweepFrame = 0;
+bool sweepPerObject = false;
+double sweepSubmitSeconds[ARRAYSIZE(sweepCounts)][2];
+
 std::wstring printText;
 
 //Global Declarations - Others//
@@ -64,8 +88,6 @@ const int Width  = 300;
 const int Height = 300;
 
 XMMATRIX WVP;
-XMMATRIX cube1World;
-XMMATRIX cube2World;
 XMMATRIX camView;
 XMMATRIX camProjection;
 
@@ -107,6 +129,9 @@ void StartTimer();
 double GetTime();
 double GetFrameTime();
 ///////////////**************new**************////////////////////
+void SubmitInstanced(UINT count, UINT side);
+void SubmitPerObject(UINT count, UINT side);
+void SweepFrame(double submitSeconds);
 
 bool InitializeWindow(HINSTANCE hInstance,
 	int ShowWnd,
@@ -425,6 +450,10 @@ void CleanUp()
 	depthStencilView->Release();
 	depthStencilBuffer->Release();
 	cbPerObjectBuffer->Release();
+	cubeInstances.Release();
+	INSTANCED_VS->Release();
+	INSTANCED_VS_Buffer->Release();
+	instancedLayout->Release();
 	Transparency->Release();
 	CCWcullMode->Release();
 	CWcullMode->Release();
@@ -501,9 +530,11 @@ bool InitScene()
 	//Compile Shaders from shader file
 	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "VS", "vs_4_0", 0, 0, 0, &VS_Buffer, 0, 0);
 	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "PS", "ps_4_0", 0, 0, 0, &PS_Buffer, 0, 0);
+	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "INSTANCED_VS", "vs_4_0", 0, 0, 0, &INSTANCED_VS_Buffer, 0, 0);
 
 	//Create the Shader Objects
 	hr = d3d11Device->CreateVertexShader(VS_Buffer->GetBufferPointer(), VS_Buffer->GetBufferSize(), NULL, &VS);
+	hr = d3d11Device->CreateVertexShader(INSTANCED_VS_Buffer->GetBufferPointer(), INSTANCED_VS_Buffer->GetBufferSize(), NULL, &INSTANCED_VS);
 	hr = d3d11Device->CreatePixelShader(PS_Buffer->GetBufferPointer(), PS_Buffer->GetBufferSize(), NULL, &PS);
 
 	//Set Vertex and Pixel Shaders
@@ -610,6 +641,13 @@ bool InitScene()
 	hr = d3d11Device->CreateInputLayout( layout, numElements, VS_Buffer->GetBufferPointer(), 
 		VS_Buffer->GetBufferSize(), &vertLayout );
 
+	//The same vertices, plus the compact instance stream in slot 1
+	D3D11_INPUT_ELEMENT_DESC instancedElements[ARRAYSIZE(layout) + 3];
+	UINT instancedElementCount = AppendInstanceLayout(INSTANCE_FORMAT_COMPACT, layout, numElements, instancedElements);
+	hr = d3d11Device->CreateInputLayout( instancedElements, instancedElementCount, INSTANCED_VS_Buffer->GetBufferPointer(), 
+		INSTANCED_VS_Buffer->GetBufferSize(), &instancedLayout );
+	hr = cubeInstances.Init(d3d11Device, INSTANCE_FORMAT_COMPACT, ARRAYSIZE(cubeTransforms));
+
 	//Set the Input Layout
 	d3d11DevCon->IASetInputLayout( vertLayout );
 
@@ -671,8 +709,8 @@ bool InitScene()
 	blendDesc.AlphaToCoverageEnable = false;
 	blendDesc.RenderTarget[0] = rtbd;
 
-	hr = D3DX11CreateShaderResourceViewFromFile( d3d11Device, L"braynzar.jpg",
-		NULL, NULL, &CubesTexture, NULL );
+	// BC1 with mips, cooked from braynzar.jpg by Headless/texture_cooker
+	hr = CreateDDSTextureFromFile(d3d11Device, L"braynzar.dds", NULL, &CubesTexture);
 
 	// Describe the Sample State
 	D3D11_SAMPLER_DESC sampDesc;
@@ -751,26 +789,121 @@ void UpdateScene(double time)
 	if(rot > 6.28f)
 		rot = 0.0f;
 
-	//Reset cube1World
-	cube1World = XMMatrixIdentity();
+	XMFLOAT3 rotaxis(0.0f, 1.0f, 0.0f);
 
-	//Define cube1's world space matrix
-	XMVECTOR rotaxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	Rotation = XMMatrixRotationAxis( rotaxis, rot);
-	Translation = XMMatrixTranslation( 0.0f, 0.0f, 4.0f );
+	//Cube1 is translated 4 along z, then turned about y with its translation
+	PackInstanceCompact(4.0f * sinf(rot), 0.0f, 4.0f * cosf(rot), 1.0f, rotaxis, rot, &cubeTransforms[0]);
 
-	//Set cube1's world space using the transformations
-	cube1World = Translation * Rotation;
+	//Cube2 is scaled and turns the other way at the origin
+	PackInstanceCompact(0.0f, 0.0f, 0.0f, 1.3f, rotaxis, -rot, &cubeTransforms[1]);
+}
 
-	//Reset cube2World
-	cube2World = XMMatrixIdentity();
+//The sweep's cube i: a square grid of side cubes a row, receding from the camera, each
+//turning a little further than the one before
+UINT SweepSide(UINT count)
+{
+	return (UINT)ceil(sqrt((double)count));
+}
 
-	//Define cube2's world space matrix
-	Rotation = XMMatrixRotationAxis( rotaxis, -rot);
-	Scale = XMMatrixScaling( 1.3f, 1.3f, 1.3f );
+void SweepCube(UINT i, UINT side, float* x, float* z, float* angle)
+{
+	*x = ((float)(i % side) - 0.5f * (side - 1)) * 3.0f;
+	*z = (float)(i / side) * 3.0f;
+	*angle = rot + i * 0.01f;
+}
 
-	//Set cube2's world space matrix
-	cube2World = Rotation * Scale;
+void SubmitInstanced(UINT count, UINT side)
+{
+	//The two cubes of the scene outside the sweep
+	if (sweepStep < 0)
+	{
+		cubeInstances.Upload(d3d11DevCon, cubeTransforms, count);
+	}
+	else
+	{
+		InstanceCompact* instances = (InstanceCompact*)cubeInstances.Map(d3d11DevCon, count);
+		if (!instances)
+			return;
+		XMFLOAT3 rotaxis(0.0f, 1.0f, 0.0f);
+		for (UINT i = 0; i < count; ++i)
+		{
+			float x, z, angle;
+			SweepCube(i, side, &x, &z, &angle);
+			PackInstanceCompact(x, 0.0f, z, 1.0f, rotaxis, angle, &instances[i]);
+		}
+		cubeInstances.Unmap(d3d11DevCon);
+	}
+
+	//The world transform comes from the instance, so WVP is only the camera
+	cbPerObj.WVP = XMMatrixTranspose(camView * camProjection);
+	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
+	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
+	d3d11DevCon->IASetInputLayout( instancedLayout );
+	d3d11DevCon->VSSetShader( INSTANCED_VS, 0, 0 );
+	cubeInstances.DrawIndexed( d3d11DevCon, 36, 0, 0 );
+	d3d11DevCon->IASetInputLayout( vertLayout );
+	d3d11DevCon->VSSetShader( VS, 0, 0 );
+}
+
+//One constant buffer update and draw per cube, the way the sample drew its two cubes
+void SubmitPerObject(UINT count, UINT side)
+{
+	XMVECTOR rotaxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMMATRIX viewProjection = camView * camProjection;
+	for (UINT i = 0; i < count; ++i)
+	{
+		float x, z, angle;
+		SweepCube(i, side, &x, &z, &angle);
+		WVP = XMMatrixRotationAxis( rotaxis, angle ) * XMMatrixTranslation( x, 0.0f, z ) * viewProjection;
+		cbPerObj.WVP = XMMatrixTranspose(WVP);	
+		d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
+		d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
+		d3d11DevCon->DrawIndexed( 36, 0, 0 );
+	}
+}
+
+//Adds a frame's submit time to the current step and moves the sweep on
+void SweepFrame(double submitSeconds)
+{
+	if (sweepFrame >= sweepWarmupFrames)
+		sweepSubmitSeconds[sweepStep][sweepPerObject] += submitSeconds / sweepFrames;
+	if (++sweepFrame < sweepWarmupFrames + sweepFrames)
+		return;
+
+	sweepFrame = 0;
+	if (!sweepPerObject && sweepCounts[sweepStep] <= sweepPerObjectLimit)
+	{
+		sweepPerObject = true;
+		return;
+	}
+	sweepPerObject = false;
+	if (++sweepStep < (int)ARRAYSIZE(sweepCounts))
+		return;
+
+	//Done: one row per step, per-object left empty past the limit
+	std::wostringstream report;
+	report << L"Instancing sweep, CPU submit ms per frame\n";
+	FILE* csv = fopen("instancing_sweep.csv", "w");
+	if (csv)
+		fprintf(csv, "instances,instanced_ms,per_object_ms\n");
+	for (int step = 0; step < (int)ARRAYSIZE(sweepCounts); ++step)
+	{
+		bool perObject = sweepCounts[step] <= sweepPerObjectLimit;
+		report << L"  " << sweepCounts[step] << L": " << sweepSubmitSeconds[step][0] * 1000.0 << L" instanced";
+		if (perObject)
+			report << L", " << sweepSubmitSeconds[step][1] * 1000.0 << L" per object";
+		report << L"\n";
+		if (!csv)
+			continue;
+		fprintf(csv, "%u,%.4f,", sweepCounts[step], sweepSubmitSeconds[step][0] * 1000.0);
+		if (perObject)
+			fprintf(csv, "%.4f", sweepSubmitSeconds[step][1] * 1000.0);
+		fprintf(csv, "\n");
+	}
+	if (csv)
+		fclose(csv);
+	OutputDebugString(report.str().c_str());
+	sweepStep = -1;
 }
 
 ///////////////**************new**************////////////////////
@@ -870,29 +1003,30 @@ void DrawScene()
 	UINT offset = 0;
 	d3d11DevCon->IASetVertexBuffers( 0, 1, &squareVertBuffer, &stride, &offset );
 
-	//Set the WVP matrix and send it to the constant buffer in effect file
-	WVP = cube1World * camView * camProjection;
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
 	d3d11DevCon->PSSetShaderResources( 0, 1, &CubesTexture );
 	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
-
 	d3d11DevCon->RSSetState(CWcullMode);
-	d3d11DevCon->DrawIndexed( 36, 0, 0 );
 
-	WVP = cube2World * camView * camProjection;
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
-	d3d11DevCon->PSSetShaderResources( 0, 1, &CubesTexture );
-	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
-
-	d3d11DevCon->RSSetState(CWcullMode);
-	d3d11DevCon->DrawIndexed( 36, 0, 0 );
+	//Both cubes in one instanced draw, or this frame's step of the sweep
+	UINT count = sweepStep < 0 ? ARRAYSIZE(cubeTransforms) : sweepCounts[sweepStep];
+	bool perObject = sweepStep >= 0 && sweepPerObject;
+	//Outside the timed region, so the submit time is only the submission
+	UINT side = SweepSide(count);
+	LARGE_INTEGER submitStart, submitEnd;
+	QueryPerformanceCounter(&submitStart);
+	if (perObject)
+		SubmitPerObject(count, side);
+	else
+		SubmitInstanced(count, side);
+	QueryPerformanceCounter(&submitEnd);
+	if (sweepStep >= 0)
+		SweepFrame(double(submitEnd.QuadPart - submitStart.QuadPart) / countsPerSecond);
 
 	///////////////**************new**************////////////////////
-	RenderText(L"FPS: ", fps);
+	if (sweepStep >= 0)
+		RenderText(perObject ? L"Per object: " : L"Instanced: ", count);
+	else
+		RenderText(L"FPS: ", fps);
 	///////////////**************new**************////////////////////
 
 	//Present the backbuffer to the screen
@@ -956,6 +1090,12 @@ LRESULT CALLBACK WndProc(HWND hwnd,
 		if( wParam == VK_ESCAPE ){
 			DestroyWindow(hwnd);
 		}
+		if( wParam == 'I' && sweepStep < 0 ){
+			ZeroMemory(sweepSubmitSeconds, sizeof(sweepSubmitSeconds));
+			sweepStep = 0;
+			sweepFrame = 0;
+			sweepPerObject = false;
+		}
 		return 0;
 
 	case WM_DESTROY:
@@ -6,21 +6,29 @@ struct Light
 	float4 diffuse;
 };
 
-cbuffer cbPerFrame
+// Fixed registers: shaders find cbPerFrame in b0 and cbPerObject in b1
+cbuffer cbPerFrame : register(b0)
 {
 	Light light;
+	float4 shIrradiance[9];	// Common/sh_irradiance.h, rgb in xyz
+	int skyOctahedral;		// the sky is SkyOctahedral rather than SkyMap
+	float skyTopMip;		// SkyMap streams in, its mip 0 is this mip of the full chain
+	float4x4 skyInvViewProj;	// clip space to a world direction, camera translation left out
 };
 
-cbuffer cbPerObject
+cbuffer cbPerObject : register(b1)
 {
 	float4x4 WVP;
 	float4x4 World;
     float3 cameraPos;
+	float roughness;		// selects the mip of the GGX prefiltered sky map
 };
 
 Texture2D ObjTexture;
 SamplerState ObjSamplerState;
 TextureCube SkyMap;
+Texture2D SkyOctahedral : register(t1);
+TextureCube EnvCapture : register(t2);	// the scene around the reflective sphere, Common/env_capture.h
 
 struct VS_OUTPUT
 {
@@ -40,8 +48,51 @@ struct REFLECT_VS_OUTPUT
     float4 Pos : SV_POSITION;
     float3 TexCoord : TEXCOORD;
     float3 normal : NORMAL;
+    float3 worldPos : POSITION;	// SV_POSITION is in pixels by the pixel shader
 };
 
+// Diffuse irradiance / pi of the sky for the normal n, the ambient of a white surface
+float3 ShIrradiance(float3 n)
+{
+	float3 result = shIrradiance[0].xyz * 0.282095f;
+	result += shIrradiance[1].xyz * (0.488603f * n.y);
+	result += shIrradiance[2].xyz * (0.488603f * n.z);
+	result += shIrradiance[3].xyz * (0.488603f * n.x);
+	result += shIrradiance[4].xyz * (1.092548f * n.x * n.y);
+	result += shIrradiance[5].xyz * (1.092548f * n.y * n.z);
+	result += shIrradiance[6].xyz * (0.315392f * (3.0f * n.z * n.z - 1.0f));
+	result += shIrradiance[7].xyz * (1.092548f * n.x * n.z);
+	result += shIrradiance[8].xyz * (0.546274f * (n.x * n.x - n.y * n.y));
+	return max(result, 0.0f);
+}
+
+// Octahedral layout of Common/env_map.h: +Y in the middle, -Y in the corners and a one
+// texel border, so plain bilinear filtering is seamless
+float2 OctahedralUV(float3 dir, float size)
+{
+	dir /= abs(dir.x) + abs(dir.y) + abs(dir.z);
+	float2 p = dir.xz;
+	if (dir.y < 0.0f)
+		p = (1.0f - abs(dir.zx)) * (dir.xz >= 0.0f ? 1.0f : -1.0f);
+	float2 uv = 0.5f + float2(0.5f, -0.5f) * p;
+	return (uv * (size - 2.0f) + 1.0f) / size;
+}
+
+// roughness 0 is the sky itself; the cube's other mips are GGX prefiltered. The border
+// of an octahedral map only holds at its top level, which is all env_convert writes.
+float4 SampleSky(float3 dir, float roughness)
+{
+	uint width, height, mipCount;
+	if (skyOctahedral)
+	{
+		SkyOctahedral.GetDimensions(0, width, height, mipCount);
+		return SkyOctahedral.SampleLevel(ObjSamplerState, OctahedralUV(dir, width), 0);
+	}
+	SkyMap.GetDimensions(0, width, height, mipCount);
+	float mip = roughness * (mipCount + skyTopMip - 1) - skyTopMip;
+	return SkyMap.SampleLevel(ObjSamplerState, dir, max(mip, 0.0f));
+}
+
 VS_OUTPUT VS(float4 inPos : POSITION, float2 inTexCoord : TEXCOORD, float3 normal : NORMAL)
 {
 	VS_OUTPUT output;
@@ -67,6 +118,21 @@ SKYMAP_VS_OUTPUT SKYMAP_VS(float3 inPos : POSITION, float2 inTexCoord : TEXCOORD
 	return output;
 }
 
+// One triangle covering the screen, (-1,-1) (-1,3) (3,-1) in clip space, on the far plane
+// like the xyww sphere. The far plane point under each pixel is its view direction.
+SKYMAP_VS_OUTPUT SKY_TRIANGLE_VS(uint id : SV_VertexID)
+{
+	SKYMAP_VS_OUTPUT output;
+
+	float2 clip = float2(id == 2 ? 3.0f : -1.0f, id == 1 ? 3.0f : -1.0f);
+	output.Pos = float4(clip, 1.0f, 1.0f);
+
+	float4 farPoint = mul(float4(clip, 1.0f, 1.0f), skyInvViewProj);
+	output.texCoord = farPoint.xyz / farPoint.w;
+
+	return output;
+}
+
 float4 PS(VS_OUTPUT input) : SV_TARGET
 {
 	input.normal = normalize(input.normal);
@@ -77,7 +143,7 @@ float4 PS(VS_OUTPUT input) : SV_TARGET
 
 	float3 finalColor;
 
-	finalColor = diffuse * light.ambient;
+	finalColor = diffuse * ShIrradiance(input.normal);
 	finalColor += saturate(dot(light.dir, input.normal) * light.diffuse * diffuse);
 
 	return float4(finalColor, diffuse.a);
@@ -85,7 +151,7 @@ float4 PS(VS_OUTPUT input) : SV_TARGET
 
 float4 SKYMAP_PS(SKYMAP_VS_OUTPUT input) : SV_Target
 {
-	return SkyMap.Sample(ObjSamplerState, input.texCoord);
+	return SampleSky(input.texCoord, 0.0f);
 }
 
 float4 D2D_PS(VS_OUTPUT input) : SV_TARGET
@@ -101,6 +167,7 @@ REFLECT_VS_OUTPUT REFLECT_VS(float3 inPos : POSITION, float2 inTexCoord : TEXCOO
     output.Pos = mul(float4(inPos, 1.0f), WVP);
     output.normal = mul(normal, World);
     output.TexCoord = inPos;
+    output.worldPos = mul(float4(inPos, 1.0f), World).xyz;
 
     return output;
 }
@@ -108,7 +175,18 @@ REFLECT_VS_OUTPUT REFLECT_VS(float3 inPos : POSITION, float2 inTexCoord : TEXCOO
 float4 REFLECT_PS(REFLECT_VS_OUTPUT input) : SV_Target
 {
     input.normal = normalize(input.normal);
-    float3 I = normalize(input.Pos - cameraPos);
+    float3 I = normalize(input.worldPos - cameraPos);
+    float3 R = reflect(I, normalize(input.normal));
+    return SampleSky(R, roughness);
+}
+
+// REFLECT_PS on the dynamic capture instead of the sky. GenerateMips box filters its
+// mips, a cheaper stand-in for the GGX prefiltering of the sky map's.
+float4 CAPTURE_REFLECT_PS(REFLECT_VS_OUTPUT input) : SV_Target
+{
+    float3 I = normalize(input.worldPos - cameraPos);
     float3 R = reflect(I, normalize(input.normal));
-    return SkyMap.Sample(ObjSamplerState, R);
+    uint width, height, mipCount;
+    EnvCapture.GetDimensions(0, width, height, mipCount);
+    return EnvCapture.SampleLevel(ObjSamplerState, R, roughness * (mipCount - 1));
 }
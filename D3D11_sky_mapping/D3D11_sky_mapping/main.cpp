@@ -10,11 +10,22 @@
 #pragma comment (lib, "dinput8.lib")
 #pragma comment (lib, "dxguid.lib")
 
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
 #include <windows.h>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
-#include <xnamath.h>
+#include "../../Common/xnamath_portable.h"
+#include "../../Common/dds_reader.h"
+#include "../../Common/sh_irradiance.h"
+#include "../../Common/shader_cache.h"
+#include "../../Common/constant_ring.h"
+#include "../../Common/profiler.h"
+#include "../../Common/texture_streamer.h"
+#include "../../Common/mesh_generator.h"
+#include "../../Common/vertex_cache.h"
+#include "../../Common/env_capture.h"
+#include "../../Common/transform_store.h"
 #include <D3D10_1.h>
 #include <DXGI.h>
 #include <D2D1.h>
@@ -23,6 +34,8 @@
 #include <dinput.h>
 ///////////////**************new**************////////////////////
 #include <vector>
+#include <algorithm>
+#include <math.h>
 ///////////////**************new**************////////////////////
 
 //Global Declarations - Interfaces//
@@ -41,7 +54,8 @@ ID3D10Blob* D2D_PS_Buffer;
 ID3D10Blob* VS_Buffer;
 ID3D10Blob* PS_Buffer;
 ID3D11InputLayout* vertLayout;
-ID3D11Buffer* cbPerObjectBuffer;
+//Per-object constants are sub-allocated per draw, see constant_ring.h
+ConstantRing constantRing;
 ID3D11BlendState* Transparency;
 ID3D11RasterizerState* CCWcullMode;
 ID3D11RasterizerState* CWcullMode;
@@ -80,11 +94,56 @@ ID3D10Blob* REFLECT_PS_Buffer;
 
 
 ID3D11ShaderResourceView* smrv;
+// Roughness of the reflective sphere, a mip of skymap_ggx.dds per step (R cycles it)
+float reflectRoughness = 0.0f;
+bool roughnessKeyDown = false;
+// skymap_oct.dds from Headless/env_convert, the same sky in one 2D texture (O toggles)
+ID3D11ShaderResourceView* skyOctahedralSRV = NULL;
+bool octahedralKeyDown = false;
+// The DDS textures stream their mips in by size on screen, within textureBudgets[budgetIndex]
+// bytes (B cycles it); smrv, skyOctahedralSRV and CubesTexture are its views of this frame
+TextureStreamer textureStreamer;
+int grassTexture = -1;
+int skyMapTexture = -1;
+int skyOctahedralTexture = -1;
+const unsigned long long textureBudgets[] = { 256ull << 20, 16ull << 20, 4ull << 20 };
+int budgetIndex = 0;
+bool budgetKeyDown = false;
+// The sky is one triangle over the whole screen whose pixels rebuild their view direction
+// from cbPerFrame's skyInvViewProj; drawn after the opaque objects, the depth test rejects
+// every covered pixel. F switches back to the camera-centred sphere for comparison.
+bool skyTriangle = true;
+bool skyKeyDown = false;
+ID3D11VertexShader* SKY_TRIANGLE_VS;
+ID3D10Blob* SKY_TRIANGLE_VS_Buffer;
+// Pipeline statistics of the sky draw, read back without stalling once the GPU is done
+ID3D11Query* skyStatsQuery;
+bool skyStatsPending = false;
+D3D11_QUERY_DATA_PIPELINE_STATISTICS skyStats;
+// The reflective sphere reflects envCapture, the ground and sky rendered from its centre.
+// captureSchedule renders captureRates[captureRateIndex] of the six faces a frame (C cycles
+// it, 0 reflects the static sky map instead), culling the ground per face. The sky in the
+// capture is a 6 ring sphere: its texture coordinates are directions, exact at any tessellation.
+EnvCaptureTarget envCapture;
+EnvCaptureSchedule captureSchedule;
+const int captureRates[] = { 1, 2, ENV_CAPTURE_FACES, 0 };
+int captureRateIndex = 0;
+bool captureKeyDown = false;
+XMFLOAT3 captureEye(0.0f, 0.0f, 0.0f);
+ID3D11Buffer* captureSkyVertBuffer;
+ID3D11Buffer* captureSkyIndexBuffer;
+int captureSkyIndexCount;
+ID3D11PixelShader* CAPTURE_REFLECT_PS;
+ID3D10Blob* CAPTURE_REFLECT_PS_Buffer;
+// Of the last frame, for the once a second report
+int captureFaces = 0;
+int captureDraws = 0;
 
 ID3D11DepthStencilState* DSLessEqual;
 ID3D11RasterizerState* RSCullNone;
 ///////////////**************new**************////////////////////
 
+D3D11_VIEWPORT viewport;
 std::wstring printText;
 
 //Global Declarations - Others//
@@ -92,6 +151,9 @@ LPCTSTR WndClassName = L"firstwindow";
 HWND hwnd = NULL;
 HRESULT hr;
 
+D3DShaderCompiler shaderCompiler;
+ShaderCache shaderCache(&shaderCompiler, "ShaderCache");
+
 int Width  = 800;
 int Height = 600;
 
@@ -124,7 +186,6 @@ XMVECTOR camForward = XMVectorSet(0.0f,0.0f,1.0f, 0.0f);
 XMVECTOR camRight = XMVectorSet(1.0f,0.0f,0.0f, 0.0f);
 
 XMMATRIX camRotationMatrix;
-XMMATRIX groundWorld;
 
 float moveLeftRight = 0.0f;
 float moveBackForward = 0.0f;
@@ -135,14 +196,16 @@ float camPitch = 0.0f;
 ///////////////**************new**************////////////////////
 int NumSphereVertices;
 int NumSphereFaces;
+DXGI_FORMAT sphereIndexFormat;
 
-XMMATRIX sphereWorld;
-XMMATRIX sphereWorld2;
 ///////////////**************new**************////////////////////
 
-XMMATRIX Rotation;
-XMMATRIX Scale;
-XMMATRIX Translation;
+//Every object's position, rotation and scale; UpdateScene composes their matrices
+TransformStore transforms;
+int groundTransform;
+int skyTransform;			//the sky sphere, centered on the camera
+int sphereTransform;		//the reflective sphere
+int captureSkyTransform;	//the sky sphere of the capture, centered on the reflective sphere
 float rot = 0.01f;
 
 double countsPerSecond = 0.0;
@@ -159,13 +222,17 @@ bool InitializeDirect3d11App(HINSTANCE hInstance);
 void CleanUp();
 bool InitScene();
 void DrawScene();
+void DrawSky();
+void CaptureEnvironment();
 bool InitD2D_D3D101_DWrite(IDXGIAdapter1 *Adapter);
 void InitD2DScreenTexture();
 void UpdateScene(double time);
+void StreamTextures();
 
 void UpdateCamera();
 ///////////////**************new**************////////////////////
 void CreateSphere(int LatLines, int LongLines);
+void CreateCaptureSky();
 ///////////////**************new**************////////////////////
 
 void RenderText(std::wstring text, int inInt);
@@ -194,6 +261,7 @@ struct cbPerObject
 	XMMATRIX  WVP;
 	XMMATRIX World;
     XMFLOAT3 camPos;
+	float roughness;
 };
 
 cbPerObject cbPerObj;
@@ -215,6 +283,12 @@ Light light;
 struct cbPerFrame
 {
 	Light  light;
+	// SH irradiance of the sky (Common/sh_irradiance.h), rgb in xyz
+	XMFLOAT4 shIrradiance[SH_COEFFICIENTS];
+	int skyOctahedral;		// sample skyOctahedralSRV instead of smrv
+	float skyTopMip;		// mip of the full chain that is mip 0 of smrv while it streams
+	XMFLOAT2 pad2;
+	XMMATRIX skyInvViewProj;	// transposed inverse of the translation-free view * projection
 };
 
 cbPerFrame constbuffPerFrame;
@@ -276,6 +350,10 @@ int WINAPI WinMain(HINSTANCE hInstance,	//Main windows function
 
 	messageloop();
 
+	//Save where the frames went: a trace for chrome://tracing and a per-marker table
+	Profiler::Instance().WriteChromeTrace("profile.json");
+	OutputDebugStringA(Profiler::Instance().SummaryTable().c_str());
+
 	CleanUp();    
 
 	return 0;
@@ -350,6 +428,8 @@ bool InitializeWindow(HINSTANCE hInstance,
 
 bool InitializeDirect3d11App(HINSTANCE hInstance)
 {	
+	PROFILE_SCOPE("InitializeDirect3d11App");
+
 	//Describe our SwapChain Buffer
 	DXGI_MODE_DESC bufferDesc;
 
@@ -428,6 +508,8 @@ bool InitializeDirect3d11App(HINSTANCE hInstance)
 
 bool InitD2D_D3D101_DWrite(IDXGIAdapter1 *Adapter)
 {
+	PROFILE_SCOPE("InitD2D_D3D101_DWrite");
+
 	//Create our Direc3D 10.1 Device///////////////////////////////////////////////////////////////////////////////////////
 	hr = D3D10CreateDevice1(Adapter, D3D10_DRIVER_TYPE_HARDWARE, NULL,D3D10_CREATE_DEVICE_BGRA_SUPPORT,
 		D3D10_FEATURE_LEVEL_9_3, D3D10_1_SDK_VERSION, &d3d101Device	);	
@@ -512,6 +594,8 @@ bool InitD2D_D3D101_DWrite(IDXGIAdapter1 *Adapter)
 
 bool InitDirectInput(HINSTANCE hInstance)
 {
+	PROFILE_SCOPE("InitDirectInput");
+
 	hr = DirectInput8Create(hInstance,
 		DIRECTINPUT_VERSION,
 		IID_IDirectInput8,
@@ -562,6 +646,8 @@ void UpdateCamera()
 
 void DetectInput(double time)
 {
+	PROFILE_SCOPE("DetectInput");
+
 	DIMOUSESTATE mouseCurrState;
 
 	BYTE keyboardState[256];
@@ -594,6 +680,33 @@ void DetectInput(double time)
 	{
 		moveBackForward -= speed;
 	}
+	bool roughnessKey = (keyboardState[DIK_R] & 0x80) != 0;
+	if (roughnessKey && !roughnessKeyDown)
+		reflectRoughness = reflectRoughness >= 1.0f ? 0.0f : std::min(reflectRoughness + 0.25f, 1.0f);
+	roughnessKeyDown = roughnessKey;
+	bool octahedralKey = (keyboardState[DIK_O] & 0x80) != 0;
+	if (octahedralKey && !octahedralKeyDown && skyOctahedralSRV && smrv)
+		constbuffPerFrame.skyOctahedral = !constbuffPerFrame.skyOctahedral;
+	octahedralKeyDown = octahedralKey;
+	bool budgetKey = (keyboardState[DIK_B] & 0x80) != 0;
+	if (budgetKey && !budgetKeyDown)
+	{
+		budgetIndex = (budgetIndex + 1) % ARRAYSIZE(textureBudgets);
+		textureStreamer.SetBudget(textureBudgets[budgetIndex]);
+	}
+	budgetKeyDown = budgetKey;
+	bool skyKey = (keyboardState[DIK_F] & 0x80) != 0;
+	if (skyKey && !skyKeyDown)
+		skyTriangle = !skyTriangle;
+	skyKeyDown = skyKey;
+	bool captureKey = (keyboardState[DIK_C] & 0x80) != 0;
+	if (captureKey && !captureKeyDown)
+	{
+		captureRateIndex = (captureRateIndex + 1) % ARRAYSIZE(captureRates);
+		captureSchedule.SetFacesPerFrame(captureRates[captureRateIndex]);
+		captureSchedule.Invalidate();
+	}
+	captureKeyDown = captureKey;
 	if((mouseCurrState.lX != mouseLastState.lX) || (mouseCurrState.lY != mouseLastState.lY))
 	{
 		camYaw += mouseLastState.lX * 0.001f;
@@ -627,7 +740,7 @@ void CleanUp()
 	vertLayout->Release();
 	depthStencilView->Release();
 	depthStencilBuffer->Release();
-	cbPerObjectBuffer->Release();
+	constantRing.Release();
 	Transparency->Release();
 	CCWcullMode->Release();
 	CWcullMode->Release();
@@ -657,8 +770,17 @@ void CleanUp()
 	SKYMAP_PS->Release();
 	SKYMAP_VS_Buffer->Release();
 	SKYMAP_PS_Buffer->Release();
+	SKY_TRIANGLE_VS->Release();
+	SKY_TRIANGLE_VS_Buffer->Release();
+	skyStatsQuery->Release();
 
-	smrv->Release();
+	envCapture.Release();
+	captureSkyVertBuffer->Release();
+	captureSkyIndexBuffer->Release();
+	CAPTURE_REFLECT_PS->Release();
+	CAPTURE_REFLECT_PS_Buffer->Release();
+
+	textureStreamer.Release();
 
 	DSLessEqual->Release();
 	RSCullNone->Release();
@@ -668,41 +790,33 @@ void CleanUp()
 ///////////////**************new**************////////////////////
 void CreateSphere(int LatLines, int LongLines)
 {
-	NumSphereVertices = ((LatLines-2) * LongLines) + 2;
-	NumSphereFaces  = ((LatLines-3)*(LongLines)*2) + (LongLines*2);
+	PROFILE_SCOPE("CreateSphere");
 
-	float sphereYaw = 0.0f;
-	float spherePitch = 0.0f;
+	//LatLines rings of vertices from pole to pole, with full UVs and normals from the generator
+	MeshData mesh;
+	GenerateUVSphere(1.0f, LatLines - 1, LongLines, &mesh);
+	NumSphereVertices = (int)mesh.vertices.size();
+	NumSphereFaces = (int)mesh.indices.size() / 3;
 
 	std::vector<Vertex> vertices(NumSphereVertices);
-
-	XMVECTOR currVertPos = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
-    
-	vertices[0].pos.x = 0.0f;
-	vertices[0].pos.y = 0.0f;
-	vertices[0].pos.z = 1.0f;
-
-	for(DWORD i = 0; i < LatLines-2; ++i)
+	for(int i = 0; i < NumSphereVertices; ++i)
 	{
-		spherePitch = (i+1) * (3.14/(LatLines-1));
-		Rotationx = XMMatrixRotationX(spherePitch);
-		for(DWORD j = 0; j < LongLines; ++j)
-		{
-			sphereYaw = j * (6.28/(LongLines));
-			Rotationy = XMMatrixRotationZ(sphereYaw);
-			currVertPos = XMVector3TransformNormal( XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), (Rotationx * Rotationy) );	
-			currVertPos = XMVector3Normalize( currVertPos );
-			vertices[i*LongLines+j+1].pos.x = XMVectorGetX(currVertPos);
-			vertices[i*LongLines+j+1].pos.y = XMVectorGetY(currVertPos);
-			vertices[i*LongLines+j+1].pos.z = XMVectorGetZ(currVertPos);
-            vertices[i*LongLines + j + 1].normal = vertices[i*LongLines + j + 1].pos;
-		}
+		const MeshVertex& v = mesh.vertices[i];
+		vertices[i] = Vertex(v.position[0], v.position[1], v.position[2], v.uv[0], v.uv[1], v.normal[0], v.normal[1], v.normal[2]);
 	}
 
-	vertices[NumSphereVertices-1].pos.x =  0.0f;
-	vertices[NumSphereVertices-1].pos.y =  0.0f;
-	vertices[NumSphereVertices-1].pos.z = -1.0f;
+	std::vector<DWORD> indices(mesh.indices.begin(), mesh.indices.end());
+
+	//Reorder for the post-transform vertex cache, then lay the vertices out in first-use order
+	int missesBefore = CountVertexCacheMisses(&indices[0], NumSphereFaces * 3, NumSphereVertices);
+	OptimizeVertexCache(&indices[0], NumSphereFaces * 3, NumSphereVertices);
+	OptimizeVertexFetch(&vertices[0], NumSphereVertices, &indices[0], NumSphereFaces * 3);
+	int missesAfter = CountVertexCacheMisses(&indices[0], NumSphereFaces * 3, NumSphereVertices);
 
+	std::wostringstream cacheString;
+	cacheString << L"CreateSphere: ACMR " << (float)missesBefore / NumSphereFaces << L" -> " << (float)missesAfter / NumSphereFaces
+		<< L", ATVR " << (float)missesBefore / NumSphereVertices << L" -> " << (float)missesAfter / NumSphereVertices << L"\n";
+	OutputDebugString(cacheString.str().c_str());
 
 	D3D11_BUFFER_DESC vertexBufferDesc;
 	ZeroMemory( &vertexBufferDesc, sizeof(vertexBufferDesc) );
@@ -720,79 +834,79 @@ void CreateSphere(int LatLines, int LongLines)
 	hr = d3d11Device->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &sphereVertBuffer);
 
 
-	std::vector<DWORD> indices(NumSphereFaces * 3);
-
-	int k = 0;
-	for(DWORD l = 0; l < LongLines-1; ++l)
-	{
-		indices[k] = 0;
-		indices[k+1] = l+1;
-		indices[k+2] = l+2;
-		k += 3;
-	}
-
-	indices[k] = 0;
-	indices[k+1] = LongLines;
-	indices[k+2] = 1;
-	k += 3;
-
-	for(DWORD i = 0; i < LatLines-3; ++i)
-	{
-		for(DWORD j = 0; j < LongLines-1; ++j)
-		{
-			indices[k]   = i*LongLines+j+1;
-			indices[k+1] = i*LongLines+j+2;
-			indices[k+2] = (i+1)*LongLines+j+1;
-
-			indices[k+3] = (i+1)*LongLines+j+1;
-			indices[k+4] = i*LongLines+j+2;
-			indices[k+5] = (i+1)*LongLines+j+2;
-
-			k += 6; // next quad
-		}
-
-		indices[k]   = (i*LongLines)+LongLines;
-		indices[k+1] = (i*LongLines)+1;
-		indices[k+2] = ((i+1)*LongLines)+LongLines;
-
-		indices[k+3] = ((i+1)*LongLines)+LongLines;
-		indices[k+4] = (i*LongLines)+1;
-		indices[k+5] = ((i+1)*LongLines)+1;
-
-		k += 6;
-	}
-
-	for(DWORD l = 0; l < LongLines-1; ++l)
+	//Use 16 bit indices whenever every vertex is addressable with them, halving the index fetch
+	std::vector<WORD> shortIndices;
+	UINT indexSize = sizeof(DWORD);
+	sphereIndexFormat = DXGI_FORMAT_R32_UINT;
+	if(NumSphereVertices <= 65536)
 	{
-		indices[k] = NumSphereVertices-1;
-		indices[k+1] = (NumSphereVertices-1)-(l+1);
-		indices[k+2] = (NumSphereVertices-1)-(l+2);
-		k += 3;
+		shortIndices.assign(indices.begin(), indices.end());
+		indexSize = sizeof(WORD);
+		sphereIndexFormat = DXGI_FORMAT_R16_UINT;
 	}
 
-	indices[k] = NumSphereVertices-1;
-	indices[k+1] = (NumSphereVertices-1)-LongLines;
-	indices[k+2] = NumSphereVertices-2;
-
 	D3D11_BUFFER_DESC indexBufferDesc;
 	ZeroMemory( &indexBufferDesc, sizeof(indexBufferDesc) );
 
 	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(DWORD) * NumSphereFaces * 3;
+	indexBufferDesc.ByteWidth = indexSize * NumSphereFaces * 3;
 	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	indexBufferDesc.CPUAccessFlags = 0;
 	indexBufferDesc.MiscFlags = 0;
 
 	D3D11_SUBRESOURCE_DATA iinitData;
 
-	iinitData.pSysMem = &indices[0];
+	if(shortIndices.empty())
+		iinitData.pSysMem = &indices[0];
+	else
+		iinitData.pSysMem = &shortIndices[0];
 	d3d11Device->CreateBuffer(&indexBufferDesc, &iinitData, &sphereIndexBuffer);
 
+	std::wostringstream printString;
+	printString << L"CreateSphere: " << NumSphereVertices << L" vertices, "
+		<< (indexSize * 8) << L" bit indices, "
+		<< (sizeof(DWORD) - indexSize) * NumSphereFaces * 3 << L" bytes saved\n";
+	OutputDebugString(printString.str().c_str());
+
+}
+
+// The sky sphere of the environment capture, 16 bit indices in creation order
+void CreateCaptureSky()
+{
+	MeshData mesh;
+	GenerateUVSphere(1.0f, 6, 12, &mesh);
+	captureSkyIndexCount = (int)mesh.indices.size();
+
+	std::vector<Vertex> vertices(mesh.vertices.size());
+	for(size_t i = 0; i < vertices.size(); ++i)
+	{
+		const MeshVertex& v = mesh.vertices[i];
+		vertices[i] = Vertex(v.position[0], v.position[1], v.position[2], v.uv[0], v.uv[1], v.normal[0], v.normal[1], v.normal[2]);
+	}
+	std::vector<WORD> indices(mesh.indices.begin(), mesh.indices.end());
+
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory( &bufferDesc, sizeof(bufferDesc) );
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = sizeof( Vertex ) * (UINT)vertices.size();
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA bufferData;
+	ZeroMemory( &bufferData, sizeof(bufferData) );
+	bufferData.pSysMem = &vertices[0];
+	hr = d3d11Device->CreateBuffer( &bufferDesc, &bufferData, &captureSkyVertBuffer);
+
+	bufferDesc.ByteWidth = sizeof( WORD ) * captureSkyIndexCount;
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bufferData.pSysMem = &indices[0];
+	hr = d3d11Device->CreateBuffer( &bufferDesc, &bufferData, &captureSkyIndexBuffer);
 }
 ///////////////**************new**************////////////////////
 
 void InitD2DScreenTexture()
 {
+	PROFILE_SCOPE("InitD2DScreenTexture");
+
 	//Create the vertex buffer
 	Vertex v[] =
 	{
@@ -846,21 +960,35 @@ void InitD2DScreenTexture()
 
 bool InitScene()
 {
+	PROFILE_SCOPE("InitScene");
+
 	InitD2DScreenTexture();
 
 	///////////////**************new**************////////////////////
 	CreateSphere(20, 20);
+	CreateCaptureSky();
 	///////////////**************new**************////////////////////
 
-	//Compile Shaders from shader file
-	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "VS", "vs_4_0", 0, 0, 0, &VS_Buffer, 0, 0);
-	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "PS", "ps_4_0", 0, 0, 0, &PS_Buffer, 0, 0);
-	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "D2D_PS", "ps_4_0", 0, 0, 0, &D2D_PS_Buffer, 0, 0);
-	///////////////**************new**************////////////////////
-	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "SKYMAP_VS", "vs_4_0", 0, 0, 0, &SKYMAP_VS_Buffer, 0, 0);
-	hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "SKYMAP_PS", "ps_4_0", 0, 0, 0, &SKYMAP_PS_Buffer, 0, 0);
-    hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "REFLECT_VS", "vs_4_0", 0, 0, 0, &REFLECT_VS_Buffer, 0, 0);
-    hr = D3DX11CompileFromFile(L"Effects.fx", 0, 0, "REFLECT_PS", "ps_4_0", 0, 0, 0, &REFLECT_PS_Buffer, 0, 0);
+	groundTransform = transforms.Add();
+	skyTransform = transforms.Add();
+	sphereTransform = transforms.Add();
+	captureSkyTransform = transforms.Add();
+
+	//Compile Shaders from shader file, or load them from the shader cache if Effects.fx is unchanged
+	{
+		PROFILE_SCOPE("CompileShaders");
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "VS", "vs_4_0", 0, &VS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "PS", "ps_4_0", 0, &PS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "D2D_PS", "ps_4_0", 0, &D2D_PS_Buffer);
+		///////////////**************new**************////////////////////
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "SKYMAP_VS", "vs_4_0", 0, &SKYMAP_VS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "SKYMAP_PS", "ps_4_0", 0, &SKYMAP_PS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "SKY_TRIANGLE_VS", "vs_4_0", 0, &SKY_TRIANGLE_VS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "REFLECT_VS", "vs_4_0", 0, &REFLECT_VS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "REFLECT_PS", "ps_4_0", 0, &REFLECT_PS_Buffer);
+		hr = CompileShaderCached(&shaderCache, L"Effects.fx", "CAPTURE_REFLECT_PS", "ps_4_0", 0, &CAPTURE_REFLECT_PS_Buffer);
+	}
+	ReportShaderCacheStats(shaderCache);
 
 	///////////////**************new**************////////////////////
 
@@ -871,8 +999,10 @@ bool InitScene()
 	///////////////**************new**************////////////////////
 	hr = d3d11Device->CreateVertexShader(SKYMAP_VS_Buffer->GetBufferPointer(), SKYMAP_VS_Buffer->GetBufferSize(), NULL, &SKYMAP_VS);
 	hr = d3d11Device->CreatePixelShader(SKYMAP_PS_Buffer->GetBufferPointer(), SKYMAP_PS_Buffer->GetBufferSize(), NULL, &SKYMAP_PS);
+	hr = d3d11Device->CreateVertexShader(SKY_TRIANGLE_VS_Buffer->GetBufferPointer(), SKY_TRIANGLE_VS_Buffer->GetBufferSize(), NULL, &SKY_TRIANGLE_VS);
     hr = d3d11Device->CreateVertexShader(REFLECT_VS_Buffer->GetBufferPointer(), REFLECT_VS_Buffer->GetBufferSize(), NULL, &REFLECT_VS);
     hr = d3d11Device->CreatePixelShader(REFLECT_PS_Buffer->GetBufferPointer(), REFLECT_PS_Buffer->GetBufferSize(), NULL, &REFLECT_PS);
+	hr = d3d11Device->CreatePixelShader(CAPTURE_REFLECT_PS_Buffer->GetBufferPointer(), CAPTURE_REFLECT_PS_Buffer->GetBufferSize(), NULL, &CAPTURE_REFLECT_PS);
 
 	///////////////**************new**************////////////////////
 
@@ -943,7 +1073,6 @@ bool InitScene()
 	d3d11DevCon->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
 
 	//Create the Viewport
-	D3D11_VIEWPORT viewport;
 	ZeroMemory(&viewport, sizeof(D3D11_VIEWPORT));
 
 	viewport.TopLeftX = 0;
@@ -960,17 +1089,9 @@ bool InitScene()
 	D3D11_BUFFER_DESC cbbd;	
 	ZeroMemory(&cbbd, sizeof(D3D11_BUFFER_DESC));
 
-	cbbd.Usage = D3D11_USAGE_DEFAULT;
-	cbbd.ByteWidth = sizeof(cbPerObject);
-	cbbd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbbd.CPUAccessFlags = 0;
-	cbbd.MiscFlags = 0;
-
-	hr = d3d11Device->CreateBuffer(&cbbd, NULL, &cbPerObjectBuffer);
+	hr = constantRing.Init(d3d11Device);
 
 	//Create the buffer to send to the cbuffer per frame in effect file
-	ZeroMemory(&cbbd, sizeof(D3D11_BUFFER_DESC));
-
 	cbbd.Usage = D3D11_USAGE_DEFAULT;
 	cbbd.ByteWidth = sizeof(cbPerFrame);
 	cbbd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
@@ -1008,32 +1129,36 @@ bool InitScene()
 	blendDesc.AlphaToCoverageEnable = false;
 	blendDesc.RenderTarget[0] = rtbd;
 
-	hr = D3DX11CreateShaderResourceViewFromFile( d3d11Device, L"grass.jpg",
-		NULL, NULL, &CubesTexture, NULL );
+	// Only the smallest mips load here, the rest streams in once frames are running
+	textureStreamer.Init(d3d11Device, d3d11DevCon, textureBudgets[budgetIndex]);
+	{
+		PROFILE_SCOPE("LoadGrassTexture");
+		// BC1 with mips, cooked from grass.jpg by Headless/texture_cooker
+		grassTexture = textureStreamer.Load(L"grass.dds");
+		CubesTexture = textureStreamer.View(grassTexture);
+	}
 
 	///////////////**************new**************////////////////////
-	//Tell D3D we will be loading a cube texture
-	D3DX11_IMAGE_LOAD_INFO loadSMInfo;
-	loadSMInfo.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-
-	//Load the texture
-	ID3D11Texture2D* SMTexture = 0;
-	hr = D3DX11CreateTextureFromFile(d3d11Device, L"skymap.dds", 
-		&loadSMInfo, 0, (ID3D11Resource**)&SMTexture, 0);
-
-	//Create the textures description
-	D3D11_TEXTURE2D_DESC SMTextureDesc;
-	SMTexture->GetDesc(&SMTextureDesc);
-
-	//Tell D3D We have a cube texture, which is an array of 2D textures
-	D3D11_SHADER_RESOURCE_VIEW_DESC SMViewDesc;
-	SMViewDesc.Format = SMTextureDesc.Format;
-	SMViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	SMViewDesc.TextureCube.MipLevels = SMTextureDesc.MipLevels;
-	SMViewDesc.TextureCube.MostDetailedMip = 0;
-
-	//Create the Resource view
-	hr = d3d11Device->CreateShaderResourceView(SMTexture, &SMViewDesc, &smrv);
+	//Load the cube texture, the DDS header marks it as a cube map
+	{
+		PROFILE_SCOPE("LoadSkyMap");
+		// GGX prefiltered by Headless/ibl_baker, one roughness per mip; the plain sky map
+		// only has mirror reflections
+		skyMapTexture = textureStreamer.Load(L"skymap_ggx.dds");
+		if (skyMapTexture < 0)
+			skyMapTexture = textureStreamer.Load(L"skymap.dds");
+		skyOctahedralTexture = textureStreamer.Load(L"skymap_oct.dds");
+		smrv = textureStreamer.View(skyMapTexture);
+		skyOctahedralSRV = textureStreamer.View(skyOctahedralTexture);
+		constbuffPerFrame.skyOctahedral = smrv == NULL && skyOctahedralSRV != NULL;
+
+		// Ambient from the sky's irradiance, or the constant ambient without a bake
+		SHIrradiance sh;
+		if (!ReadSHIrradiance("skymap_sh.txt", &sh))
+			SetSHConstant(&light.ambient.x, &sh);
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			constbuffPerFrame.shIrradiance[i] = XMFLOAT4(sh.rgb[i][0], sh.rgb[i][1], sh.rgb[i][2], 0.0f);
+	}
 	///////////////**************new**************////////////////////
 
 	// Describe the Sample State
@@ -1075,6 +1200,13 @@ bool InitScene()
 	dssDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
 
 	d3d11Device->CreateDepthStencilState(&dssDesc, &DSLessEqual);
+
+	D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_PIPELINE_STATISTICS, 0 };
+	hr = d3d11Device->CreateQuery(&queryDesc, &skyStatsQuery);
+	ZeroMemory(&skyStats, sizeof(skyStats));
+
+	hr = envCapture.Init(d3d11Device, 256);
+	captureSchedule.SetFacesPerFrame(captureRates[captureRateIndex]);
 	///////////////**************new**************////////////////////
 
 	return true;
@@ -1115,34 +1247,58 @@ double GetFrameTime()
 
 void UpdateScene(double time)
 {
-	//Reset cube1World
-	groundWorld = XMMatrixIdentity();
-
-	//Define cube1's world space matrix
-	Scale = XMMatrixScaling( 10.0f, 10.0f, 10.0f );
-	Translation = XMMatrixTranslation( 0.0f, 10.0f, 0.0f );
+	PROFILE_SCOPE("UpdateScene");
 
-	//Set cube1's world space using the transformations
-	groundWorld = Scale * Translation;
+	//Define the ground's world space transform
+	transforms.SetScale(groundTransform, 10.0f, 10.0f, 10.0f);
+	transforms.SetPosition(groundTransform, 0.0f, 10.0f, 0.0f);
 
 	///////////////**************new**************////////////////////
-	//Reset sphereWorld
-	sphereWorld = XMMatrixIdentity();
+	//Make sure the sky sphere is always centered around camera
+	transforms.SetScale(skyTransform, 5.0f, 5.0f, 5.0f);
+	transforms.SetPosition(skyTransform, XMVectorGetX(camPosition), XMVectorGetY(camPosition), XMVectorGetZ(camPosition));
+	///////////////**************new**************////////////////////
+	transforms.SetPosition(sphereTransform, 0.0f, 5.5f, 0.0f);
 
-	//Define sphereWorld's world space matrix
-	Scale = XMMatrixScaling( 5.0f, 5.0f, 5.0f );
-	//Make sure the sphere is always centered around camera
-	Translation = XMMatrixTranslation( XMVectorGetX(camPosition), XMVectorGetY(camPosition), XMVectorGetZ(camPosition) );
+	//The capture's sky sphere surrounds the reflective sphere
+	XMFLOAT3 eye = transforms.Position(sphereTransform);
+	transforms.SetScale(captureSkyTransform, 5.0f, 5.0f, 5.0f);
+	transforms.SetPosition(captureSkyTransform, eye.x, eye.y, eye.z);
 
-	//Set sphereWorld's world space using the transformations
-	sphereWorld = Scale * Translation;
-	///////////////**************new**************////////////////////
-    Translation = XMMatrixTranslation(0, 5.5f, 0);
-    sphereWorld2 = XMMatrixIdentity()*Translation;
+	//World and WVP of every object, already transposed for the constant buffer
+	transforms.Compose(camView * camProjection, NULL);
+}
+
+// Tells the streamer how many pixels each texture spans, then lets it swap mips in and out
+void StreamTextures()
+{
+	PROFILE_SCOPE("StreamTextures");
+
+	// Pixels per unit of tangent, from camProjection's field of view
+	float pixelsPerTangent = Height / (2.0f * tanf(0.2f * 3.14f));
+
+	// A cube face spans a tangent of 2. The octahedral square matches the texel angle of
+	// cube faces sqrt(4 pi) / (pi / 2) times smaller, see EnvTexelAngle.
+	float faceSize = 2.0f * pixelsPerTangent;
+	if (constbuffPerFrame.skyOctahedral)
+		textureStreamer.Request(skyOctahedralTexture, faceSize * 2.26f);
+	else
+		textureStreamer.Request(skyMapTexture, faceSize);
+
+	// The ground repeats the grass every 0.2 units, densest right below the camera
+	float groundDistance = std::max(fabsf(XMVectorGetY(camPosition)), 1.0f);
+	textureStreamer.Request(grassTexture, 0.2f * pixelsPerTangent / groundDistance);
+
+	textureStreamer.Update();
+	smrv = textureStreamer.View(skyMapTexture);
+	skyOctahedralSRV = textureStreamer.View(skyOctahedralTexture);
+	CubesTexture = textureStreamer.View(grassTexture);
+	constbuffPerFrame.skyTopMip = (float)textureStreamer.ResidentMip(skyMapTexture);
 }
 
 void RenderText(std::wstring text, int inInt)
 {
+	PROFILE_SCOPE("RenderText");
 
 	d3d11DevCon->PSSetShader(D2D_PS, 0, 0);
 
@@ -1207,8 +1363,8 @@ void RenderText(std::wstring text, int inInt)
 
 	WVP =  XMMatrixIdentity();
 	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
+	ID3D11Buffer* objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+	d3d11DevCon->VSSetConstantBuffers( 1, 1, &objectBuffer );
 	d3d11DevCon->PSSetShaderResources( 0, 1, &d2dTexture );
 	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
 
@@ -1217,16 +1373,151 @@ void RenderText(std::wstring text, int inInt)
 	d3d11DevCon->DrawIndexed( 6, 0, 0 );	
 }
 
+// The sky pass, inside the pipeline statistics query whenever the previous one has been read
+void DrawSky()
+{
+	if (skyStatsPending && d3d11DevCon->GetData(skyStatsQuery, &skyStats, sizeof(skyStats), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		skyStatsPending = false;
+	bool measure = !skyStatsPending;
+	if (measure)
+		d3d11DevCon->Begin(skyStatsQuery);
+
+	d3d11DevCon->PSSetShader(SKYMAP_PS, 0, 0);
+	d3d11DevCon->OMSetDepthStencilState(DSLessEqual, 0);
+	d3d11DevCon->RSSetState(RSCullNone);
+	if (skyTriangle)
+	{
+		//No vertex buffer: SKY_TRIANGLE_VS makes the three corners from SV_VertexID
+		d3d11DevCon->IASetInputLayout(NULL);
+		d3d11DevCon->VSSetShader(SKY_TRIANGLE_VS, 0, 0);
+		d3d11DevCon->Draw(3, 0);
+		d3d11DevCon->IASetInputLayout(vertLayout);
+	}
+	else
+	{
+		//The sphere's buffers are bound by DrawScene
+		cbPerObj.WVP = LoadTransformMatrix(transforms.WVP(skyTransform));
+		cbPerObj.World = LoadTransformMatrix(transforms.World(skyTransform));
+		ID3D11Buffer* objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+		d3d11DevCon->VSSetConstantBuffers( 1, 1, &objectBuffer );
+		d3d11DevCon->VSSetShader(SKYMAP_VS, 0, 0);
+		d3d11DevCon->DrawIndexed( NumSphereFaces * 3, 0, 0 );
+	}
+
+	if (measure)
+	{
+		d3d11DevCon->End(skyStatsQuery);
+		skyStatsPending = true;
+	}
+}
+
+// Renders this frame's faces of envCapture from the reflective sphere's centre: the
+// ground on the faces that see it, then the sky. Leaves the main viewport set; DrawScene
+// binds its render target afterwards.
+void CaptureEnvironment()
+{
+	PROFILE_SCOPE("CaptureEnvironment");
+
+	captureFaces = captureDraws = 0;
+	if (captureSchedule.FacesPerFrame() == 0 || !envCapture.View())
+		return;
+
+	XMFLOAT3 eye = transforms.Position(sphereTransform);
+	if (eye.x != captureEye.x || eye.y != captureEye.y || eye.z != captureEye.z)
+	{
+		captureEye = eye;
+		captureSchedule.Invalidate();
+	}
+	int faces[ENV_CAPTURE_FACES];
+	int count = captureSchedule.Next(faces);
+
+	//The sphere reads the capture from t2, which can't stay bound while it is a render target
+	ID3D11ShaderResourceView* nullView = NULL;
+	d3d11DevCon->PSSetShaderResources(2, 1, &nullView);
+	ID3D11ShaderResourceView* skyViews[2] = { smrv, skyOctahedralSRV };
+	d3d11DevCon->PSSetShaderResources(0, 2, skyViews);
+	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
+	d3d11DevCon->OMSetBlendState(0, 0, 0xffffffff);
+	d3d11DevCon->RSSetState(RSCullNone);
+
+	const float nearZ = 0.1f, farZ = 1000.0f;
+	const XMFLOAT3 groundMin(-10.0f, 0.0f, -10.0f), groundMax(10.0f, 0.0f, 10.0f);
+	XMMATRIX captureProjection = CubeFaceProjection(nearZ, farZ);
+	XMMATRIX groundWorld = LoadTransformMatrix(transforms.World(groundTransform));
+	XMMATRIX skyWorld = LoadTransformMatrix(transforms.World(captureSkyTransform));
+	float clearColor[4] = { 0.1f, 0.1f, 0.1f, 1.0f };
+	UINT stride = sizeof( Vertex );
+	UINT offset = 0;
+	//The ground reflects the view ray from the capture point, not from the player
+	cbPerObj.camPos = eye;
+	cbPerObj.roughness = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		int face = faces[i];
+		envCapture.BeginFace(d3d11DevCon, face, clearColor);
+		//The worlds are stored transposed, so (world * viewProjection)^T is viewProjection^T * world
+		XMMATRIX faceViewProjection = XMMatrixTranspose(CubeFaceView(face, XMLoadFloat3(&eye)) * captureProjection);
+
+		if (CubeFaceSeesBox(face, eye, groundMin, groundMax, nearZ, farZ))
+		{
+			d3d11DevCon->IASetIndexBuffer( squareIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			d3d11DevCon->IASetVertexBuffers( 0, 1, &squareVertBuffer, &stride, &offset );
+			cbPerObj.WVP = faceViewProjection * groundWorld;
+			cbPerObj.World = groundWorld;
+			ID3D11Buffer* objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+			d3d11DevCon->VSSetConstantBuffers( 1, 1, &objectBuffer );
+			d3d11DevCon->PSSetConstantBuffers( 1, 1, &objectBuffer );
+			d3d11DevCon->VSSetShader(REFLECT_VS, 0, 0);
+			d3d11DevCon->PSSetShader(REFLECT_PS, 0, 0);
+			d3d11DevCon->OMSetDepthStencilState(NULL, 0);
+			d3d11DevCon->DrawIndexed( 6, 0, 0 );
+			captureDraws++;
+		}
+
+		//The sky last, on the pixels the ground left
+		d3d11DevCon->IASetIndexBuffer( captureSkyIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		d3d11DevCon->IASetVertexBuffers( 0, 1, &captureSkyVertBuffer, &stride, &offset );
+		cbPerObj.WVP = faceViewProjection * skyWorld;
+		cbPerObj.World = skyWorld;
+		ID3D11Buffer* objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+		d3d11DevCon->VSSetConstantBuffers( 1, 1, &objectBuffer );
+		d3d11DevCon->VSSetShader(SKYMAP_VS, 0, 0);
+		d3d11DevCon->PSSetShader(SKYMAP_PS, 0, 0);
+		d3d11DevCon->OMSetDepthStencilState(DSLessEqual, 0);
+		d3d11DevCon->DrawIndexed( captureSkyIndexCount, 0, 0 );
+		captureDraws++;
+	}
+	captureFaces = count;
+
+	d3d11DevCon->OMSetDepthStencilState(NULL, 0);
+	d3d11DevCon->OMSetRenderTargets( 1, &renderTargetView, depthStencilView );
+	d3d11DevCon->RSSetViewports(1, &viewport);
+	if (count > 0)
+		envCapture.Finish(d3d11DevCon);
+}
+
 void DrawScene()
 {
+	PROFILE_SCOPE("DrawScene");
+
 	//Clear our render target and depth/stencil view
 	float bgColor[4] = { 0.1f, 0.1f, 0.1f, 1.0f };
 	d3d11DevCon->ClearRenderTargetView(renderTargetView, bgColor);	
 	d3d11DevCon->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH|D3D11_CLEAR_STENCIL, 1.0f, 0);
 
+	constantRing.BeginFrame(d3d11DevCon);
+
 	constbuffPerFrame.light = light;
+	//The sky only needs the camera's rotation: drop the view's translation before inverting
+	XMMATRIX skyView = camView;
+	skyView.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMVECTOR determinant;
+	constbuffPerFrame.skyInvViewProj = XMMatrixTranspose(XMMatrixInverse(&determinant, skyView * camProjection));
 	d3d11DevCon->UpdateSubresource( cbPerFrameBuffer, 0, NULL, &constbuffPerFrame, 0, 0 );
 	d3d11DevCon->PSSetConstantBuffers(0, 1, &cbPerFrameBuffer);	
+	d3d11DevCon->VSSetConstantBuffers(0, 1, &cbPerFrameBuffer);
+
+	CaptureEnvironment();
 
 	//Set our Render Target
 	d3d11DevCon->OMSetRenderTargets( 1, &renderTargetView, depthStencilView );
@@ -1246,14 +1537,18 @@ void DrawScene()
 	d3d11DevCon->IASetVertexBuffers( 0, 1, &squareVertBuffer, &stride, &offset );
 
 	//Set the WVP matrix and send it to the constant buffer in effect file
-	WVP = groundWorld * camView * camProjection;
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	cbPerObj.World = XMMatrixTranspose(groundWorld);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
+	cbPerObj.WVP = LoadTransformMatrix(transforms.WVP(groundTransform));
+	cbPerObj.World = LoadTransformMatrix(transforms.World(groundTransform));
+	//REFLECT_PS and CAPTURE_REFLECT_PS reflect the view ray from the eye
+	XMStoreFloat3(&cbPerObj.camPos, camPosition);
+	cbPerObj.roughness = 0.0f;
+	ID3D11Buffer* objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+	d3d11DevCon->VSSetConstantBuffers( 1, 1, &objectBuffer );
+	d3d11DevCon->PSSetConstantBuffers( 1, 1, &objectBuffer );
 	//d3d11DevCon->PSSetShaderResources( 0, 1, &CubesTexture );
 	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
-    d3d11DevCon->PSSetShaderResources(0, 1, &smrv);
+    ID3D11ShaderResourceView* skyViews[2] = { smrv, skyOctahedralSRV };
+    d3d11DevCon->PSSetShaderResources(0, 2, skyViews);
 
     d3d11DevCon->VSSetShader(REFLECT_VS, 0, 0);
     d3d11DevCon->PSSetShader(REFLECT_PS, 0, 0);
@@ -1262,41 +1557,36 @@ void DrawScene()
 
 	///////////////**************new**************////////////////////
 	//Set the spheres index buffer
-	d3d11DevCon->IASetIndexBuffer( sphereIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	d3d11DevCon->IASetIndexBuffer( sphereIndexBuffer, sphereIndexFormat, 0);
 	//Set the spheres vertex buffer
 	d3d11DevCon->IASetVertexBuffers( 0, 1, &sphereVertBuffer, &stride, &offset );
 
-	//Set the WVP matrix and send it to the constant buffer in effect file
-	WVP = sphereWorld * camView * camProjection;
-	cbPerObj.WVP = XMMatrixTranspose(WVP);	
-	cbPerObj.World = XMMatrixTranspose(sphereWorld);	
-	d3d11DevCon->UpdateSubresource( cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0 );
-	d3d11DevCon->VSSetConstantBuffers( 0, 1, &cbPerObjectBuffer );
-	//Send our skymap resource view to pixel shader
-	d3d11DevCon->PSSetShaderResources( 0, 1, &smrv );
-	d3d11DevCon->PSSetSamplers( 0, 1, &CubesTexSamplerState );
+	if(!skyTriangle)
+		DrawSky();
 
-	////Set the new VS and PS shaders
-    d3d11DevCon->VSSetShader(SKYMAP_VS, 0, 0);
-    d3d11DevCon->PSSetShader(SKYMAP_PS, 0, 0);
-	//Set the new depth/stencil and RS states
-	d3d11DevCon->OMSetDepthStencilState(DSLessEqual, 0);
-	d3d11DevCon->RSSetState(RSCullNone);
-	d3d11DevCon->DrawIndexed( NumSphereFaces * 3, 0, 0 );
-
-    WVP = sphereWorld2 * camView * camProjection;
-    cbPerObj.WVP = XMMatrixTranspose(WVP);
-    cbPerObj.World = XMMatrixTranspose(sphereWorld2);
-    d3d11DevCon->UpdateSubresource(cbPerObjectBuffer, 0, NULL, &cbPerObj, 0, 0);
-    d3d11DevCon->VSSetConstantBuffers(0, 1, &cbPerObjectBuffer);
-    d3d11DevCon->PSSetConstantBuffers(0, 1, &cbPerObjectBuffer);
+    cbPerObj.WVP = LoadTransformMatrix(transforms.WVP(sphereTransform));
+    cbPerObj.World = LoadTransformMatrix(transforms.World(sphereTransform));
+    cbPerObj.roughness = reflectRoughness;
+    objectBuffer = constantRing.Upload(d3d11DevCon, &cbPerObj, sizeof(cbPerObj));
+    d3d11DevCon->VSSetConstantBuffers(1, 1, &objectBuffer);
+    d3d11DevCon->PSSetConstantBuffers(1, 1, &objectBuffer);
     d3d11DevCon->VSSetShader(REFLECT_VS, 0, 0);
     d3d11DevCon->PSSetShader(REFLECT_PS, 0, 0);
   //  d3d11DevCon->OMSetDepthStencilState(NULL, 0); 
     d3d11DevCon->RSSetState(CCWcullMode);
+	if (captureSchedule.FacesPerFrame() > 0 && envCapture.View())
+	{
+		ID3D11ShaderResourceView* captureView = envCapture.View();
+		d3d11DevCon->PSSetShaderResources(2, 1, &captureView);
+		d3d11DevCon->PSSetShader(CAPTURE_REFLECT_PS, 0, 0);
+	}
 
     d3d11DevCon->DrawIndexed(NumSphereFaces * 3, 0, 0);
 
+	//Last of the opaque geometry, so only uncovered pixels run SKYMAP_PS
+	if(skyTriangle)
+		DrawSky();
+
 	//Set the default VS shader and depth/stencil state
     d3d11DevCon->VSSetShader(VS, 0, 0);
     d3d11DevCon->PSSetShader(PS, 0, 0);
@@ -1307,7 +1597,10 @@ void DrawScene()
 	RenderText(L"FPS: ", fps);
 
 	//Present the backbuffer to the screen
-	SwapChain->Present(0, 0);
+	{
+		PROFILE_SCOPE("Present");
+		SwapChain->Present(0, 0);
+	}
 }
 
 int messageloop(){
@@ -1332,18 +1625,49 @@ int messageloop(){
 		}
 		else{
 			// run game code    
+			PROFILE_SCOPE("Frame");
 			frameCount++;
 			if(GetTime() > 1.0f)
 			{
 				fps = frameCount;
 				frameCount = 0;
 				StartTimer();
+
+				const ConstantRingStats& cbStats = constantRing.LastFrameStats();
+				std::wostringstream cbString;
+				cbString << L"ConstantRing: " << cbStats.allocations << L" blocks, " << cbStats.bytesUploaded << L" bytes uploaded ("
+					<< cbStats.bytesReserved << L" reserved) per frame\n";
+				OutputDebugString(cbString.str().c_str());
+
+				std::wostringstream streamString;
+				streamString << L"TextureStreamer: " << (textureStreamer.CommittedBytes() >> 10) << L" KB of "
+					<< (textureStreamer.Budget() >> 10) << L" KB budget\n";
+				for (int i = 0; i < textureStreamer.Count(); ++i)
+				{
+					TextureStreamStats stats;
+					textureStreamer.Stats(i, &stats);
+					streamString << L"  " << textureStreamer.Name(i) << L": mips " << stats.residentMip << L".." << stats.mipLevels - 1
+						<< L" resident, wants " << stats.wantedMip << L", " << (stats.residentBytes >> 10) << L" of "
+						<< (stats.fullBytes >> 10) << L" KB\n";
+				}
+				OutputDebugString(streamString.str().c_str());
+
+				std::wostringstream skyString;
+				skyString << L"Sky (" << (skyTriangle ? L"triangle" : L"sphere") << L"): " << skyStats.VSInvocations << L" vertices, "
+					<< skyStats.CPrimitives << L" triangles rasterized, " << skyStats.PSInvocations << L" pixels shaded\n";
+				OutputDebugString(skyString.str().c_str());
+
+				std::wostringstream captureString;
+				captureString << L"EnvCapture (" << captureSchedule.FacesPerFrame() << L" faces a frame): " << captureFaces << L" faces, "
+					<< captureDraws << L" draws, against " << ENV_CAPTURE_FACES * 2 << L" for all six faces\n";
+				OutputDebugString(captureString.str().c_str());
 			}	
 
 			frameTime = GetFrameTime();
 
 			DetectInput(frameTime);
 			UpdateScene(frameTime);
+			StreamTextures();
 			DrawScene();
 		}
 	}
@@ -0,0 +1,125 @@
+//--------------------------------------------------------------------------------------
+// File: cone_baker.cpp
+//
+// Offline baker for the relaxed cone step map read by NORMALMAP_CONE_PS in
+// Tutorial05_Parallax. Takes the height from the alpha of a normal map PNG and writes
+// an R8G8_UNORM DDS with a full mip chain: height in r, sqrt(cone ratio) in g. See
+// Common/cone_step_map.h for the definition of the cones.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread cone_baker.cpp -o cone_baker
+//   cl /O2 /EHsc /DXM_PORTABLE cone_baker.cpp
+//
+// Usage: cone_baker [-threads N] [input.png] [output.dds]
+// Defaults to ../Tutorial05_Parallax/four_NM_height.png and four_NM_cone.dds next to
+// it; -threads 0 (the default) uses every hardware thread.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../Common/xnamath_portable.h"
+#include "../Common/png_reader.h"
+#include "../Common/dds_writer.h"
+#include "../Common/profiler.h"
+#include "../Common/cone_step_map.h"
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	std::string input = "../Tutorial05_Parallax/four_NM_height.png";
+	std::string output = "../Tutorial05_Parallax/four_NM_cone.dds";
+	int threads = 0, files = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && files == 0)
+			input = argv[i], files++;
+		else if (argv[i][0] != '-' && files == 1)
+			output = argv[i], files++;
+		else
+		{
+			fprintf(stderr, "usage: cone_baker [-threads N] [input.png] [output.dds]\n");
+			return 1;
+		}
+	}
+
+	std::vector<unsigned char> data;
+	PNGImage image;
+	if (!ReadFile(input, &data) || !DecodePNG(&data[0], data.size(), &image))
+	{
+		fprintf(stderr, "can't read %s\n", input.c_str());
+		return 1;
+	}
+	std::vector<float> heights((size_t)image.width * image.height);
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights[i] = image.rgba[i * 4 + 3] / 255.0f;
+
+	SoftThreadPool pool(threads);
+	std::vector<float> cones(heights.size());
+	long long start = Profiler::Now();
+	ConeStepBaker baker(&heights[0], image.width, image.height);
+	baker.Bake(&pool, &cones[0]);
+	double seconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+
+	double sum = 0.0;
+	float narrowest = 1.0f;
+	for (size_t i = 0; i < cones.size(); ++i)
+	{
+		sum += cones[i];
+		narrowest = std::min(narrowest, cones[i]);
+	}
+	printf("%s: %dx%d baked in %.2f s on %d threads, cone ratio avg %.3f min %.4f\n", input.c_str(),
+		image.width, image.height, seconds, pool.ThreadCount(), sum / cones.size(), narrowest);
+
+	std::vector<ConeStepLevel> levels;
+	EncodeConeStepMap(&heights[0], &cones[0], image.width, image.height, &levels);
+
+	DDSImage dds;
+	dds.format = DDS_FORMAT_R8G8_UNORM;
+	dds.dimension = DDS_DIMENSION_TEXTURE2D;
+	dds.width = image.width;
+	dds.height = image.height;
+	dds.depth = 1;
+	dds.mipLevels = (unsigned int)levels.size();
+	dds.arraySize = 1;
+	dds.isCube = false;
+	dds.forceOpaqueAlpha = false;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		DDSSubresource sub;
+		sub.data = &levels[i].texels[0];
+		sub.rowPitch = levels[i].width * 2;
+		sub.slicePitch = sub.rowPitch * levels[i].height;
+		sub.width = levels[i].width;
+		sub.height = levels[i].height;
+		sub.depth = 1;
+		dds.subresources.push_back(sub);
+	}
+	if (!WriteDDS(output.c_str(), dds))
+	{
+		fprintf(stderr, "can't write %s\n", output.c_str());
+		return 1;
+	}
+	printf("wrote %s, %u mips\n", output.c_str(), dds.mipLevels);
+	return 0;
+}
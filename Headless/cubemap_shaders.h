@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// File: cubemap_shaders.h
+//
+// C++ versions of the entry points in Tutorial05_CubeMap/Tutorial05.fx for the software
+// rasterizer. As in sky_mapping_shaders.h the matrices are the untransposed ones.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "../Common/xnamath_portable.h"
+#include "../Common/soft_rasterizer.h"
+#include "shader_math.h"
+
+namespace CubeMapFx
+{
+
+// Same layout as the sample's SimpleVertex and its POSITION/NORMAL input layout
+struct SimpleVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+};
+
+// ConstantBuffer plus the bound cube map
+struct Constants
+{
+	XMMATRIX WVP;
+	XMMATRIX World;
+	XMFLOAT3 cameraPos;
+	const SoftMipCube* SkyMap;
+};
+
+// SKYMAP_VS_OUTPUT: texCoord in varyings 0-2
+inline void SKYMAP_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const SimpleVertex& v = *(const SimpleVertex*)vertex;
+	XMVECTOR pos = XMVector3Transform(XMLoadFloat3(&v.Pos), cb.WVP);
+	StorePosition(XMVectorSet(XMVectorGetX(pos), XMVectorGetY(pos), XMVectorGetW(pos), XMVectorGetW(pos)), output);
+	output->varyings[0] = v.Pos.x;
+	output->varyings[1] = v.Pos.y;
+	output->varyings[2] = v.Pos.z;
+}
+
+inline void SKYMAP_PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	SampleCube(cb.SkyMap, input.varyings, color);
+}
+
+// REFLECT_VS_OUTPUT: PosW in varyings 0-2, normal in 3-5
+inline void REFLECT_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const SimpleVertex& v = *(const SimpleVertex*)vertex;
+	XMVECTOR pos = XMLoadFloat3(&v.Pos);
+	StorePosition(XMVector3Transform(pos, cb.WVP), output);
+	StoreVaryings3(XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.Normal), cb.World)), output, 3);
+	StoreVaryings3(XMVector3Transform(pos, cb.World), output, 0);
+}
+
+inline void REFLECT_PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	float incident[3] = { input.varyings[0] - cb.cameraPos.x, input.varyings[1] - cb.cameraPos.y, input.varyings[2] - cb.cameraPos.z };
+	Normalize3(incident, incident);
+
+	// The interpolated normal is used as is, the HLSL doesn't renormalize it either
+	float reflected[3];
+	Reflect3(incident, &input.varyings[3], reflected);
+	SampleCube(cb.SkyMap, reflected, color);
+}
+
+}
@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------------
+// File: dds_check.cpp
+//
+// Parses every .dds file the repository ships with Common/dds_reader.h's ParseDDS and
+// checks what it returns against what the file is known to hold: format, size, mip
+// count and, for every subresource, its extent, row and slice pitch and position in the
+// file. The pitches are recomputed here from the format's block size rather than with
+// DDSSurfaceInfo, and the subresources must tile the data after the header exactly, so
+// a layout bug in the reader shows up as a mismatch instead of a texture that looks
+// almost right.
+//
+// Files given on the command line are checked for layout only, their format and mip
+// count are printed.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 dds_check.cpp -o dds_check
+//   cl /O2 /EHsc dds_check.cpp
+//
+// Usage: dds_check [files.dds...]
+// Without files it checks the committed textures (run from the Headless directory).
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../Common/dds_reader.h"
+
+struct DDSExpectation
+{
+	const char* fileName;
+	unsigned int format;		// DDS_FORMAT_UNKNOWN: layout check only
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipLevels;
+	bool forceOpaqueAlpha;
+};
+
+// What texture_cooker wrote (or the original sample shipped) for each committed texture
+static const DDSExpectation g_CommittedTextures[] =
+{
+	{ "../D3D11Lighting/D3D11Lighting/braynzar.dds", DDS_FORMAT_BC1_UNORM, 256, 256, 9, false },
+	{ "../D3D11_HRTimer/D3D11_HRTimer/braynzar.dds", DDS_FORMAT_BC1_UNORM, 256, 256, 9, false },
+	{ "../D3D11_sky_mapping/D3D11_sky_mapping/grass.dds", DDS_FORMAT_BC1_UNORM, 512, 512, 10, false },
+	{ "../Tutorial05_Parallax/four_NM_cone.dds", DDS_FORMAT_R8G8_UNORM, 256, 256, 9, false },
+	{ "../Tutorial05_Parallax/seafloor.dds", DDS_FORMAT_R8G8B8A8_UNORM, 256, 256, 1, true },
+};
+
+const char* FormatName(unsigned int format)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_R8G8B8A8_UNORM: return "R8G8B8A8_UNORM";
+	case DDS_FORMAT_B8G8R8A8_UNORM: return "B8G8R8A8_UNORM";
+	case DDS_FORMAT_B8G8R8X8_UNORM: return "B8G8R8X8_UNORM";
+	case DDS_FORMAT_R8G8_UNORM: return "R8G8_UNORM";
+	case DDS_FORMAT_R8_UNORM: return "R8_UNORM";
+	case DDS_FORMAT_R16G16B16A16_FLOAT: return "R16G16B16A16_FLOAT";
+	case DDS_FORMAT_R32G32B32A32_FLOAT: return "R32G32B32A32_FLOAT";
+	case DDS_FORMAT_BC1_UNORM: return "BC1_UNORM";
+	case DDS_FORMAT_BC3_UNORM: return "BC3_UNORM";
+	case DDS_FORMAT_BC4_UNORM: return "BC4_UNORM";
+	case DDS_FORMAT_BC5_UNORM: return "BC5_UNORM";
+	case DDS_FORMAT_BC7_UNORM: return "BC7_UNORM";
+	}
+	return "?";
+}
+
+// Bytes per 4x4 block (blockSize 4) or per pixel (blockSize 1), independent of dds_reader.h
+bool FormatSize(unsigned int format, unsigned int* bytes, unsigned int* blockSize)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_BC1_UNORM:
+	case DDS_FORMAT_BC4_UNORM:
+		*bytes = 8, *blockSize = 4;
+		return true;
+	case DDS_FORMAT_BC3_UNORM:
+	case DDS_FORMAT_BC5_UNORM:
+	case DDS_FORMAT_BC7_UNORM:
+		*bytes = 16, *blockSize = 4;
+		return true;
+	case DDS_FORMAT_R32G32B32A32_FLOAT:
+		*bytes = 16, *blockSize = 1;
+		return true;
+	case DDS_FORMAT_R16G16B16A16_FLOAT:
+		*bytes = 8, *blockSize = 1;
+		return true;
+	case DDS_FORMAT_R8G8B8A8_UNORM:
+	case DDS_FORMAT_B8G8R8A8_UNORM:
+	case DDS_FORMAT_B8G8R8X8_UNORM:
+		*bytes = 4, *blockSize = 1;
+		return true;
+	case DDS_FORMAT_R8G8_UNORM:
+		*bytes = 2, *blockSize = 1;
+		return true;
+	case DDS_FORMAT_R8_UNORM:
+		*bytes = 1, *blockSize = 1;
+		return true;
+	}
+	return false;
+}
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+//--------------------------------------------------------------------------------------
+// Check one file, printing the first problem found. Returns true when it is correct.
+//--------------------------------------------------------------------------------------
+bool CheckDDS(const DDSExpectation& expected)
+{
+	const char* name = strrchr(expected.fileName, '/') ? strrchr(expected.fileName, '/') + 1 : expected.fileName;
+	std::vector<unsigned char> data;
+	if (!ReadFile(expected.fileName, &data))
+	{
+		printf("%-20s FAIL: cannot be read (%s)\n", name, expected.fileName);
+		return false;
+	}
+	DDSImage image;
+	if (!ParseDDS(&data[0], data.size(), &image))
+	{
+		printf("%-20s FAIL: ParseDDS rejected it\n", name);
+		return false;
+	}
+
+	printf("%-20s %-18s %5ux%-5u %4u mips %8u bytes ", name, FormatName(image.format), image.width, image.height,
+		image.mipLevels, (unsigned int)data.size());
+	if (expected.format != DDS_FORMAT_UNKNOWN &&
+		(image.format != expected.format || image.width != expected.width || image.height != expected.height ||
+		image.mipLevels != expected.mipLevels || image.forceOpaqueAlpha != expected.forceOpaqueAlpha))
+	{
+		printf("FAIL: expected %s %ux%u, %u mips%s\n", FormatName(expected.format), expected.width, expected.height,
+			expected.mipLevels, expected.forceOpaqueAlpha ? ", opaque alpha" : "");
+		return false;
+	}
+
+	unsigned int bytes, blockSize;
+	if (!FormatSize(image.format, &bytes, &blockSize))
+	{
+		printf("FAIL: no block size for format %u\n", image.format);
+		return false;
+	}
+	unsigned int slices = image.arraySize * (image.isCube ? 6 : 1);
+	if (image.subresources.size() != slices * image.mipLevels)
+	{
+		printf("FAIL: %u subresources, expected %u\n", (unsigned int)image.subresources.size(), slices * image.mipLevels);
+		return false;
+	}
+
+	// The pixel data starts right after the header (and its DX10 extension) and the
+	// subresources follow each other without gaps up to the end of the file
+	size_t offset = data.size();
+	if (!image.subresources.empty())
+		offset = image.subresources[0].data - &data[0];
+	if (offset != 4 + sizeof(DDSHeader) && offset != 4 + sizeof(DDSHeader) + sizeof(DDSHeaderDX10))
+	{
+		printf("FAIL: pixel data at offset %u\n", (unsigned int)offset);
+		return false;
+	}
+	for (unsigned int slice = 0; slice < slices; ++slice)
+	{
+		for (unsigned int mip = 0; mip < image.mipLevels; ++mip)
+		{
+			const DDSSubresource& subresource = image.subresources[slice * image.mipLevels + mip];
+			unsigned int width = std::max(image.width >> mip, 1u);
+			unsigned int height = std::max(image.height >> mip, 1u);
+			unsigned int depth = std::max(image.depth >> mip, 1u);
+			unsigned int rowPitch = (width + blockSize - 1) / blockSize * bytes;
+			unsigned int slicePitch = rowPitch * ((height + blockSize - 1) / blockSize);
+			if (subresource.width != width || subresource.height != height || subresource.depth != depth ||
+				subresource.rowPitch != rowPitch || subresource.slicePitch != slicePitch ||
+				subresource.data != &data[0] + offset)
+			{
+				printf("FAIL: slice %u mip %u is %ux%ux%u, pitch %u/%u at %u, expected %ux%ux%u, pitch %u/%u at %u\n", slice, mip,
+					subresource.width, subresource.height, subresource.depth, subresource.rowPitch, subresource.slicePitch,
+					(unsigned int)(subresource.data - &data[0]), width, height, depth, rowPitch, slicePitch, (unsigned int)offset);
+				return false;
+			}
+			offset += (size_t)slicePitch * depth;
+		}
+	}
+	if (offset != data.size())
+	{
+		printf("FAIL: %u bytes after the last mip\n", (unsigned int)(data.size() - offset));
+		return false;
+	}
+	printf("ok\n");
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<DDSExpectation> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: dds_check [files.dds...]\n");
+			return 1;
+		}
+		DDSExpectation file = { argv[i], DDS_FORMAT_UNKNOWN, 0, 0, 0, false };
+		files.push_back(file);
+	}
+	if (files.empty())
+		files.assign(g_CommittedTextures, g_CommittedTextures + sizeof(g_CommittedTextures) / sizeof(g_CommittedTextures[0]));
+
+	int failed = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+		failed += CheckDDS(files[i]) ? 0 : 1;
+	printf("\n%d of %d files ok\n", (int)files.size() - failed, (int)files.size());
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+//--------------------------------------------------------------------------------------
+// File: decode_bench.cpp
+//
+// Startup benchmark for the image decode stage in Common/image_decoder.h: decodes the
+// samples' JPEG and PNG textures once serially on the main thread, the way the D3DX
+// loaders did, and then through ImageDecodeQueue with 1, 2, ... worker threads, and
+// prints the wall-clock time of each. Times cover reading the files, decoding, and
+// handing every image back in completion order; the upload itself needs a device and
+// is left out. "first" is how long the main thread waits before it can upload the
+// first texture.
+//
+// The pixel pool is warmed by an untimed pass, like a level load after the first one;
+// "allocs" counts the buffers the timed passes still had to allocate.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread decode_bench.cpp -o decode_bench
+//   cl /O2 /EHsc /DXM_PORTABLE decode_bench.cpp
+//
+// Usage: decode_bench [-threads N] [-passes N] [-copies N] [image...]
+// Without images it decodes the samples' textures (run from the Headless directory).
+// -threads is the largest worker count tried, every hardware thread by default;
+// -copies queues each image that many times to stand in for a bigger scene.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../Common/image_decoder.h"
+#include "../Common/profiler.h"
+
+static const char* g_DefaultImages[] =
+{
+	"../D3D11_sky_mapping/D3D11_sky_mapping/grass.jpg",
+	"../D3D11Lighting/D3D11Lighting/braynzar.jpg",
+	"../Tutorial05_Parallax/four_NM_height.png",
+	"../Tutorial05_NormalMap/grassNormal.png",
+	"../Tutorial05_NormalMap/grass.jpg",
+	"../Tutorial05_Parallax/Tutorial05.jpg",
+};
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+// Serial decode into fresh buffers, as a loader without the decode stage does
+bool DecodeSerial(const std::vector<std::string>& images, size_t* pixelBytes)
+{
+	*pixelBytes = 0;
+	for (size_t i = 0; i < images.size(); ++i)
+	{
+		std::vector<unsigned char> data;
+		if (!ReadFile(images[i], &data) || data.size() < 4)
+			return false;
+		if (data[0] == 0xff && data[1] == 0xd8)
+		{
+			JPEGImage jpeg;
+			if (!DecodeJPEG(&data[0], data.size(), &jpeg))
+				return false;
+			*pixelBytes += jpeg.rgba.size();
+		}
+		else
+		{
+			PNGImage png;
+			if (!DecodePNG(&data[0], data.size(), &png))
+				return false;
+			*pixelBytes += png.rgba.size();
+		}
+	}
+	return true;
+}
+
+// Seconds until all images and until the first one came back
+bool DecodeQueued(ImageDecodeQueue* queue, const std::vector<std::string>& images, int threads,
+	double* seconds, double* firstSeconds)
+{
+	long long start = Profiler::Now(), first = 0;
+	for (size_t i = 0; i < images.size(); ++i)
+		queue->Add(images[i].c_str(), (int)i);
+	queue->Start(threads);
+
+	bool ok = true;
+	DecodedImage image;
+	while (queue->Next(&image))
+	{
+		if (first == 0)
+			first = Profiler::Now();
+		ok = ok && image.ok;
+		queue->Recycle(&image);
+	}
+	*seconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+	*firstSeconds = (double)(first - start) / Profiler::TicksPerSecond();
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int maxThreads = 0, passes = 5, copies = 1;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			maxThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-passes") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			passes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-copies") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			copies = atoi(argv[++i]);
+		else if (argv[i][0] != '-')
+			inputs.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "usage: decode_bench [-threads N] [-passes N] [-copies N] [image...]\n");
+			return 1;
+		}
+	}
+	if (inputs.empty())
+		inputs.assign(g_DefaultImages, g_DefaultImages + sizeof(g_DefaultImages) / sizeof(g_DefaultImages[0]));
+	if (maxThreads <= 0)
+		maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// Missing files would only time fopen failures
+	std::vector<std::string> images;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		std::vector<unsigned char> data;
+		unsigned int width, height;
+		if (!ReadFile(inputs[i], &data) || !ImageDimensions(&data[0], data.size(), &width, &height))
+		{
+			printf("%s: missing or not a PNG/JPEG, skipped\n", inputs[i].c_str());
+			continue;
+		}
+		printf("%s: %ux%u, %u KB\n", inputs[i].c_str(), width, height, (unsigned int)(data.size() / 1024));
+		for (int c = 0; c < copies; ++c)
+			images.push_back(inputs[i]);
+	}
+	if (images.empty())
+		return 1;
+
+	double serial = 1e30;
+	size_t pixelBytes = 0;
+	for (int p = 0; p < passes; ++p)
+	{
+		long long start = Profiler::Now();
+		if (!DecodeSerial(images, &pixelBytes))
+		{
+			fprintf(stderr, "decode failed\n");
+			return 1;
+		}
+		serial = std::min(serial, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+	}
+	printf("\n%d images, %.1f MB of pixels, best of %d passes\n", (int)images.size(), pixelBytes / 1048576.0, passes);
+	printf("serial     %8.2f ms\n", serial * 1000.0);
+
+	for (int threads = 1; threads <= maxThreads; ++threads)
+	{
+		ImageDecodeQueue queue;
+		double seconds, firstSeconds, best = 1e30, bestFirst = 1e30;
+		DecodeQueued(&queue, images, threads, &seconds, &firstSeconds);
+		unsigned int warmAllocations = queue.Pool().Allocations();
+		for (int p = 0; p < passes; ++p)
+		{
+			if (!DecodeQueued(&queue, images, threads, &seconds, &firstSeconds))
+			{
+				fprintf(stderr, "decode failed\n");
+				return 1;
+			}
+			best = std::min(best, seconds);
+			bestFirst = std::min(bestFirst, firstSeconds);
+		}
+		printf("%2d workers %8.2f ms  %5.2fx  first %6.2f ms  allocs %u\n", threads, best * 1000.0, serial / best,
+			bestFirst * 1000.0, queue.Pool().Allocations() - warmAllocations);
+		if (threads >= (int)images.size())
+			break;
+	}
+	return 0;
+}
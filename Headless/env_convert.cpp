@@ -0,0 +1,661 @@
+//--------------------------------------------------------------------------------------
+// File: env_convert.cpp
+//
+// Converts environment maps between the equirectangular, cube and octahedral layouts
+// of Common/env_map.h, e.g. an HDR panorama into the skymap.dds D3D11_sky_mapping
+// loads, or a cube map into the octahedral skymap_oct.dds it can use instead.
+//
+// The output is resampled in 64x64 texel tiles on a SoftThreadPool, each texel
+// averaging a grid of samples as fine as the source's texels so downsizing does not
+// alias. Tiles are written into the DDS as they finish, and a Radiance .hdr panorama is
+// streamed, with only the band of rows the current batch of tiles reads decoded
+// (-memory). Tiles run in the order of the rows they need, so every row is decoded
+// about once. PNG, JPEG and DDS inputs are decoded whole; their size is checked from
+// the header first, and an input whose decode would take more than -memory is refused
+// rather than allowed to run past it.
+//
+// Colours are resampled in linear space: .hdr and float DDS inputs are linear, 8 bit
+// inputs are decoded from sRGB. R8G8B8A8 output is sRGB encoded after -exposure, like
+// the samples' other textures; R16G16B16A16_FLOAT output keeps the linear values.
+// Only the top level is written; Headless/ibl_baker makes the mips of a cube.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread env_convert.cpp -o env_convert
+//   cl /O2 /EHsc /DXM_PORTABLE env_convert.cpp
+//
+// Usage: env_convert [-threads N] [-size N] [-format rgba8|rgba16f] [-exposure E]
+//                    [-memory MB] [-from equirect|octahedral] input output cube|octahedral|equirect
+// Inputs are .hdr, .png and .jpg panoramas, cube map DDS files, and 2D DDS files in
+// the -from layout (by default equirect when twice as wide as high, else octahedral).
+// -size is the face size of a cube, the side of an octahedral map (border included)
+// or the width of a panorama.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../Common/env_map.h"
+#include "../Common/dds_writer.h"
+#include "../Common/png_reader.h"
+#include "../Common/jpeg_reader.h"
+#include "../Common/mip_generator.h"
+#include "../Common/profiler.h"
+
+#define ENV_TILE_SIZE			64
+#define ENV_MAX_SUBSAMPLES		8		// per axis
+#define ENV_TILES_PER_BATCH		256
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+bool HasExtension(const std::string& fileName, const char* extension)
+{
+	size_t length = strlen(extension);
+	if (fileName.size() < length)
+		return false;
+	for (size_t i = 0; i < length; ++i)
+		if (tolower(fileName[fileName.size() - length + i]) != extension[i])
+			return false;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Sources
+//--------------------------------------------------------------------------------------
+class EnvSource
+{
+public:
+	virtual ~EnvSource() {}
+	virtual EnvLayout Layout() const = 0;
+	virtual int Width() const = 0;
+	virtual int Height() const = 0;
+	// Linear RGBA along dir, bilinear
+	virtual void Sample(const float dir[3], float color[4]) const = 0;
+
+	// A streamed panorama only holds the rows last loaded
+	virtual bool Streamed() const { return false; }
+	virtual bool LoadRows(int, int) { return true; }
+	virtual int LoadedRows() const { return Height(); }
+};
+
+// Equirectangular, resident or streamed from a Radiance file
+class EquirectSource : public EnvSource
+{
+public:
+	EquirectSource() : m_Reader(NULL), m_Width(0), m_Height(0), m_First(0), m_Last(-1) {}
+	~EquirectSource() { delete m_Reader; }
+
+	bool OpenRadiance(const char* fileName)
+	{
+		m_Reader = new RadianceReader;
+		if (!m_Reader->Open(fileName))
+			return false;
+		m_Width = m_Reader->Width();
+		m_Height = m_Reader->Height();
+		return true;
+	}
+
+	void SetImage(int width, int height, std::vector<float>& rgba)
+	{
+		m_Width = width;
+		m_Height = height;
+		m_Rows.swap(rgba);
+		m_First = 0;
+		m_Last = height - 1;
+	}
+
+	EnvLayout Layout() const { return ENV_LAYOUT_EQUIRECT; }
+	int Width() const { return m_Width; }
+	int Height() const { return m_Height; }
+	bool Streamed() const { return m_Reader != NULL; }
+	int LoadedRows() const { return m_Last - m_First + 1; }
+
+	// Keeps the rows already loaded that are still needed and decodes the others
+	bool LoadRows(int first, int last)
+	{
+		if (m_Reader == NULL)
+			return true;
+		first = std::max(first, 0);
+		last = std::min(last, m_Height - 1);
+		size_t rowFloats = (size_t)m_Width * 4;
+		std::vector<float> rows((size_t)(last - first + 1) * rowFloats);
+		for (int row = first; row <= last; ++row)
+		{
+			float* out = &rows[(size_t)(row - first) * rowFloats];
+			if (row >= m_First && row <= m_Last)
+				memcpy(out, &m_Rows[(size_t)(row - m_First) * rowFloats], rowFloats * sizeof(float));
+			else if (!m_Reader->ReadRow(row, out))
+				return false;
+		}
+		m_Rows.swap(rows);
+		m_First = first;
+		m_Last = last;
+		return true;
+	}
+
+	void Sample(const float dir[3], float color[4]) const
+	{
+		float u, v;
+		EquirectUV(dir, &u, &v);
+		float x = u * m_Width - 0.5f, y = v * m_Height - 0.5f;
+		float fx = floorf(x), fy = floorf(y);
+		float ax = x - fx, ay = y - fy;
+		int x0 = (((int)fx % m_Width) + m_Width) % m_Width, x1 = (x0 + 1) % m_Width;
+		int y0 = std::min(std::max((int)fy, m_First), m_Last), y1 = std::min(std::max((int)fy + 1, m_First), m_Last);
+		const float* row0 = &m_Rows[(size_t)(y0 - m_First) * m_Width * 4];
+		const float* row1 = &m_Rows[(size_t)(y1 - m_First) * m_Width * 4];
+		for (int c = 0; c < 4; ++c)
+		{
+			float top = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * ax;
+			float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * ax;
+			color[c] = top + (bottom - top) * ay;
+		}
+	}
+
+private:
+	RadianceReader* m_Reader;
+	int m_Width;
+	int m_Height;
+	std::vector<float> m_Rows;		// m_First to m_Last
+	int m_First;
+	int m_Last;
+};
+
+class CubeSource : public EnvSource
+{
+public:
+	void SetFaces(int size, const std::vector<float> faces[6])
+	{
+		const float* data[6];
+		for (int face = 0; face < 6; ++face)
+			data[face] = &faces[face][0];
+		m_Cube.Create(size, data, false);
+	}
+
+	EnvLayout Layout() const { return ENV_LAYOUT_CUBE; }
+	int Width() const { return m_Cube.Size(); }
+	int Height() const { return m_Cube.Size(); }
+	void Sample(const float dir[3], float color[4]) const { m_Cube.SampleLevel(SoftLinearWrapSamplerDesc(), dir, 0.0f, color); }
+
+private:
+	SoftMipCube m_Cube;
+};
+
+class OctahedralSource : public EnvSource
+{
+public:
+	void SetImage(int size, const std::vector<float>& rgba) { m_Texture.Create(size, size, &rgba[0], false); }
+
+	EnvLayout Layout() const { return ENV_LAYOUT_OCTAHEDRAL; }
+	int Width() const { return m_Texture.Width(); }
+	int Height() const { return m_Texture.Width(); }
+
+	// The border texels make clamped bilinear taps seamless
+	void Sample(const float dir[3], float color[4]) const
+	{
+		SoftSamplerDesc sampler = { SOFT_FILTER_MIN_MAG_MIP_LINEAR, SOFT_ADDRESS_CLAMP, SOFT_ADDRESS_CLAMP, 0.0f };
+		float u, v;
+		OctahedralUV(dir, m_Texture.Width(), &u, &v);
+		m_Texture.SampleLevel(sampler, u, v, 0.0f, color);
+	}
+
+private:
+	SoftMipTexture m_Texture;
+};
+
+// Top level of an uncompressed RGBA DDS subresource as linear floats
+bool DecodeSubresource(const DDSImage& image, const DDSSubresource& sub, std::vector<float>* rgba)
+{
+	bool bgra = image.format == DDS_FORMAT_B8G8R8A8_UNORM || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	bool opaque = image.forceOpaqueAlpha || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	if (!bgra && image.format != DDS_FORMAT_R8G8B8A8_UNORM && image.format != DDS_FORMAT_R16G16B16A16_FLOAT &&
+		image.format != DDS_FORMAT_R32G32B32A32_FLOAT)
+		return false;
+
+	rgba->resize((size_t)sub.width * sub.height * 4);
+	float* out = &(*rgba)[0];
+	for (unsigned int y = 0; y < sub.height; ++y)
+	{
+		const unsigned char* row = sub.data + (size_t)y * sub.rowPitch;
+		for (unsigned int x = 0; x < sub.width; ++x, out += 4)
+		{
+			if (image.format == DDS_FORMAT_R32G32B32A32_FLOAT)
+				memcpy(out, row + x * 16, 16);
+			else if (image.format == DDS_FORMAT_R16G16B16A16_FLOAT)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					unsigned short half;
+					memcpy(&half, row + x * 8 + c * 2, 2);
+					out[c] = HalfToFloat(half);
+				}
+			}
+			else
+			{
+				const unsigned char* p = row + x * 4;
+				out[0] = MipSRGBToLinear(p[bgra ? 2 : 0] / 255.0f);
+				out[1] = MipSRGBToLinear(p[1] / 255.0f);
+				out[2] = MipSRGBToLinear(p[bgra ? 0 : 2] / 255.0f);
+				out[3] = opaque ? 1.0f : p[3] / 255.0f;
+			}
+		}
+	}
+	return true;
+}
+
+// Whole-image inputs: the file, plus bytesPerTexel for what the decode keeps resident
+// at its peak, must fit -memory
+bool FitsMemory(const std::string& fileName, size_t fileBytes, unsigned long long texels, int bytesPerTexel, size_t memoryBytes)
+{
+	unsigned long long bytes = fileBytes + texels * bytesPerTexel;
+	if (bytes <= memoryBytes)
+		return true;
+	fprintf(stderr, "%s is decoded whole and needs about %.0f MB, more than -memory %.0f MB; raise -memory, or convert it to a "
+		".hdr panorama, which is streamed\n", fileName.c_str(), bytes / (1024.0 * 1024.0), memoryBytes / (1024.0 * 1024.0));
+	return false;
+}
+
+EnvSource* OpenSource(const std::string& fileName, const std::string& from, size_t memoryBytes)
+{
+	if (HasExtension(fileName, ".hdr"))
+	{
+		EquirectSource* source = new EquirectSource;
+		if (source->OpenRadiance(fileName.c_str()))
+			return source;
+		delete source;
+		return NULL;
+	}
+
+	std::vector<unsigned char> data;
+	if (!ReadFile(fileName, &data))
+		return NULL;
+
+	// 8 bit panoramas
+	std::vector<unsigned char> rgba8;
+	unsigned int width = 0, height = 0;
+	if (HasExtension(fileName, ".png") || HasExtension(fileName, ".jpg") || HasExtension(fileName, ".jpeg"))
+	{
+		// 8 bit RGBA from the decoder and the linear float copy made from it
+		bool sized = HasExtension(fileName, ".png") ? ReadPNGSize(&data[0], data.size(), &width, &height) :
+			ReadJPEGSize(&data[0], data.size(), &width, &height);
+		if (!sized || !FitsMemory(fileName, data.size(), (unsigned long long)width * height, 4 + 16, memoryBytes))
+			return NULL;
+
+		PNGImage png;
+		JPEGImage jpeg;
+		if (HasExtension(fileName, ".png") && DecodePNG(&data[0], data.size(), &png))
+			width = png.width, height = png.height, rgba8.swap(png.rgba);
+		else if (!HasExtension(fileName, ".png") && DecodeJPEG(&data[0], data.size(), &jpeg))
+			width = jpeg.width, height = jpeg.height, rgba8.swap(jpeg.rgba);
+		else
+			return NULL;
+		std::vector<float> rgba(rgba8.size());
+		for (size_t i = 0; i < rgba8.size(); ++i)
+			rgba[i] = (i & 3) == 3 ? rgba8[i] / 255.0f : MipSRGBToLinear(rgba8[i] / 255.0f);
+		EquirectSource* source = new EquirectSource;
+		source->SetImage(width, height, rgba);
+		return source;
+	}
+
+	DDSImage image;
+	if (!ParseDDS(&data[0], data.size(), &image) || image.dimension != DDS_DIMENSION_TEXTURE2D)
+		return NULL;
+	// Linear floats of the top level, copied once more into the sampler's tiled
+	// storage for cube and octahedral maps
+	bool equirect = !image.isCube && (from.empty() ? image.width == 2 * image.height : from == "equirect");
+	if (!FitsMemory(fileName, data.size(), (unsigned long long)image.width * image.height * (image.isCube ? 6 : 1),
+		equirect ? 16 : 32, memoryBytes))
+		return NULL;
+	if (image.isCube)
+	{
+		if (image.width != image.height)
+			return NULL;
+		std::vector<float> faces[6];
+		for (int face = 0; face < 6; ++face)
+			if (!DecodeSubresource(image, image.subresources[face * image.mipLevels], &faces[face]))
+				return NULL;
+		CubeSource* source = new CubeSource;
+		source->SetFaces(image.width, faces);
+		return source;
+	}
+
+	std::vector<float> rgba;
+	if (!DecodeSubresource(image, image.subresources[0], &rgba))
+		return NULL;
+	if (!equirect)
+	{
+		if (image.width != image.height)
+			return NULL;
+		OctahedralSource* source = new OctahedralSource;
+		source->SetImage(image.width, rgba);
+		return source;
+	}
+	EquirectSource* source = new EquirectSource;
+	source->SetImage(image.width, image.height, rgba);
+	return source;
+}
+
+//--------------------------------------------------------------------------------------
+// Tiled resampling
+//--------------------------------------------------------------------------------------
+struct EnvOutput
+{
+	EnvLayout layout;
+	int width;			// of a face
+	int height;
+	int faces;
+	unsigned int format;
+	unsigned int texelBytes;
+	float exposure;
+};
+
+struct EnvTile
+{
+	int face;
+	int x0, y0, width, height;
+	int firstRow, lastRow;				// of a streamed source
+	std::vector<unsigned char> texels;	// in the output format, while the batch runs
+};
+
+struct ResampleJob
+{
+	const EnvSource* source;
+	const EnvOutput* output;
+	std::vector<EnvTile>* tiles;
+	const int* order;			// tiles of the batch
+	int subsamples;
+};
+
+void EncodeTexel(const EnvOutput& output, const float color[4], unsigned char* out)
+{
+	if (output.format == DDS_FORMAT_R16G16B16A16_FLOAT)
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			unsigned short half = FloatToHalf(c < 3 ? color[c] * output.exposure : color[c]);
+			memcpy(out + c * 2, &half, 2);
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; ++c)
+			out[c] = MipToUnorm8(MipLinearToSRGB(std::max(color[c] * output.exposure, 0.0f)));
+		out[3] = MipToUnorm8(color[3]);
+	}
+}
+
+void ResampleTile(void* context, int index)
+{
+	const ResampleJob* job = (const ResampleJob*)context;
+	const EnvOutput& output = *job->output;
+	EnvTile& tile = (*job->tiles)[job->order[index]];
+	int n = job->subsamples;
+	tile.texels.resize((size_t)tile.width * tile.height * output.texelBytes);
+	unsigned char* out = &tile.texels[0];
+	for (int y = tile.y0; y < tile.y0 + tile.height; ++y)
+	{
+		for (int x = tile.x0; x < tile.x0 + tile.width; ++x, out += output.texelBytes)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int j = 0; j < n; ++j)
+			{
+				for (int i = 0; i < n; ++i)
+				{
+					float dir[3], color[4];
+					EnvTexelDirection(output.layout, tile.face, output.width, output.height, x + (i + 0.5f) / n, y + (j + 0.5f) / n, dir);
+					job->source->Sample(dir, color);
+					for (int c = 0; c < 4; ++c)
+						sum[c] += color[c];
+				}
+			}
+			for (int c = 0; c < 4; ++c)
+				sum[c] /= n * n;
+			EncodeTexel(output, sum, out);
+		}
+	}
+}
+
+// Panorama rows a tile reads: its texel centres bound them up to about a texel of the
+// output either way, plus the bilinear footprint
+struct RowRangeJob
+{
+	const EnvSource* source;
+	const EnvOutput* output;
+	std::vector<EnvTile>* tiles;
+	int margin;
+};
+
+void TileRowRange(void* context, int index)
+{
+	const RowRangeJob* job = (const RowRangeJob*)context;
+	const EnvOutput& output = *job->output;
+	EnvTile& tile = (*job->tiles)[index];
+	float vMin = 1.0f, vMax = 0.0f;
+	for (int y = tile.y0; y < tile.y0 + tile.height; ++y)
+	{
+		for (int x = tile.x0; x < tile.x0 + tile.width; ++x)
+		{
+			float dir[3], u, v;
+			EnvTexelDirection(output.layout, tile.face, output.width, output.height, x + 0.5f, y + 0.5f, dir);
+			EquirectUV(dir, &u, &v);
+			vMin = std::min(vMin, v);
+			vMax = std::max(vMax, v);
+		}
+	}
+	int height = job->source->Height();
+	tile.firstRow = std::max((int)floorf(vMin * height - 0.5f) - job->margin, 0);
+	tile.lastRow = std::min((int)floorf(vMax * height - 0.5f) + 1 + job->margin, height - 1);
+}
+
+struct FirstRowOrder
+{
+	const std::vector<EnvTile>* tiles;
+	bool operator()(int a, int b) const { return (*tiles)[a].firstRow < (*tiles)[b].firstRow; }
+};
+
+bool Convert(EnvSource* source, const EnvOutput& output, size_t memoryBytes, SoftThreadPool* pool, FILE* file)
+{
+	std::vector<EnvTile> tiles;
+	for (int face = 0; face < output.faces; ++face)
+	{
+		for (int y = 0; y < output.height; y += ENV_TILE_SIZE)
+		{
+			for (int x = 0; x < output.width; x += ENV_TILE_SIZE)
+			{
+				EnvTile tile;
+				tile.face = face;
+				tile.x0 = x;
+				tile.y0 = y;
+				tile.width = std::min(ENV_TILE_SIZE, output.width - x);
+				tile.height = std::min(ENV_TILE_SIZE, output.height - y);
+				tile.firstRow = 0;
+				tile.lastRow = source->Height() - 1;
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	float outputAngle = EnvTexelAngle(output.layout, output.width, output.height);
+	float sourceAngle = EnvTexelAngle(source->Layout(), source->Width(), source->Height());
+	ResampleJob job;
+	job.source = source;
+	job.output = &output;
+	job.tiles = &tiles;
+	job.subsamples = std::min(std::max((int)ceilf(outputAngle / sourceAngle - 0.5f), 1), ENV_MAX_SUBSAMPLES);
+
+	std::vector<int> order(tiles.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = (int)i;
+	int windowRows = source->Height();
+	if (source->Streamed())
+	{
+		RowRangeJob rangeJob = { source, &output, &tiles, (int)ceilf(outputAngle / sourceAngle) + 1 };
+		pool->ParallelFor((int)tiles.size(), TileRowRange, &rangeJob);
+		FirstRowOrder compare = { &tiles };
+		std::stable_sort(order.begin(), order.end(), compare);
+		windowRows = std::max((int)(memoryBytes / ((size_t)source->Width() * 4 * sizeof(float))), 1);
+	}
+
+	// Batches of tiles whose rows fit the window, bigger only for a tile that needs more
+	size_t rowBytes = (size_t)output.width * output.texelBytes;
+	size_t faceBytes = rowBytes * output.height;
+	int batches = 0, peakRows = 0;
+	for (size_t begin = 0; begin < order.size(); )
+	{
+		int firstRow = tiles[order[begin]].firstRow, lastRow = tiles[order[begin]].lastRow;
+		size_t end = begin + 1;
+		while (end < order.size() && end - begin < ENV_TILES_PER_BATCH &&
+			std::max(lastRow, tiles[order[end]].lastRow) - firstRow < windowRows)
+			lastRow = std::max(lastRow, tiles[order[end++]].lastRow);
+		if (!source->LoadRows(firstRow, lastRow))
+		{
+			fprintf(stderr, "can't read rows %d to %d\n", firstRow, lastRow);
+			return false;
+		}
+		peakRows = std::max(peakRows, source->LoadedRows());
+
+		job.order = &order[begin];
+		pool->ParallelFor((int)(end - begin), ResampleTile, &job);
+		for (size_t i = begin; i < end; ++i)
+		{
+			EnvTile& tile = tiles[order[i]];
+			size_t tileRowBytes = (size_t)tile.width * output.texelBytes;
+			for (int y = 0; y < tile.height; ++y)
+			{
+				fseek(file, (long)(DDS_HEADER_BYTES + tile.face * faceBytes + (tile.y0 + y) * rowBytes + tile.x0 * output.texelBytes), SEEK_SET);
+				fwrite(&tile.texels[y * tileRowBytes], tileRowBytes, 1, file);
+			}
+			std::vector<unsigned char>().swap(tile.texels);
+		}
+		batches++;
+		begin = end;
+	}
+
+	printf("%d tiles in %d batches, %dx%d samples a texel", (int)tiles.size(), batches, job.subsamples, job.subsamples);
+	if (source->Streamed())
+		printf(", %d source rows resident at most (%.1f MB)", peakRows, (double)peakRows * source->Width() * 4 * sizeof(float) / (1024.0 * 1024.0));
+	printf("\n");
+	return ferror(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string input, output, layoutName, from, formatName = "rgba8";
+	int threads = 0, size = 0;
+	float exposure = 1.0f;
+	size_t memoryBytes = (size_t)256 << 20;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-size") && i + 1 < argc && atoi(argv[i + 1]) > 2)
+			size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-format") && i + 1 < argc && (!strcmp(argv[i + 1], "rgba8") || !strcmp(argv[i + 1], "rgba16f")))
+			formatName = argv[++i];
+		else if (!strcmp(argv[i], "-exposure") && i + 1 < argc)
+			exposure = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-memory") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			memoryBytes = (size_t)atoi(argv[++i]) << 20;
+		else if (!strcmp(argv[i], "-from") && i + 1 < argc && (!strcmp(argv[i + 1], "equirect") || !strcmp(argv[i + 1], "octahedral")))
+			from = argv[++i];
+		else if (argv[i][0] != '-' && i + 2 == argc - 1 &&
+			(!strcmp(argv[i + 2], "cube") || !strcmp(argv[i + 2], "octahedral") || !strcmp(argv[i + 2], "equirect")))
+		{
+			input = argv[i];
+			output = argv[i + 1];
+			layoutName = argv[i + 2];
+			i += 2;
+		}
+		else
+			break;
+	}
+	if (layoutName.empty())
+	{
+		fprintf(stderr, "usage: env_convert [-threads N] [-size N] [-format rgba8|rgba16f] [-exposure E]\n"
+			"                   [-memory MB] [-from equirect|octahedral] input output cube|octahedral|equirect\n");
+		return 1;
+	}
+
+	EnvSource* source = OpenSource(input, from, memoryBytes);
+	if (source == NULL)
+	{
+		fprintf(stderr, "can't convert %s\n", input.c_str());
+		return 1;
+	}
+	static const char* layoutNames[] = { "equirect", "cube", "octahedral" };
+	printf("%s: %s %dx%d%s\n", input.c_str(), layoutNames[source->Layout()], source->Width(), source->Height(),
+		source->Streamed() ? ", streamed" : "");
+
+	// Default sizes keep about the source's resolution
+	EnvOutput out;
+	out.layout = layoutName == "cube" ? ENV_LAYOUT_CUBE : layoutName == "octahedral" ? ENV_LAYOUT_OCTAHEDRAL : ENV_LAYOUT_EQUIRECT;
+	float sourceAngle = EnvTexelAngle(source->Layout(), source->Width(), source->Height());
+	if (out.layout == ENV_LAYOUT_CUBE)
+		out.width = out.height = size ? size : std::max((int)(0.5f * ENV_PI / sourceAngle + 0.5f), 1);
+	else if (out.layout == ENV_LAYOUT_OCTAHEDRAL)
+		out.width = out.height = size ? size : std::max((int)(2.0f * 0.5f * ENV_PI / sourceAngle + 0.5f) + 2, 3);
+	else
+	{
+		out.height = size ? std::max(size / 2, 1) : std::max((int)(ENV_PI / sourceAngle + 0.5f), 1);
+		out.width = 2 * out.height;
+	}
+	out.faces = out.layout == ENV_LAYOUT_CUBE ? 6 : 1;
+	out.format = formatName == "rgba16f" ? DDS_FORMAT_R16G16B16A16_FLOAT : DDS_FORMAT_R8G8B8A8_UNORM;
+	out.texelBytes = DDSBitsPerPixel(out.format) / 8;
+	out.exposure = exposure;
+
+	DDSImage dds;
+	dds.format = out.format;
+	dds.dimension = DDS_DIMENSION_TEXTURE2D;
+	dds.width = out.width;
+	dds.height = out.height;
+	dds.depth = 1;
+	dds.mipLevels = 1;
+	dds.arraySize = 1;
+	dds.isCube = out.layout == ENV_LAYOUT_CUBE;
+	dds.forceOpaqueAlpha = false;
+
+	FILE* file = fopen(output.c_str(), "wb");
+	if (file == NULL || !WriteDDSHeader(file, dds))
+	{
+		fprintf(stderr, "can't write %s\n", output.c_str());
+		if (file != NULL)
+			fclose(file);
+		delete source;
+		return 1;
+	}
+
+	SoftThreadPool pool(threads);
+	long long start = Profiler::Now();
+	bool ok = Convert(source, out, memoryBytes, &pool, file);
+	ok = fclose(file) == 0 && ok;
+	double seconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+	delete source;
+	if (!ok)
+	{
+		fprintf(stderr, "can't write %s\n", output.c_str());
+		return 1;
+	}
+	printf("%s: %s %dx%d%s %s, %.1f ms on %d threads\n", output.c_str(), layoutNames[out.layout], out.width, out.height,
+		out.faces > 1 ? " x6" : "", formatName.c_str(), seconds * 1000.0, pool.ThreadCount());
+	return 0;
+}
@@ -0,0 +1,224 @@
+//--------------------------------------------------------------------------------------
+// File: ibl_baker.cpp
+//
+// Offline image based lighting baker for the sky map: writes a cube map DDS whose mips
+// are the sky prefiltered with GGX lobes of increasing roughness, and a text sidecar
+// with the sky's SH irradiance. D3D11_sky_mapping loads both (skymap_ggx.dds and
+// skymap_sh.txt) and falls back to skymap.dds and its constant ambient without them.
+//
+// The sky is decoded from sRGB and prefiltered in linear space (Common/ibl_baker.h),
+// then stored as R8G8B8A8_UNORM in sRGB again so the samples' loaders and shaders read
+// it exactly like the original. The SH is projected from the stored values, which is
+// what the samples' shaders light with.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread ibl_baker.cpp -o ibl_baker
+//   cl /O2 /EHsc /DXM_PORTABLE ibl_baker.cpp
+//
+// Usage: ibl_baker [-threads N] [-samples N] [input.dds output.dds sh.txt]
+// Without files it bakes the sky_mapping sample's skymap.dds (run from the Headless
+// directory); without a readable cube map DDS it bakes the procedural sky.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "../Common/dds_writer.h"
+#include "../Common/ibl_baker.h"
+#include "../Common/mip_generator.h"
+#include "../Common/profiler.h"
+#include "procedural_sky.h"
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+// Top level of an R8G8B8A8 or B8G8R8A8 cube map
+bool LoadCubeMap(const std::string& fileName, IBLCubeLevel* cube)
+{
+	std::vector<unsigned char> data;
+	DDSImage image;
+	if (!ReadFile(fileName, &data) || !ParseDDS(&data[0], data.size(), &image) || !image.isCube ||
+		image.width != image.height)
+		return false;
+
+	bool bgra = image.format == DDS_FORMAT_B8G8R8A8_UNORM || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	bool opaque = image.forceOpaqueAlpha || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	if (!bgra && image.format != DDS_FORMAT_R8G8B8A8_UNORM)
+		return false;
+
+	cube->size = image.width;
+	for (int face = 0; face < 6; ++face)
+	{
+		const DDSSubresource& subresource = image.subresources[face * image.mipLevels];
+		cube->faces[face].resize((size_t)cube->size * cube->size * 4);
+		float* texel = &cube->faces[face][0];
+		for (int y = 0; y < cube->size; ++y)
+		{
+			const unsigned char* p = subresource.data + y * subresource.rowPitch;
+			for (int x = 0; x < cube->size; ++x, p += 4, texel += 4)
+			{
+				texel[0] = p[bgra ? 2 : 0] / 255.0f;
+				texel[1] = p[1] / 255.0f;
+				texel[2] = p[bgra ? 0 : 2] / 255.0f;
+				texel[3] = opaque ? 1.0f : p[3] / 255.0f;
+			}
+		}
+	}
+	return true;
+}
+
+void CreateProceduralSky(int size, IBLCubeLevel* cube)
+{
+	cube->size = size;
+	for (int face = 0; face < 6; ++face)
+	{
+		cube->faces[face].resize((size_t)size * size * 4);
+		float* texel = &cube->faces[face][0];
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x, texel += 4)
+			{
+				float d[3];
+				SoftMipCube::FaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, d);
+				float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+				d[0] /= length, d[1] /= length, d[2] /= length;
+				ProceduralSkyColor(d, texel);
+			}
+		}
+	}
+}
+
+bool WriteCubeMap(const std::string& fileName, const std::vector<IBLCubeLevel>& levels)
+{
+	// Face major, mip minor like D3D11 subresources
+	std::vector<std::vector<unsigned char> > texels(6 * levels.size());
+	DDSImage dds;
+	dds.format = DDS_FORMAT_R8G8B8A8_UNORM;
+	dds.dimension = DDS_DIMENSION_TEXTURE2D;
+	dds.width = dds.height = levels[0].size;
+	dds.depth = 1;
+	dds.mipLevels = (unsigned int)levels.size();
+	dds.arraySize = 1;
+	dds.isCube = true;
+	dds.forceOpaqueAlpha = false;
+	for (int face = 0; face < 6; ++face)
+	{
+		for (size_t m = 0; m < levels.size(); ++m)
+		{
+			const std::vector<float>& source = levels[m].faces[face];
+			std::vector<unsigned char>& out = texels[face * levels.size() + m];
+			out.resize(source.size());
+			for (size_t i = 0; i < source.size(); ++i)
+				out[i] = MipToUnorm8((i & 3) == 3 ? source[i] : MipLinearToSRGB(std::max(source[i], 0.0f)));
+
+			DDSSubresource sub;
+			sub.data = &out[0];
+			sub.width = sub.height = levels[m].size;
+			sub.depth = 1;
+			sub.rowPitch = levels[m].size * 4;
+			sub.slicePitch = sub.rowPitch * levels[m].size;
+			dds.subresources.push_back(sub);
+		}
+	}
+	return WriteDDS(fileName.c_str(), dds);
+}
+
+int main(int argc, char** argv)
+{
+	std::string input = "../D3D11_sky_mapping/D3D11_sky_mapping/skymap.dds";
+	std::string output = "../D3D11_sky_mapping/D3D11_sky_mapping/skymap_ggx.dds";
+	std::string shOutput = "../D3D11_sky_mapping/D3D11_sky_mapping/skymap_sh.txt";
+	int threads = 0, samples = 64;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-samples") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			samples = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && i + 2 == argc - 1)
+		{
+			input = argv[i];
+			output = argv[i + 1];
+			shOutput = argv[i + 2];
+			i += 2;
+		}
+		else
+		{
+			fprintf(stderr, "usage: ibl_baker [-threads N] [-samples N] [input.dds output.dds sh.txt]\n");
+			return 1;
+		}
+	}
+
+	IBLCubeLevel sky;
+	if (LoadCubeMap(input, &sky))
+		printf("Sky map: %s, %dx%d\n", input.c_str(), sky.size, sky.size);
+	else
+	{
+		printf("Sky map: %s not usable, using the procedural sky\n", input.c_str());
+		CreateProceduralSky(256, &sky);
+	}
+
+	SoftThreadPool pool(threads);
+	long long start = Profiler::Now();
+	SHIrradiance sh;
+	ProjectSHIrradiance(sky, &pool, &sh);
+	double shSeconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+
+	// Prefilter in linear space, from a source with box mips and seam borders
+	start = Profiler::Now();
+	std::vector<float> linear[6];
+	const float* faces[6];
+	for (int face = 0; face < 6; ++face)
+	{
+		linear[face] = sky.faces[face];
+		for (size_t i = 0; i < linear[face].size(); ++i)
+			if ((i & 3) != 3)
+				linear[face][i] = MipSRGBToLinear(linear[face][i]);
+		faces[face] = &linear[face][0];
+	}
+	SoftMipCube source;
+	source.Create(sky.size, faces, true);
+
+	int mipCount = 1;
+	while ((sky.size >> mipCount) > 0)
+		mipCount++;
+	std::vector<IBLCubeLevel> levels;
+	GGXPrefilter prefilter(&source, sky.size, mipCount, samples);
+	prefilter.Run(&pool, &levels);
+	double ggxSeconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+
+	if (!WriteCubeMap(output, levels))
+	{
+		fprintf(stderr, "can't write %s\n", output.c_str());
+		return 1;
+	}
+	if (!WriteSHIrradiance(shOutput.c_str(), sh, input.c_str()))
+	{
+		fprintf(stderr, "can't write %s\n", shOutput.c_str());
+		return 1;
+	}
+
+	printf("GGX %s: %d mips, roughness 0..1 in steps of %.3f, %d samples, %.1f ms on %d threads\n", output.c_str(),
+		mipCount, GGXPrefilter::Roughness(1, mipCount), (samples + 3) & ~3, ggxSeconds * 1000.0, pool.ThreadCount());
+	printf("SH  %s: %.1f ms\n", shOutput.c_str(), shSeconds * 1000.0);
+	for (int i = 0; i < SH_COEFFICIENTS; ++i)
+		printf("    %d: %9.5f %9.5f %9.5f\n", i, sh.rgb[i][0], sh.rgb[i][1], sh.rgb[i][2]);
+	return 0;
+}
@@ -0,0 +1,574 @@
+//--------------------------------------------------------------------------------------
+// File: main.cpp
+//
+// Renders the D3D11_sky_mapping and Tutorial05_CubeMap scenes with the software
+// rasterizer, without a window or a Direct3D device, and writes the last frame of each
+// as a binary PPM. Draw order, states, camera and animation follow the samples' own
+// DrawScene/Render code. Text overlays (Direct2D) are not drawn.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread main.cpp -o headless
+//   cl /O2 /EHsc /DXM_PORTABLE main.cpp
+//
+// Usage: headless [-scene sky_mapping|cubemap|all] [-frames N] [-size WxH] [-threads N]
+//                 [-skymap file.dds] [-skyoct file.dds] [-sky triangle|sphere|compare] [-out prefix]
+// Without a readable cube map DDS a procedural sky is used, so the output is the same
+// on every machine. -skyoct draws sky_mapping from an octahedral map made by env_convert.
+// -sky picks sky_mapping's sky pass like the sample's F key: the fullscreen triangle
+// after the opaque objects (default) or the camera-centred sphere. compare renders both,
+// prints the pixels each sky pass shaded and how far the images differ, and writes
+// <prefix>sky_mapping_sphere.ppm next to the triangle's image.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../Common/xnamath_portable.h"
+#include "../Common/dds_reader.h"
+#include "../Common/profiler.h"
+#include "../Common/soft_rasterizer.h"
+#include "../Common/soft_sampler.h"
+#include "../Common/mesh_generator.h"
+#include "sky_mapping_shaders.h"
+#include "cubemap_shaders.h"
+#include "procedural_sky.h"
+
+//--------------------------------------------------------------------------------------
+// Options
+//--------------------------------------------------------------------------------------
+struct Options
+{
+	std::string scene;
+	int frames;
+	int width;
+	int height;
+	int threads;
+	std::string skyMap;
+	std::string skyOctahedral;
+	std::string sky;
+	std::string outPrefix;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+	options->scene = "all";
+	options->frames = 60;
+	options->width = 800;
+	options->height = 600;
+	options->threads = 0;
+	options->skyMap = "skymap.dds";
+	options->sky = "triangle";
+	options->outPrefix = "headless_";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "-scene") && hasValue)
+			options->scene = argv[++i];
+		else if (!strcmp(argv[i], "-frames") && hasValue)
+			options->frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-size") && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-threads") && hasValue)
+			options->threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-skymap") && hasValue)
+			options->skyMap = argv[++i];
+		else if (!strcmp(argv[i], "-skyoct") && hasValue)
+			options->skyOctahedral = argv[++i];
+		else if (!strcmp(argv[i], "-sky") && hasValue)
+			options->sky = argv[++i];
+		else if (!strcmp(argv[i], "-out") && hasValue)
+			options->outPrefix = argv[++i];
+		else
+			return false;
+	}
+	bool skyValid = options->sky == "triangle" || options->sky == "sphere" || options->sky == "compare";
+	return skyValid && options->frames > 0 && options->width > 0 && options->height > 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+// 8 bit RGBA/BGRA formats only
+bool DecodeSubresource(const DDSImage& image, const DDSSubresource& subresource, std::vector<float>* rgba)
+{
+	bool bgra = image.format == DDS_FORMAT_B8G8R8A8_UNORM || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	bool opaque = image.forceOpaqueAlpha || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	if (!bgra && image.format != DDS_FORMAT_R8G8B8A8_UNORM)
+		return false;
+
+	rgba->resize((size_t)subresource.width * subresource.height * 4);
+	for (unsigned int y = 0; y < subresource.height; ++y)
+	{
+		const unsigned char* row = subresource.data + y * subresource.rowPitch;
+		for (unsigned int x = 0; x < subresource.width; ++x)
+		{
+			const unsigned char* p = row + x * 4;
+			float* texel = &(*rgba)[((size_t)y * subresource.width + x) * 4];
+			texel[0] = p[bgra ? 2 : 0] / 255.0f;
+			texel[1] = p[1] / 255.0f;
+			texel[2] = p[bgra ? 0 : 2] / 255.0f;
+			texel[3] = opaque ? 1.0f : p[3] / 255.0f;
+		}
+	}
+	return true;
+}
+
+// Top mip of each face
+bool LoadCubeMap(const std::string& fileName, SoftMipCube* cube)
+{
+	std::vector<unsigned char> data;
+	DDSImage image;
+	if (!ReadFile(fileName, &data) || !ParseDDS(&data[0], data.size(), &image) || !image.isCube || image.width != image.height)
+		return false;
+
+	std::vector<float> rgba[6];
+	const float* faces[6];
+	for (int face = 0; face < 6; ++face)
+	{
+		if (!DecodeSubresource(image, image.subresources[face * image.mipLevels], &rgba[face]))
+			return false;
+		faces[face] = &rgba[face][0];
+	}
+	cube->Create(image.width, faces, false);
+	return true;
+}
+
+// Top mip of a square 2D map from env_convert
+bool LoadOctahedralMap(const std::string& fileName, SoftMipTexture* texture)
+{
+	std::vector<unsigned char> data;
+	std::vector<float> rgba;
+	DDSImage image;
+	if (!ReadFile(fileName, &data) || !ParseDDS(&data[0], data.size(), &image) || image.isCube ||
+		image.dimension != DDS_DIMENSION_TEXTURE2D || image.width != image.height || image.width <= 2 ||
+		!DecodeSubresource(image, image.subresources[0], &rgba))
+		return false;
+	texture->Create(image.width, image.height, &rgba[0], false);
+	return true;
+}
+
+// The sky of procedural_sky.h on a cube of the given size
+void CreateProceduralSky(int size, SoftMipCube* cube)
+{
+	std::vector<float> rgba[6];
+	const float* faces[6];
+	for (int face = 0; face < 6; ++face)
+	{
+		rgba[face].resize((size_t)size * size * 4);
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				float d[3];
+				SoftMipCube::FaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, d);
+				Normalize3(d, d);
+				ProceduralSkyColor(d, &rgba[face][((size_t)y * size + x) * 4]);
+			}
+		}
+		faces[face] = &rgba[face][0];
+	}
+	cube->Create(size, faces, false);
+}
+
+bool WritePPM(const std::string& fileName, const SoftRenderer& renderer)
+{
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", renderer.Width(), renderer.Height());
+	const unsigned int* pixels = renderer.ColorBuffer();
+	std::vector<unsigned char> row(renderer.Width() * 3);
+	for (int y = 0; y < renderer.Height(); ++y)
+	{
+		for (int x = 0; x < renderer.Width(); ++x)
+		{
+			unsigned int p = pixels[y * renderer.Width() + x];
+			row[x * 3 + 0] = p & 0xff;
+			row[x * 3 + 1] = (p >> 8) & 0xff;
+			row[x * 3 + 2] = (p >> 16) & 0xff;
+		}
+		fwrite(&row[0], row.size(), 1, file);
+	}
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+//--------------------------------------------------------------------------------------
+// D3D11_sky_mapping
+//--------------------------------------------------------------------------------------
+// Same mesh as the sample's CreateSphere, without the vertex cache reordering
+void CreateSphere(int LatLines, int LongLines, std::vector<SkyMappingFx::Vertex>* vertices, std::vector<unsigned short>* indices)
+{
+	MeshData mesh;
+	GenerateUVSphere(1.0f, LatLines - 1, LongLines, &mesh);
+	vertices->resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const MeshVertex& v = mesh.vertices[i];
+		SkyMappingFx::Vertex vertex =
+		{
+			XMFLOAT3(v.position[0], v.position[1], v.position[2]), XMFLOAT2(v.uv[0], v.uv[1]), XMFLOAT3(v.normal[0], v.normal[1], v.normal[2])
+		};
+		(*vertices)[i] = vertex;
+	}
+	indices->assign(mesh.indices.begin(), mesh.indices.end());
+}
+
+// skyOctahedral replaces skyMap unless it is empty, like the sample's O key. The sky pass
+// is inside the renderer's query, so queryPixelsShaded is its pixel cost.
+void RenderSkyMapping(SoftRenderer& renderer, const SoftMipCube& skyMap, const SoftMipTexture& skyOctahedral, bool skyTriangle,
+	int frames)
+{
+	using namespace SkyMappingFx;
+
+	Vertex ground[] =
+	{
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(100.0f, 100.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 100.0f), XMFLOAT3(-1.0f, 1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(-1.0f, 1.0f, -1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(100.0f, 100.0f), XMFLOAT3(1.0f, 1.0f, -1.0f) },
+	};
+	unsigned int groundIndices[] = { 0, 1, 2, 0, 2, 3 };
+
+	std::vector<Vertex> sphereVertices;
+	std::vector<unsigned short> sphereIndices;
+	CreateSphere(20, 20, &sphereVertices, &sphereIndices);
+	SkyTriangleVertex skyTriangleVertices[] = { { 0 }, { 1 }, { 2 } };
+	unsigned short skyTriangleIndices[] = { 0, 1, 2 };
+
+	// The sample's states
+	SoftRasterizerDesc CCWcullMode = { SOFT_CULL_BACK, true };
+	SoftRasterizerDesc RSCullNone = { SOFT_CULL_NONE, false };
+	SoftDepthStencilDesc DSLessEqual = { true, true, SOFT_COMPARISON_LESS_EQUAL };
+
+	Constants cb;
+	cb.light.dir = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	cb.light.pad = 0.0f;
+	cb.light.ambient = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
+	cb.light.diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	// No skymap_sh.txt next to a procedural sky: the sample's constant ambient
+	SetSHConstant(&cb.light.ambient.x, &cb.shIrradiance);
+	cb.roughness = 0.0f;
+	cb.ObjTexture = NULL;
+	cb.SkyMap = &skyMap;
+	cb.SkyOctahedral = &skyOctahedral;
+	cb.skyOctahedral = skyOctahedral.Width() > 0;
+
+	// UpdateCamera with no input: looking down +z from the start position. The sample
+	// computes the aspect ratio with integer division, so it is kept here.
+	XMVECTOR camPosition = XMVectorSet(0.0f, 5.0f, -8.0f, 0.0f);
+	XMVECTOR camTarget = camPosition + XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+	XMMATRIX camView = XMMatrixLookAtLH(camPosition, camTarget, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX camProjection = XMMatrixPerspectiveFovLH(0.4f*3.14f, (float)(renderer.Width()/renderer.Height()), 1.0f, 1000.0f);
+	XMMATRIX skyView = camView;
+	skyView.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMVECTOR determinant;
+	cb.skyInvViewProj = XMMatrixInverse(&determinant, skyView * camProjection);
+	XMStoreFloat3(&cb.cameraPos, camPosition);
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		PROFILE_SCOPE("SkyMappingFrame");
+
+		// UpdateScene
+		XMMATRIX groundWorld = XMMatrixScaling(10.0f, 10.0f, 10.0f) * XMMatrixTranslation(0.0f, 10.0f, 0.0f);
+		XMMATRIX sphereWorld = XMMatrixScaling(5.0f, 5.0f, 5.0f) *
+			XMMatrixTranslation(XMVectorGetX(camPosition), XMVectorGetY(camPosition), XMVectorGetZ(camPosition));
+		XMMATRIX sphereWorld2 = XMMatrixTranslation(0, 5.5f, 0);
+
+		// DrawScene
+		float bgColor[4] = { 0.1f, 0.1f, 0.1f, 1.0f };
+		renderer.ClearRenderTarget(bgColor);
+		renderer.ClearDepth(1.0f);
+		renderer.SetBlendState(NULL);
+
+		renderer.SetIndexBuffer(groundIndices, false);
+		renderer.SetVertexBuffer(ground, sizeof(Vertex));
+		cb.WVP = groundWorld * camView * camProjection;
+		cb.World = groundWorld;
+		renderer.SetConstants(&cb, sizeof(cb));
+		renderer.SetVertexShader(REFLECT_VS, 9);
+		renderer.SetPixelShader(REFLECT_PS);
+		renderer.SetRasterizerState(&RSCullNone);
+		renderer.DrawIndexed(6, 0, 0);
+
+		if (!skyTriangle)
+		{
+			renderer.BeginQuery();
+			renderer.SetIndexBuffer(&sphereIndices[0], true);
+			renderer.SetVertexBuffer(&sphereVertices[0], sizeof(Vertex));
+			cb.WVP = sphereWorld * camView * camProjection;
+			cb.World = sphereWorld;
+			renderer.SetConstants(&cb, sizeof(cb));
+			renderer.SetVertexShader(SKYMAP_VS, 3);
+			renderer.SetPixelShader(SKYMAP_PS);
+			renderer.SetDepthStencilState(&DSLessEqual);
+			renderer.SetRasterizerState(&RSCullNone);
+			renderer.DrawIndexed((unsigned int)sphereIndices.size(), 0, 0);
+			renderer.EndQuery();
+		}
+
+		renderer.SetIndexBuffer(&sphereIndices[0], true);
+		renderer.SetVertexBuffer(&sphereVertices[0], sizeof(Vertex));
+		cb.WVP = sphereWorld2 * camView * camProjection;
+		cb.World = sphereWorld2;
+		renderer.SetConstants(&cb, sizeof(cb));
+		renderer.SetVertexShader(REFLECT_VS, 9);
+		renderer.SetPixelShader(REFLECT_PS);
+		renderer.SetRasterizerState(&CCWcullMode);
+		renderer.DrawIndexed((unsigned int)sphereIndices.size(), 0, 0);
+
+		if (skyTriangle)
+		{
+			renderer.BeginQuery();
+			renderer.SetIndexBuffer(skyTriangleIndices, true);
+			renderer.SetVertexBuffer(skyTriangleVertices, sizeof(SkyTriangleVertex));
+			renderer.SetVertexShader(SKY_TRIANGLE_VS, 3);
+			renderer.SetPixelShader(SKYMAP_PS);
+			renderer.SetDepthStencilState(&DSLessEqual);
+			renderer.SetRasterizerState(&RSCullNone);
+			renderer.DrawIndexed(3, 0, 0);
+			renderer.EndQuery();
+		}
+
+		renderer.SetDepthStencilState(NULL);
+
+		// Present
+		PROFILE_SCOPE("Flush");
+		renderer.Flush();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Tutorial05_CubeMap
+//--------------------------------------------------------------------------------------
+void RenderCubeMap(SoftRenderer& renderer, const SoftMipCube& skyMap, int frames)
+{
+	using namespace CubeMapFx;
+
+	SimpleVertex cubeVertices[] =
+	{
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, -1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, -1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT3(0.0f, -1.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(0.0f, -1.0f, 0.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f) },
+
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) },
+	};
+	unsigned short indices[] =
+	{
+		3,1,0, 2,1,3,
+		6,4,5, 7,4,6,
+		11,9,8, 10,9,11,
+		14,12,13, 15,12,14,
+		19,17,16, 18,17,19,
+		22,20,21, 23,20,22
+	};
+
+	SoftRasterizerDesc g_CWcullMode = { SOFT_CULL_BACK, false };
+	SoftRasterizerDesc g_RSCullNone = { SOFT_CULL_NONE, false };
+	SoftDepthStencilDesc g_DSLessEqual = { true, true, SOFT_COMPARISON_LESS_EQUAL };
+
+	XMVECTOR g_CamPosition = XMVectorSet(0.0f, 2.0f, -5.0f, 0.0f);
+	XMVECTOR g_CamTarget = g_CamPosition + XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+	XMMATRIX g_View = XMMatrixLookAtLH(g_CamPosition, g_CamTarget, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, renderer.Width() / (float)renderer.Height(), 0.01f, 100.0f);
+
+	renderer.SetVertexBuffer(cubeVertices, sizeof(SimpleVertex));
+	renderer.SetIndexBuffer(indices, true);
+
+	Constants cb;
+	cb.SkyMap = &skyMap;
+	XMStoreFloat3(&cb.cameraPos, g_CamPosition);
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		PROFILE_SCOPE("CubeMapFrame");
+
+		// UpdateTime at a fixed 60 Hz, so every run renders the same frames
+		float g_CurrentTime = frame / 60.0f / 2.0f;
+
+		renderer.SetBlendState(NULL);
+		float ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f };
+		renderer.ClearRenderTarget(ClearColor);
+		renderer.ClearDepth(1.0f);
+
+		XMMATRIX g_CubeWorld1 = XMMatrixRotationY(g_CurrentTime);
+		cb.World = g_CubeWorld1;
+		cb.WVP = g_CubeWorld1 * g_View * g_Projection;
+		renderer.SetConstants(&cb, sizeof(cb));
+		renderer.SetRasterizerState(&g_CWcullMode);
+		renderer.SetVertexShader(REFLECT_VS, 6);
+		renderer.SetPixelShader(REFLECT_PS);
+		renderer.DrawIndexed(36, 0, 0);
+
+		XMMATRIX mSpin = XMMatrixRotationZ(-g_CurrentTime);
+		XMMATRIX mOrbit = XMMatrixRotationY(-g_CurrentTime * 2.0f);
+		XMMATRIX mTranslate = XMMatrixTranslation(-8.0f, 0.0f, 0.0f);
+		XMMATRIX mScale = XMMatrixScaling(1.0f, 3.0f, 2.0f);
+		XMMATRIX g_CubeWorld2 = mScale * mSpin * mTranslate * mOrbit;
+		cb.World = g_CubeWorld2;
+		cb.WVP = g_CubeWorld2 * g_View * g_Projection;
+		renderer.SetConstants(&cb, sizeof(cb));
+		renderer.DrawIndexed(36, 0, 0);
+
+		XMMATRIX g_SkyBoxWorld = XMMatrixScaling(1.0f, 1.0f, 1.0f) *
+			XMMatrixTranslation(XMVectorGetX(g_CamPosition), XMVectorGetY(g_CamPosition), XMVectorGetZ(g_CamPosition));
+		cb.World = g_SkyBoxWorld;
+		cb.WVP = g_SkyBoxWorld * g_View * g_Projection;
+		renderer.SetConstants(&cb, sizeof(cb));
+		renderer.SetVertexShader(SKYMAP_VS, 3);
+		renderer.SetPixelShader(SKYMAP_PS);
+		// Stays bound into the next frame, as in the sample
+		renderer.SetDepthStencilState(&g_DSLessEqual);
+		renderer.SetRasterizerState(&g_RSCullNone);
+		renderer.DrawIndexed(36, 0, 0);
+
+		PROFILE_SCOPE("Flush");
+		renderer.Flush();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+void ReportScene(const char* name, const SoftRenderer& renderer, int frames, double seconds)
+{
+	const SoftRenderStats& stats = renderer.Stats();
+	printf("%s: %d frames at %dx%d on %d threads, %.3f ms/frame (%.1f fps)\n", name, frames,
+		renderer.Width(), renderer.Height(), renderer.ThreadCount(), seconds * 1000.0 / frames, frames / seconds);
+	printf("  per frame: %u draws, %u triangles, %u culled, %u clipped, %u binned, %u tile entries, %llu pixels shaded\n",
+		stats.draws / frames, stats.trianglesSubmitted / frames, stats.trianglesCulled / frames, stats.trianglesClipped / frames,
+		stats.trianglesBinned / frames, stats.tileEntries / frames, stats.pixelsShaded / frames);
+}
+
+// Largest channel difference and how many pixels differ by more than 2/255
+void CompareImages(const SoftRenderer& a, const SoftRenderer& b)
+{
+	const unsigned int* pa = a.ColorBuffer();
+	const unsigned int* pb = b.ColorBuffer();
+	int maxDifference = 0, differing = 0, pixels = a.Width() * a.Height();
+	for (int i = 0; i < pixels; ++i)
+	{
+		int pixelDifference = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+			pixelDifference = std::max(pixelDifference, abs((int)((pa[i] >> shift) & 0xff) - (int)((pb[i] >> shift) & 0xff)));
+		maxDifference = std::max(maxDifference, pixelDifference);
+		differing += pixelDifference > 2;
+	}
+	printf("sky triangle vs sphere: max difference %d/255, %d of %d pixels differ by more than 2\n", maxDifference, differing, pixels);
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		fprintf(stderr, "usage: headless [-scene sky_mapping|cubemap|all] [-frames N] [-size WxH] [-threads N] [-skymap file.dds]\n"
+			"                [-skyoct file.dds] [-sky triangle|sphere|compare] [-out prefix]\n");
+		return 1;
+	}
+
+	SoftMipCube skyMap;
+	if (LoadCubeMap(options.skyMap, &skyMap))
+		printf("Sky map: %s\n", options.skyMap.c_str());
+	else
+	{
+		printf("Sky map: %s not usable, using the procedural sky\n", options.skyMap.c_str());
+		CreateProceduralSky(256, &skyMap);
+	}
+	SoftMipTexture skyOctahedral;
+	if (!options.skyOctahedral.empty())
+	{
+		if (LoadOctahedralMap(options.skyOctahedral, &skyOctahedral))
+			printf("Octahedral sky map for sky_mapping: %s\n", options.skyOctahedral.c_str());
+		else
+		{
+			fprintf(stderr, "can't read %s\n", options.skyOctahedral.c_str());
+			return 1;
+		}
+	}
+
+	bool all = options.scene == "all";
+	bool ok = true;
+	if (all || options.scene == "sky_mapping")
+	{
+		SoftRenderer renderer(options.width, options.height, options.threads);
+		bool skyTriangle = options.sky != "sphere";
+		long long start = Profiler::Now();
+		RenderSkyMapping(renderer, skyMap, skyOctahedral, skyTriangle, options.frames);
+		ReportScene(skyTriangle ? "sky_mapping (sky triangle)" : "sky_mapping (sky sphere)", renderer, options.frames,
+			(Profiler::Now() - start) / Profiler::TicksPerSecond());
+		printf("  sky pass: %llu pixels shaded per frame\n", renderer.Stats().queryPixelsShaded / options.frames);
+		ok &= WritePPM(options.outPrefix + "sky_mapping.ppm", renderer);
+
+		if (options.sky == "compare")
+		{
+			SoftRenderer sphere(options.width, options.height, options.threads);
+			start = Profiler::Now();
+			RenderSkyMapping(sphere, skyMap, skyOctahedral, false, options.frames);
+			ReportScene("sky_mapping (sky sphere)", sphere, options.frames, (Profiler::Now() - start) / Profiler::TicksPerSecond());
+			printf("  sky pass: %llu pixels shaded per frame\n", sphere.Stats().queryPixelsShaded / options.frames);
+			ok &= WritePPM(options.outPrefix + "sky_mapping_sphere.ppm", sphere);
+			CompareImages(renderer, sphere);
+		}
+	}
+	if (all || options.scene == "cubemap")
+	{
+		SoftRenderer renderer(options.width, options.height, options.threads);
+		long long start = Profiler::Now();
+		RenderCubeMap(renderer, skyMap, options.frames);
+		ReportScene("cubemap", renderer, options.frames, (Profiler::Now() - start) / Profiler::TicksPerSecond());
+		ok &= WritePPM(options.outPrefix + "cubemap.ppm", renderer);
+	}
+
+	printf("\n%s", Profiler::Instance().SummaryTable().c_str());
+	return ok ? 0 : 1;
+}
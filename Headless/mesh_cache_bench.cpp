@@ -0,0 +1,149 @@
+//--------------------------------------------------------------------------------------
+// File: mesh_cache_bench.cpp
+//
+// Cold versus warm model loads through Common/mesh_import.h, with Tutorial05_NormalMap's
+// vertex layout. A cold load deletes the cache first, so it hashes the source, imports it
+// with assimp, packs and post-processes the submeshes and writes the cache. A warm load
+// hashes the source and maps the cache. The best of -passes runs of each is printed, and
+// the warm pool is compared byte for byte with the cold one.
+//
+// Caches are written to -cache (default: the current directory) as <name>.bench.meshcache,
+// so the samples' own .meshcache files are left alone.
+//
+// Needs assimp, whose headers come with the Tutorial05 samples:
+//   g++ -O2 -std=c++11 -pthread -I../Tutorial05_NormalMap/include mesh_cache_bench.cpp -lassimp -o mesh_cache_bench
+//   cl /O2 /EHsc /DXM_PORTABLE /I..\Tutorial05_NormalMap\include mesh_cache_bench.cpp ..\Tutorial05_NormalMap\assimp-vc120-mt.lib
+//
+// Usage: mesh_cache_bench [-passes N] [-cache directory] [mesh files...]
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "../Common/xnamath_portable.h"
+#include "../Common/mesh_import.h"
+#include "../Common/tangent_space.h"
+
+// Tutorial05_NormalMap's vertex
+struct SimpleVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 UV;
+	XMFLOAT4 Tangent;
+};
+
+SimpleVertex ConvertVertex(const aiMesh* mesh, unsigned i, const aiMatrix4x4& transform, const aiMatrix3x3& normalMatrix, const aiMatrix3x3& tangentMatrix)
+{
+	SimpleVertex vertex;
+	memset(&vertex, 0, sizeof(vertex));
+
+	aiVector3D p = transform * mesh->mVertices[i];
+	vertex.Pos = XMFLOAT3(p.x, p.y, p.z);
+
+	aiVector3D n(0.0f, 0.0f, 0.0f);
+	if (mesh->HasNormals())
+	{
+		n = normalMatrix * mesh->mNormals[i];
+		n.Normalize();
+		vertex.Normal = XMFLOAT3(n.x, n.y, n.z);
+	}
+	if (mesh->HasTextureCoords(0))
+		vertex.UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+	if (mesh->HasTangentsAndBitangents())
+	{
+		aiVector3D t = tangentMatrix * mesh->mTangents[i];
+		aiVector3D b = tangentMatrix * mesh->mBitangents[i];
+		t.Normalize();
+		float w = ((n ^ t) * b) < 0.0f ? -1.0f : 1.0f;
+		vertex.Tangent = XMFLOAT4(t.x, t.y, t.z, w);
+	}
+	return vertex;
+}
+
+void FinishSubmesh(const aiMesh* mesh, int submeshIndex, SimpleVertex* vertices, int verticesNum, unsigned short* indices, int indicesNum)
+{
+	if (!mesh->HasTangentsAndBitangents() && mesh->HasNormals() && mesh->HasTextureCoords(0))
+		ComputeTangentSpace(vertices, verticesNum, indices, indicesNum / 3);
+}
+
+bool SamePool(const MeshPool<SimpleVertex>& a, const MeshPool<SimpleVertex>& b)
+{
+	return a.verticesNum == b.verticesNum && a.indicesNum == b.indicesNum && a.submeshes.size() == b.submeshes.size() &&
+		!memcmp(&a.submeshes[0], &b.submeshes[0], a.submeshes.size() * sizeof(Submesh)) &&
+		!memcmp(a.vertices, b.vertices, a.verticesNum * sizeof(SimpleVertex)) &&
+		!memcmp(a.indices, b.indices, a.indicesNum * sizeof(unsigned short));
+}
+
+int main(int argc, char** argv)
+{
+	int passes = 5;
+	std::string cacheDirectory = ".";
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-passes") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			passes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+			cacheDirectory = argv[++i];
+		else if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "usage: mesh_cache_bench [-passes N] [-cache directory] [mesh files...]\n");
+			return 1;
+		}
+	}
+	if (files.empty())
+	{
+		files.push_back("../Tutorial05_NormalMap/Box.fbx");
+		files.push_back("../Tutorial05_NormalMap/Disc.x");
+		files.push_back("../Tutorial05_Parallax/tree.x");
+		files.push_back("../Tutorial05_Parallax/stone.x");
+	}
+
+	MeshImportHooks<SimpleVertex> hooks = { ConvertVertex, FinishSubmesh };
+	printf("best of %d passes, caches in %s\n\n", passes, cacheDirectory.c_str());
+	printf("%-12s %9s %8s %8s %10s %10s %10s %8s %s\n", "mesh", "submeshes", "vertices", "indices", "cache KB", "cold ms", "warm ms",
+		"speedup", "same");
+
+	bool failed = false;
+	for (size_t f = 0; f < files.size(); ++f)
+	{
+		const char* name = strrchr(files[f], '/') ? strrchr(files[f], '/') + 1 : files[f];
+		std::string cacheFile = cacheDirectory + "/" + name + ".bench.meshcache";
+
+		MeshPool<SimpleVertex> cold, warm;
+		MeshLoadStats stats;
+		double coldMs = 1e30, warmMs = 1e30;
+		bool ok = true;
+		for (int p = 0; p < passes && ok; ++p)
+		{
+			ReleaseMeshPool(&cold);
+			remove(cacheFile.c_str());
+			ok = LoadMeshPool(files[f], cacheFile, hooks, &cold, &stats) && !stats.cacheHit;
+			coldMs = std::min(coldMs, stats.milliseconds);
+		}
+		for (int p = 0; p < passes && ok; ++p)
+		{
+			ReleaseMeshPool(&warm);
+			ok = LoadMeshPool(files[f], cacheFile, hooks, &warm, &stats) && stats.cacheHit;
+			warmMs = std::min(warmMs, stats.milliseconds);
+		}
+		if (!ok)
+		{
+			printf("%-12s could not be imported or cached\n", name);
+			failed = true;
+			continue;
+		}
+
+		bool same = SamePool(cold, warm);
+		failed |= !same;
+		printf("%-12s %9d %8d %8d %10.1f %10.3f %10.3f %7.1fx %s\n", name, (int)warm.submeshes.size(), warm.verticesNum, warm.indicesNum,
+			warm.cacheFile.size / 1024.0, coldMs, warmMs, coldMs / warmMs, same ? "yes" : "NO");
+		ReleaseMeshPool(&cold);
+		ReleaseMeshPool(&warm);
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,599 @@
+//--------------------------------------------------------------------------------------
+// File: parallax_bench.cpp
+//
+// Cost and accuracy of the parallax shaders in Tutorial05_Parallax, the linear search
+// of NORMALMAP_PS and the relaxed cone stepping of NORMALMAP_CONE_PS, as a function of
+// HeightMapScale and view angle. The C++ ports in parallax_shaders.h shade a quad
+// textured with four_NM_height.png and seafloor.dds, standing in for a face of the
+// sample's box, at a sweep of angles about the vertical axis. For every configuration
+// and path it reports:
+//   - height map reads per pixel, average and worst case,
+//   - the lockstep cost per 2x2 quad (the slowest lane, helper pixels included), which
+//     is what the GPU pays for the data-dependent loop,
+//   - the error of the final texture offset in texels against a 256 step march refined
+//     by bisection over the same filtered height field,
+//   - the color error that offset error causes, in 8 bit steps.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread parallax_bench.cpp -o parallax_bench
+//   cl /O2 /EHsc /DXM_PORTABLE parallax_bench.cpp
+//
+// Usage: parallax_bench [-scales 0.05,0.1,0.2,0.3] [-angles 0,30,60,75,85] [-size WxH]
+//                       [-path pom|cone|both] [-steps max,min] [-cone steps,binary[,min]]
+//                       [-repeat N] [-refstride N] [-light x,y,z] [-out prefix]
+//                       [-normalmap file.png] [-texture file.dds] [-conemap file.dds]
+// -steps changes the lerp(50, 8, ...) budget and -cone the CONE_STEPS, BINARY_STEPS and
+// MIN_CONE_STEP of the cone path. -refstride computes the ground truth for every Nth
+// pixel only, -light replaces the sample's light direction, and -out writes one PPM per
+// configuration and path.
+// Without the cone map cone_baker writes, it is baked from the normal map on the fly.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../Common/xnamath_portable.h"
+#include "../Common/dds_reader.h"
+#include "../Common/png_reader.h"
+#include "../Common/profiler.h"
+#include "../Common/soft_sampler.h"
+#include "../Common/cone_step_map.h"
+#include "parallax_shaders.h"
+
+using namespace ParallaxFx;
+
+//--------------------------------------------------------------------------------------
+// Options
+//--------------------------------------------------------------------------------------
+struct Options
+{
+	std::vector<float> scales;
+	std::vector<float> angles;
+	int width;
+	int height;
+	bool pom;
+	bool cone;
+	StepBudget budget;
+	ConeStepBudget coneBudget;
+	float repeat;
+	int refStride;
+	float light[3];
+	std::string outPrefix;
+	std::string normalMap;
+	std::string texture;
+	std::string coneMap;
+};
+
+bool ParseList(const char* text, std::vector<float>* values)
+{
+	values->clear();
+	while (*text)
+	{
+		char* end;
+		values->push_back((float)strtod(text, &end));
+		if (end == text)
+			return false;
+		text = *end == ',' ? end + 1 : end;
+	}
+	return !values->empty();
+}
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+	ParseList("0.05,0.1,0.2,0.3", &options->scales);
+	ParseList("0,30,60,75,85", &options->angles);
+	options->width = 512;
+	options->height = 384;
+	options->pom = options->cone = true;
+	options->budget = ShaderStepBudget();
+	options->coneBudget = ShaderConeStepBudget();
+	options->repeat = 1.0f;
+	options->refStride = 4;
+	options->light[0] = 1.0f;
+	options->light[1] = options->light[2] = 0.0f;
+	options->normalMap = "../Tutorial05_Parallax/four_NM_height.png";
+	options->texture = "../Tutorial05_Parallax/seafloor.dds";
+	options->coneMap = "../Tutorial05_Parallax/four_NM_cone.dds";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "-scales") && hasValue)
+		{
+			if (!ParseList(argv[++i], &options->scales))
+				return false;
+		}
+		else if (!strcmp(argv[i], "-angles") && hasValue)
+		{
+			if (!ParseList(argv[++i], &options->angles))
+				return false;
+		}
+		else if (!strcmp(argv[i], "-size") && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-path") && hasValue)
+		{
+			++i;
+			options->pom = !strcmp(argv[i], "pom") || !strcmp(argv[i], "both");
+			options->cone = !strcmp(argv[i], "cone") || !strcmp(argv[i], "both");
+			if (!options->pom && !options->cone)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-steps") && hasValue)
+		{
+			if (sscanf(argv[++i], "%f,%f", &options->budget.maxSteps, &options->budget.minSteps) != 2)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-cone") && hasValue)
+		{
+			if (sscanf(argv[++i], "%d,%d,%f", &options->coneBudget.coneSteps, &options->coneBudget.binarySteps, &options->coneBudget.minStep) < 2)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-light") && hasValue)
+		{
+			if (sscanf(argv[++i], "%f,%f,%f", &options->light[0], &options->light[1], &options->light[2]) != 3)
+				return false;
+		}
+		else if (!strcmp(argv[i], "-repeat") && hasValue)
+			options->repeat = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-refstride") && hasValue)
+			options->refStride = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-out") && hasValue)
+			options->outPrefix = argv[++i];
+		else if (!strcmp(argv[i], "-normalmap") && hasValue)
+			options->normalMap = argv[++i];
+		else if (!strcmp(argv[i], "-texture") && hasValue)
+			options->texture = argv[++i];
+		else if (!strcmp(argv[i], "-conemap") && hasValue)
+			options->coneMap = argv[++i];
+		else
+			return false;
+	}
+	return options->width > 1 && options->height > 1 && options->refStride > 0 && options->budget.minSteps >= 1.0f &&
+		options->coneBudget.coneSteps >= 1 && options->coneBudget.binarySteps >= 0 && options->coneBudget.minStep >= 0.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+bool LoadNormalMap(const std::string& fileName, SoftMipTexture* texture)
+{
+	std::vector<unsigned char> data;
+	PNGImage image;
+	if (!ReadFile(fileName, &data) || !DecodePNG(&data[0], data.size(), &image))
+		return false;
+	std::vector<float> rgba(image.rgba.size());
+	for (size_t i = 0; i < rgba.size(); ++i)
+		rgba[i] = image.rgba[i] / 255.0f;
+	texture->Create(image.width, image.height, &rgba[0], true);
+	return true;
+}
+
+// Top mip of an 8 bit RGBA/BGRA DDS; the sampler builds its own chain
+bool LoadDiffuse(const std::string& fileName, SoftMipTexture* texture)
+{
+	std::vector<unsigned char> data;
+	DDSImage image;
+	if (!ReadFile(fileName, &data) || !ParseDDS(&data[0], data.size(), &image) || image.isCube)
+		return false;
+	bool bgra = image.format == DDS_FORMAT_B8G8R8A8_UNORM || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	bool opaque = image.forceOpaqueAlpha || image.format == DDS_FORMAT_B8G8R8X8_UNORM;
+	if (!bgra && image.format != DDS_FORMAT_R8G8B8A8_UNORM)
+		return false;
+
+	const DDSSubresource& top = image.subresources[0];
+	std::vector<float> rgba((size_t)top.width * top.height * 4);
+	for (unsigned int y = 0; y < top.height; ++y)
+	{
+		const unsigned char* row = top.data + y * top.rowPitch;
+		for (unsigned int x = 0; x < top.width; ++x)
+		{
+			const unsigned char* p = row + x * 4;
+			float* texel = &rgba[((size_t)y * top.width + x) * 4];
+			texel[0] = p[bgra ? 2 : 0] / 255.0f;
+			texel[1] = p[1] / 255.0f;
+			texel[2] = p[bgra ? 0 : 2] / 255.0f;
+			texel[3] = opaque ? 1.0f : p[3] / 255.0f;
+		}
+	}
+	texture->Create(top.width, top.height, &rgba[0], true);
+	return true;
+}
+
+// The sampler's box filtered chain would average the cones, so every level is replaced
+// by the encoded one
+void CreateConeTexture(const std::vector<ConeStepLevel>& levels, SoftMipTexture* texture)
+{
+	const ConeStepLevel& top = levels[0];
+	std::vector<float> rgba((size_t)top.width * top.height * 4, 1.0f);
+	texture->Create(top.width, top.height, &rgba[0], levels.size() > 1);
+	for (int i = 0; i < texture->LevelCount() && i < (int)levels.size(); ++i)
+	{
+		const ConeStepLevel& level = levels[i];
+		for (int y = 0; y < level.height; ++y)
+		{
+			for (int x = 0; x < level.width; ++x)
+			{
+				const unsigned char* p = &level.texels[((size_t)y * level.width + x) * 2];
+				float* texel = texture->Texel(i, x, y);
+				texel[0] = p[0] / 255.0f;
+				texel[1] = p[1] / 255.0f;
+				texel[2] = 0.0f;
+			}
+		}
+	}
+}
+
+// cone_baker's output, R8G8_UNORM with the full chain
+bool LoadConeMap(const std::string& fileName, std::vector<ConeStepLevel>* levels)
+{
+	std::vector<unsigned char> data;
+	DDSImage image;
+	if (!ReadFile(fileName, &data) || !ParseDDS(&data[0], data.size(), &image) || image.isCube || image.format != DDS_FORMAT_R8G8_UNORM)
+		return false;
+	levels->clear();
+	for (unsigned int i = 0; i < image.mipLevels; ++i)
+	{
+		const DDSSubresource& sub = image.subresources[i];
+		ConeStepLevel level;
+		level.width = sub.width;
+		level.height = sub.height;
+		level.texels.resize((size_t)sub.width * sub.height * 2);
+		for (unsigned int y = 0; y < sub.height; ++y)
+			memcpy(&level.texels[(size_t)y * sub.width * 2], sub.data + y * sub.rowPitch, sub.width * 2);
+		levels->push_back(level);
+	}
+	return true;
+}
+
+void BakeConeMap(const SoftMipTexture& normalMap, std::vector<ConeStepLevel>* levels)
+{
+	int width = normalMap.Width(), height = normalMap.Height();
+	std::vector<float> heights((size_t)width * height), cones(heights.size());
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			heights[(size_t)y * width + x] = normalMap.Texel(0, x, y)[3];
+
+	SoftThreadPool pool(0);
+	ConeStepBaker baker(&heights[0], width, height);
+	baker.Bake(&pool, &cones[0]);
+	EncodeConeStepMap(&heights[0], &cones[0], width, height, levels);
+}
+
+//--------------------------------------------------------------------------------------
+// Scene: one quad facing the sample's camera, rotated about y
+//--------------------------------------------------------------------------------------
+// Corners in the sample's winding (clockwise from the camera), UV v pointing down
+const Vertex g_QuadVertices[4] =
+{
+	{ XMFLOAT3(-4.0f, -4.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+	{ XMFLOAT3(-4.0f, 4.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+	{ XMFLOAT3(4.0f, 4.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+	{ XMFLOAT3(4.0f, -4.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT2(1.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
+};
+const int g_QuadTriangles[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+
+struct Result
+{
+	unsigned long long pixels;
+	unsigned long long helperLanes;
+	unsigned long long quads;
+	unsigned long long samples;			// over covered pixels
+	unsigned long long quadCost;		// sum over quads of the slowest lane
+	unsigned long long steps;			// sum of nNumSteps over covered pixels
+	int worstSamples;
+	std::vector<float> errors;			// texels, for the reference subset
+	double colorSquares;				// sum of squared channel errors, 8 bit steps
+	float worstColor;
+	double seconds;
+};
+
+// Perspective-correct interpolation is exact for a plane, so each pixel takes the VS
+// outputs at the point where its view ray meets the quad's plane. Lanes outside the
+// triangle (helpers) extrapolate, like on hardware.
+void ShadeConfiguration(const Constants& cb, const Options& options, bool cone, XMVECTOR eye, float tanHalfFov,
+	const SoftVertexOutput shaded[4], XMFLOAT3 corner[4], std::vector<float>* image, Result* result)
+{
+	XMFLOAT3 e1(corner[3].x - corner[0].x, corner[3].y - corner[0].y, corner[3].z - corner[0].z);
+	XMFLOAT3 e2(corner[1].x - corner[0].x, corner[1].y - corner[0].y, corner[1].z - corner[0].z);
+	XMFLOAT3 eyePos, normal;
+	XMStoreFloat3(&eyePos, eye);
+	XMStoreFloat3(&normal, XMVector3Cross(XMLoadFloat3(&e1), XMLoadFloat3(&e2)));
+	float aspect = (float)options.width / options.height;
+
+	result->pixels = result->helperLanes = result->quads = result->samples = result->quadCost = result->steps = 0;
+	result->worstSamples = 0;
+	result->errors.clear();
+	result->colorSquares = 0.0;
+	result->worstColor = 0.0f;
+	image->assign((size_t)options.width * options.height * 4, 0.0f);
+	double shadeTicks = 0.0;
+	unsigned long long pixelIndex = 0;
+
+	for (int qy = 0; qy + 1 < options.height; qy += 2)
+	{
+		for (int qx = 0; qx + 1 < options.width; qx += 2)
+		{
+			// Quad parameters (s along e1, t along e2) of each lane's ray hit
+			float s[4], t[4];
+			bool inFront[4];
+			for (int l = 0; l < 4; ++l)
+			{
+				float px = qx + (l & 1) + 0.5f, py = qy + (l >> 1) + 0.5f;
+				float d[3] = { (px / options.width * 2.0f - 1.0f) * tanHalfFov * aspect, (1.0f - py / options.height * 2.0f) * tanHalfFov, 1.0f };
+				// The quad is a rotated rectangle, so e1 and e2 are orthogonal
+				float denom = normal.x * d[0] + normal.y * d[1] + normal.z * d[2];
+				float lambda = denom != 0.0f ? ((corner[0].x - eyePos.x) * normal.x + (corner[0].y - eyePos.y) * normal.y + (corner[0].z - eyePos.z) * normal.z) / denom : -1.0f;
+				float h[3] = { eyePos.x + lambda * d[0] - corner[0].x, eyePos.y + lambda * d[1] - corner[0].y, eyePos.z + lambda * d[2] - corner[0].z };
+				s[l] = (h[0] * e1.x + h[1] * e1.y + h[2] * e1.z) / (e1.x * e1.x + e1.y * e1.y + e1.z * e1.z);
+				t[l] = (h[0] * e2.x + h[1] * e2.y + h[2] * e2.z) / (e2.x * e2.x + e2.y * e2.y + e2.z * e2.z);
+				inFront[l] = lambda > 0.0f;
+			}
+
+			for (int tri = 0; tri < 2; ++tri)
+			{
+				// Barycentrics in (s, t): triangle 0 is (0,0) (0,1) (1,1), triangle 1 is (0,0) (1,1) (1,0)
+				float bary[4][3];
+				bool covered[4];
+				int coveredCount = 0;
+				for (int l = 0; l < 4; ++l)
+				{
+					if (tri == 0)
+					{
+						bary[l][0] = 1.0f - t[l];
+						bary[l][1] = t[l] - s[l];
+						bary[l][2] = s[l];
+					}
+					else
+					{
+						bary[l][0] = 1.0f - s[l];
+						bary[l][1] = t[l];
+						bary[l][2] = s[l] - t[l];
+					}
+					// Pixels on the shared diagonal go to triangle 0
+					covered[l] = inFront[l] && bary[l][0] >= 0.0f && bary[l][1] >= 0.0f && bary[l][2] >= 0.0f && (tri == 0 || bary[l][2] > 0.0f);
+					coveredCount += covered[l];
+				}
+				if (coveredCount == 0)
+					continue;
+
+				SoftPixelInput input[4];
+				for (int l = 0; l < 4; ++l)
+				{
+					memset(&input[l], 0, sizeof(input[l]));
+					for (int k = 0; k < 3; ++k)
+					{
+						const SoftVertexOutput& v = shaded[g_QuadTriangles[tri][k]];
+						for (int c = 0; c < VARYING_COUNT; ++c)
+							input[l].varyings[c] += bary[l][k] * v.varyings[c];
+					}
+				}
+
+				float colors[4][4];
+				QuadStats stats;
+				long long start = Profiler::Now();
+				if (cone)
+					NORMALMAP_CONE_PS_Quad(cb, options.coneBudget, input, colors, &stats);
+				else
+					NORMALMAP_PS_Quad(cb, options.budget, input, colors, &stats);
+				shadeTicks += (double)(Profiler::Now() - start);
+
+				int slowest = 0;
+				for (int l = 0; l < 4; ++l)
+					slowest = std::max(slowest, stats.samples[l]);
+				result->quads++;
+				result->quadCost += slowest;
+				result->helperLanes += 4 - coveredCount;
+
+				float dx[2] = { input[1].varyings[VARYING_TEXCOORD] - input[0].varyings[VARYING_TEXCOORD],
+					input[1].varyings[VARYING_TEXCOORD + 1] - input[0].varyings[VARYING_TEXCOORD + 1] };
+				float dy[2] = { input[2].varyings[VARYING_TEXCOORD] - input[0].varyings[VARYING_TEXCOORD],
+					input[2].varyings[VARYING_TEXCOORD + 1] - input[0].varyings[VARYING_TEXCOORD + 1] };
+				for (int l = 0; l < 4; ++l)
+				{
+					if (!covered[l])
+						continue;
+					result->pixels++;
+					result->samples += stats.samples[l];
+					result->steps += stats.steps[l];
+					result->worstSamples = std::max(result->worstSamples, stats.samples[l]);
+					int x = qx + (l & 1), y = qy + (l >> 1);
+					memcpy(&(*image)[((size_t)y * options.width + x) * 4], colors[l], 4 * sizeof(float));
+
+					if (pixelIndex++ % options.refStride == 0)
+					{
+						float reference[2];
+						ParallaxReferenceOffset(cb, input[l], dx, dy, 256, reference);
+						float ex = (stats.offset[l][0] - reference[0]) * cb.ObjNormMap->Width();
+						float ey = (stats.offset[l][1] - reference[1]) * cb.ObjNormMap->Height();
+						result->errors.push_back(sqrtf(ex * ex + ey * ey));
+
+						float referenceColor[4], color[4];
+						ParallaxShadeAt(cb, input[l], reference, dx, dy, referenceColor);
+						ParallaxShadeAt(cb, input[l], stats.offset[l], dx, dy, color);
+						for (int c = 0; c < 3; ++c)
+						{
+							float e = (color[c] - referenceColor[c]) * 255.0f;
+							result->colorSquares += e * e;
+							result->worstColor = std::max(result->worstColor, fabsf(e));
+						}
+					}
+				}
+			}
+		}
+	}
+	result->seconds = shadeTicks / Profiler::TicksPerSecond();
+}
+
+bool WritePPM(const std::string& fileName, const std::vector<float>& image, int width, int height)
+{
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width * 3; ++x)
+		{
+			float v = image[((size_t)y * width + x / 3) * 4 + x % 3];
+			row[x] = (unsigned char)(Saturate(v) * 255.0f + 0.5f);
+		}
+		fwrite(&row[0], row.size(), 1, file);
+	}
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		fprintf(stderr, "usage: parallax_bench [-scales a,b,..] [-angles a,b,..] [-size WxH] [-path pom|cone|both]\n"
+			"                      [-steps max,min] [-cone steps,binary[,min]] [-repeat N] [-refstride N] [-light x,y,z]\n"
+			"                      [-out prefix] [-normalmap file.png] [-texture file.dds] [-conemap file.dds]\n");
+		return 1;
+	}
+
+	SoftMipTexture normalMap, diffuse, coneMap;
+	if (!LoadNormalMap(options.normalMap, &normalMap))
+	{
+		fprintf(stderr, "can't read %s\n", options.normalMap.c_str());
+		return 1;
+	}
+	if (!LoadDiffuse(options.texture, &diffuse))
+	{
+		printf("%s not usable, using white\n", options.texture.c_str());
+		const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		diffuse.Create(1, 1, white, false);
+	}
+	if (options.cone)
+	{
+		std::vector<ConeStepLevel> levels;
+		if (!LoadConeMap(options.coneMap, &levels))
+		{
+			long long start = Profiler::Now();
+			BakeConeMap(normalMap, &levels);
+			printf("%s not usable, baked the cone map in %.2f s\n", options.coneMap.c_str(),
+				(double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+		}
+		CreateConeTexture(levels, &coneMap);
+	}
+
+	// The sample's camera, light and sampler
+	XMVECTOR eye = XMVectorSet(0.0f, 0.0f, -5.0f, 0.0f);
+	XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, options.width / (float)options.height, 0.01f, 100.0f);
+
+	Constants cb;
+	cb.View = view;
+	XMStoreFloat4(&cb.EyePosition, eye);
+	cb.BaseTextureRepeat = options.repeat;
+	XMStoreFloat3(&cb.light.dir, XMVector3Normalize(XMVectorSet(options.light[0], options.light[1], options.light[2], 0.0f)));
+	cb.light.zz = 0.0f;
+	cb.light.ambient = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
+	cb.light.diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	cb.ObjTexture = &diffuse;
+	cb.ObjNormMap = &normalMap;
+	cb.ObjConeMap = &coneMap;
+	cb.ObjSamplerState = SoftLinearWrapSamplerDesc();
+
+	printf("%dx%d, pom steps lerp(%g, %g), cone steps %d + %d binary (min %g), texture repeat %g, ground truth every %d pixels\n\n",
+		options.width, options.height, options.budget.maxSteps, options.budget.minSteps, options.coneBudget.coneSteps,
+		options.coneBudget.binarySteps, options.coneBudget.minStep, options.repeat, options.refStride);
+	printf("%6s %6s %4s %8s %7s | %7s %6s %7s %6s | %7s %7s %7s %7s | %7s %7s | %8s\n", "scale", "angle", "path", "pixels", "helpers",
+		"reads/px", "worst", "quad/px", "steps", "err avg", "err p99", "err max", ">1 tx", "rgb rms", "rgb max", "Mpix/s");
+
+	std::vector<float> image;
+	for (size_t si = 0; si < options.scales.size(); ++si)
+	{
+		for (size_t ai = 0; ai < options.angles.size(); ++ai)
+		{
+			cb.HeightMapScale = options.scales[si];
+			cb.World = XMMatrixRotationY(options.angles[ai] * XM_PI / 180.0f);
+			cb.WVP = cb.World * view * projection;
+
+			SoftVertexOutput shaded[4];
+			XMFLOAT3 corner[4];
+			for (int v = 0; v < 4; ++v)
+			{
+				NORMALMAP_VS(&cb, &g_QuadVertices[v], &shaded[v]);
+				XMStoreFloat3(&corner[v], XMVector3Transform(XMLoadFloat3(&g_QuadVertices[v].Pos), cb.World));
+			}
+
+			for (int path = 0; path < 2; ++path)
+			{
+				bool cone = path == 1;
+				if (!(cone ? options.cone : options.pom))
+					continue;
+
+				Result result;
+				ShadeConfiguration(cb, options, cone, eye, 1.0f, shaded, corner, &image, &result);
+				if (result.pixels == 0)
+				{
+					printf("%6.3f %6.1f no pixels\n", options.scales[si], options.angles[ai]);
+					break;
+				}
+
+				std::vector<float>& errors = result.errors;
+				std::sort(errors.begin(), errors.end());
+				double errorSum = 0.0;
+				size_t above = 0;
+				for (size_t i = 0; i < errors.size(); ++i)
+				{
+					errorSum += errors[i];
+					above += errors[i] > 1.0f;
+				}
+				float p99 = errors.empty() ? 0.0f : errors[std::min(errors.size() - 1, errors.size() * 99 / 100)];
+				float maxError = errors.empty() ? 0.0f : errors.back();
+				double pixels = (double)result.pixels;
+				printf("%6.3f %6.1f %4s %8llu %6.1f%% | %7.2f %6d %7.2f %6.1f | %7.3f %7.3f %7.2f %6.2f%% | %7.2f %7.1f | %8.2f\n",
+					options.scales[si], options.angles[ai], cone ? "cone" : "pom", result.pixels, 100.0 * result.helperLanes / (result.quads * 4.0),
+					result.samples / pixels, result.worstSamples, result.quadCost * 4.0 / (result.quads * 4.0 - result.helperLanes),
+					result.steps / pixels, errors.empty() ? 0.0 : errorSum / errors.size(), p99, maxError,
+					errors.empty() ? 0.0 : 100.0 * above / errors.size(), errors.empty() ? 0.0 : sqrt(result.colorSquares / (errors.size() * 3.0)),
+					result.worstColor, pixels / result.seconds / 1e6);
+
+				if (!options.outPrefix.empty())
+				{
+					char name[64];
+					sprintf(name, "%s_scale%.3f_angle%.0f.ppm", cone ? "cone" : "pom", options.scales[si], options.angles[ai]);
+					WritePPM(options.outPrefix + name, image, options.width, options.height);
+				}
+			}
+		}
+	}
+
+	printf("\nreads/px: height map reads per covered pixel. quad/px: lockstep cost, the slowest lane of\n"
+		"each quad times 4, per covered pixel. steps: average nNumSteps for pom, cone steps taken for\n"
+		"cone. err: distance of the final offset from the ground truth, in texels of the top mip.\n"
+		"rgb: color error from the offset error alone, in 8 bit steps.\n");
+	return 0;
+}
@@ -0,0 +1,465 @@
+//--------------------------------------------------------------------------------------
+// File: parallax_shaders.h
+//
+// C++ versions of NORMALMAP_VS, NORMALMAP_PS and NORMALMAP_CONE_PS in
+// Tutorial05_Parallax/Tutorial05.fx. The pixel shaders run on a 2x2 pixel quad the way
+// the GPU does: the four lanes march in lockstep until the last one finds the surface,
+// ddx/ddy are coarse quad differences, and helper lanes (pixels outside the triangle)
+// march too. Per lane sample counts are returned so callers can see what the
+// data-dependent loops cost.
+//
+// As in sky_mapping_shaders.h the matrices are the untransposed ones. vNormalWS and
+// vViewWS are left out of the vertex output: the pixel shader normalizes them and never
+// reads the result.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "../Common/xnamath_portable.h"
+#include "../Common/soft_rasterizer.h"
+#include "../Common/soft_sampler.h"
+#include "shader_math.h"
+
+namespace ParallaxFx
+{
+
+// SimpleVertex and its POSITION/NORMAL/TEXCOORD/TANGENT layout
+struct Vertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 UV;
+	XMFLOAT3 Tangent;
+};
+
+struct Light
+{
+	XMFLOAT3 dir;
+	float zz;
+	XMFLOAT4 ambient;
+	XMFLOAT4 diffuse;
+};
+
+// cbPerFrame and cbPerObject plus the bound textures and sampler
+struct Constants
+{
+	XMMATRIX WVP;
+	XMMATRIX World;
+	XMMATRIX View;
+	XMFLOAT4 EyePosition;
+	float BaseTextureRepeat;
+	float HeightMapScale;
+	Light light;
+	const SoftMipTexture* ObjTexture;
+	const SoftMipTexture* ObjNormMap;		// normal in rgb, height in alpha
+	const SoftMipTexture* ObjConeMap;		// height in r, sqrt(cone ratio) in g
+	SoftSamplerDesc ObjSamplerState;
+};
+
+// nNumSteps = (int) lerp(maxSteps, minSteps, vViewTS.z); the shader uses 50 and 8
+struct StepBudget
+{
+	float maxSteps;
+	float minSteps;
+};
+
+inline StepBudget ShaderStepBudget()
+{
+	StepBudget budget = { 50.0f, 8.0f };
+	return budget;
+}
+
+// CONE_STEPS, BINARY_STEPS and MIN_CONE_STEP of NORMALMAP_CONE_PS
+struct ConeStepBudget
+{
+	int coneSteps;
+	int binarySteps;
+	float minStep;			// depth, keeps grazing rays from stalling; longer than the cone allows when taken
+};
+
+inline ConeStepBudget ShaderConeStepBudget()
+{
+	ConeStepBudget budget = { 16, 4, 1.0f / 32.0f };
+	return budget;
+}
+
+// NORMALMAP_VS_OUTPUT without vNormalWS/vViewWS
+enum
+{
+	VARYING_TEXCOORD = 0,			// 2 floats
+	VARYING_LIGHT_TS = 2,			// 3 floats, denormalized
+	VARYING_VIEW_TS = 5,			// 3 floats, denormalized
+	VARYING_PARALLAX_OFFSET_TS = 8,	// 2 floats
+	VARYING_COUNT = 10,
+};
+
+inline void NORMALMAP_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const Vertex& v = *(const Vertex*)vertex;
+
+	// Make sure tangent is completely orthogonal to normal
+	XMVECTOR normal = XMLoadFloat3(&v.Normal);
+	XMVECTOR tangent = XMLoadFloat3(&v.Tangent);
+	tangent = XMVector3Normalize(tangent - XMVectorMultiply(XMVector3Dot(tangent, normal), normal));
+
+	XMVECTOR vNormalWS = XMVector3Normalize(XMVector3TransformNormal(normal, cb.World));
+	XMVECTOR vTangentWS = XMVector3Normalize(XMVector3TransformNormal(tangent, cb.World));
+	XMVECTOR vBiTangentWS = XMVector3Normalize(XMVector3TransformNormal(XMVector3Cross(normal, tangent), cb.World));
+
+	// mul(TBN, v) with the TBN rows tangent, bitangent, normal
+	XMVECTOR lightDir = XMLoadFloat3(&cb.light.dir);
+	XMVECTOR vLightTS = XMVectorSet(XMVectorGetX(XMVector3Dot(vTangentWS, lightDir)),
+		XMVectorGetX(XMVector3Dot(vBiTangentWS, lightDir)), XMVectorGetX(XMVector3Dot(vNormalWS, lightDir)), 0.0f);
+
+	XMVECTOR pos = XMLoadFloat3(&v.Pos);
+	StorePosition(XMVector3Transform(pos, cb.WVP), output);
+	output->varyings[VARYING_TEXCOORD] = v.UV.x * cb.BaseTextureRepeat;
+	output->varyings[VARYING_TEXCOORD + 1] = v.UV.y * cb.BaseTextureRepeat;
+	StoreVaryings3(vLightTS, output, VARYING_LIGHT_TS);
+
+	XMVECTOR vViewWS = XMLoadFloat4(&cb.EyePosition) - XMVector3Transform(pos, cb.World);
+	float viewTS[3] = {
+		XMVectorGetX(XMVector3Dot(vTangentWS, vViewWS)),
+		XMVectorGetX(XMVector3Dot(vBiTangentWS, vViewWS)),
+		XMVectorGetX(XMVector3Dot(vNormalWS, vViewWS)) };
+	output->varyings[VARYING_VIEW_TS] = viewTS[0];
+	output->varyings[VARYING_VIEW_TS + 1] = viewTS[1];
+	output->varyings[VARYING_VIEW_TS + 2] = viewTS[2];
+
+	// Parallax displacement direction and length for the full height range
+	float lengthXY = sqrtf(viewTS[0] * viewTS[0] + viewTS[1] * viewTS[1]);
+	float fParallaxLimit = -lengthXY / viewTS[2] * cb.HeightMapScale;
+	float scale = lengthXY > 0.0f ? fParallaxLimit / lengthXY : 0.0f;
+	output->varyings[VARYING_PARALLAX_OFFSET_TS] = viewTS[0] * scale;
+	output->varyings[VARYING_PARALLAX_OFFSET_TS + 1] = viewTS[1] * scale;
+}
+
+// Lanes are the quad's top-left, top-right, bottom-left and bottom-right pixels
+struct QuadStats
+{
+	int samples[4];			// height map reads per lane
+	int steps[4];			// nNumSteps per lane
+	float offset[4][2];		// final vCurrOffset
+};
+
+// The end of both pixel shaders: normal and diffuse at the displaced coordinates
+inline void ShadeQuad(const Constants& cb, const float texCoord[2][4], const float currOffset[2][4], const float lightTS[4][3], float colors[4][4], QuadStats* stats)
+{
+	// Sample() takes its derivatives from the displaced coordinates
+	float texSample[2][4], sdx[2][4], sdy[2][4];
+	for (int l = 0; l < 4; ++l)
+	{
+		texSample[0][l] = texCoord[0][l] + currOffset[0][l];
+		texSample[1][l] = texCoord[1][l] + currOffset[1][l];
+		stats->offset[l][0] = currOffset[0][l];
+		stats->offset[l][1] = currOffset[1][l];
+	}
+	for (int c = 0; c < 2; ++c)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			sdx[c][l] = texSample[c][1] - texSample[c][0];
+			sdy[c][l] = texSample[c][2] - texSample[c][0];
+		}
+	}
+
+	float normalMap[4][4], diffuse[4][4];
+	cb.ObjNormMap->SampleGrad4(cb.ObjSamplerState, texSample, sdx, sdy, normalMap);
+	cb.ObjTexture->SampleGrad4(cb.ObjSamplerState, texSample, sdx, sdy, diffuse);
+	for (int l = 0; l < 4; ++l)
+	{
+		// normalize() runs on the float4, height included, before the .xyz swizzle
+		float n[4];
+		for (int c = 0; c < 4; ++c)
+			n[c] = normalMap[l][c] * 2.0f - 1.0f;
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] + n[3] * n[3]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		float nDotL = (n[0] * lightTS[l][0] + n[1] * lightTS[l][1] + n[2] * lightTS[l][2]) * scale;
+		const float lightDiffuse[3] = { cb.light.diffuse.x, cb.light.diffuse.y, cb.light.diffuse.z };
+		for (int c = 0; c < 3; ++c)
+			colors[l][c] = Saturate(nDotL * lightDiffuse[c] * diffuse[l][c]);
+		colors[l][3] = diffuse[l][3];
+	}
+}
+
+inline void NORMALMAP_PS_Quad(const Constants& cb, const StepBudget& budget, const SoftPixelInput input[4], float colors[4][4], QuadStats* stats)
+{
+	float texCoord[2][4], parallax[2][4], lightTS[4][3];
+	int numSteps[4];
+	float stepSize[4];
+	for (int l = 0; l < 4; ++l)
+	{
+		const float* v = input[l].varyings;
+		texCoord[0][l] = v[VARYING_TEXCOORD];
+		texCoord[1][l] = v[VARYING_TEXCOORD + 1];
+		parallax[0][l] = v[VARYING_PARALLAX_OFFSET_TS];
+		parallax[1][l] = v[VARYING_PARALLAX_OFFSET_TS + 1];
+
+		Normalize3(&v[VARYING_LIGHT_TS], lightTS[l]);
+		lightTS[l][1] = -lightTS[l][1];
+		float viewTS[3];
+		Normalize3(&v[VARYING_VIEW_TS], viewTS);
+		numSteps[l] = std::max((int)(budget.maxSteps + (budget.minSteps - budget.maxSteps) * viewTS[2]), 1);
+		stepSize[l] = 1.0f / (float)numSteps[l];
+		stats->steps[l] = numSteps[l];
+		stats->samples[l] = 0;
+	}
+
+	// ddx/ddy of i.texCoord, the same for the whole quad
+	float dx[2][4], dy[2][4];
+	for (int c = 0; c < 2; ++c)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			dx[c][l] = texCoord[c][1] - texCoord[c][0];
+			dy[c][l] = texCoord[c][2] - texCoord[c][0];
+		}
+	}
+
+	// The march, one SampleGrad per iteration for every lane still looking
+	float currOffset[2][4] = { { 0.0f }, { 0.0f } }, lastOffset[2][4] = { { 0.0f }, { 0.0f } };
+	float currentBound[4] = { 1.0f, 1.0f, 1.0f, 1.0f }, prevHeight[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	int stepIndex[4] = { 0, 0, 0, 0 };
+	for (;;)
+	{
+		bool any = false;
+		for (int l = 0; l < 4; ++l)
+			any |= stepIndex[l] < numSteps[l];
+		if (!any)
+			break;
+
+		float uv[2][4], height[4][4];
+		for (int l = 0; l < 4; ++l)
+		{
+			uv[0][l] = texCoord[0][l] + currOffset[0][l];
+			uv[1][l] = texCoord[1][l] + currOffset[1][l];
+		}
+		cb.ObjNormMap->SampleGrad4(cb.ObjSamplerState, uv, dx, dy, height);
+
+		for (int l = 0; l < 4; ++l)
+		{
+			if (stepIndex[l] >= numSteps[l])
+				continue;
+			stats->samples[l]++;
+			float fCurrHeight = height[l][3];
+			if (fCurrHeight > currentBound[l])
+			{
+				float delta1 = fCurrHeight - currentBound[l];
+				float delta2 = (currentBound[l] + stepSize[l]) - prevHeight[l];
+				float ratio = delta1 / (delta1 + delta2);
+				currOffset[0][l] = ratio * lastOffset[0][l] + (1.0f - ratio) * currOffset[0][l];
+				currOffset[1][l] = ratio * lastOffset[1][l] + (1.0f - ratio) * currOffset[1][l];
+				stepIndex[l] = numSteps[l] + 1;
+			}
+			else
+			{
+				currentBound[l] -= stepSize[l];
+				stepIndex[l]++;
+				prevHeight[l] = fCurrHeight;
+				lastOffset[0][l] = currOffset[0][l];
+				lastOffset[1][l] = currOffset[1][l];
+				currOffset[0][l] += stepSize[l] * parallax[0][l];
+				currOffset[1][l] += stepSize[l] * parallax[1][l];
+			}
+		}
+	}
+
+	ShadeQuad(cb, texCoord, currOffset, lightTS, colors, stats);
+}
+
+// Relaxed cone stepping: a step to the edge of the cone under the ray crosses the
+// surface at most once, so the ray is below it right after the first crossing. A binary
+// search over the last step and a secant between its ends find the hit. Near the surface
+// the cones shrink and a grazing ray would creep along it, hence the minimum step; when
+// it is taken the step is longer than the cone allows, and the ray can go through a
+// feature thinner than minStep. Lanes still above the surface after coneSteps use the
+// last position. stats->steps counts cone steps taken.
+inline void NORMALMAP_CONE_PS_Quad(const Constants& cb, const ConeStepBudget& budget, const SoftPixelInput input[4], float colors[4][4], QuadStats* stats)
+{
+	float texCoord[2][4], rayDir[3][4], rayRatio[4], lightTS[4][3];
+	for (int l = 0; l < 4; ++l)
+	{
+		const float* v = input[l].varyings;
+		texCoord[0][l] = v[VARYING_TEXCOORD];
+		texCoord[1][l] = v[VARYING_TEXCOORD + 1];
+		rayDir[0][l] = v[VARYING_PARALLAX_OFFSET_TS];
+		rayDir[1][l] = v[VARYING_PARALLAX_OFFSET_TS + 1];
+		rayDir[2][l] = 1.0f;
+		rayRatio[l] = sqrtf(rayDir[0][l] * rayDir[0][l] + rayDir[1][l] * rayDir[1][l]);
+
+		Normalize3(&v[VARYING_LIGHT_TS], lightTS[l]);
+		lightTS[l][1] = -lightTS[l][1];
+		stats->steps[l] = 0;
+		stats->samples[l] = 0;
+	}
+
+	float dx[2][4], dy[2][4];
+	for (int c = 0; c < 2; ++c)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			dx[c][l] = texCoord[c][1] - texCoord[c][0];
+			dy[c][l] = texCoord[c][2] - texCoord[c][0];
+		}
+	}
+
+	// Offset from texCoord and depth below the top; gap is the surface depth minus the
+	// ray depth, positive above the surface
+	float rayPos[3][4] = { { 0.0f }, { 0.0f }, { 0.0f } }, prevPos[3][4] = { { 0.0f }, { 0.0f }, { 0.0f } };
+	float gap[4] = { 0.0f }, prevGap[4] = { 0.0f };
+	bool marching[4] = { true, true, true, true }, crossed[4] = { false, false, false, false };
+	for (int step = 0; step < budget.coneSteps; ++step)
+	{
+		if (!(marching[0] || marching[1] || marching[2] || marching[3]))
+			break;
+
+		float uv[2][4], cone[4][4];
+		for (int l = 0; l < 4; ++l)
+		{
+			uv[0][l] = texCoord[0][l] + rayPos[0][l];
+			uv[1][l] = texCoord[1][l] + rayPos[1][l];
+		}
+		cb.ObjConeMap->SampleGrad4(cb.ObjSamplerState, uv, dx, dy, cone);
+
+		for (int l = 0; l < 4; ++l)
+		{
+			if (!marching[l])
+				continue;
+			stats->samples[l]++;
+			gap[l] = (1.0f - cone[l][0]) - rayPos[2][l];
+			if (gap[l] <= 0.0f)
+			{
+				crossed[l] = true;
+				marching[l] = false;
+				continue;
+			}
+			float coneRatio = cone[l][1] * cone[l][1];
+			float distance = std::max(coneRatio * gap[l] / (rayRatio[l] + coneRatio), budget.minStep);
+			prevGap[l] = gap[l];
+			for (int c = 0; c < 3; ++c)
+			{
+				prevPos[c][l] = rayPos[c][l];
+				rayPos[c][l] += rayDir[c][l] * distance;
+			}
+			stats->steps[l]++;
+		}
+	}
+
+	if (crossed[0] || crossed[1] || crossed[2] || crossed[3])
+	{
+		for (int step = 0; step < budget.binarySteps; ++step)
+		{
+			float mid[3][4], uv[2][4], cone[4][4];
+			for (int l = 0; l < 4; ++l)
+			{
+				for (int c = 0; c < 3; ++c)
+					mid[c][l] = 0.5f * (prevPos[c][l] + rayPos[c][l]);
+				uv[0][l] = texCoord[0][l] + mid[0][l];
+				uv[1][l] = texCoord[1][l] + mid[1][l];
+			}
+			cb.ObjConeMap->SampleGrad4(cb.ObjSamplerState, uv, dx, dy, cone);
+
+			for (int l = 0; l < 4; ++l)
+			{
+				if (!crossed[l])
+					continue;
+				stats->samples[l]++;
+				float midGap = (1.0f - cone[l][0]) - mid[2][l];
+				float (*end)[4] = midGap > 0.0f ? prevPos : rayPos;
+				for (int c = 0; c < 3; ++c)
+					end[c][l] = mid[c][l];
+				if (midGap > 0.0f)
+					prevGap[l] = midGap;
+				else
+					gap[l] = midGap;
+			}
+		}
+		for (int l = 0; l < 4; ++l)
+		{
+			if (!crossed[l])
+				continue;
+			float t = prevGap[l] / std::max(prevGap[l] - gap[l], 1e-6f);
+			for (int c = 0; c < 2; ++c)
+				rayPos[c][l] = prevPos[c][l] + (rayPos[c][l] - prevPos[c][l]) * t;
+		}
+	}
+
+	float currOffset[2][4];
+	for (int l = 0; l < 4; ++l)
+	{
+		currOffset[0][l] = rayPos[0][l];
+		currOffset[1][l] = rayPos[1][l];
+	}
+	ShadeQuad(cb, texCoord, currOffset, lightTS, colors, stats);
+}
+
+// Ground truth for one pixel: the same ray and the same filtered height field, marched
+// in `steps` uniform steps and refined by bisection, so the only difference from the
+// shader is where along the ray the surface is found
+inline void ParallaxReferenceOffset(const Constants& cb, const SoftPixelInput& input, const float dx[2], const float dy[2], int steps, float offset[2])
+{
+	const float* v = input.varyings;
+	float u0 = v[VARYING_TEXCOORD], v0 = v[VARYING_TEXCOORD + 1];
+	float px = v[VARYING_PARALLAX_OFFSET_TS], py = v[VARYING_PARALLAX_OFFSET_TS + 1];
+
+	// Height above the surface along the ray: bound(t) = 1 - t, hit where height > bound
+	float previous = 0.0f, t = 0.0f;
+	bool hit = false;
+	for (int i = 0; i <= steps; ++i)
+	{
+		t = (float)i / steps;
+		float color[4];
+		cb.ObjNormMap->SampleGrad(cb.ObjSamplerState, u0 + t * px, v0 + t * py, dx[0], dx[1], dy[0], dy[1], color);
+		if (color[3] > 1.0f - t)
+		{
+			hit = true;
+			break;
+		}
+		previous = t;
+	}
+	if (hit && t > 0.0f)
+	{
+		float low = previous, high = t;
+		for (int i = 0; i < 16; ++i)
+		{
+			float mid = 0.5f * (low + high);
+			float color[4];
+			cb.ObjNormMap->SampleGrad(cb.ObjSamplerState, u0 + mid * px, v0 + mid * py, dx[0], dx[1], dy[0], dy[1], color);
+			if (color[3] > 1.0f - mid)
+				high = mid;
+			else
+				low = mid;
+		}
+		t = 0.5f * (low + high);
+	}
+	offset[0] = t * px;
+	offset[1] = t * py;
+}
+
+// One pixel shaded at a given offset with the undisplaced derivatives, so the colors
+// of two offsets for the same pixel differ only by where the surface was found
+inline void ParallaxShadeAt(const Constants& cb, const SoftPixelInput& input, const float offset[2], const float dx[2], const float dy[2], float color[4])
+{
+	const float* v = input.varyings;
+	float lightTS[3];
+	Normalize3(&v[VARYING_LIGHT_TS], lightTS);
+	lightTS[1] = -lightTS[1];
+
+	float u = v[VARYING_TEXCOORD] + offset[0], w = v[VARYING_TEXCOORD + 1] + offset[1];
+	float normalMap[4], diffuse[4];
+	cb.ObjNormMap->SampleGrad(cb.ObjSamplerState, u, w, dx[0], dx[1], dy[0], dy[1], normalMap);
+	cb.ObjTexture->SampleGrad(cb.ObjSamplerState, u, w, dx[0], dx[1], dy[0], dy[1], diffuse);
+
+	float n[4];
+	for (int c = 0; c < 4; ++c)
+		n[c] = normalMap[c] * 2.0f - 1.0f;
+	float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] + n[3] * n[3]);
+	float scale = length > 0.0f ? 1.0f / length : 0.0f;
+	float nDotL = (n[0] * lightTS[0] + n[1] * lightTS[1] + n[2] * lightTS[2]) * scale;
+	const float lightDiffuse[3] = { cb.light.diffuse.x, cb.light.diffuse.y, cb.light.diffuse.z };
+	for (int c = 0; c < 3; ++c)
+		color[c] = Saturate(nDotL * lightDiffuse[c] * diffuse[c]);
+	color[3] = diffuse[3];
+}
+
+}
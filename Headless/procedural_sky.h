@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// File: procedural_sky.h
+//
+// The sky the headless tools use when no cube map DDS is readable: a gradient over a
+// dark ground with a grid, so reflections and filtering are easy to judge and the
+// output is the same on every machine.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+
+// d must be normalized
+inline void ProceduralSkyColor(const float d[3], float color[4])
+{
+	if (d[1] >= 0.0f)
+	{
+		color[0] = 0.55f - 0.35f * d[1];
+		color[1] = 0.7f - 0.3f * d[1];
+		color[2] = 0.95f - 0.1f * d[1];
+	}
+	else
+	{
+		float u = d[0] / -d[1], v = d[2] / -d[1];
+		bool line = fabsf(u - floorf(u + 0.5f)) < 0.03f || fabsf(v - floorf(v + 0.5f)) < 0.03f;
+		color[0] = line ? 0.8f : 0.25f;
+		color[1] = line ? 0.8f : 0.2f;
+		color[2] = line ? 0.8f : 0.15f;
+	}
+	color[3] = 1.0f;
+}
@@ -0,0 +1,234 @@
+//--------------------------------------------------------------------------------------
+// File: shader_cache_check.cpp
+//
+// Checks the cache logic in Common/shader_cache.h against a stub ShaderCompiler that
+// serves effect files from memory and "compiles" them into bytes derived from all of
+// its inputs. A cold cache must miss on every entry and preprocess each file/define set
+// once; a second ShaderCache on the same directory, standing in for the next launch,
+// must hit on every entry without compiling and return the same bytecode; and changing
+// the source, an included file, a define, the profile or the flags must miss once and
+// hit again after that.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 shader_cache_check.cpp -o shader_cache_check
+//   cl /O2 /EHsc shader_cache_check.cpp
+//
+// Usage: shader_cache_check [cacheDirectory]
+// The directory (shader_cache_check.cache by default) is removed before and after the run.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "../Common/shader_cache.h"
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------------------------------
+// Effect files live in a map; a line "#include name" pulls in another entry, and the
+// defines are written out first, the way the real preprocessor expands them into the text
+//--------------------------------------------------------------------------------------
+class StubShaderCompiler : public ShaderCompiler
+{
+public:
+	std::map<std::wstring, std::string> files;
+	unsigned int preprocessCalls;
+	unsigned int compileCalls;
+
+	StubShaderCompiler() : preprocessCalls(0), compileCalls(0) {}
+
+	virtual bool Preprocess(const wchar_t* fileName, const ShaderDefine* defines, std::string* text, std::string* errors)
+	{
+		preprocessCalls++;
+		text->clear();
+		for (const ShaderDefine* define = defines; define && define->name; ++define)
+			*text += std::string("#define ") + define->name + " " + (define->definition ? define->definition : "") + "\n";
+		return Expand(fileName, text, errors);
+	}
+
+	virtual bool Compile(const std::string& text, const char* sourceName, const char* entryPoint, const char* profile,
+		unsigned int flags, std::vector<unsigned char>* bytecode, std::string* errors)
+	{
+		compileCalls++;
+		if (text.find(std::string("void ") + entryPoint + "(") == std::string::npos)
+		{
+			*errors = std::string(sourceName) + ": no entry point " + entryPoint;
+			return false;
+		}
+		char code[128];
+		sprintf(code, "%s:%s:%08x:%016llx", profile, entryPoint, flags, ShaderCache::Hash(text.data(), text.size()));
+		bytecode->assign(code, code + strlen(code));
+		return true;
+	}
+
+private:
+	bool Expand(const std::wstring& fileName, std::string* text, std::string* errors)
+	{
+		std::map<std::wstring, std::string>::const_iterator file = files.find(fileName);
+		if (file == files.end())
+		{
+			*errors = "missing file";
+			return false;
+		}
+		const std::string& source = file->second;
+		for (size_t start = 0; start < source.size();)
+		{
+			size_t end = source.find('\n', start);
+			end = end == std::string::npos ? source.size() : end + 1;
+			std::string line = source.substr(start, end - start);
+			if (line.compare(0, 9, "#include ") == 0)
+			{
+				std::string name = line.substr(9, line.find_last_not_of("\r\n") - 8);
+				if (!Expand(std::wstring(name.begin(), name.end()), text, errors))
+					return false;
+			}
+			else
+				*text += line;
+			start = end;
+		}
+		return true;
+	}
+};
+
+void RemoveCacheDirectory(const std::string& directory)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA((directory + "/*.cso").c_str(), &found);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+			remove((directory + "/" + found.cFileName).c_str());
+		while (FindNextFileA(find, &found));
+		FindClose(find);
+	}
+	RemoveDirectoryA(directory.c_str());
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == NULL)
+		return;
+	while (dirent* entry = readdir(dir))
+	{
+		size_t length = strlen(entry->d_name);
+		if (length > 4 && !strcmp(entry->d_name + length - 4, ".cso"))
+			remove((directory + "/" + entry->d_name).c_str());
+	}
+	closedir(dir);
+	rmdir(directory.c_str());
+#endif
+}
+
+// One GetBytecode call of the sample's kind
+struct ShaderRequest
+{
+	const wchar_t* fileName;
+	const char* entryPoint;
+	const char* profile;
+	unsigned int flags;
+	const ShaderDefine* defines;
+};
+
+static int g_Failures = 0;
+
+void Expect(bool condition, const char* what)
+{
+	printf("  %-60s %s\n", what, condition ? "ok" : "FAIL");
+	if (!condition)
+		g_Failures++;
+}
+
+// Runs the requests through a fresh ShaderCache and returns its statistics
+ShaderCacheStats Run(StubShaderCompiler* compiler, const std::string& directory, const ShaderRequest* requests, int count,
+	std::vector<std::vector<unsigned char> >* bytecodes = NULL)
+{
+	ShaderCache cache(compiler, directory);
+	compiler->preprocessCalls = 0;
+	compiler->compileCalls = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		std::vector<unsigned char> bytecode;
+		std::string errors;
+		if (!cache.GetBytecode(requests[i].fileName, requests[i].entryPoint, requests[i].profile, requests[i].flags,
+			requests[i].defines, &bytecode, &errors))
+			printf("  %s: %s\n", requests[i].entryPoint, errors.c_str());
+		if (bytecodes)
+			bytecodes->push_back(bytecode);
+	}
+	return cache.Stats();
+}
+
+// One changed request: a miss, then a hit for the same request
+void ExpectOneMiss(StubShaderCompiler* compiler, const std::string& directory, const ShaderRequest& request, const char* change)
+{
+	ShaderCacheStats first = Run(compiler, directory, &request, 1);
+	ShaderCacheStats second = Run(compiler, directory, &request, 1);
+	char what[128];
+	sprintf(what, "%s: miss, then hit", change);
+	Expect(first.misses == 1 && first.hits == 0 && second.hits == 1 && second.misses == 0, what);
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "shader_cache_check.cache";
+	if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+	{
+		fprintf(stderr, "usage: shader_cache_check [cacheDirectory]\n");
+		return 1;
+	}
+	if (argc == 2)
+		directory = argv[1];
+	RemoveCacheDirectory(directory);
+
+	StubShaderCompiler compiler;
+	compiler.files[L"Effects.fx"] = "#include Common.fxh\nvoid VS() {}\nvoid PS() {}\n";
+	compiler.files[L"Common.fxh"] = "float4 light;\n";
+
+	static const ShaderDefine noShadows[] = { { "SHADOWS", "0" }, { NULL, NULL } };
+	static const ShaderRequest requests[] =
+	{
+		{ L"Effects.fx", "VS", "vs_4_0", 0, NULL },
+		{ L"Effects.fx", "PS", "ps_4_0", 0, NULL },
+		{ L"Effects.fx", "PS", "ps_4_0", 0, noShadows },
+	};
+	const int requestCount = sizeof(requests) / sizeof(requests[0]);
+
+	printf("cold run\n");
+	std::vector<std::vector<unsigned char> > coldCode;
+	ShaderCacheStats cold = Run(&compiler, directory, requests, requestCount, &coldCode);
+	Expect(cold.misses == requestCount && cold.hits == 0 && cold.failures == 0, "every entry misses");
+	Expect(compiler.compileCalls == requestCount, "every entry is compiled");
+	Expect(compiler.preprocessCalls == 2, "each file/define set is preprocessed once");
+
+	printf("warm run\n");
+	std::vector<std::vector<unsigned char> > warmCode;
+	ShaderCacheStats warm = Run(&compiler, directory, requests, requestCount, &warmCode);
+	Expect(warm.hits == requestCount && warm.misses == 0 && warm.failures == 0, "every entry hits");
+	Expect(compiler.compileCalls == 0, "nothing is compiled");
+	Expect(warmCode == coldCode, "the bytecode read back is the bytecode compiled");
+
+	// Each change is made to a request whose unchanged entry is in the cache, so a hit
+	// would mean the change is missing from the key
+	printf("changed inputs\n");
+	static const ShaderDefine withShadows[] = { { "SHADOWS", "1" }, { NULL, NULL } };
+	ShaderRequest changed = requests[2];
+	changed.defines = withShadows;
+	ExpectOneMiss(&compiler, directory, changed, "define changed");
+	changed = requests[1];
+	changed.profile = "ps_5_0";
+	ExpectOneMiss(&compiler, directory, changed, "profile changed");
+	changed = requests[1];
+	changed.flags = 1;
+	ExpectOneMiss(&compiler, directory, changed, "flags changed");
+	compiler.files[L"Effects.fx"] += "// edited\n";
+	ExpectOneMiss(&compiler, directory, requests[0], "source edited");
+	compiler.files[L"Common.fxh"] += "float4 ambient;\n";
+	ExpectOneMiss(&compiler, directory, requests[0], "included file edited");
+
+	RemoveCacheDirectory(directory);
+	printf("\n%s\n", g_Failures ? "FAILED" : "all checks ok");
+	return g_Failures ? 1 : 0;
+}
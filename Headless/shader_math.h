@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// File: shader_math.h
+//
+// The handful of HLSL intrinsics the C++ shader ports need, on float arrays. Texture
+// reads of an unbound resource return zero, as in Direct3D 11.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include "../Common/xnamath_portable.h"
+#include "../Common/soft_rasterizer.h"
+#include "../Common/soft_sampler.h"
+
+inline float Saturate(float v)
+{
+	return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+inline float Dot3(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// In place is fine, out may alias v
+inline void Normalize3(const float v[3], float out[3])
+{
+	float length = sqrtf(Dot3(v, v));
+	float scale = length > 0.0f ? 1.0f / length : 0.0f;
+	out[0] = v[0] * scale;
+	out[1] = v[1] * scale;
+	out[2] = v[2] * scale;
+}
+
+// reflect(i, n) = i - 2 * dot(i, n) * n
+inline void Reflect3(const float i[3], const float n[3], float out[3])
+{
+	float d = 2.0f * Dot3(i, n);
+	out[0] = i[0] - d * n[0];
+	out[1] = i[1] - d * n[1];
+	out[2] = i[2] - d * n[2];
+}
+
+inline void StorePosition(FXMVECTOR position, SoftVertexOutput* output)
+{
+	XMFLOAT4 p;
+	XMStoreFloat4(&p, position);
+	output->position[0] = p.x;
+	output->position[1] = p.y;
+	output->position[2] = p.z;
+	output->position[3] = p.w;
+}
+
+inline void StoreVaryings3(FXMVECTOR v, SoftVertexOutput* output, int first)
+{
+	XMFLOAT3 f;
+	XMStoreFloat3(&f, v);
+	output->varyings[first] = f.x;
+	output->varyings[first + 1] = f.y;
+	output->varyings[first + 2] = f.z;
+}
+
+// ObjSamplerState: linear filtering, WRAP addressing. The rasterizer has no screen-space
+// derivatives, so the ports read the top mip like Sample does on a magnified texture.
+inline void SampleTexture(const SoftMipTexture* texture, float u, float v, float color[4])
+{
+	if (texture == NULL || texture->LevelCount() == 0)
+	{
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+		return;
+	}
+	texture->SampleLevel(SoftLinearWrapSamplerDesc(), u, v, 0.0f, color);
+}
+
+// Filters across face edges like the hardware; SampleLevel returns zero for an empty cube
+inline void SampleCube(const SoftMipCube* texture, const float direction[3], float color[4])
+{
+	if (texture == NULL)
+	{
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+		return;
+	}
+	texture->SampleLevel(SoftLinearWrapSamplerDesc(), direction, 0.0f, color);
+}
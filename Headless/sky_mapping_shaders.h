@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// File: sky_mapping_shaders.h
+//
+// C++ versions of the entry points in D3D11_sky_mapping/Effects.fx for the software
+// rasterizer. The matrices here are the untransposed ones: the sample uploads transposed
+// copies that HLSL reads column-major, which is the same row-vector multiply as below.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "../Common/xnamath_portable.h"
+#include "../Common/soft_rasterizer.h"
+#include "../Common/sh_irradiance.h"
+#include "../Common/env_map.h"
+#include "shader_math.h"
+
+namespace SkyMappingFx
+{
+
+// Same layout as the sample's Vertex and its POSITION/TEXCOORD/NORMAL input layout
+struct Vertex
+{
+	XMFLOAT3 pos;
+	XMFLOAT2 texCoord;
+	XMFLOAT3 normal;
+};
+
+struct Light
+{
+	XMFLOAT3 dir;
+	float pad;
+	XMFLOAT4 ambient;
+	XMFLOAT4 diffuse;
+};
+
+// cbPerObject and cbPerFrame plus the bound shader resources
+struct Constants
+{
+	XMMATRIX WVP;
+	XMMATRIX World;
+	XMFLOAT3 cameraPos;
+	float roughness;	// mip of REFLECT_PS; the cube is loaded without mips, the mirror
+	Light light;
+	SHIrradiance shIrradiance;
+	const SoftMipTexture* ObjTexture;
+	const SoftMipCube* SkyMap;
+	const SoftMipTexture* SkyOctahedral;
+	int skyOctahedral;
+	XMMATRIX skyInvViewProj;	// untransposed, like WVP
+};
+
+// The software rasterizer has no SV_VertexID, so SKY_TRIANGLE_VS reads it from a vertex
+// buffer holding 0, 1, 2
+struct SkyTriangleVertex
+{
+	unsigned int id;
+};
+
+// VS_OUTPUT: TexCoord in varyings 0-1, normal in 2-4
+inline void VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const Vertex& v = *(const Vertex*)vertex;
+	StorePosition(XMVector3Transform(XMLoadFloat3(&v.pos), cb.WVP), output);
+	output->varyings[0] = v.texCoord.x;
+	output->varyings[1] = v.texCoord.y;
+	StoreVaryings3(XMVector3TransformNormal(XMLoadFloat3(&v.normal), cb.World), output, 2);
+}
+
+inline void PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	float normal[3];
+	Normalize3(&input.varyings[2], normal);
+
+	float diffuse[4];
+	SampleTexture(cb.ObjTexture, input.varyings[0], input.varyings[1], diffuse);
+
+	float ambient[3];
+	EvaluateSHIrradiance(cb.shIrradiance, normal, ambient);
+	const float lightDiffuse[3] = { cb.light.diffuse.x, cb.light.diffuse.y, cb.light.diffuse.z };
+	const float lightDir[3] = { cb.light.dir.x, cb.light.dir.y, cb.light.dir.z };
+	float nDotL = Dot3(lightDir, normal);
+	for (int c = 0; c < 3; ++c)
+		color[c] = diffuse[c] * std::max(ambient[c], 0.0f) + Saturate(nDotL * lightDiffuse[c] * diffuse[c]);
+	color[3] = diffuse[3];
+}
+
+// SKYMAP_VS_OUTPUT: texCoord in varyings 0-2
+inline void SKYMAP_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const Vertex& v = *(const Vertex*)vertex;
+	// xyww, so the sky always lands on the far plane
+	XMVECTOR pos = XMVector3Transform(XMLoadFloat3(&v.pos), cb.WVP);
+	StorePosition(XMVectorSet(XMVectorGetX(pos), XMVectorGetY(pos), XMVectorGetW(pos), XMVectorGetW(pos)), output);
+	output->varyings[0] = v.pos.x;
+	output->varyings[1] = v.pos.y;
+	output->varyings[2] = v.pos.z;
+}
+
+// SKYMAP_VS_OUTPUT for one triangle over the screen: the far plane point under each
+// pixel, camera translation left out, is its view direction
+inline void SKY_TRIANGLE_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	unsigned int id = ((const SkyTriangleVertex*)vertex)->id;
+	XMVECTOR clip = XMVectorSet(id == 2 ? 3.0f : -1.0f, id == 1 ? 3.0f : -1.0f, 1.0f, 1.0f);
+	StorePosition(clip, output);
+	StoreVaryings3(XMVector3TransformCoord(clip, cb.skyInvViewProj), output, 0);
+}
+
+// SampleSky at roughness 0, the only level the loaded cube has
+inline void SampleSky(const Constants& cb, const float dir[3], float color[4])
+{
+	if (cb.skyOctahedral)
+	{
+		float u, v;
+		OctahedralUV(dir, cb.SkyOctahedral->Width(), &u, &v);
+		SampleTexture(cb.SkyOctahedral, u, v, color);
+		return;
+	}
+	SampleCube(cb.SkyMap, dir, color);
+}
+
+inline void SKYMAP_PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	SampleSky(cb, input.varyings, color);
+}
+
+inline void D2D_PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	SampleTexture(cb.ObjTexture, input.varyings[0], input.varyings[1], color);
+}
+
+// REFLECT_VS_OUTPUT: TexCoord in varyings 0-2, normal in 3-5, worldPos in 6-8
+inline void REFLECT_VS(const void* constants, const void* vertex, SoftVertexOutput* output)
+{
+	const Constants& cb = *(const Constants*)constants;
+	const Vertex& v = *(const Vertex*)vertex;
+	StorePosition(XMVector3Transform(XMLoadFloat3(&v.pos), cb.WVP), output);
+	output->varyings[0] = v.pos.x;
+	output->varyings[1] = v.pos.y;
+	output->varyings[2] = v.pos.z;
+	StoreVaryings3(XMVector3TransformNormal(XMLoadFloat3(&v.normal), cb.World), output, 3);
+	StoreVaryings3(XMVector3TransformCoord(XMLoadFloat3(&v.pos), cb.World), output, 6);
+}
+
+inline void REFLECT_PS(const void* constants, const SoftPixelInput& input, float color[4])
+{
+	const Constants& cb = *(const Constants*)constants;
+	float normal[3];
+	Normalize3(&input.varyings[3], normal);
+
+	float incident[3] = { input.varyings[6] - cb.cameraPos.x, input.varyings[7] - cb.cameraPos.y, input.varyings[8] - cb.cameraPos.z };
+	Normalize3(incident, incident);
+
+	float reflected[3];
+	Reflect3(incident, normal, reflected);
+	SampleSky(cb, reflected, color);
+}
+
+}
@@ -0,0 +1,287 @@
+//--------------------------------------------------------------------------------------
+// File: tangent_bench.cpp
+//
+// Timing and accuracy of Common/tangent_space.h against the ComputeTangentsII that
+// Tutorial05_NormalMap shipped before it, on the sample's meshes (Box.fbx and Disc.x by
+// default). Each mesh is loaded with assimp and every triangle mesh in it is processed
+// separately; the best of -passes runs of each routine is printed.
+//
+// The old routine reads its second corner as vertices[indices[i * 3] + 1] and solves
+// tcV1 * edge1 - tcV2 * edge2 where the tangent is tcV2 * edge1 - tcV1 * edge2, so its
+// output cannot be matched exactly; its mean deviation is printed as "old mean". The check
+// compares against its method with both fixed: the per-vertex sum of the faces' tangents,
+// normalized. Both are projected onto the normal plane and a mesh passes when the mean
+// difference is within -tolerance degrees. The largest difference and the vertices beyond
+// the tolerance are printed too; they come from the weighting, where the new routine
+// averages normalized face tangents by corner angle instead of summing them by 1/det.
+// Vertices the old math leaves undefined (degenerate UVs) are counted but not compared.
+// The exit code is 1 when a mesh fails.
+//
+// Needs assimp, whose headers come with the Tutorial05 samples:
+//   g++ -O2 -std=c++11 -pthread -I../Tutorial05_NormalMap/include tangent_bench.cpp -lassimp -o tangent_bench
+//   cl /O2 /EHsc /DXM_PORTABLE /I..\Tutorial05_NormalMap\include tangent_bench.cpp ..\Tutorial05_NormalMap\assimp-vc120-mt.lib
+//
+// Usage: tangent_bench [-passes N] [-threads N] [-tolerance degrees] [mesh files...]
+// -threads sizes the SoftThreadPool the new routine runs on, every hardware thread by default.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "../Common/xnamath_portable.h"
+#include "../Common/tangent_space.h"
+#include "../Common/profiler.h"
+
+typedef unsigned short WORD;
+
+// Tutorial05_NormalMap's vertex
+struct SimpleVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 UV;
+	XMFLOAT4 Tangent;
+};
+
+// The sample's ComputeTangentsII before the rewrite, without its per-vertex OutputDebugString
+void LegacyComputeTangents(SimpleVertex vertices[], int verticesCount, WORD indices[], int triangleCount)
+{
+	std::vector<XMFLOAT3> tempTangent;
+	XMFLOAT3 tangent = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	float tcU1, tcV1, tcU2, tcV2;
+	float vecX, vecY, vecZ;
+	XMVECTOR edge1 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR edge2 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+
+	for (int i = 0; i < triangleCount; ++i)
+	{
+		vecX = vertices[indices[(i * 3)] + 1].Pos.x - vertices[indices[(i * 3) + 0]].Pos.x;
+		vecY = vertices[indices[(i * 3)] + 1].Pos.y - vertices[indices[(i * 3) + 0]].Pos.y;
+		vecZ = vertices[indices[(i * 3)] + 1].Pos.z - vertices[indices[(i * 3) + 0]].Pos.z;
+		edge1 = XMVectorSet(vecX, vecY, vecZ, 0.0f);
+
+		vecX = vertices[indices[(i * 3) + 2]].Pos.x - vertices[indices[(i * 3) + 0]].Pos.x;
+		vecY = vertices[indices[(i * 3) + 2]].Pos.y - vertices[indices[(i * 3) + 0]].Pos.y;
+		vecZ = vertices[indices[(i * 3) + 2]].Pos.z - vertices[indices[(i * 3) + 0]].Pos.z;
+		edge2 = XMVectorSet(vecX, vecY, vecZ, 0.0f);
+
+		tcU1 = vertices[indices[(i * 3)] + 1].UV.x - vertices[indices[(i * 3) + 0]].UV.x;
+		tcV1 = vertices[indices[(i * 3)] + 1].UV.y - vertices[indices[(i * 3) + 0]].UV.y;
+		tcU2 = vertices[indices[(i * 3) + 2]].UV.x - vertices[indices[(i * 3) + 0]].UV.x;
+		tcV2 = vertices[indices[(i * 3) + 2]].UV.y - vertices[indices[(i * 3) + 0]].UV.y;
+
+		tangent.x = (tcV1 * XMVectorGetX(edge1) - tcV2 * XMVectorGetX(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
+		tangent.y = (tcV1 * XMVectorGetY(edge1) - tcV2 * XMVectorGetY(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
+		tangent.z = (tcV1 * XMVectorGetZ(edge1) - tcV2 * XMVectorGetZ(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
+		tempTangent.push_back(tangent);
+	}
+
+	XMVECTOR tangentSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+	int facesUsing = 0;
+	float tX, tY, tZ;
+	for (int i = 0; i < verticesCount; ++i)
+	{
+		for (int j = 0; j < triangleCount; ++j)
+		{
+			if (indices[j * 3] == i || indices[(j * 3) + 1] == i || indices[(j * 3) + 2] == i)
+			{
+				tX = XMVectorGetX(tangentSum) + tempTangent[j].x;
+				tY = XMVectorGetY(tangentSum) + tempTangent[j].y;
+				tZ = XMVectorGetZ(tangentSum) + tempTangent[j].z;
+				tangentSum = XMVectorSet(tX, tY, tZ, 0.0f);
+				facesUsing++;
+			}
+		}
+		tangentSum = tangentSum / (float)facesUsing;
+		tangentSum = XMVector3Normalize(tangentSum);
+		vertices[i].Tangent.x = XMVectorGetX(tangentSum);
+		vertices[i].Tangent.y = XMVectorGetY(tangentSum);
+		vertices[i].Tangent.z = XMVectorGetZ(tangentSum);
+		tangentSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+		facesUsing = 0;
+	}
+}
+
+// The old routine's per-vertex sum of face tangents, with both corners read and the
+// tangent solved correctly, in linear time
+void ReferenceTangents(const std::vector<SimpleVertex>& vertices, const std::vector<WORD>& indices, std::vector<XMFLOAT3>* tangents)
+{
+	std::vector<XMFLOAT3> sums(vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const SimpleVertex& v0 = vertices[indices[i]];
+		const SimpleVertex& v1 = vertices[indices[i + 1]];
+		const SimpleVertex& v2 = vertices[indices[i + 2]];
+		float e1[3] = { v1.Pos.x - v0.Pos.x, v1.Pos.y - v0.Pos.y, v1.Pos.z - v0.Pos.z };
+		float e2[3] = { v2.Pos.x - v0.Pos.x, v2.Pos.y - v0.Pos.y, v2.Pos.z - v0.Pos.z };
+		float tcU1 = v1.UV.x - v0.UV.x, tcV1 = v1.UV.y - v0.UV.y;
+		float tcU2 = v2.UV.x - v0.UV.x, tcV2 = v2.UV.y - v0.UV.y;
+		float r = 1.0f / (tcU1 * tcV2 - tcU2 * tcV1);
+		float t[3] = { (tcV2 * e1[0] - tcV1 * e2[0]) * r, (tcV2 * e1[1] - tcV1 * e2[1]) * r, (tcV2 * e1[2] - tcV1 * e2[2]) * r };
+		for (int c = 0; c < 3; ++c)
+		{
+			XMFLOAT3& sum = sums[indices[i + c]];
+			sum.x += t[0];
+			sum.y += t[1];
+			sum.z += t[2];
+		}
+	}
+	*tangents = sums;
+}
+
+struct TangentCheck
+{
+	float maxAngle;
+	float meanAngle;
+	int compared;
+	int over;
+	int undefined;
+};
+
+// Degrees between the reference and the computed tangents, both in the normal plane. The
+// bitangent sign is not compared, the old routine had none.
+void Check(const std::vector<SimpleVertex>& vertices, const std::vector<XMFLOAT3>& reference, float tolerance, TangentCheck* check)
+{
+	check->maxAngle = check->meanAngle = 0.0f;
+	check->compared = check->over = check->undefined = 0;
+	double sum = 0.0;
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertices[i].Normal));
+		XMVECTOR r = XMLoadFloat3(&reference[i]);
+		r = XMVectorSubtract(r, XMVectorMultiply(n, XMVector3Dot(n, r)));
+		float lengthSq = XMVectorGetX(XMVector3LengthSq(r));
+		if (!(lengthSq > 1e-12f) || lengthSq != lengthSq || lengthSq > 1e30f)
+		{
+			check->undefined++;
+			continue;
+		}
+		XMVECTOR t = XMLoadFloat3((const XMFLOAT3*)&vertices[i].Tangent);
+		float cosAngle = XMVectorGetX(XMVector3Dot(XMVector3Normalize(r), XMVector3Normalize(t)));
+		cosAngle = std::min(1.0f, std::max(-1.0f, cosAngle));
+		float angle = acosf(cosAngle) * (180.0f / XM_PI);
+		check->maxAngle = std::max(check->maxAngle, angle);
+		check->over += angle > tolerance;
+		sum += angle;
+		check->compared++;
+	}
+	if (check->compared)
+		check->meanAngle = (float)(sum / check->compared);
+}
+
+void LoadVertices(const aiMesh* mesh, std::vector<SimpleVertex>* vertices, std::vector<WORD>* indices)
+{
+	vertices->resize(mesh->mNumVertices);
+	for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+	{
+		SimpleVertex& v = (*vertices)[i];
+		v.Tangent = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+		v.Pos = XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		v.Normal = XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		v.UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+	}
+	indices->clear();
+	for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+	{
+		if (mesh->mFaces[i].mNumIndices != 3)
+			continue;
+		for (unsigned j = 0; j < 3; ++j)
+			indices->push_back((WORD)mesh->mFaces[i].mIndices[j]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int passes = 3;
+	int threads = 0;
+	float tolerance = 1.0f;
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-passes") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			passes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-tolerance") && i + 1 < argc && atof(argv[i + 1]) > 0.0)
+			tolerance = (float)atof(argv[++i]);
+		else if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "usage: tangent_bench [-passes N] [-threads N] [-tolerance degrees] [mesh files...]\n");
+			return 1;
+		}
+	}
+	if (files.empty())
+	{
+		files.push_back("../Tutorial05_NormalMap/Box.fbx");
+		files.push_back("../Tutorial05_NormalMap/Disc.x");
+	}
+
+	SoftThreadPool pool(threads);
+	printf("best of %d passes, %d threads, tolerance %.2f degrees\n\n", passes, pool.ThreadCount(), tolerance);
+	printf("%-24s %8s %8s %10s %10s %8s %9s %9s %6s %9s %6s %s\n", "mesh", "vertices", "tris", "old ms", "new ms", "speedup",
+		"max deg", "mean deg", "over", "old mean", "undef", "result");
+
+	bool failed = false;
+	for (size_t f = 0; f < files.size(); ++f)
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(files[f], aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+		if (scene == NULL || !scene->HasMeshes())
+		{
+			printf("%-24s could not be loaded\n", files[f]);
+			failed = true;
+			continue;
+		}
+
+		for (unsigned m = 0; m < scene->mNumMeshes; ++m)
+		{
+			const aiMesh* mesh = scene->mMeshes[m];
+			char name[64];
+			sprintf(name, "%.22s #%u", strrchr(files[f], '/') ? strrchr(files[f], '/') + 1 : files[f], m);
+			if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE) || !mesh->HasNormals() || !mesh->HasTextureCoords(0))
+				continue;
+			if (mesh->mNumVertices > 65536)
+			{
+				printf("%-24s %8u skipped, the old routine takes 16 bit indices\n", name, mesh->mNumVertices);
+				continue;
+			}
+
+			std::vector<SimpleVertex> source, vertices, legacyVertices;
+			std::vector<WORD> indices;
+			LoadVertices(mesh, &source, &indices);
+			int triangles = (int)indices.size() / 3;
+
+			double legacy = 1e30, best = 1e30;
+			for (int p = 0; p < passes; ++p)
+			{
+				legacyVertices = source;
+				long long start = Profiler::Now();
+				LegacyComputeTangents(&legacyVertices[0], (int)legacyVertices.size(), &indices[0], triangles);
+				legacy = std::min(legacy, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+
+				vertices = source;
+				start = Profiler::Now();
+				ComputeTangentSpace(&vertices[0], (int)vertices.size(), &indices[0], triangles, &pool);
+				best = std::min(best, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+			}
+
+			std::vector<XMFLOAT3> reference;
+			ReferenceTangents(source, indices, &reference);
+			TangentCheck check, legacyCheck;
+			Check(vertices, reference, tolerance, &check);
+			Check(legacyVertices, reference, tolerance, &legacyCheck);
+			bool pass = check.meanAngle <= tolerance;
+			failed |= !pass;
+			printf("%-24s %8d %8d %10.3f %10.3f %7.1fx %9.3f %9.3f %6d %9.3f %6d %s\n", name, (int)vertices.size(), triangles,
+				legacy * 1000.0, best * 1000.0, legacy / best, check.maxAngle, check.meanAngle, check.over, legacyCheck.meanAngle,
+				check.undefined, pass ? "ok" : "FAIL");
+		}
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+//--------------------------------------------------------------------------------------
+// File: texture_cooker.cpp
+//
+// Offline texture cooker: turns the samples' JPEG and PNG textures into block
+// compressed DDS files with a full mip chain, in the format that suits each texture's
+// role:
+//   albedo  BC1, or BC7 when the image has alpha (or with -albedo bc7)
+//   normal  BC5, the x and y of a tangent-space normal map; z is rebuilt in the shader
+//   height  BC4, the height field from the alpha of a normal map
+// For every texture it prints the PSNR of the top level over the channels the role
+// keeps, and the size against the R8G8B8A8 texture with mips D3DX would create.
+//
+// Mips come from Common/mip_generator.h: albedo is filtered in linear space, normal
+// maps are renormalized, and -coverage keeps the alpha test coverage of albedo with
+// alpha. The encoders are in Common/bc_encoder.h.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread texture_cooker.cpp -o texture_cooker
+//   cl /O2 /EHsc /DXM_PORTABLE texture_cooker.cpp
+//
+// Usage: texture_cooker [-threads N] [-albedo bc1|bc7|auto] [-filter box|kaiser|lanczos]
+//                       [-coverage ref] [role input output]...
+// Without textures on the command line it cooks the samples' textures in place (run
+// from the Headless directory); missing inputs are reported and skipped.
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "../Common/png_reader.h"
+#include "../Common/jpeg_reader.h"
+#include "../Common/dds_writer.h"
+#include "../Common/bc_encoder.h"
+#include "../Common/mip_generator.h"
+#include "../Common/profiler.h"
+
+struct CookJob
+{
+	std::string role;
+	std::string input;
+	std::string output;
+};
+
+struct CookSettings
+{
+	std::string albedoFormat;	// bc1, bc7 or auto
+	MipFilter filter;
+	float alphaCoverage;		// alpha test reference of albedo textures, 0 for none
+};
+
+static const CookJob g_DefaultJobs[] =
+{
+	{ "albedo", "../D3D11Lighting/D3D11Lighting/braynzar.jpg", "../D3D11Lighting/D3D11Lighting/braynzar.dds" },
+	{ "albedo", "../D3D11_HRTimer/D3D11_HRTimer/braynzar.jpg", "../D3D11_HRTimer/D3D11_HRTimer/braynzar.dds" },
+	{ "albedo", "../D3D11_sky_mapping/D3D11_sky_mapping/grass.jpg", "../D3D11_sky_mapping/D3D11_sky_mapping/grass.dds" },
+	{ "normal", "../Tutorial05_Parallax/four_NM_height.png", "../Tutorial05_Parallax/four_NM_normal.dds" },
+	{ "height", "../Tutorial05_Parallax/four_NM_height.png", "../Tutorial05_Parallax/four_NM_height.dds" },
+	{ "normal", "../Tutorial05_NormalMap/grassNormal.png", "../Tutorial05_NormalMap/grassNormal.dds" },
+};
+
+bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size > 0;
+	if (ok)
+	{
+		data->resize(size);
+		ok = fread(&(*data)[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+// PNG or baseline JPEG, told apart by signature
+bool LoadSourceImage(const std::string& fileName, MipSurface* image)
+{
+	std::vector<unsigned char> data;
+	if (!ReadFile(fileName, &data) || data.size() < 4)
+		return false;
+	if (data[0] == 0xff && data[1] == 0xd8)
+	{
+		JPEGImage jpeg;
+		if (!DecodeJPEG(&data[0], data.size(), &jpeg))
+			return false;
+		image->width = jpeg.width;
+		image->height = jpeg.height;
+		image->rgba.swap(jpeg.rgba);
+		return true;
+	}
+	PNGImage png;
+	if (!DecodePNG(&data[0], data.size(), &png))
+		return false;
+	image->width = png.width;
+	image->height = png.height;
+	image->rgba.swap(png.rgba);
+	return true;
+}
+
+double PSNR(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int channels)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i += 4)
+	{
+		for (int c = 0; c < channels; ++c)
+		{
+			double d = (double)a[i + c] - b[i + c];
+			sum += d * d;
+		}
+	}
+	double mse = sum / (a.size() / 4 * channels);
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+const char* FormatName(unsigned int format)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_BC1_UNORM: return "BC1";
+	case DDS_FORMAT_BC3_UNORM: return "BC3";
+	case DDS_FORMAT_BC4_UNORM: return "BC4";
+	case DDS_FORMAT_BC5_UNORM: return "BC5";
+	case DDS_FORMAT_BC7_UNORM: return "BC7";
+	}
+	return "?";
+}
+
+//--------------------------------------------------------------------------------------
+// Cooks one texture, adds its sizes to the totals. Returns false on errors, true for
+// written or skipped textures.
+//--------------------------------------------------------------------------------------
+bool Cook(const CookJob& job, const CookSettings& settings, SoftThreadPool* pool, size_t* totalRaw, size_t* totalCooked)
+{
+	MipSurface source;
+	if (!LoadSourceImage(job.input, &source))
+	{
+		FILE* file = fopen(job.input.c_str(), "rb");
+		if (file == NULL)
+		{
+			printf("%-7s %s: missing, skipped\n", job.role.c_str(), job.input.c_str());
+			return true;
+		}
+		fclose(file);
+		fprintf(stderr, "can't decode %s\n", job.input.c_str());
+		return false;
+	}
+
+	// Pick the format and mip options, and move the channels the format keeps to where
+	// the hardware returns them
+	unsigned int format;
+	int channels;
+	MipOptions mipOptions;
+	mipOptions.filter = settings.filter;
+	if (job.role == "albedo")
+	{
+		bool alpha = false;
+		for (size_t i = 3; i < source.rgba.size() && !alpha; i += 4)
+			alpha = source.rgba[i] != 255;
+		bool bc7 = settings.albedoFormat == "bc7" || (settings.albedoFormat == "auto" && alpha);
+		format = bc7 ? DDS_FORMAT_BC7_UNORM : DDS_FORMAT_BC1_UNORM;
+		channels = bc7 && alpha ? 4 : 3;
+		mipOptions.srgb = true;
+		mipOptions.alphaCoverage = alpha ? settings.alphaCoverage : 0.0f;
+	}
+	else if (job.role == "normal")
+	{
+		format = DDS_FORMAT_BC5_UNORM;
+		channels = 2;
+		mipOptions.normalMap = true;
+	}
+	else if (job.role == "height")
+	{
+		for (size_t i = 0; i < source.rgba.size(); i += 4)
+			source.rgba[i] = source.rgba[i + 3];
+		format = DDS_FORMAT_BC4_UNORM;
+		channels = 1;
+	}
+	else
+	{
+		fprintf(stderr, "unknown role %s\n", job.role.c_str());
+		return false;
+	}
+
+	long long start = Profiler::Now();
+	std::vector<MipSurface> levels;
+	GenerateMips(mipOptions, source.width, source.height, &source.rgba[0], pool, &levels);
+	double mipSeconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+	const MipSurface& top = levels[0];
+	std::vector<std::vector<unsigned char> > blocks(levels.size());
+	size_t raw = 0, cooked = 0;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		BCCompressSurface(format, levels[i].width, levels[i].height, &levels[i].rgba[0], pool, &blocks[i]);
+		raw += levels[i].rgba.size();
+		cooked += blocks[i].size();
+	}
+	double seconds = (double)(Profiler::Now() - start) / Profiler::TicksPerSecond();
+
+	DDSImage dds;
+	dds.format = format;
+	dds.dimension = DDS_DIMENSION_TEXTURE2D;
+	dds.width = top.width;
+	dds.height = top.height;
+	dds.depth = 1;
+	dds.mipLevels = (unsigned int)levels.size();
+	dds.arraySize = 1;
+	dds.isCube = false;
+	dds.forceOpaqueAlpha = false;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		DDSSubresource sub;
+		unsigned int rowPitch, rowCount;
+		DDSSurfaceInfo(format, levels[i].width, levels[i].height, &rowPitch, &rowCount);
+		sub.data = &blocks[i][0];
+		sub.rowPitch = rowPitch;
+		sub.slicePitch = rowPitch * rowCount;
+		sub.width = levels[i].width;
+		sub.height = levels[i].height;
+		sub.depth = 1;
+		dds.subresources.push_back(sub);
+	}
+	if (!WriteDDS(job.output.c_str(), dds))
+	{
+		fprintf(stderr, "can't write %s\n", job.output.c_str());
+		return false;
+	}
+
+	std::vector<unsigned char> decoded;
+	BCDecompressSurface(format, top.width, top.height, &blocks[0][0], &decoded);
+	printf("%-7s %s -> %s\n        %s %dx%d, %u mips, PSNR %.2f dB, %u -> %u bytes (saved %u, %.1fx), %.1f ms (mips %.1f)\n",
+		job.role.c_str(), job.input.c_str(), job.output.c_str(), FormatName(format), top.width, top.height, dds.mipLevels,
+		PSNR(top.rgba, decoded, channels), (unsigned int)raw, (unsigned int)cooked, (unsigned int)(raw - cooked),
+		(double)raw / cooked, seconds * 1000.0, mipSeconds * 1000.0);
+	*totalRaw += raw;
+	*totalCooked += cooked;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<CookJob> jobs;
+	CookSettings settings;
+	settings.albedoFormat = "auto";
+	settings.filter = MIP_FILTER_KAISER;
+	settings.alphaCoverage = 0.0f;
+	int threads = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-albedo") && i + 1 < argc &&
+			(!strcmp(argv[i + 1], "bc1") || !strcmp(argv[i + 1], "bc7") || !strcmp(argv[i + 1], "auto")))
+			settings.albedoFormat = argv[++i];
+		else if (!strcmp(argv[i], "-filter") && i + 1 < argc && !strcmp(argv[i + 1], "box"))
+			settings.filter = MIP_FILTER_BOX, i++;
+		else if (!strcmp(argv[i], "-filter") && i + 1 < argc && !strcmp(argv[i + 1], "kaiser"))
+			settings.filter = MIP_FILTER_KAISER, i++;
+		else if (!strcmp(argv[i], "-filter") && i + 1 < argc && !strcmp(argv[i + 1], "lanczos"))
+			settings.filter = MIP_FILTER_LANCZOS, i++;
+		else if (!strcmp(argv[i], "-coverage") && i + 1 < argc)
+			settings.alphaCoverage = (float)atof(argv[++i]);
+		else if (argv[i][0] != '-' && i + 2 < argc)
+		{
+			CookJob job;
+			job.role = argv[i];
+			job.input = argv[i + 1];
+			job.output = argv[i + 2];
+			jobs.push_back(job);
+			i += 2;
+		}
+		else
+		{
+			fprintf(stderr, "usage: texture_cooker [-threads N] [-albedo bc1|bc7|auto] [-filter box|kaiser|lanczos]\n"
+				"                      [-coverage ref] [albedo|normal|height input output]...\n");
+			return 1;
+		}
+	}
+	if (jobs.empty())
+		jobs.assign(g_DefaultJobs, g_DefaultJobs + sizeof(g_DefaultJobs) / sizeof(g_DefaultJobs[0]));
+
+	SoftThreadPool pool(threads);
+	size_t totalRaw = 0, totalCooked = 0;
+	bool ok = true;
+	for (size_t i = 0; i < jobs.size(); ++i)
+		ok = Cook(jobs[i], settings, &pool, &totalRaw, &totalCooked) && ok;
+	if (totalCooked > 0)
+		printf("total %u -> %u bytes, saved %u on %d threads\n", (unsigned int)totalRaw, (unsigned int)totalCooked,
+			(unsigned int)(totalRaw - totalCooked), pool.ThreadCount());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------
+// File: transform_bench.cpp
+//
+// Throughput and accuracy of Common/transform_store.h. -objects transforms with random
+// positions, rotations and scales are composed into world and world-view-projection
+// matrices; the best of -passes runs gives the objects per second. The first line is
+// the samples' per-object path for comparison: Scale * Rotation * Translation, times
+// view * projection, and a transpose of each result.
+//
+// The store is then timed on the calling thread and on every hardware thread, and the
+// largest difference of its matrices from the per-object ones is printed. The last line
+// is ComposeWorld on the calling thread, the instanced samples' path. Build with
+// -mavx2 (/arch:AVX2) for the AVX2 path or -DTRANSFORM_STORE_SCALAR for the scalar one.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -std=c++11 -pthread transform_bench.cpp -o transform_bench
+//   cl /O2 /EHsc /DXM_PORTABLE transform_bench.cpp
+//
+// Usage: transform_bench [-objects N] [-passes N] [-threads N]
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "../Common/xnamath_portable.h"
+#include "../Common/transform_store.h"
+#include "../Common/profiler.h"
+
+struct Object
+{
+	XMFLOAT3 position;
+	XMFLOAT3 scale;
+	XMFLOAT3 axis;
+	float angle;
+};
+
+float Random(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rand() / RAND_MAX;
+}
+
+// The samples' UpdateScene and DrawScene, one object at a time
+void LegacyCompose(const std::vector<Object>& objects, CXMMATRIX view, CXMMATRIX projection, std::vector<XMMATRIX>* world,
+	std::vector<XMMATRIX>* wvp)
+{
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		const Object& o = objects[i];
+		XMMATRIX Scale = XMMatrixScaling(o.scale.x, o.scale.y, o.scale.z);
+		XMMATRIX Rotation = XMMatrixRotationAxis(XMLoadFloat3(&o.axis), o.angle);
+		XMMATRIX Translation = XMMatrixTranslation(o.position.x, o.position.y, o.position.z);
+		XMMATRIX objectWorld = Scale * Rotation * Translation;
+		(*world)[i] = XMMatrixTranspose(objectWorld);
+		(*wvp)[i] = XMMatrixTranspose(objectWorld * view * projection);
+	}
+}
+
+// Largest difference relative to the element's magnitude, at least 1
+float MaxError(const TransformMatrix& packed, CXMMATRIX expected)
+{
+	float error = 0.0f;
+	for (int r = 0; r < 4; ++r)
+	{
+		XMFLOAT4 e;
+		XMStoreFloat4(&e, expected.r[r]);
+		const XMFLOAT4& p = packed.row[r];
+		float d[4][2] = { { p.x, e.x }, { p.y, e.y }, { p.z, e.z }, { p.w, e.w } };
+		for (int c = 0; c < 4; ++c)
+			error = std::max(error, fabsf(d[c][0] - d[c][1]) / std::max(1.0f, fabsf(d[c][1])));
+	}
+	return error;
+}
+
+int main(int argc, char** argv)
+{
+	int objectCount = 100000, passes = 10, threads = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-objects") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			objectCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-passes") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			passes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+			threads = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: transform_bench [-objects N] [-passes N] [-threads N]\n");
+			return 1;
+		}
+	}
+
+	std::vector<Object> objects(objectCount);
+	TransformStore store;
+	for (int i = 0; i < objectCount; ++i)
+	{
+		Object& o = objects[i];
+		o.position = XMFLOAT3(Random(-100.0f, 100.0f), Random(-100.0f, 100.0f), Random(-100.0f, 100.0f));
+		o.scale = XMFLOAT3(Random(0.1f, 10.0f), Random(0.1f, 10.0f), Random(0.1f, 10.0f));
+		XMVECTOR axis = XMVector3Normalize(XMVectorSet(Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), 0.0f));
+		XMStoreFloat3(&o.axis, axis);
+		o.angle = Random(-XM_PI, XM_PI);
+
+		int index = store.Add();
+		store.SetPosition(index, o.position.x, o.position.y, o.position.z);
+		store.SetScale(index, o.scale.x, o.scale.y, o.scale.z);
+		store.SetRotationAxis(index, o.axis, o.angle);
+	}
+
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 50.0f, -200.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(0.4f * 3.14f, 16.0f / 9.0f, 1.0f, 1000.0f);
+	XMMATRIX viewProjection = view * projection;
+
+#if defined(TRANSFORM_STORE_AVX2)
+	printf("AVX2 path, %d objects, best of %d passes\n\n", objectCount, passes);
+#elif defined(TRANSFORM_STORE_SSE2)
+	printf("SSE2 path, %d objects, best of %d passes\n\n", objectCount, passes);
+#else
+	printf("scalar path, %d objects, best of %d passes\n\n", objectCount, passes);
+#endif
+	printf("%-16s %8s %9s %9s %10s\n", "path", "threads", "ms", "Mobj/s", "max error");
+
+	std::vector<XMMATRIX> world(objectCount), wvp(objectCount);
+	double legacy = 1e30;
+	for (int p = 0; p < passes; ++p)
+	{
+		long long start = Profiler::Now();
+		LegacyCompose(objects, view, projection, &world, &wvp);
+		legacy = std::min(legacy, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+	}
+	printf("%-16s %8d %9.3f %9.1f\n", "per object", 1, legacy * 1000.0, objectCount / legacy * 1e-6);
+
+	SoftThreadPool pool(threads);
+	for (int run = 0; run < 2; ++run)
+	{
+		SoftThreadPool* runPool = run == 0 ? NULL : &pool;
+		double best = 1e30;
+		for (int p = 0; p < passes; ++p)
+		{
+			long long start = Profiler::Now();
+			store.Compose(viewProjection, runPool);
+			best = std::min(best, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+		}
+		float error = 0.0f;
+		for (int i = 0; i < objectCount; ++i)
+			error = std::max(error, std::max(MaxError(store.World(i), world[i]), MaxError(store.WVP(i), wvp[i])));
+		printf("%-16s %8d %9.3f %9.1f %10.2e\n", "transform store", runPool ? pool.ThreadCount() : 1, best * 1000.0,
+			objectCount / best * 1e-6, error);
+	}
+
+	double worldBest = 1e30;
+	for (int p = 0; p < passes; ++p)
+	{
+		long long start = Profiler::Now();
+		store.ComposeWorld(NULL);
+		worldBest = std::min(worldBest, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+	}
+	float worldError = 0.0f;
+	for (int i = 0; i < objectCount; ++i)
+		worldError = std::max(worldError, MaxError(store.World(i), world[i]));
+	printf("%-16s %8d %9.3f %9.1f %10.2e\n", "world only", 1, worldBest * 1000.0, objectCount / worldBest * 1e-6, worldError);
+	return 0;
+}
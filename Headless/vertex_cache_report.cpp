@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// File: vertex_cache_report.cpp
+//
+// Before/after numbers for Common/vertex_cache.h on the meshes the samples draw: Disc.x
+// (Tutorial05_NormalMap), tree.x and stone.x (Tutorial05_Parallax) and the sky sphere of
+// D3D11_sky_mapping, CreateSphere(20, 20). The model files go through the same import as
+// the Tutorial05 samples (Common/mesh_import.h, submeshes of at most 65536 vertices), the
+// sphere through Common/mesh_generator.h like the sample.
+//
+// For each mesh it prints the FIFO-16 ACMR (misses per triangle) and ATVR (misses per
+// vertex) of the original index order and after OptimizeVertexCache + OptimizeVertexFetch,
+// and the time the two took. ATVR 1.0 is the ideal, every vertex transformed once.
+//
+// Needs assimp, whose headers come with the Tutorial05 samples:
+//   g++ -O2 -std=c++11 -I../Tutorial05_NormalMap/include vertex_cache_report.cpp -lassimp -o vertex_cache_report
+//   cl /O2 /EHsc /DXM_PORTABLE /I..\Tutorial05_NormalMap\include vertex_cache_report.cpp ..\Tutorial05_NormalMap\assimp-vc120-mt.lib
+//
+// Usage: vertex_cache_report [mesh files...]
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../Common/xnamath_portable.h"
+#include "../Common/vertex_cache.h"
+#include "../Common/mesh_import.h"
+#include "../Common/mesh_generator.h"
+#include "../Common/profiler.h"
+
+struct ReportVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 UV;
+};
+
+struct CacheReport
+{
+	int triangles;
+	int vertices;
+	int missesBefore;
+	int missesAfter;
+	double milliseconds;
+};
+
+// Totals of the submeshes imported so far, the import hooks take no context
+CacheReport g_Report;
+
+ReportVertex ConvertVertex(const aiMesh* mesh, unsigned i, const aiMatrix4x4& transform, const aiMatrix3x3& normalMatrix, const aiMatrix3x3& tangentMatrix)
+{
+	ReportVertex vertex;
+	aiVector3D p = transform * mesh->mVertices[i];
+	vertex.Pos = XMFLOAT3(p.x, p.y, p.z);
+	vertex.Normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	vertex.UV = XMFLOAT2(0.0f, 0.0f);
+	if (mesh->HasNormals())
+	{
+		aiVector3D n = normalMatrix * mesh->mNormals[i];
+		vertex.Normal = XMFLOAT3(n.x, n.y, n.z);
+	}
+	if (mesh->HasTextureCoords(0))
+		vertex.UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+	return vertex;
+}
+
+template <typename Vertex, typename Index>
+void Optimize(Vertex* vertices, int verticesNum, Index* indices, int indicesNum, CacheReport* report)
+{
+	report->triangles += indicesNum / 3;
+	report->vertices += verticesNum;
+	report->missesBefore += CountVertexCacheMisses(indices, indicesNum, verticesNum);
+	long long start = Profiler::Now();
+	OptimizeVertexCache(indices, indicesNum, verticesNum);
+	OptimizeVertexFetch(vertices, verticesNum, indices, indicesNum);
+	report->milliseconds += (double)(Profiler::Now() - start) * 1000.0 / Profiler::TicksPerSecond();
+	report->missesAfter += CountVertexCacheMisses(indices, indicesNum, verticesNum);
+}
+
+void FinishSubmesh(const aiMesh* mesh, int submeshIndex, ReportVertex* vertices, int verticesNum, unsigned short* indices, int indicesNum)
+{
+	Optimize(vertices, verticesNum, indices, indicesNum, &g_Report);
+}
+
+void Print(const char* name, int submeshes, const CacheReport& report)
+{
+	printf("%-12s %9d %9d %9d %7.3f -> %5.3f %7.3f -> %5.3f %10.3f\n", name, submeshes, report.triangles, report.vertices,
+		(float)report.missesBefore / report.triangles, (float)report.missesAfter / report.triangles,
+		(float)report.missesBefore / report.vertices, (float)report.missesAfter / report.vertices, report.milliseconds);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "usage: vertex_cache_report [mesh files...]\n");
+			return 1;
+		}
+	}
+	if (files.empty())
+	{
+		files.push_back("../Tutorial05_NormalMap/Disc.x");
+		files.push_back("../Tutorial05_Parallax/tree.x");
+		files.push_back("../Tutorial05_Parallax/stone.x");
+	}
+
+	printf("FIFO-%d post-transform cache, Forsyth LRU-%d optimizer\n\n", FIFO_CACHE_SIZE, VERTEX_CACHE_SIZE);
+	printf("%-12s %9s %9s %9s %16s %16s %10s\n", "mesh", "submeshes", "triangles", "vertices", "ACMR", "ATVR", "ms");
+
+	bool failed = false;
+	MeshImportHooks<ReportVertex> hooks = { ConvertVertex, FinishSubmesh };
+	for (size_t f = 0; f < files.size(); ++f)
+	{
+		const char* name = strrchr(files[f], '/') ? strrchr(files[f], '/') + 1 : files[f];
+		memset(&g_Report, 0, sizeof(g_Report));
+		MeshPool<ReportVertex> pool;
+		if (!ImportMesh(files[f], hooks, &pool))
+		{
+			printf("%-12s could not be imported\n", name);
+			failed = true;
+			continue;
+		}
+		Print(name, (int)pool.submeshes.size(), g_Report);
+	}
+
+	// D3D11_sky_mapping's CreateSphere(20, 20)
+	MeshData sphere;
+	GenerateUVSphere(1.0f, 20 - 1, 20, &sphere);
+	CacheReport report;
+	memset(&report, 0, sizeof(report));
+	Optimize(&sphere.vertices[0], (int)sphere.vertices.size(), &sphere.indices[0], (int)sphere.indices.size(), &report);
+	Print("sky sphere", 1, report);
+	return failed ? 1 : 0;
+}
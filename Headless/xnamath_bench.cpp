@@ -0,0 +1,265 @@
+//--------------------------------------------------------------------------------------
+// File: xnamath_bench.cpp
+//
+// Checks Common/xnamath_portable.h's SSE2 back-end against its scalar one
+// (XM_NO_INTRINSICS_) and times every function of both.
+//
+// The header picks its back-end when it is included, so this file is compiled twice: once
+// with XNAMATH_BENCH_SCALAR, which wraps the header in namespace Scalar with
+// XM_NO_INTRINSICS_ defined, and once normally, which wraps it in namespace Simd and holds
+// main(). Each op runs over -items random inputs on both paths; the largest difference,
+// relative to the element's magnitude (at least 1), must stay within -tolerance. ns is the
+// best of -passes runs divided by the item count, loads and stores included.
+//
+// Builds with any C++11 compiler, no DirectX SDK needed:
+//   g++ -O2 -c -DXNAMATH_BENCH_SCALAR xnamath_bench.cpp -o xnamath_bench_scalar.o
+//   g++ -O2 xnamath_bench.cpp xnamath_bench_scalar.o -o xnamath_bench
+//   cl /O2 /EHsc /DXM_PORTABLE /DXNAMATH_BENCH_SCALAR /c xnamath_bench.cpp /Foxnamath_bench_scalar.obj
+//   cl /O2 /EHsc /DXM_PORTABLE xnamath_bench.cpp xnamath_bench_scalar.obj
+//
+// Usage: xnamath_bench [-items N] [-passes N] [-tolerance T]
+//--------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// Every item reads XNA_BENCH_INPUT floats and writes outputFloats of XNA_BENCH_OUTPUT
+#define XNA_BENCH_INPUT		32
+#define XNA_BENCH_OUTPUT	16
+
+struct XnaBenchOp
+{
+	const char* name;
+	int outputFloats;
+	void (*run)(const float* input, float* output, int count);
+};
+
+#ifdef XNAMATH_BENCH_SCALAR
+#define XM_NO_INTRINSICS_
+#define XNAMATH_BENCH_NAMESPACE	Scalar
+#else
+#define XNAMATH_BENCH_NAMESPACE	Simd
+#endif
+
+// The header's own includes are already in, so only its declarations land in the namespace
+namespace XNAMATH_BENCH_NAMESPACE
+{
+#include "../Common/xnamath_portable.h"
+
+inline XMVECTOR Load(const float* p) { return XMLoadFloat4((const XMFLOAT4*)p); }
+inline void Store(float* p, FXMVECTOR v) { XMStoreFloat4((XMFLOAT4*)p, v); }
+inline XMMATRIX LoadMatrix(const float* p) { return XMMATRIX(Load(p), Load(p + 4), Load(p + 8), Load(p + 12)); }
+inline void StoreMatrix(float* p, CXMMATRIX m)
+{
+	for (int r = 0; r < 4; ++r)
+		Store(p + r * 4, m.r[r]);
+}
+
+// a and b are the first two vectors of the item, m and n its two matrices (m overlaps a and
+// b), s, t and u three scalars; all inputs lie in [-2, 2]
+#define XNA_BENCH_OP(name, store) \
+	void name(const float* in, float* out, int count) \
+	{ \
+		for (int i = 0; i < count; ++i, in += XNA_BENCH_INPUT, out += XNA_BENCH_OUTPUT) \
+		{ \
+			XMVECTOR a = Load(in); \
+			XMVECTOR b = Load(in + 4); \
+			float s = in[8], t = in[9], u = in[10]; \
+			(void)a; (void)b; (void)s; (void)t; (void)u; \
+			store; \
+		} \
+	}
+#define XNA_VECTOR_OP(name, expression)	XNA_BENCH_OP(name, Store(out, expression))
+#define XNA_FLOAT3_OP(name, expression) \
+	XNA_BENCH_OP(name, XMFLOAT3 f; XMStoreFloat3(&f, expression); out[0] = f.x; out[1] = f.y; out[2] = f.z)
+#define XNA_MATRIX_OP(name, expression) \
+	XNA_BENCH_OP(name, XMMATRIX m = LoadMatrix(in); XMMATRIX n = LoadMatrix(in + 16); (void)m; (void)n; StoreMatrix(out, expression))
+
+XNA_BENCH_OP(VectorSet, Store(out, XMVectorSet(s, t, u, in[11])))
+XNA_BENCH_OP(VectorGet, out[0] = XMVectorGetX(a); out[1] = XMVectorGetY(a); out[2] = XMVectorGetZ(a); out[3] = XMVectorGetW(a))
+XNA_VECTOR_OP(VectorReplicate, XMVectorReplicate(s))
+XNA_VECTOR_OP(VectorSplat, XMVectorAdd(XMVectorAdd(XMVectorSplatX(a), XMVectorSplatY(b)), XMVectorMultiply(XMVectorSplatZ(a), XMVectorSplatW(b))))
+XNA_VECTOR_OP(VectorAdd, XMVectorAdd(a, b))
+XNA_VECTOR_OP(VectorSubtract, XMVectorSubtract(a, b))
+XNA_VECTOR_OP(VectorMultiply, XMVectorMultiply(a, b))
+XNA_VECTOR_OP(VectorDivide, XMVectorDivide(a, b))
+XNA_VECTOR_OP(VectorScale, XMVectorScale(a, s))
+XNA_VECTOR_OP(VectorMin, XMVectorMin(a, b))
+XNA_VECTOR_OP(VectorMax, XMVectorMax(a, b))
+XNA_VECTOR_OP(VectorSqrt, XMVectorSqrt(XMVectorMultiply(a, a)))
+XNA_VECTOR_OP(VectorSetW, XMVectorSetW(a, s))
+XNA_VECTOR_OP(Vector3Dot, XMVector3Dot(a, b))
+XNA_VECTOR_OP(Vector3Cross, XMVector3Cross(a, b))
+XNA_VECTOR_OP(Vector3LengthSq, XMVector3LengthSq(a))
+XNA_VECTOR_OP(Vector3Length, XMVector3Length(a))
+XNA_FLOAT3_OP(Vector3Normalize, XMVector3Normalize(a))
+XNA_BENCH_OP(Vector3Transform, XMMATRIX n = LoadMatrix(in + 16); Store(out, XMVector3Transform(a, n)))
+XNA_BENCH_OP(Vector3TransformCoord, XMMATRIX n = LoadMatrix(in + 16); XMFLOAT3 f; XMStoreFloat3(&f, XMVector3TransformCoord(a, n));
+	out[0] = f.x; out[1] = f.y; out[2] = f.z)
+XNA_FLOAT3_OP(Vector3TransformNormal, XMVector3TransformNormal(a, LoadMatrix(in + 16)))
+XNA_FLOAT3_OP(LoadStoreFloat3, XMLoadFloat3((const XMFLOAT3*)(in + 12)))
+XNA_MATRIX_OP(MatrixMultiply, XMMatrixMultiply(m, n))
+XNA_MATRIX_OP(MatrixTranspose, XMMatrixTranspose(m))
+XNA_MATRIX_OP(MatrixInverse, XMMatrixInverse(NULL, m))
+XNA_MATRIX_OP(MatrixScaling, XMMatrixScaling(s, t, u))
+XNA_MATRIX_OP(MatrixTranslation, XMMatrixTranslation(s, t, u))
+XNA_MATRIX_OP(MatrixRotationX, XMMatrixRotationX(s))
+XNA_MATRIX_OP(MatrixRotationY, XMMatrixRotationY(s))
+XNA_MATRIX_OP(MatrixRotationZ, XMMatrixRotationZ(s))
+XNA_MATRIX_OP(MatrixRollPitchYaw, XMMatrixRotationRollPitchYaw(s, t, u))
+XNA_MATRIX_OP(MatrixRotationNormal, XMMatrixRotationNormal(XMVector3Normalize(a), s))
+XNA_MATRIX_OP(MatrixRotationAxis, XMMatrixRotationAxis(a, s))
+XNA_MATRIX_OP(MatrixLookToLH, XMMatrixLookToLH(a, b, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)))
+XNA_MATRIX_OP(MatrixLookAtLH, XMMatrixLookAtLH(a, b, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)))
+XNA_MATRIX_OP(MatrixPerspectiveFovLH, XMMatrixPerspectiveFovLH(0.5f + fabsf(s) * 0.5f, 1.0f + fabsf(t), 0.1f, 10.0f + fabsf(u)))
+
+const XnaBenchOp* GetOps(int* count)
+{
+	static const XnaBenchOp ops[] =
+	{
+		{ "VectorSet", 4, VectorSet },
+		{ "VectorGetX..W", 4, VectorGet },
+		{ "VectorReplicate", 4, VectorReplicate },
+		{ "VectorSplatX..W", 4, VectorSplat },
+		{ "VectorAdd", 4, VectorAdd },
+		{ "VectorSubtract", 4, VectorSubtract },
+		{ "VectorMultiply", 4, VectorMultiply },
+		{ "VectorDivide", 4, VectorDivide },
+		{ "VectorScale", 4, VectorScale },
+		{ "VectorMin", 4, VectorMin },
+		{ "VectorMax", 4, VectorMax },
+		{ "VectorSqrt", 4, VectorSqrt },
+		{ "VectorSetW", 4, VectorSetW },
+		{ "Vector3Dot", 4, Vector3Dot },
+		{ "Vector3Cross", 4, Vector3Cross },
+		{ "Vector3LengthSq", 4, Vector3LengthSq },
+		{ "Vector3Length", 4, Vector3Length },
+		{ "Vector3Normalize", 3, Vector3Normalize },
+		{ "Vector3Transform", 4, Vector3Transform },
+		{ "Vector3TransformCoord", 3, Vector3TransformCoord },
+		{ "Vector3TransformNormal", 3, Vector3TransformNormal },
+		{ "Load/StoreFloat3", 3, LoadStoreFloat3 },
+		{ "MatrixMultiply", 16, MatrixMultiply },
+		{ "MatrixTranspose", 16, MatrixTranspose },
+		{ "MatrixInverse", 16, MatrixInverse },
+		{ "MatrixScaling", 16, MatrixScaling },
+		{ "MatrixTranslation", 16, MatrixTranslation },
+		{ "MatrixRotationX", 16, MatrixRotationX },
+		{ "MatrixRotationY", 16, MatrixRotationY },
+		{ "MatrixRotationZ", 16, MatrixRotationZ },
+		{ "MatrixRotationRPY", 16, MatrixRollPitchYaw },
+		{ "MatrixRotationNormal", 16, MatrixRotationNormal },
+		{ "MatrixRotationAxis", 16, MatrixRotationAxis },
+		{ "MatrixLookToLH", 16, MatrixLookToLH },
+		{ "MatrixLookAtLH", 16, MatrixLookAtLH },
+		{ "MatrixPerspectiveFovLH", 16, MatrixPerspectiveFovLH },
+	};
+	*count = sizeof(ops) / sizeof(ops[0]);
+	return ops;
+}
+
+bool IsSSE2()
+{
+#if defined(XM_PORTABLE_SSE2)
+	return true;
+#else
+	return false;
+#endif
+}
+}
+
+#ifndef XNAMATH_BENCH_SCALAR
+
+#include "../Common/profiler.h"
+
+namespace Scalar
+{
+const XnaBenchOp* GetOps(int* count);
+bool IsSSE2();
+}
+
+// Largest difference relative to the element's magnitude, at least 1; NaN only matches NaN
+float MaxError(const std::vector<float>& a, const std::vector<float>& b, int items, int floats)
+{
+	float error = 0.0f;
+	for (int i = 0; i < items; ++i)
+	{
+		for (int j = 0; j < floats; ++j)
+		{
+			float x = a[i * XNA_BENCH_OUTPUT + j], y = b[i * XNA_BENCH_OUTPUT + j];
+			if (x != x || y != y)
+			{
+				if ((x != x) != (y != y))
+					return INFINITY;
+				continue;
+			}
+			error = std::max(error, fabsf(x - y) / std::max(1.0f, fabsf(y)));
+		}
+	}
+	return error;
+}
+
+double Time(const XnaBenchOp& op, const std::vector<float>& input, std::vector<float>* output, int items, int passes)
+{
+	double best = 1e30;
+	for (int p = 0; p < passes; ++p)
+	{
+		long long start = Profiler::Now();
+		op.run(&input[0], &(*output)[0], items);
+		best = std::min(best, (double)(Profiler::Now() - start) / Profiler::TicksPerSecond());
+	}
+	return best * 1e9 / items;
+}
+
+int main(int argc, char** argv)
+{
+	int items = 1 << 16, passes = 10;
+	float tolerance = 1e-5f;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-items") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			items = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-passes") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			passes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-tolerance") && i + 1 < argc && atof(argv[i + 1]) > 0.0)
+			tolerance = (float)atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: xnamath_bench [-items N] [-passes N] [-tolerance T]\n");
+			return 1;
+		}
+	}
+
+	int opCount = 0, scalarCount = 0;
+	const XnaBenchOp* ops = Simd::GetOps(&opCount);
+	const XnaBenchOp* scalarOps = Scalar::GetOps(&scalarCount);
+	if (!Simd::IsSSE2() || Scalar::IsSSE2())
+		printf("warning: no SSE2 back-end on this target, both paths are scalar\n");
+
+	std::vector<float> input((size_t)items * XNA_BENCH_INPUT);
+	for (size_t i = 0; i < input.size(); ++i)
+		input[i] = -2.0f + 4.0f * (float)rand() / RAND_MAX;
+	std::vector<float> simdOutput((size_t)items * XNA_BENCH_OUTPUT), scalarOutput((size_t)items * XNA_BENCH_OUTPUT);
+
+	printf("%d items, best of %d passes, tolerance %.1e\n\n", items, passes, tolerance);
+	printf("%-24s %10s %10s %8s %10s %s\n", "op", "scalar ns", "SSE2 ns", "speedup", "max error", "result");
+	bool failed = false;
+	for (int i = 0; i < opCount && i < scalarCount; ++i)
+	{
+		double scalarNs = Time(scalarOps[i], input, &scalarOutput, items, passes);
+		double simdNs = Time(ops[i], input, &simdOutput, items, passes);
+		float error = MaxError(simdOutput, scalarOutput, items, ops[i].outputFloats);
+		bool pass = error <= tolerance;
+		failed |= !pass;
+		printf("%-24s %10.2f %10.2f %7.2fx %10.2e %s\n", ops[i].name, scalarNs, simdNs, scalarNs / simdNs, error, pass ? "ok" : "FAIL");
+	}
+	return failed ? 1 : 0;
+}
+
+#endif
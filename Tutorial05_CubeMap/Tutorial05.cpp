@@ -9,7 +9,10 @@
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dcompiler.h>
-#include <xnamath.h>
+#include "../Common/xnamath_portable.h"
+#include "../Common/dds_reader.h"
+#include "../Common/shader_cache.h"
+#include "../Common/instancing.h"
 #include "resource.h"
 #include <dinput.h>
 
@@ -54,6 +57,11 @@ ID3D11InputLayout*      g_pVertexLayout = NULL;
 ID3D11Buffer*           g_pVertexBuffer = NULL;
 ID3D11Buffer*           g_pIndexBuffer = NULL;
 ID3D11Buffer*           g_pConstantBuffer = NULL;
+// Both cubes go out in one DrawIndexedInstanced, their world matrices packed into
+// g_CubeInstances (Common/instancing.h)
+InstanceBuffer          g_CubeInstances;
+ID3D11VertexShader*     g_pInstancedReflectVertexShader = NULL;
+ID3D11InputLayout*      g_pInstancedVertexLayout = NULL;
 XMMATRIX                g_CubeWorld1;
 XMMATRIX                g_CubeWorld2;
 XMMATRIX                g_View;
@@ -100,6 +108,10 @@ double g_CurrentTime = 0;
 double g_LastTime = 0;
 DWORD g_StartTick = 0;
 
+// Compiled shaders live in ShaderCache\ under the working directory
+D3DShaderCompiler g_ShaderCompiler;
+ShaderCache g_ShaderCache(&g_ShaderCompiler, "ShaderCache");
+
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
@@ -208,12 +220,10 @@ HRESULT InitWindow( HINSTANCE hInstance, int nCmdShow )
 
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DX11
+// Helper for compiling shaders, served from the on-disk shader cache when unchanged
 //--------------------------------------------------------------------------------------
 HRESULT CompileShaderFromFile( WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
 {
-    HRESULT hr = S_OK;
-
     DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
 #if defined( DEBUG ) || defined( _DEBUG )
     // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
@@ -223,19 +233,7 @@ HRESULT CompileShaderFromFile( WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR sz
     dwShaderFlags |= D3DCOMPILE_DEBUG;
 #endif
 
-    ID3DBlob* pErrorBlob;
-    hr = D3DX11CompileFromFile( szFileName, NULL, NULL, szEntryPoint, szShaderModel, 
-        dwShaderFlags, 0, NULL, ppBlobOut, &pErrorBlob, NULL );
-    if( FAILED(hr) )
-    {
-        if( pErrorBlob != NULL )
-            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
-        if( pErrorBlob ) pErrorBlob->Release();
-        return hr;
-    }
-    if( pErrorBlob ) pErrorBlob->Release();
-
-    return S_OK;
+    return CompileShaderCached(&g_ShaderCache, szFileName, szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut);
 }
 
 
@@ -369,6 +367,23 @@ HRESULT InitDevice()
 	if( FAILED( hr ) )
         return hr;
 
+    // The same vertices, plus a world matrix per instance in slot 1
+	ID3DBlob* pInstancedVSBlob = NULL;
+	hr = CompileAndCreateVertexShader("INSTANCED_REFLECT_VS", pInstancedVSBlob, g_pInstancedReflectVertexShader);
+	if( FAILED( hr ) )
+		return hr;
+	D3D11_INPUT_ELEMENT_DESC instancedLayout[ARRAYSIZE( layout ) + 3];
+	UINT numInstancedElements = AppendInstanceLayout( INSTANCE_FORMAT_MATRIX, layout, numElements, instancedLayout );
+	hr = g_pd3dDevice->CreateInputLayout( instancedLayout, numInstancedElements, pInstancedVSBlob->GetBufferPointer(),
+                                          pInstancedVSBlob->GetBufferSize(), &g_pInstancedVertexLayout );
+	pInstancedVSBlob->Release();
+	if( FAILED( hr ) )
+        return hr;
+
+	hr = g_CubeInstances.Init( g_pd3dDevice, INSTANCE_FORMAT_MATRIX, 2 );
+	if( FAILED( hr ) )
+        return hr;
+
     // Set the input layout
     g_pImmediateContext->IASetInputLayout( g_pVertexLayout );
 
@@ -497,6 +512,7 @@ HRESULT InitDevice()
 	g_Projection = XMMatrixPerspectiveFovLH( XM_PIDIV2, width / (FLOAT)height, 0.01f, 100.0f );
 
 	LoadSkyMapAndCreateState();
+	ReportShaderCacheStats(g_ShaderCache);
 
     return S_OK;
 }
@@ -518,6 +534,11 @@ void CleanupDevice()
 		g_pIndexBuffer->Release();
     if( g_pVertexLayout )
 		g_pVertexLayout->Release();
+    if( g_pInstancedVertexLayout )
+		g_pInstancedVertexLayout->Release();
+    if( g_pInstancedReflectVertexShader )
+		g_pInstancedReflectVertexShader->Release();
+	g_CubeInstances.Release();
     if( g_pReflectVertexShader )
 		g_pReflectVertexShader->Release();
     if( g_pReflectPixelShader )
@@ -598,30 +619,6 @@ void Render()
 	// 1st Cube: Rotate around the origin
 	g_CubeWorld1 = XMMatrixRotationY(g_CurrentTime);
 	//g_CubeWorld1 = XMMatrixRotationY(0);
-    //
-    // Update variables for the first cube
-    //
-    ConstantBuffer cbCube1;
-	cbCube1.mWorld = XMMatrixTranspose( g_CubeWorld1 );
-	g_WVP = g_CubeWorld1 * g_View * g_Projection;
-	cbCube1.mWVP = XMMatrixTranspose(g_WVP);
-	XMVECTOR aa = XMVectorSet(0.0f, 2.0f, -5.0f, 0.0f);
-
-	XMStoreFloat3(&cbCube1.mCamPos, g_CamPosition);
-	g_pImmediateContext->UpdateSubresource( g_pConstantBuffer, 0, NULL, &cbCube1, 0, 0 );
-	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-
-	//
-    // Render the first cube
-    //
-	g_pImmediateContext->PSSetSamplers(0, 1, &g_CubesTexSamplerState);
-	g_pImmediateContext->PSSetShaderResources(0, 1, &g_ShaderResourceView);
-	g_pImmediateContext->RSSetState(g_CWcullMode);
-	g_pImmediateContext->VSSetShader(g_pReflectVertexShader, NULL, 0);
-	g_pImmediateContext->PSSetShader( g_pReflectPixelShader, NULL, 0 );
-	g_pImmediateContext->DrawIndexed( 36, 0, 0 );
-
 
 	// 2nd Cube:  Rotate around origin
 	XMMATRIX mSpin = XMMatrixRotationZ(-g_CurrentTime);
@@ -634,19 +631,35 @@ void Render()
 	g_CubeWorld2 = mScale * mSpin * mTranslate * mOrbit;
 
     //
-    // Update variables for the second cube
+    // Both cubes take their world matrix from the instance stream, so the constant
+    // buffer only holds the camera
     //
-    ConstantBuffer cbCube2;
-	cbCube2.mWorld = XMMatrixTranspose( g_CubeWorld2 );
-	g_WVP = g_CubeWorld2 * g_View * g_Projection;
-	cbCube2.mWVP = XMMatrixTranspose(g_WVP);
-	
-	XMStoreFloat3(&cbCube2.mCamPos, g_CamPosition);
-	g_pImmediateContext->UpdateSubresource( g_pConstantBuffer, 0, NULL, &cbCube2, 0, 0 );
+	InstanceMatrix* instances = (InstanceMatrix*)g_CubeInstances.Map( g_pImmediateContext, 2 );
+	if( instances )
+	{
+		PackInstanceMatrix( g_CubeWorld1, &instances[0] );
+		PackInstanceMatrix( g_CubeWorld2, &instances[1] );
+		g_CubeInstances.Unmap( g_pImmediateContext );
+	}
+    ConstantBuffer cbCubes;
+	cbCubes.mWorld = XMMatrixIdentity();
+	cbCubes.mWVP = XMMatrixTranspose(g_View * g_Projection);
+	XMStoreFloat3(&cbCubes.mCamPos, g_CamPosition);
+	g_pImmediateContext->UpdateSubresource( g_pConstantBuffer, 0, NULL, &cbCubes, 0, 0 );
 	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
 	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
 
-	g_pImmediateContext->DrawIndexed( 36, 0, 0 );
+	//
+    // Render both cubes
+    //
+	g_pImmediateContext->PSSetSamplers(0, 1, &g_CubesTexSamplerState);
+	g_pImmediateContext->PSSetShaderResources(0, 1, &g_ShaderResourceView);
+	g_pImmediateContext->RSSetState(g_CWcullMode);
+	g_pImmediateContext->IASetInputLayout( g_pInstancedVertexLayout );
+	g_pImmediateContext->VSSetShader(g_pInstancedReflectVertexShader, NULL, 0);
+	g_pImmediateContext->PSSetShader( g_pReflectPixelShader, NULL, 0 );
+	g_CubeInstances.DrawIndexed( g_pImmediateContext, 36, 0, 0 );
+	g_pImmediateContext->IASetInputLayout( g_pVertexLayout );
 
 
 	ConstantBuffer cbSkyBox;
@@ -819,24 +832,8 @@ void LoadSkyMapAndCreateState()
 	rtbd.RenderTargetWriteMask = D3D10_COLOR_WRITE_ENABLE_ALL;
 
 
-	D3DX11_IMAGE_LOAD_INFO loadSMInfo;
-	loadSMInfo.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-
-	//Load the texture
-	ID3D11Texture2D* SMTexture = 0;
-	hr = D3DX11CreateTextureFromFile(g_pd3dDevice, L"skymap.dds",
-		&loadSMInfo, 0, (ID3D11Resource**)&SMTexture, 0);
-
-	D3D11_TEXTURE2D_DESC SMTextureDesc;
-	SMTexture->GetDesc(&SMTextureDesc);
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC SMViewDesc;
-	SMViewDesc.Format = SMTextureDesc.Format;
-	SMViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	SMViewDesc.TextureCube.MipLevels = SMTextureDesc.MipLevels;
-	SMViewDesc.TextureCube.MostDetailedMip = 0;
-	//Create the Resource view
-	hr = g_pd3dDevice->CreateShaderResourceView(SMTexture, &SMViewDesc, &g_ShaderResourceView);
+	//Load the cube texture, the DDS header marks it as a cube map
+	hr = CreateDDSTextureFromFile(g_pd3dDevice, L"skymap.dds", NULL, &g_ShaderResourceView);
 	
 	D3D11_SAMPLER_DESC sampDesc;
 	ZeroMemory(&sampDesc, sizeof(sampDesc));
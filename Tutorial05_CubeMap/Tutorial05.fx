@@ -78,6 +78,21 @@ REFLECT_VS_OUTPUT REFLECT_VS(float3 inPos : POSITION, float3 normal : NORMAL)
 	return output;
 }
 
+// REFLECT_VS for a matrix instance of Common/instancing.h: the world matrix's first
+// three columns come from the instance and WVP holds only view * projection
+REFLECT_VS_OUTPUT INSTANCED_REFLECT_VS(float3 inPos : POSITION, float3 normal : NORMAL,
+	float4 column0 : INSTANCE0, float4 column1 : INSTANCE1, float4 column2 : INSTANCE2)
+{
+	REFLECT_VS_OUTPUT output = (REFLECT_VS_OUTPUT)0;
+
+	float4 pos = float4(inPos, 1.0f);
+	output.PosW = float3(dot(pos, column0), dot(pos, column1), dot(pos, column2));
+	output.Pos = mul(float4(output.PosW, 1.0f), WVP);
+	output.normal = normalize(float3(dot(normal, column0.xyz), dot(normal, column1.xyz), dot(normal, column2.xyz)));
+
+	return output;
+}
+
 float4 REFLECT_PS(REFLECT_VS_OUTPUT input) : SV_Target
 {
 
@@ -5,17 +5,25 @@
 //
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //--------------------------------------------------------------------------------------
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
 #include <windows.h>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dcompiler.h>
-#include <xnamath.h>
+#include "../Common/xnamath_portable.h"
+#include "../Common/dds_reader.h"
+#include "../Common/shader_cache.h"
+#include "../Common/image_decoder.h"
+#include "../Common/tangent_space.h"
+#include "../Common/vertex_cache.h"
+#include "../Common/mesh_import.h"
+#include "../Common/constant_ring.h"
 #include "resource.h"
 #include <dinput.h>
 #include <vector>
-#include <assimp/Importer.hpp>      // C++ importer interface
-#include <assimp/scene.h>           // Output data structure
-#include <assimp/postprocess.h>     // Post processing flags
+#include <algorithm>
+#include <math.h>
+#include <float.h>
 
 #pragma comment (lib, "dinput8.lib")
 
@@ -28,7 +36,7 @@ struct SimpleVertex
 
 	XMFLOAT3 Normal;
 	XMFLOAT2 UV;
-	XMFLOAT3 Tangent;
+	XMFLOAT4 Tangent; // w = bitangent sign
 };
 
 struct Light
@@ -47,14 +55,20 @@ struct Light
 Light g_Light;
 
 
-struct ConstantBuffer
+// b0, uploaded once per frame
+struct cbPerFrame
 {
-	XMMATRIX  mWVP;
-	XMMATRIX mWorld;
 //	XMFLOAT3 mCamPos;
 	Light  light;
 };
 
+// b1, a fresh ConstantRing block for every draw
+struct cbPerObject
+{
+	XMMATRIX  mWVP;
+	XMMATRIX mWorld;
+};
+
 
 
 //--------------------------------------------------------------------------------------
@@ -77,7 +91,9 @@ ID3D11InputLayout*      g_pVertexLayout = NULL;
 ID3D11Buffer*           g_pVertexBuffer = NULL;
 ID3D11Buffer*			g_pTangentsBuffer = NULL;
 ID3D11Buffer*           g_pIndexBuffer = NULL;
-ID3D11Buffer*           g_pConstantBuffer = NULL;
+ID3D11Buffer*           g_pFrameConstantBuffer = NULL;
+ConstantRing            g_ConstantRing;
+SoftThreadPool*         g_pLoadThreadPool = NULL;	// set while LoadMesh runs, for FinishSubmesh
 XMMATRIX                g_CubeWorld1;
 XMMATRIX                g_CubeWorld2;
 XMMATRIX                g_View;
@@ -123,6 +139,16 @@ double g_CurrentTime = 0;
 double g_LastTime = 0;
 DWORD g_StartTick = 0;
 
+// Compiled shaders live in ShaderCache\ under the working directory
+D3DShaderCompiler g_ShaderCompiler;
+ShaderCache g_ShaderCache(&g_ShaderCompiler, "ShaderCache");
+
+// PNG/JPEG textures decode on worker threads while the device and shaders are set up
+ImageDecodeQueue g_ImageDecodes;
+enum { IMAGE_NORMAL_MAP };
+
+std::vector<Submesh> g_Submeshes;
+
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
@@ -141,8 +167,7 @@ void UpdateCamera();
 HRESULT CompileAndCreateVertexShader(LPCSTR entry, ID3DBlob*& pVSBlob, ID3D11VertexShader*& vs);
 HRESULT CompileAndCreatePixelShader(LPCSTR entry, ID3DBlob*& pVSBlob, ID3D11PixelShader*& ps);
 HRESULT ComputeTangents(SimpleVertex vertices[], int verticesCount, WORD indices[], int triangleCount);
-HRESULT ComputeTangentsII(SimpleVertex vertices[], int verticesCount, WORD indices[], int triangleCount);
-bool LoadMesh(std::string& pFile, SimpleVertex** vertexes, int* verticesNum, WORD** indices, int* indicesNum, int* traingalNum);
+bool LoadMesh(const std::string& pFile, MeshPool<SimpleVertex>* pool);
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -233,12 +258,10 @@ HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
 
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DX11
+// Helper for compiling shaders, served from the on-disk shader cache when unchanged
 //--------------------------------------------------------------------------------------
 HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
 {
-	HRESULT hr = S_OK;
-
 	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
 #if defined( DEBUG ) || defined( _DEBUG )
 	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
@@ -248,23 +271,9 @@ HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szS
 	dwShaderFlags |= D3DCOMPILE_DEBUG;
 #endif
 
-	ID3DBlob* pErrorBlob;
-	hr = D3DX11CompileFromFile(szFileName, NULL, NULL, szEntryPoint, szShaderModel,
-		dwShaderFlags, 0, NULL, ppBlobOut, &pErrorBlob, NULL);
-	if (FAILED(hr))
-	{
-		if (pErrorBlob != NULL)
-			OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-		if (pErrorBlob) pErrorBlob->Release();
-		return hr;
-	}
-	if (pErrorBlob) pErrorBlob->Release();
-
-	return S_OK;
+	return CompileShaderCached(&g_ShaderCache, szFileName, szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut);
 }
 
-int g_IndicesNum;
-
 //--------------------------------------------------------------------------------------
 // Create Direct3D device and swap chain
 //--------------------------------------------------------------------------------------
@@ -272,6 +281,9 @@ HRESULT InitDevice()
 {
 	HRESULT hr = S_OK;
 
+	g_ImageDecodes.Add("grassNormal.png", IMAGE_NORMAL_MAP);
+	g_ImageDecodes.Start(0);
+
 	RECT rc;
 	GetClientRect(g_hWnd, &rc);
 	UINT width = rc.right - rc.left;
@@ -385,7 +397,7 @@ HRESULT InitDevice()
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "NORMAL",	 0, DXGI_FORMAT_R32G32B32_FLOAT,   0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{"TANGENT",0,DXGI_FORMAT_R32G32B32_FLOAT ,0, 32 , D3D11_INPUT_PER_VERTEX_DATA, 0 }
+		{"TANGENT",0,DXGI_FORMAT_R32G32B32A32_FLOAT ,0, 32 , D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 	UINT numElements = ARRAYSIZE(layout);
 
@@ -443,35 +455,35 @@ HRESULT InitDevice()
 		//{ XMFLOAT3(-1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(0.0f, 1.0f),XMFLOAT3(-1.0f, 0.0f, 0.0f) },
 		
 		//Front
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(0.0f, 1.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),   XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(1.0f, 0.0f) ,XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f),  XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(0.0f, 1.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),   XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(1.0f, 0.0f) ,XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f),  XMFLOAT3(0.0f, 0.0f, -1.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
 		//Back
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(0.0f, 1.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 0.0f, 1.0f),XMFLOAT2(0.0f, 1.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
 		//Top
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f) ,XMFLOAT2(0.0f, 0.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 1.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f) ,XMFLOAT2(1.0f, 0.0f),XMFLOAT3(1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f) ,XMFLOAT2(0.0f, 0.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f),   XMFLOAT3(0.0f, 1.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(0.0f, 1.0f, 0.0f) ,XMFLOAT2(1.0f, 0.0f),XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f) },
 		//Bottom
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT3(-1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f),   XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT3(-1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT3(-1.0f, 0.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(1.0f, 0.0f) ,XMFLOAT3(-1.0f, 0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT4(-1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f),   XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT4(-1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(0.0f, 0.0f),XMFLOAT4(-1.0f, 0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f),  XMFLOAT3(0.0f, -1.0f, 0.0f),XMFLOAT2(1.0f, 0.0f) ,XMFLOAT4(-1.0f, 0.0f, 0.0f, 1.0f) },
 		//Left
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 0.0f) ,XMFLOAT3(0.0f, 0.0f, -1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),   XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT3(0.0f, 0.0f, -1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),  XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 1.0f) ,XMFLOAT3(0.0f, 0.0f, -1.0f) },
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f),  XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT3(0.0f, 0.0f, -1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 0.0f) ,XMFLOAT4(0.0f, 0.0f, -1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f),   XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT4(0.0f, 0.0f, -1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f),  XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 1.0f) ,XMFLOAT4(0.0f, 0.0f, -1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f),  XMFLOAT3(-1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT4(0.0f, 0.0f, -1.0f, 1.0f) },
 		//Right
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f),   XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT3(0.0f, 0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT3(0.0f, 0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT3(0.0f, 0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 0.0f) ,XMFLOAT3(0.0f, 0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f),   XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 0.0f),XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(1.0f, 1.0f),XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 1.0f) ,XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f),  XMFLOAT3(1.0f, 0.0f, 0.0f),XMFLOAT2(0.0f, 0.0f) ,XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f) },
 		
 	};
 
@@ -504,22 +516,30 @@ HRESULT InitDevice()
 	};
 
 	std::string meshPath("Box.fbx");
-	SimpleVertex* cubeVertices = cubeVertices0;
-	int vertNum(24), triNum;
-	WORD* indices = indices0;
-	int indicesNum = 36;
-	LoadMesh(meshPath, &cubeVertices, &vertNum, &indices, &indicesNum, &triNum);
-	g_IndicesNum = indicesNum;
+	MeshPool<SimpleVertex> meshPool;
+	if (!LoadMesh(meshPath, &meshPool))
+	{
+		// Fall back to the built-in cube and derive its tangents from the UV layout
+		OptimizeVertexCache(indices0, 36, 24);
+		OptimizeVertexFetch(cubeVertices0, 24, indices0, 36);
+		ComputeTangentSpace(cubeVertices0, 24, indices0, 12);
+		Submesh cube = { 0, 0, 36, 0, XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+		meshPool.submeshes.push_back(cube);
+		meshPool.vertices = cubeVertices0;
+		meshPool.indices = indices0;
+		meshPool.verticesNum = 24;
+		meshPool.indicesNum = 36;
+	}
+	g_Submeshes = meshPool.submeshes;
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex) * vertNum;
+	bd.ByteWidth = sizeof(SimpleVertex) * meshPool.verticesNum;
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	bd.CPUAccessFlags = 0;
 	D3D11_SUBRESOURCE_DATA InitData;
 	ZeroMemory(&InitData, sizeof(InitData));
-	//ComputeTangentsII(cubeVertices, 24, indices, 12);
-	InitData.pSysMem = cubeVertices;
+	InitData.pSysMem = meshPool.vertices;
 	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pVertexBuffer);
 	if (FAILED(hr))
 		return hr;
@@ -531,14 +551,17 @@ HRESULT InitDevice()
 
 	// Create index buffer
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(WORD) * indicesNum;        // 36 vertices needed for 12 triangles in a triangle list
+	bd.ByteWidth = sizeof(WORD) * meshPool.indicesNum;
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	bd.CPUAccessFlags = 0;
-	InitData.pSysMem = indices;
+	InitData.pSysMem = meshPool.indices;
 	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pIndexBuffer);
 	if (FAILED(hr))
 		return hr;
 
+	// The buffers own a copy now, drop the pool and any mesh cache view behind it
+	ReleaseMeshPool(&meshPool);
+
 	// Set index buffer
 	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
@@ -553,10 +576,13 @@ HRESULT InitDevice()
 	g_Light.diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	ZeroMemory(&bd, sizeof(D3D11_BUFFER_DESC));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(ConstantBuffer);
+	bd.ByteWidth = sizeof(cbPerFrame);
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	bd.CPUAccessFlags = 0;
-	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pConstantBuffer);
+	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pFrameConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+	hr = g_ConstantRing.Init(g_pd3dDevice);
 	if (FAILED(hr))
 		return hr;
 	// Initialize the world matrix
@@ -573,6 +599,7 @@ HRESULT InitDevice()
 
 
 	LoadSkyMapAndCreateState();
+	ReportShaderCacheStats(g_ShaderCache);
 	
 
 	return S_OK;
@@ -587,8 +614,9 @@ void CleanupDevice()
 	if (g_pImmediateContext)
 		g_pImmediateContext->ClearState();
 
-	if (g_pConstantBuffer)
-		g_pConstantBuffer->Release();
+	if (g_pFrameConstantBuffer)
+		g_pFrameConstantBuffer->Release();
+	g_ConstantRing.Release();
 	if (g_pVertexBuffer)
 		g_pVertexBuffer->Release();
 	if (g_pIndexBuffer)
@@ -674,6 +702,15 @@ void Render()
 	//
 	g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
+	g_ConstantRing.BeginFrame(g_pImmediateContext);
+
+	cbPerFrame cbFrame;
+	cbFrame.light = g_Light;
+	//XMStoreFloat3(&cbFrame.mCamPos, g_CamPosition);
+	g_pImmediateContext->UpdateSubresource(g_pFrameConstantBuffer, 0, NULL, &cbFrame, 0, 0);
+	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pFrameConstantBuffer);
+	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pFrameConstantBuffer);
+
 	XMMATRIX mScale = XMMatrixScaling(0.05f, 0.05f, 0.05f);
 	mScale = XMMatrixIdentity();
 	// 1st Cube: Rotate around the origin
@@ -684,19 +721,15 @@ void Render()
 	//
 	// Update variables for the first cube
 	//
-	ConstantBuffer cbCube1;
+	cbPerObject cbCube1;
 	
 	//g_CubeWorld1 = mScale;
 	cbCube1.mWorld = XMMatrixTranspose(g_CubeWorld1);
 	g_WVP = g_CubeWorld1 * g_View * g_Projection;
 	cbCube1.mWVP = XMMatrixTranspose(g_WVP);
 	//XMVECTOR aa = XMVectorSet(0.0f, 2.0f, -5.0f, 0.0f);
-	cbCube1.light = g_Light;
-	cbCube1.light.ambient = g_Light.ambient;
-	//XMStoreFloat3(&cbCube1.mCamPos, g_CamPosition);
-	g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, NULL, &cbCube1, 0, 0);
-	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+	ID3D11Buffer* objectBuffer = g_ConstantRing.Upload(g_pImmediateContext, &cbCube1, sizeof(cbCube1));
+	g_pImmediateContext->VSSetConstantBuffers(1, 1, &objectBuffer);
 
 	//
 	// Render the first cube
@@ -707,7 +740,11 @@ void Render()
 	g_pImmediateContext->RSSetState(g_CWcullMode);
 	g_pImmediateContext->VSSetShader(g_pReflectVertexShader, NULL, 0);
 	g_pImmediateContext->PSSetShader(g_pReflectPixelShader, NULL, 0);
-	g_pImmediateContext->DrawIndexed(g_IndicesNum, 0, 0);
+	for (size_t i = 0; i < g_Submeshes.size(); ++i)
+	{
+		const Submesh& sub = g_Submeshes[i];
+		g_pImmediateContext->DrawIndexed(sub.indexCount, sub.firstIndex, sub.baseVertex);
+	}
 
 
 	// 2nd Cube:  Rotate around origin
@@ -723,21 +760,18 @@ void Render()
 	//
 	// Update variables for the second cube
 	//
-	//ConstantBuffer cbCube2;
+	//cbPerObject cbCube2;
 	//
 	//cbCube2.mWorld = XMMatrixTranspose(g_CubeWorld2);
 	//g_WVP = g_CubeWorld2 * g_View * g_Projection;
 	//cbCube2.mWVP = XMMatrixTranspose(g_WVP);
-	//cbCube2.light = g_Light;
-	//g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, NULL, &cbCube2, 0, 0);
-	//g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-	//g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+	//objectBuffer = g_ConstantRing.Upload(g_pImmediateContext, &cbCube2, sizeof(cbCube2));
+	//g_pImmediateContext->VSSetConstantBuffers(1, 1, &objectBuffer);
 
 	//g_pImmediateContext->DrawIndexed(g_IndicesNum, 0, 0);
 
 
-	//ConstantBuffer cbSkyBox;
-	//cbSkyBox.light = g_Light;
+	//cbPerObject cbSkyBox;
 	//XMMATRIX skyBoxScale = XMMatrixScaling(1.0f, 1.0f, 1.0f);
 	//XMMATRIX skyBoxTranslation = XMMatrixTranslation(XMVectorGetX(g_CamPosition), XMVectorGetY(g_CamPosition), XMVectorGetZ(g_CamPosition));
 
@@ -746,8 +780,8 @@ void Render()
 	//g_WVP = g_SkyBoxWorld * g_View * g_Projection;
 	//cbSkyBox.mWVP = XMMatrixTranspose(g_WVP);
 	//cbSkyBox.mWorld = XMMatrixTranspose(g_SkyBoxWorld);
-	//g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, NULL, &cbSkyBox, 0, 0);
-	//g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+	//objectBuffer = g_ConstantRing.Upload(g_pImmediateContext, &cbSkyBox, sizeof(cbSkyBox));
+	//g_pImmediateContext->VSSetConstantBuffers(1, 1, &objectBuffer);
 
 
 	//g_pImmediateContext->PSSetShaderResources(0, 1, &g_SkyMapSRV);
@@ -917,29 +951,20 @@ void LoadSkyMapAndCreateState()
 	rtbd.RenderTargetWriteMask = D3D10_COLOR_WRITE_ENABLE_ALL;
 
 
-	D3DX11_IMAGE_LOAD_INFO loadSMInfo;
-	loadSMInfo.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-
-	//Load the cube texture
-	ID3D11Texture2D* SMTexture = 0;
-	hr = D3DX11CreateTextureFromFile(g_pd3dDevice, L"skymap.dds",
-		&loadSMInfo, 0, (ID3D11Resource**)&SMTexture, 0);
-
-	D3D11_TEXTURE2D_DESC SMTextureDesc;
-	SMTexture->GetDesc(&SMTextureDesc);
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC SMViewDesc;
-	SMViewDesc.Format = SMTextureDesc.Format;
-	SMViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	SMViewDesc.TextureCube.MipLevels = SMTextureDesc.MipLevels;
-	SMViewDesc.TextureCube.MostDetailedMip = 0;
-	//Create the Resource view
-	hr = g_pd3dDevice->CreateShaderResourceView(SMTexture, &SMViewDesc, &g_SkyMapSRV);
+	//Load the cube texture, the DDS header marks it as a cube map
+	hr = CreateDDSTextureFromFile(g_pd3dDevice, L"skymap.dds", NULL, &g_SkyMapSRV);
 
 	//Load the 2d texture
 	// Load the Texture
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice, L"seafloor.dds", NULL, NULL, &g_pTextureRV, NULL);
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice, L"grassNormal.png", NULL, NULL, &g_pNormalMapRV, NULL);
+	hr = CreateDDSTextureFromFile(g_pd3dDevice, L"seafloor.dds", NULL, &g_pTextureRV);
+	// Upload each decoded image as soon as it is done
+	DecodedImage image;
+	while (g_ImageDecodes.Next(&image))
+	{
+		if (image.tag == IMAGE_NORMAL_MAP)
+			hr = CreateTextureFromImage(g_pd3dDevice, g_pImmediateContext, image, &g_pNormalMapRV);
+		g_ImageDecodes.Recycle(&image);
+	}
 
 
 	D3D11_SAMPLER_DESC sampDesc;
@@ -1011,130 +1036,6 @@ HRESULT CompileAndCreatePixelShader(LPCSTR entry, ID3DBlob*& pPSBlob, ID3D11Pixe
 	return hr;
 }
 
-HRESULT ComputeTangentsII(SimpleVertex vertices[], int verticesCount, WORD indices[], int triangleCount)
-{
-
-	//normalized and unnormalized normals
-	XMFLOAT3 unnormalized = XMFLOAT3(0.0f, 0.0f, 0.0f);
-
-	///////////////**************new**************////////////////////
-	//tangent stuff
-	std::vector<XMFLOAT3> tempTangent;
-	XMFLOAT3 tangent = XMFLOAT3(0.0f, 0.0f, 0.0f);
-	float tcU1, tcV1, tcU2, tcV2;
-	///////////////**************new**************////////////////////
-
-	//Used to get vectors (sides) from the position of the verts
-	float vecX, vecY, vecZ;
-
-	//Two edges of our triangle
-	XMVECTOR edge1 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-	XMVECTOR edge2 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-
-	//Compute face normals
-	//And Tangents
-	for (int i = 0; i < triangleCount; ++i)
-	{
-
-
-		//Get the vector describing one edge of our triangle (edge 0,2)
-		vecX = vertices[indices[(i * 3)] + 1].Pos.x - vertices[indices[(i * 3) + 0]].Pos.x;
-		vecY = vertices[indices[(i * 3)] + 1].Pos.y - vertices[indices[(i * 3) + 0]].Pos.y;
-		vecZ = vertices[indices[(i * 3)] + 1].Pos.z - vertices[indices[(i * 3) + 0]].Pos.z;
-		edge1 = XMVectorSet(vecX, vecY, vecZ, 0.0f);	//Create our first edge
-
-														//Get the vector describing another edge of our triangle (edge 2,1)
-		vecX = vertices[indices[(i * 3) + 2]].Pos.x - vertices[indices[(i * 3) + 0]].Pos.x;
-		vecY = vertices[indices[(i * 3) + 2]].Pos.y - vertices[indices[(i * 3) + 0]].Pos.y;
-		vecZ = vertices[indices[(i * 3) + 2]].Pos.z - vertices[indices[(i * 3) + 0]].Pos.z;
-		edge2 = XMVectorSet(vecX, vecY, vecZ, 0.0f);	//Create our second edge
-
-														//Cross multiply the two edge vectors to get the un-normalized face normal
-		XMStoreFloat3(&unnormalized, XMVector3Cross(edge1, edge2));
-
-
-		///////////////**************new**************////////////////////
-		//Find first texture coordinate edge 2d vector
-		tcU1 = vertices[indices[(i * 3)]+1].UV.x - vertices[indices[(i * 3) + 0]].UV.x;
-		tcV1 = vertices[indices[(i * 3)]+1].UV.y - vertices[indices[(i * 3) + 0]].UV.y;
-
-		//Find second texture coordinate edge 2d vector
-		tcU2 = vertices[indices[(i * 3) + 2]].UV.x - vertices[indices[(i * 3) + 0]].UV.x;
-		tcV2 = vertices[indices[(i * 3) + 2]].UV.y - vertices[indices[(i * 3) + 0]].UV.y;
-
-		//Find tangent using both tex coord edges and position edges
-		tangent.x = (tcV1 * XMVectorGetX(edge1) - tcV2 * XMVectorGetX(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
-		tangent.y = (tcV1 * XMVectorGetY(edge1) - tcV2 * XMVectorGetY(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
-		tangent.z = (tcV1 * XMVectorGetZ(edge1) - tcV2 * XMVectorGetZ(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
-
-		tempTangent.push_back(tangent);
-		///////////////**************new**************////////////////////
-	}
-
-	//Compute vertex normals (normal Averaging)
-	XMVECTOR normalSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-	XMVECTOR tangentSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-	int facesUsing = 0;
-	float tX, tY, tZ;	//temp axis variables
-
-						//Go through each vertex
-	for (int i = 0; i < verticesCount; ++i)
-	{
-		//Check which triangles use this vertex
-		for (int j = 0; j < triangleCount; ++j)
-		{
-			if (indices[j * 3] == i ||
-				indices[(j * 3) + 1] == i ||
-				indices[(j * 3) + 2] == i)
-			{
-																	///////////////**************new**************////////////////////		
-															//We can reuse tX, tY, tZ to sum up tangents
-				tX = XMVectorGetX(tangentSum) + tempTangent[j].x;
-				tY = XMVectorGetY(tangentSum) + tempTangent[j].y;
-				tZ = XMVectorGetZ(tangentSum) + tempTangent[j].z;
-
-				tangentSum = XMVectorSet(tX, tY, tZ, 0.0f); //sum up face tangents using this vertex
-															///////////////**************new**************////////////////////
-
-				facesUsing++;
-			}
-		}
-
-		//Get the actual normal by dividing the normalSum by the number of faces sharing the vertex
-		normalSum = normalSum / facesUsing;
-		///////////////**************new**************////////////////////
-		tangentSum = tangentSum / facesUsing;
-		///////////////**************new**************////////////////////
-
-		//Normalize the normalSum vector and tangent
-		normalSum = XMVector3Normalize(normalSum);
-		///////////////**************new**************////////////////////
-		tangentSum = XMVector3Normalize(tangentSum);
-		///////////////**************new**************////////////////////
-
-	
-		///////////////**************new**************////////////////////
-		vertices[i].Tangent.x = XMVectorGetX(tangentSum);
-		vertices[i].Tangent.y = XMVectorGetY(tangentSum);
-		vertices[i].Tangent.z = XMVectorGetZ(tangentSum);
-		///////////////**************new**************////////////////////
-
-		//Clear normalSum, tangentSum and facesUsing for next vertex
-		normalSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-		///////////////**************new**************////////////////////
-		tangentSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-		///////////////**************new**************////////////////////
-		facesUsing = 0;
-
-		wchar_t text_buffer[50] = { 0 }; //temporary buffer
-		swprintf(text_buffer, _countof(text_buffer), L"indices%d: (%f,%f,%f)\n", i , vertices[i].Tangent.x, vertices[i].Tangent.y, vertices[i].Tangent.z); // convert
-		OutputDebugString(text_buffer); // print
-
-	}
-	HRESULT hr = S_OK;
-	return hr;
-}
-
 HRESULT ComputeTangents(SimpleVertex vertices[], int verticesCount, WORD indices[], int triangleCount)
 {
 	HRESULT hr = S_OK;
@@ -1174,9 +1075,9 @@ HRESULT ComputeTangents(SimpleVertex vertices[], int verticesCount, WORD indices
 		tangent.y = (tcV1 * XMVectorGetY(edge1) - tcV2 * XMVectorGetY(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
 		tangent.z = (tcV1 * XMVectorGetZ(edge1) - tcV2 * XMVectorGetZ(edge2)) * (1.0f / (tcU1 * tcV2 - tcU2 * tcV1));
 
-		vertices[indices[(i * 3)]].Tangent = tangent;
-		vertices[indices[(i * 3) + 1]].Tangent = tangent;
-		vertices[indices[(i * 3) + 2]].Tangent = tangent;
+		vertices[indices[(i * 3)]].Tangent = XMFLOAT4(tangent.x, tangent.y, tangent.z, 1.0f);
+		vertices[indices[(i * 3) + 1]].Tangent = XMFLOAT4(tangent.x, tangent.y, tangent.z, 1.0f);
+		vertices[indices[(i * 3) + 2]].Tangent = XMFLOAT4(tangent.x, tangent.y, tangent.z, 1.0f);
 
 
 		wchar_t text_buffer[50] = { 0 }; //temporary buffer
@@ -1191,56 +1092,77 @@ HRESULT ComputeTangents(SimpleVertex vertices[], int verticesCount, WORD indices
 }
 
 
-bool LoadMesh(std::string& pFile,SimpleVertex** vertexes,int* verticesNum,WORD** indices,int* indicesNum,int* traingalNum)
-{
-	Assimp::Importer importer;
-	// And have it read the given file with some example postprocessing
-	// Usually - if speed is not the most important aspect for you - you'll 
-	// propably to request more postprocessing than we do in this example.
-	const aiScene* scene = importer.ReadFile(pFile,
-		aiProcess_CalcTangentSpace |
-		//aiProcess_MakeLeftHanded|
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_SortByPType);
-	if (scene->HasMeshes())
-	{
-		aiMesh* mesh = scene->mMeshes[0];
-		*vertexes = new SimpleVertex[mesh->mNumVertices];
-		*verticesNum = mesh->mNumVertices;
-		for (int i = 0; i < mesh->mNumVertices; ++i)
-		{
-			(*vertexes)[i].Pos = XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-			(*vertexes)[i].Normal = XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-			(*vertexes)[i].Tangent = XMFLOAT3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
-			(*vertexes)[i].UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
-			int  j;
-		}
 
-		int sumIdices = 0;
-		for (int i = 0;i<mesh->mNumFaces;++i)
-		{
-			for (int j = 0;j<mesh->mFaces[i].mNumIndices;++j)
-			{
-				++sumIdices;
-			}
-		}
-		*indicesNum = sumIdices;
+//--------------------------------------------------------------------------------------
+// Mesh import hooks, Common/mesh_import.h does the packing and the binary mesh cache
+//--------------------------------------------------------------------------------------
+SimpleVertex ConvertVertex(const aiMesh* mesh, unsigned i, const aiMatrix4x4& transform, const aiMatrix3x3& normalMatrix, const aiMatrix3x3& tangentMatrix)
+{
+	SimpleVertex vertex;
+	ZeroMemory(&vertex, sizeof(vertex));
 
-		*indices = new WORD[sumIdices];
-		int indicesIdx = 0;
-		for (int i = 0; i < mesh->mNumFaces; ++i)
-		{
-			for (int j = 0; j < mesh->mFaces[i].mNumIndices; ++j)
-			{
-				(*indices)[indicesIdx] = mesh->mFaces[i].mIndices[j];
-				++indicesIdx;
-			}
-		}
+	aiVector3D p = transform * mesh->mVertices[i];
+	vertex.Pos = XMFLOAT3(p.x, p.y, p.z);
 
-		*traingalNum = mesh->mNumFaces;
+	aiVector3D n(0.0f, 0.0f, 0.0f);
+	if (mesh->HasNormals())
+	{
+		n = normalMatrix * mesh->mNormals[i];
+		n.Normalize();
+		vertex.Normal = XMFLOAT3(n.x, n.y, n.z);
+	}
+	if (mesh->HasTextureCoords(0))
+		vertex.UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+	if (mesh->HasTangentsAndBitangents())
+	{
+		aiVector3D t = tangentMatrix * mesh->mTangents[i];
+		aiVector3D b = tangentMatrix * mesh->mBitangents[i];
+		t.Normalize();
+		// Bitangent sign, so mirrored UVs survive cross(normal, tangent) in the shader
+		float w = ((n ^ t) * b) < 0.0f ? -1.0f : 1.0f;
+		vertex.Tangent = XMFLOAT4(t.x, t.y, t.z, w);
+	}
+	return vertex;
+}
 
+// Reorder for the post-transform cache, then derive tangents the file didn't have
+void FinishSubmesh(const aiMesh* mesh, int submeshIndex, SimpleVertex* vertices, int verticesNum, WORD* indices, int indicesNum)
+{
+	int missesBefore = CountVertexCacheMisses(indices, indicesNum, verticesNum);
+	OptimizeVertexCache(indices, indicesNum, verticesNum);
+	OptimizeVertexFetch(vertices, verticesNum, indices, indicesNum);
+	int missesAfter = CountVertexCacheMisses(indices, indicesNum, verticesNum);
+
+	float triangles = indicesNum / 3.0f;
+	wchar_t text_buffer[256] = { 0 }; //temporary buffer
+	swprintf(text_buffer, _countof(text_buffer), L"submesh %d: %d triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		submeshIndex, indicesNum / 3, missesBefore / triangles, missesAfter / triangles,
+		(float)missesBefore / verticesNum, (float)missesAfter / verticesNum);
+	OutputDebugString(text_buffer);
+
+	if (!mesh->HasTangentsAndBitangents() && mesh->HasNormals() && mesh->HasTextureCoords(0))
+	{
+		ComputeTangentSpace(vertices, verticesNum, indices, indicesNum / 3, g_pLoadThreadPool);
 	}
+}
+
+bool LoadMesh(const std::string& pFile, MeshPool<SimpleVertex>* pool)
+{
+	MeshImportHooks<SimpleVertex> hooks = { ConvertVertex, FinishSubmesh };
+	MeshLoadStats stats;
+	// The import hooks take no context, so the pool for the tangent passes is a global
+	SoftThreadPool threadPool(0);
+	g_pLoadThreadPool = &threadPool;
+	bool loaded = LoadMeshPool(pFile, pFile + ".meshcache", hooks, pool, &stats);
+	g_pLoadThreadPool = NULL;
+	if (!loaded)
+		return false;
+
+	wchar_t text_buffer[256] = { 0 }; //temporary buffer
+	swprintf(text_buffer, _countof(text_buffer), L"LoadMesh(%S): %s, %d submeshes, 16 bit indices save %d bytes, %.3f ms\n", pFile.c_str(),
+		stats.cacheHit ? L"cache hit" : L"cache miss", (int)pool->submeshes.size(), pool->indicesNum * (int)(sizeof(DWORD) - sizeof(WORD)),
+		stats.milliseconds);
+	OutputDebugString(text_buffer);
 	return true;
 }
 
@@ -15,12 +15,15 @@ struct Light
 	float4 diffuse;
 };
 
-cbuffer ConstantBuffer : register( b0 )
+cbuffer cbPerFrame : register( b0 )
+{
+	Light light;
+}
+
+cbuffer cbPerObject : register( b1 )
 {
 	float4x4 WVP;
 	float4x4 World;
-	Light light;
-	
 }
 
 Texture2D ObjTexture;
@@ -35,7 +38,7 @@ struct SKYMAP_VS_INPUT
 	float3 Pos : POSITION;
 	float3 normal : NORMAL;
 	float2 texCoord : TEXCOORD;
-	float3 tangent : TANGENT;
+	float4 tangent : TANGENT;
 };
 
 
@@ -52,7 +55,7 @@ struct NORMALMAP_VS_INPUT
 	float3 Pos : POSITION;
 	float3 normal : NORMAL;
 	float2 texCoord : TEXCOORD0;
-	float3 tangent : TANGENT;
+	float4 tangent : TANGENT;     // w = bitangent sign
 };
 
 struct NORMALMAP_VS_OUTPUT
@@ -94,11 +97,11 @@ NORMALMAP_VS_OUTPUT NORMALMAP_VS(NORMALMAP_VS_INPUT input)
 {
 	NORMALMAP_VS_OUTPUT Out = (NORMALMAP_VS_OUTPUT)0;
 	//Make sure tangent is completely orthogonal to normal
-	input.tangent = normalize(input.tangent - dot(input.tangent, input.normal)*input.normal);
+	float3 tangent = normalize(input.tangent.xyz - dot(input.tangent.xyz, input.normal)*input.normal);
 	// Transform the normal, tangent and binormal vectors from object space to homogeneous projection space:
 	float3 vNormalWS = mul(input.normal, (float3x3) World);
-	float3 vTangentWS = mul(input.tangent, (float3x3) World);
-	float3 vBiTangentWS = cross(input.normal, input.tangent);
+	float3 vTangentWS = mul(tangent, (float3x3) World);
+	float3 vBiTangentWS = cross(input.normal, tangent) * input.tangent.w;
 	vBiTangentWS = mul(vBiTangentWS, (float3x3)World);
 	vNormalWS = normalize(vNormalWS);
 	vTangentWS = normalize(vTangentWS);
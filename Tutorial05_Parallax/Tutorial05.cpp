@@ -5,17 +5,24 @@
 //
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //--------------------------------------------------------------------------------------
+#define NOMINMAX	// std::min/std::max instead of the windows.h macros
 #include <windows.h>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dcompiler.h>
-#include <xnamath.h>
+#include "../Common/xnamath_portable.h"
+#include "../Common/dds_reader.h"
+#include "../Common/shader_cache.h"
+#include "../Common/image_decoder.h"
+#include "../Common/vertex_cache.h"
+#include "../Common/mesh_import.h"
+#include "../Common/constant_ring.h"
 #include "resource.h"
 #include <dinput.h>
 #include <vector>
-#include <assimp/Importer.hpp>      // C++ importer interface
-#include <assimp/scene.h>           // Output data structure
-#include <assimp/postprocess.h>     // Post processing flags
+#include <algorithm>
+#include <math.h>
+#include <float.h>
 
 #pragma comment (lib, "dinput8.lib")
 
@@ -47,10 +54,9 @@ struct Light
 Light g_Light;
 
 
-struct ConstantBuffer
+// b0, uploaded once per frame
+struct cbPerFrame
 {
-	XMMATRIX  mWVP;
-	XMMATRIX mWorld;
 	XMMATRIX mView;
 	XMFLOAT4 mCamPos;
 	float  BaseTextureRepeat;
@@ -60,6 +66,13 @@ struct ConstantBuffer
 	Light  light;
 };
 
+// b1, a fresh ConstantRing block for every draw
+struct cbPerObject
+{
+	XMMATRIX  mWVP;
+	XMMATRIX mWorld;
+};
+
 
 
 //--------------------------------------------------------------------------------------
@@ -78,11 +91,13 @@ ID3D11Texture2D*        g_pDepthStencil = NULL;
 ID3D11DepthStencilView* g_pDepthStencilView = NULL;
 ID3D11VertexShader*     g_pNormalMapVertexShader = NULL;
 ID3D11PixelShader*      g_pNormalMapPixelShader = NULL;
+ID3D11PixelShader*      g_pConeMapPixelShader = NULL;
 ID3D11InputLayout*      g_pVertexLayout = NULL;
 ID3D11Buffer*           g_pVertexBuffer = NULL;
 ID3D11Buffer*			g_pTangentsBuffer = NULL;
 ID3D11Buffer*           g_pIndexBuffer = NULL;
-ID3D11Buffer*           g_pConstantBuffer = NULL;
+ID3D11Buffer*           g_pFrameConstantBuffer = NULL;
+ConstantRing            g_ConstantRing;
 XMMATRIX                g_CubeWorld1;
 XMMATRIX                g_CubeWorld2;
 XMMATRIX                g_View;
@@ -95,6 +110,12 @@ ID3D11DepthStencilState* g_DSLessEqual;
 ID3D11RasterizerState* g_RSCullNone;
 ID3D11ShaderResourceView* g_pTextureRV = NULL;
 ID3D11ShaderResourceView* g_pNormalMapRV = NULL;
+ID3D11ShaderResourceView* g_pConeMapRV = NULL;
+
+// C switches between the linear search and relaxed cone stepping once four_NM_cone.dds
+// (written by Headless/cone_baker) is loaded
+bool g_UseConeMap = false;
+bool g_ConeKeyDown = false;
 
 LPDIRECTINPUT8 g_DirectInput;
 IDirectInputDevice8* g_DIMouse;
@@ -124,6 +145,16 @@ double g_CurrentTime = 0;
 double g_LastTime = 0;
 DWORD g_StartTick = 0;
 
+// Compiled shaders live in ShaderCache\ under the working directory
+D3DShaderCompiler g_ShaderCompiler;
+ShaderCache g_ShaderCache(&g_ShaderCompiler, "ShaderCache");
+
+// PNG/JPEG textures decode on worker threads while the device and shaders are set up
+ImageDecodeQueue g_ImageDecodes;
+enum { IMAGE_NORMAL_MAP };
+
+std::vector<Submesh> g_Submeshes;
+
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
@@ -141,7 +172,7 @@ void UpdateTime();
 void UpdateCamera();
 HRESULT CompileAndCreateVertexShader(LPCSTR entry, ID3DBlob*& pVSBlob, ID3D11VertexShader*& vs);
 HRESULT CompileAndCreatePixelShader(LPCSTR entry, ID3DBlob*& pVSBlob, ID3D11PixelShader*& ps);
-bool LoadMesh(std::string& pFile, SimpleVertex** vertexes, int* verticesNum, WORD** indices, int* indicesNum, int* traingalNum);
+bool LoadMesh(const std::string& pFile, MeshPool<SimpleVertex>* pool);
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -232,12 +263,10 @@ HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
 
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DX11
+// Helper for compiling shaders, served from the on-disk shader cache when unchanged
 //--------------------------------------------------------------------------------------
 HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
 {
-	HRESULT hr = S_OK;
-
 	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
 #if defined( DEBUG ) || defined( _DEBUG )
 	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
@@ -247,23 +276,9 @@ HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szS
 	dwShaderFlags |= D3DCOMPILE_DEBUG;
 #endif
 
-	ID3DBlob* pErrorBlob;
-	hr = D3DX11CompileFromFile(szFileName, NULL, NULL, szEntryPoint, szShaderModel,
-		dwShaderFlags, 0, NULL, ppBlobOut, &pErrorBlob, NULL);
-	if (FAILED(hr))
-	{
-		if (pErrorBlob != NULL)
-			OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-		if (pErrorBlob) pErrorBlob->Release();
-		return hr;
-	}
-	if (pErrorBlob) pErrorBlob->Release();
-
-	return S_OK;
+	return CompileShaderCached(&g_ShaderCache, szFileName, szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut);
 }
 
-int g_IndicesNum;
-
 //--------------------------------------------------------------------------------------
 // Create Direct3D device and swap chain
 //--------------------------------------------------------------------------------------
@@ -271,6 +286,9 @@ HRESULT InitDevice()
 {
 	HRESULT hr = S_OK;
 
+	g_ImageDecodes.Add("four_NM_height.png", IMAGE_NORMAL_MAP);
+	g_ImageDecodes.Start(0);
+
 	RECT rc;
 	GetClientRect(g_hWnd, &rc);
 	UINT width = rc.right - rc.left;
@@ -401,26 +419,30 @@ HRESULT InitDevice()
 	ID3DBlob* pPSBlob = NULL;
 	hr = CompileAndCreatePixelShader("NORMALMAP_PS", pPSBlob, g_pNormalMapPixelShader);
 
+	pPSBlob->Release();
+	if (FAILED(hr))
+		return hr;
+
+	hr = CompileAndCreatePixelShader("NORMALMAP_CONE_PS", pPSBlob, g_pConeMapPixelShader);
+
 	pPSBlob->Release();
 	if (FAILED(hr))
 		return hr;
 
 	std::string meshPath("Box.fbx");
-	SimpleVertex* cubeVertices = NULL;
-	int vertNum(24), triNum;
-	WORD* indices = NULL;
-	int indicesNum = 36;
-	LoadMesh(meshPath, &cubeVertices, &vertNum, &indices, &indicesNum, &triNum);
-	g_IndicesNum = indicesNum;
+	MeshPool<SimpleVertex> meshPool;
+	if (!LoadMesh(meshPath, &meshPool))
+		return E_FAIL;
+	g_Submeshes = meshPool.submeshes;
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex) * vertNum;
+	bd.ByteWidth = sizeof(SimpleVertex) * meshPool.verticesNum;
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	bd.CPUAccessFlags = 0;
 	D3D11_SUBRESOURCE_DATA InitData;
 	ZeroMemory(&InitData, sizeof(InitData));
-	InitData.pSysMem = cubeVertices;
+	InitData.pSysMem = meshPool.vertices;
 	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pVertexBuffer);
 	if (FAILED(hr))
 		return hr;
@@ -432,14 +454,17 @@ HRESULT InitDevice()
 
 	// Create index buffer
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(WORD) * indicesNum;        // 36 vertices needed for 12 triangles in a triangle list
+	bd.ByteWidth = sizeof(WORD) * meshPool.indicesNum;
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	bd.CPUAccessFlags = 0;
-	InitData.pSysMem = indices;
+	InitData.pSysMem = meshPool.indices;
 	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pIndexBuffer);
 	if (FAILED(hr))
 		return hr;
 
+	// The buffers own a copy now, drop the pool and any mesh cache view behind it
+	ReleaseMeshPool(&meshPool);
+
 	// Set index buffer
 	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
@@ -454,10 +479,13 @@ HRESULT InitDevice()
 	g_Light.diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	ZeroMemory(&bd, sizeof(D3D11_BUFFER_DESC));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(ConstantBuffer);
+	bd.ByteWidth = sizeof(cbPerFrame);
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	bd.CPUAccessFlags = 0;
-	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pConstantBuffer);
+	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pFrameConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+	hr = g_ConstantRing.Init(g_pd3dDevice);
 	if (FAILED(hr))
 		return hr;
 	// Initialize the world matrix
@@ -474,6 +502,7 @@ HRESULT InitDevice()
 
 
 	LoadSkyMapAndCreateState();
+	ReportShaderCacheStats(g_ShaderCache);
 	
 
 	return S_OK;
@@ -488,8 +517,9 @@ void CleanupDevice()
 	if (g_pImmediateContext)
 		g_pImmediateContext->ClearState();
 
-	if (g_pConstantBuffer)
-		g_pConstantBuffer->Release();
+	if (g_pFrameConstantBuffer)
+		g_pFrameConstantBuffer->Release();
+	g_ConstantRing.Release();
 	if (g_pVertexBuffer)
 		g_pVertexBuffer->Release();
 	if (g_pIndexBuffer)
@@ -500,6 +530,8 @@ void CleanupDevice()
 		g_pNormalMapVertexShader->Release();
 	if (g_pNormalMapPixelShader)
 		g_pNormalMapPixelShader->Release();
+	if (g_pConeMapPixelShader)
+		g_pConeMapPixelShader->Release();
 	if (g_pDepthStencil)
 		g_pDepthStencil->Release();
 	if (g_pDepthStencilView)
@@ -518,6 +550,8 @@ void CleanupDevice()
 		g_pTextureRV->Release();
 	if (g_pNormalMapRV)
 		g_pNormalMapRV->Release();
+	if (g_pConeMapRV)
+		g_pConeMapRV->Release();
 
 }
 
@@ -569,6 +603,20 @@ void Render()
 	//
 	g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
+	g_ConstantRing.BeginFrame(g_pImmediateContext);
+
+	cbPerFrame cbFrame;
+	cbFrame.light = g_Light;
+	XMStoreFloat4(&cbFrame.mCamPos, g_CamPosition);
+	cbFrame.mView = g_View;
+	cbFrame.BaseTextureRepeat = 1.0f;
+	cbFrame.HeightMapScale = 0.2f;
+	cbFrame.f1 = 0.0f;
+	cbFrame.f2 = 0.0f;
+	g_pImmediateContext->UpdateSubresource(g_pFrameConstantBuffer, 0, NULL, &cbFrame, 0, 0);
+	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pFrameConstantBuffer);
+	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pFrameConstantBuffer);
+
 	XMMATRIX mScale = XMMatrixScaling(0.05f, 0.05f, 0.05f);
 	mScale = XMMatrixIdentity();
 	// 1st Cube: Rotate around the origin
@@ -579,23 +627,15 @@ void Render()
 	//
 	// Update variables for the first cube
 	//
-	ConstantBuffer cbCube1;
+	cbPerObject cbCube1;
 	
 	//g_CubeWorld1 = mScale;
 	cbCube1.mWorld = XMMatrixTranspose(g_CubeWorld1);
 	g_WVP = g_CubeWorld1 * g_View * g_Projection;
 	cbCube1.mWVP = XMMatrixTranspose(g_WVP);
 	//XMVECTOR aa = XMVectorSet(0.0f, 2.0f, -5.0f, 0.0f);
-	cbCube1.light = g_Light;
-	cbCube1.light.ambient = g_Light.ambient;
-	XMStoreFloat4(&cbCube1.mCamPos, g_CamPosition);
-	cbCube1.mView = g_View;
-	cbCube1.BaseTextureRepeat = 1.0f;
-	cbCube1.HeightMapScale = 0.2f;
-
-	g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, NULL, &cbCube1, 0, 0);
-	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-	g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+	ID3D11Buffer* objectBuffer = g_ConstantRing.Upload(g_pImmediateContext, &cbCube1, sizeof(cbCube1));
+	g_pImmediateContext->VSSetConstantBuffers(1, 1, &objectBuffer);
 
 	//
 	// Render the first cube
@@ -603,10 +643,15 @@ void Render()
 	g_pImmediateContext->PSSetSamplers(0, 1, &g_CubesTexSamplerState);
 	g_pImmediateContext->PSSetShaderResources(0, 1, &g_pTextureRV);
 	g_pImmediateContext->PSSetShaderResources(1, 1, &g_pNormalMapRV);
+	g_pImmediateContext->PSSetShaderResources(2, 1, &g_pConeMapRV);
 	g_pImmediateContext->RSSetState(g_CWcullMode);
 	g_pImmediateContext->VSSetShader(g_pNormalMapVertexShader, NULL, 0);
-	g_pImmediateContext->PSSetShader(g_pNormalMapPixelShader, NULL, 0);
-	g_pImmediateContext->DrawIndexed(g_IndicesNum, 0, 0);
+	g_pImmediateContext->PSSetShader(g_UseConeMap ? g_pConeMapPixelShader : g_pNormalMapPixelShader, NULL, 0);
+	for (size_t i = 0; i < g_Submeshes.size(); ++i)
+	{
+		const Submesh& sub = g_Submeshes[i];
+		g_pImmediateContext->DrawIndexed(sub.indexCount, sub.firstIndex, sub.baseVertex);
+	}
 
 
 		g_pSwapChain->Present(0, 0);
@@ -718,6 +763,10 @@ void DetectInput(double time)
 	{
 		g_MoveUpDown += speed;
 	}
+	bool coneKeyDown = (keyboardState[DIK_C] & 0x80) != 0;
+	if (coneKeyDown && !g_ConeKeyDown && g_pConeMapRV)
+		g_UseConeMap = !g_UseConeMap;
+	g_ConeKeyDown = coneKeyDown;
 	if (keyboardState[DIK_R] & 0x80)
 	{
 		g_MoveUpDown = 0;
@@ -760,13 +809,18 @@ void LoadSkyMapAndCreateState()
 	rtbd.RenderTargetWriteMask = D3D10_COLOR_WRITE_ENABLE_ALL;
 
 
-	D3DX11_IMAGE_LOAD_INFO loadSMInfo;
-	loadSMInfo.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-
 	//Load the 2d texture
 	// Load the Texture
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice, L"seafloor.dds", NULL, NULL, &g_pTextureRV, NULL);
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice, L"four_NM_height.png", NULL, NULL, &g_pNormalMapRV, NULL);
+	hr = CreateDDSTextureFromFile(g_pd3dDevice, L"seafloor.dds", NULL, &g_pTextureRV);
+	// Upload each decoded image as soon as it is done
+	DecodedImage image;
+	while (g_ImageDecodes.Next(&image))
+	{
+		if (image.tag == IMAGE_NORMAL_MAP)
+			hr = CreateTextureFromImage(g_pd3dDevice, g_pImmediateContext, image, &g_pNormalMapRV);
+		g_ImageDecodes.Recycle(&image);
+	}
+	hr = CreateDDSTextureFromFile(g_pd3dDevice, L"four_NM_cone.dds", NULL, &g_pConeMapRV);
 
 
 	D3D11_SAMPLER_DESC sampDesc;
@@ -838,56 +892,64 @@ HRESULT CompileAndCreatePixelShader(LPCSTR entry, ID3DBlob*& pPSBlob, ID3D11Pixe
 	return hr;
 }
 
-bool LoadMesh(std::string& pFile,SimpleVertex** vertexes,int* verticesNum,WORD** indices,int* indicesNum,int* traingalNum)
+
+//--------------------------------------------------------------------------------------
+// Mesh import hooks, Common/mesh_import.h does the packing and the binary mesh cache
+//--------------------------------------------------------------------------------------
+SimpleVertex ConvertVertex(const aiMesh* mesh, unsigned i, const aiMatrix4x4& transform, const aiMatrix3x3& normalMatrix, const aiMatrix3x3& tangentMatrix)
 {
-	Assimp::Importer importer;
-	// And have it read the given file with some example postprocessing
-	// Usually - if speed is not the most important aspect for you - you'll 
-	// propably to request more postprocessing than we do in this example.
-	const aiScene* scene = importer.ReadFile(pFile,
-		aiProcess_CalcTangentSpace |
-		//aiProcess_MakeLeftHanded|
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_SortByPType);
-	if (scene->HasMeshes())
-	{
-		aiMesh* mesh = scene->mMeshes[0];
-		*vertexes = new SimpleVertex[mesh->mNumVertices];
-		*verticesNum = mesh->mNumVertices;
-		for (unsigned i = 0; i < mesh->mNumVertices; ++i)
-		{
-			(*vertexes)[i].Pos = XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-			(*vertexes)[i].Normal = XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-			(*vertexes)[i].Tangent = XMFLOAT3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
-			(*vertexes)[i].UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
-		
-		}
+	SimpleVertex vertex;
+	ZeroMemory(&vertex, sizeof(vertex));
 
-		int sumIdices = 0;
-		for (unsigned i = 0;i<mesh->mNumFaces;++i)
-		{
-			for (unsigned j = 0;j<mesh->mFaces[i].mNumIndices;++j)
-			{
-				++sumIdices;
-			}
-		}
-		*indicesNum = sumIdices;
+	aiVector3D p = transform * mesh->mVertices[i];
+	vertex.Pos = XMFLOAT3(p.x, p.y, p.z);
 
-		*indices = new WORD[sumIdices];
-		int indicesIdx = 0;
-		for (unsigned i = 0; i < mesh->mNumFaces; ++i)
-		{
-			for (unsigned j = 0; j < mesh->mFaces[i].mNumIndices; ++j)
-			{
-				(*indices)[indicesIdx] = mesh->mFaces[i].mIndices[j];
-				++indicesIdx;
-			}
-		}
+	if (mesh->HasNormals())
+	{
+		aiVector3D n = normalMatrix * mesh->mNormals[i];
+		n.Normalize();
+		vertex.Normal = XMFLOAT3(n.x, n.y, n.z);
+	}
+	if (mesh->HasTextureCoords(0))
+		vertex.UV = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+	vertex.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	if (mesh->HasTangentsAndBitangents())
+	{
+		aiVector3D t = tangentMatrix * mesh->mTangents[i];
+		t.Normalize();
+		vertex.Tangent = XMFLOAT3(t.x, t.y, t.z);
+	}
+	return vertex;
+}
 
-		*traingalNum = mesh->mNumFaces;
+// Reorder for the post-transform cache
+void FinishSubmesh(const aiMesh* mesh, int submeshIndex, SimpleVertex* vertices, int verticesNum, WORD* indices, int indicesNum)
+{
+	int missesBefore = CountVertexCacheMisses(indices, indicesNum, verticesNum);
+	OptimizeVertexCache(indices, indicesNum, verticesNum);
+	OptimizeVertexFetch(vertices, verticesNum, indices, indicesNum);
+	int missesAfter = CountVertexCacheMisses(indices, indicesNum, verticesNum);
+
+	float triangles = indicesNum / 3.0f;
+	wchar_t text_buffer[256] = { 0 }; //temporary buffer
+	swprintf(text_buffer, _countof(text_buffer), L"submesh %d: %d triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		submeshIndex, indicesNum / 3, missesBefore / triangles, missesAfter / triangles,
+		(float)missesBefore / verticesNum, (float)missesAfter / verticesNum);
+	OutputDebugString(text_buffer);
+}
 
-	}
+bool LoadMesh(const std::string& pFile, MeshPool<SimpleVertex>* pool)
+{
+	MeshImportHooks<SimpleVertex> hooks = { ConvertVertex, FinishSubmesh };
+	MeshLoadStats stats;
+	if (!LoadMeshPool(pFile, pFile + ".meshcache", hooks, pool, &stats))
+		return false;
+
+	wchar_t text_buffer[256] = { 0 }; //temporary buffer
+	swprintf(text_buffer, _countof(text_buffer), L"LoadMesh(%S): %s, %d submeshes, 16 bit indices save %d bytes, %.3f ms\n", pFile.c_str(),
+		stats.cacheHit ? L"cache hit" : L"cache miss", (int)pool->submeshes.size(), pool->indicesNum * (int)(sizeof(DWORD) - sizeof(WORD)),
+		stats.milliseconds);
+	OutputDebugString(text_buffer);
 	return true;
 }
 
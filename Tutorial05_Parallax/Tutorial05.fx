@@ -15,10 +15,8 @@ struct Light
 	float4 diffuse;
 };
 
-cbuffer ConstantBuffer : register( b0 )
+cbuffer cbPerFrame : register( b0 )
 {
-	float4x4 WVP;
-	float4x4 World;
 	float4x4 View;                   // View matrix 
 	float4   EyePosition;                    // Camera's location
 	float    BaseTextureRepeat;      // The tiling factor for base and normal map textures
@@ -26,13 +24,25 @@ cbuffer ConstantBuffer : register( b0 )
 	float f1;
 	float f2;
 	Light light;
-	
+}
+
+cbuffer cbPerObject : register( b1 )
+{
+	float4x4 WVP;
+	float4x4 World;
 }
 
 Texture2D ObjTexture;
 Texture2D ObjNormMap;
+Texture2D ObjConeMap;                    // Height in r, sqrt(relaxed cone ratio) in g, from Headless/cone_baker
 SamplerState ObjSamplerState;
 
+// Relaxed cone stepping budget for NORMALMAP_CONE_PS
+static const int CONE_STEPS = 16;
+static const int BINARY_STEPS = 4;
+static const float MIN_CONE_STEP = 1.0 / 32.0;   // in depth, keeps grazing rays from stalling near the surface,
+                                                 // at the cost of the cone's one-crossing guarantee
+
 
 //--------------------------------------------------------------------------------------
 
@@ -170,3 +180,74 @@ float4 NORMALMAP_PS(NORMALMAP_VS_OUTPUT i) : SV_Target
 	return float4(finalColor, diffuse.a);
 }
 
+// Relaxed cone step mapping, Policarpo and Oliveira, GPU Gems 3 chapter 18.
+// Same ray as NORMALMAP_PS in (texture, depth) space. A step to the edge of the relaxed cone under
+// the ray crosses the surface at most once, so once the ray is below it a binary search over the
+// last step finds the hit. Near the surface and at grazing angles the cones shrink and the ray
+// would creep along, so steps are at least MIN_CONE_STEP; whenever that floor is taken the step
+// is longer than the cone allows and the ray can pass through a feature thinner than the step
+// and come out the other side.
+float4 NORMALMAP_CONE_PS(NORMALMAP_VS_OUTPUT i) : SV_Target
+{
+    float3 vLightTS = normalize(i.vLightTS);
+    vLightTS = float3(vLightTS.x, -vLightTS.y, vLightTS.z);
+
+    float2 dx = ddx(i.texCoord);
+    float2 dy = ddy(i.texCoord);
+
+    // Offset from i.texCoord in xy and depth below the top in z. The gap is the surface depth
+    // minus the ray depth, positive while the ray is above the surface.
+    float3 vRayDir = float3(i.vParallaxOffsetTS, 1.0);
+    float fRayRatio = length(i.vParallaxOffsetTS);
+    float3 vRayPos = float3(0, 0, 0);
+    float3 vPrevPos = vRayPos;
+    float fGap = 0.0;
+    float fPrevGap = 0.0;
+    bool bCrossed = false;
+
+    [loop]
+    for (int nStep = 0; nStep < CONE_STEPS; nStep++)
+    {
+        float2 vCone = ObjConeMap.SampleGrad(ObjSamplerState, i.texCoord + vRayPos.xy, dx, dy).rg;
+        fGap = (1.0 - vCone.r) - vRayPos.z;
+        if (fGap <= 0.0)
+        {
+            bCrossed = true;
+            break;
+        }
+        float fConeRatio = vCone.g * vCone.g;
+        vPrevPos = vRayPos;
+        fPrevGap = fGap;
+        vRayPos += vRayDir * max(fConeRatio * fGap / (fRayRatio + fConeRatio), MIN_CONE_STEP);
+    }
+
+    if (bCrossed)
+    {
+        [loop]
+        for (int nBinary = 0; nBinary < BINARY_STEPS; nBinary++)
+        {
+            float3 vMid = 0.5 * (vPrevPos + vRayPos);
+            float fMidGap = (1.0 - ObjConeMap.SampleGrad(ObjSamplerState, i.texCoord + vMid.xy, dx, dy).r) - vMid.z;
+            if (fMidGap > 0.0)
+            {
+                vPrevPos = vMid;
+                fPrevGap = fMidGap;
+            }
+            else
+            {
+                vRayPos = vMid;
+                fGap = fMidGap;
+            }
+        }
+        // Treat the surface as linear between the last point above and the first below it
+        vRayPos = lerp(vPrevPos, vRayPos, fPrevGap / max(fPrevGap - fGap, 1e-6));
+    }
+
+    float2 texSample = i.texCoord + vRayPos.xy;
+
+    float3 vNormalTS = normalize(ObjNormMap.Sample(ObjSamplerState, texSample) * 2 - 1);
+    float4 diffuse = ObjTexture.Sample(ObjSamplerState, texSample);
+    float3 finalColor;
+    finalColor = saturate(dot(vNormalTS, vLightTS)*light.diffuse  * diffuse);
+    return float4(finalColor, diffuse.a);
+}
@@ -8,7 +8,7 @@
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
-#include <xnamath.h>
+#include "../../Common/xnamath_portable.h"
 
 
 //Global Declarations - Interfaces//